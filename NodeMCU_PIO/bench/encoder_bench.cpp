@@ -0,0 +1,75 @@
+// Host benchmark of the zone payload encoders (include/zone_encoder.h).
+// Built once per policy by run_encoder_bench.sh, which also reports the
+// code size and stack use of encodeZoneBatch<Encoder>.
+//
+//   encoder_bench [rows] [iterations] [--dump]
+//
+// Prints "<policy> <rows> <payload bytes> <ns per encode>", or with --dump
+// the payload itself on stdout.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "zone_encoder.h"
+
+// A window of realistic readings at the RTC buffer's resolution, with one
+// row taken across a range switch and, in longer windows, a failed read
+static void makeRows(ZoneRow* rows, uint8_t n) {
+  for (uint8_t i = 0; i < n; i++) {
+    rows[i].tick = 1000 + i;
+    // 32V_2A, like the batch
+    rows[i].data.range = 2;
+    float per_mA = RANGE_COUNTS_PER_MA[rows[i].data.range];
+    rows[i].data.current_mA = 1250.0f + 37.3f * i - (i % 3) * 12.1f;
+    rows[i].data.busvoltage = 12.034f + 0.004f * (i % 5);
+    rows[i].data.power_mW = rows[i].data.current_mA * rows[i].data.busvoltage;
+    // Quantize like packZone()/unpackZone()
+    rows[i].data.current_mA = (int)(rows[i].data.current_mA * per_mA) / per_mA;
+    rows[i].data.busvoltage = (int)(rows[i].data.busvoltage * 250) / 250.0f;
+    rows[i].data.power_mW = (int)(rows[i].data.power_mW * per_mA / RANGE_POWER_LSBS) *
+                            RANGE_POWER_LSBS / per_mA;
+    rows[i].data.current_filt_mA = (int)((1250.0f + 37.3f * i) * per_mA) / per_mA;
+    rows[i].flags = i == n / 2 ? ZONE_FLAG_RANGE_SWITCH : 0;
+    if (n > 2 && i == 1) {
+      rows[i].data = {};
+      rows[i].flags = ZONE_FLAG_I2C_ERROR;
+    }
+  }
+}
+
+// Kept out of line so its size and stack use can be measured
+__attribute__((noinline)) size_t encode(const ZoneBatch& batch, const ZoneRow* rows,
+                                        uint8_t* out, size_t size) {
+  return encodeZoneBatch<ZoneEncoder>(batch, rows, out, size);
+}
+
+int main(int argc, char** argv) {
+  uint8_t n = argc > 1 ? atoi(argv[1]) : 12;
+  long iterations = argc > 2 ? atol(argv[2]) : 200000;
+  bool dump = argc > 3;
+  n = n < 1 ? 1 : (n > 64 ? 64 : n);
+
+  ZoneRow rows[64];
+  makeRows(rows, n);
+  ZoneBatch batch = {"esp-a1b2c3", "zone1", "32V_2A", 3735928559u, 500, (uint32_t)(500 + n - 1),
+                     123456789ull, 5000, 1500, n};
+  static uint8_t out[4096];
+
+  size_t length = encode(batch, rows, out, sizeof(out));
+  if (dump) {
+    fwrite(out, 1, length, stdout);
+    return 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  size_t sink = 0;
+  for (long i = 0; i < iterations; i++) {
+    batch.seq += 1;  // keep the compiler from hoisting the encode
+    sink += encode(batch, rows, out, sizeof(out));
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  printf("%s %u %zu %.0f %zu\n", ZoneEncoder::NAME, n, length, ns, sink % 2);
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Host benchmark of the fixed-point FFT (include/fft_fixed.h). Built once
+// per RIPPLE_POINTS by run_fft_bench.sh.
+//
+//   fft_bench [iterations]
+//
+// Prints "<points> <ns per transform> <ns per two-channel analysis>
+// <RAM bytes> <voltage Hz> <voltage amplitude> <current Hz> <current
+// amplitude>" for a synthetic burst with known ripple.
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fft_fixed.h"
+
+#define SAMPLE_RATE_HZ (1e6 / RIPPLE_SAMPLE_US)
+
+// Raw INA219 counts: 12 V bus (4 mV) with 100 Hz rectifier ripple, and a
+// 1 A load (0.1 mA with a 0.1 ohm shunt) with converter ripple, both with
+// ADC noise
+static void makeBurst(int16_t* bus, int16_t* shunt, double v_Hz, double v_amp, double i_Hz, double i_amp) {
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  for (uint16_t n = 0; n < RIPPLE_POINTS; n++) {
+    double t = n / SAMPLE_RATE_HZ;
+    bus[n] = (int16_t)lround(3000 + v_amp * sin(2 * M_PI * v_Hz * t) + 0.5 * noise(rng));
+    shunt[n] = (int16_t)lround(10000 + i_amp * sin(2 * M_PI * i_Hz * t + 0.3) + 4 * noise(rng));
+  }
+}
+
+int main(int argc, char** argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 20000;
+  const double v_Hz = 100.0, v_amp = 5.0, i_Hz = 437.5, i_amp = 150.0;
+  static int16_t bus[RIPPLE_POINTS], shunt[RIPPLE_POINTS];
+  static int16_t re[RIPPLE_POINTS], im[RIPPLE_POINTS];
+  fftBegin();
+
+  makeBurst(bus, shunt, v_Hz, v_amp, i_Hz, i_amp);
+  RippleTone v, i;
+  memcpy(re, bus, sizeof(re));
+  memcpy(im, shunt, sizeof(im));
+  rippleAnalyze(re, im, SAMPLE_RATE_HZ, &v, &i);
+
+  long sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long n = 0; n < iterations; n++) {
+    memcpy(re, bus, sizeof(re));
+    memcpy(im, shunt, sizeof(im));
+    sink += fftTransform(re, im);
+  }
+  double transform_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (long n = 0; n < iterations; n++) {
+    memcpy(re, bus, sizeof(re));
+    memcpy(im, shunt, sizeof(im));
+    RippleTone a, b;
+    rippleAnalyze(re, im, SAMPLE_RATE_HZ, &a, &b);
+    sink += (long)a.freq_Hz;
+  }
+  double analyze_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  // The burst buffers plus the quarter-wave table
+  size_t ram = 2 * RIPPLE_POINTS * sizeof(int16_t) + (RIPPLE_POINTS / 4 + 1) * sizeof(int16_t);
+  printf("%d %.0f %.0f %zu %.2f %.3f %.2f %.3f %ld\n", RIPPLE_POINTS, transform_ns / iterations,
+         analyze_ns / iterations, ram, v.freq_Hz, v.amplitude, i.freq_Hz, i.amplitude, sink % 2);
+  return 0;
+}
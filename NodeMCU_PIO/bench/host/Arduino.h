@@ -0,0 +1,35 @@
+#ifndef BENCH_HOST_ARDUINO_H
+#define BENCH_HOST_ARDUINO_H
+
+// Just enough of Arduino.h for the header-only encoders and the firmware
+// modules built on the host. The clock and the pins are host_arduino.cpp's:
+// the bench sets the time, and pin writes are logged for it to read back.
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+using std::max;
+using std::min;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+template <typename T>
+T constrain(T v, T lo, T hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+uint32_t millis();
+uint32_t micros();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+
+// The ESP8266 libc has strlcpy; glibc only since 2.38
+size_t hostStrlcpy(char* dst, const char* src, size_t size);
+#define strlcpy hostStrlcpy
+
+#endif
@@ -0,0 +1,140 @@
+// C entry points into the firmware modules for the host tools in
+// zone-flow-monitor (firmware_host.py loads them with ctypes). Wrappers
+// only; the logic run is the module's own.
+
+#include "batch_control.h"
+#include "broker_pool.h"
+#include "host_arduino.h"
+#include "protection.h"
+#include "sample_buffer.h"
+#include "wake_plan.h"
+#include "zone_filter.h"
+
+extern "C" {
+
+uint8_t hostZoneCount() {
+  return ZONE_COUNT;
+}
+
+uint8_t hostSampleBufferCapacity() {
+  return SAMPLE_BUFFER_CAPACITY;
+}
+
+// Zone z's relay is on pin z
+void hostProtectionBegin() {
+  uint8_t pins[ZONE_COUNT];
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    pins[z] = z;
+  }
+  protectionBegin(pins);
+}
+
+void hostProtectionConfigure(uint8_t zone, float trip_mA, float reset_mA, uint32_t holdoff_ms,
+                             uint32_t reclose_ms) {
+  protectionConfigure(zone, {trip_mA, reset_mA, holdoff_ms, reclose_ms});
+}
+
+// A reading taken at at_us, handed over the way the node's read passes do
+// it: sampled_us is micros() when the read started
+void hostProtectionSample(uint8_t zone, float current_mA, uint64_t at_us) {
+  hostSetMicros(at_us);
+  protectionSample(zone, current_mA, micros());
+}
+
+uint8_t hostProtectionState(uint8_t zone) {
+  return protectionState(zone);
+}
+
+bool hostProtectionPopEvent(ProtectionEvent* event) {
+  return protectionPopEvent(event);
+}
+
+void hostBatchBegin(uint8_t min_samples, uint8_t max_samples, uint8_t initial) {
+  batchBegin(min_samples, max_samples, initial);
+}
+
+uint8_t hostBatchUpdate(uint32_t srtt_ms, uint32_t retransmits, int32_t rssi) {
+  return batchUpdate(srtt_ms, retransmits, rssi);
+}
+
+uint8_t hostBatchSamples() {
+  return batchSamples();
+}
+
+const char* hostBatchLink() {
+  return linkQualityName(batchState().link);
+}
+
+void hostBrokerSet(const char* const* servers, const uint16_t* ports, uint8_t count) {
+  brokerPoolSet(servers, ports, count);
+}
+
+uint8_t hostBrokerCount() {
+  return brokerCount();
+}
+
+void hostBrokerHealth(uint8_t index, BrokerHealth* health) {
+  *health = brokerHealth(index);
+}
+
+uint8_t hostBrokerNext(uint32_t now_ms) {
+  return brokerNext(now_ms);
+}
+
+uint32_t hostBrokerRetryDelay(uint32_t now_ms) {
+  return brokerRetryDelay(now_ms);
+}
+
+void hostBrokerAttempted(uint8_t index, bool ok, uint32_t elapsed_ms, uint32_t now_ms) {
+  brokerAttempted(index, ok, elapsed_ms, now_ms);
+}
+
+void hostBrokerDisconnected() {
+  brokerDisconnected();
+}
+
+int8_t hostBrokerActive() {
+  return brokerActive();
+}
+
+int8_t hostBrokerFailbackCandidate(uint32_t now_ms) {
+  return brokerFailbackCandidate(now_ms);
+}
+
+bool hostBrokerProbed(uint8_t index, bool ok, uint32_t elapsed_ms, uint32_t now_ms) {
+  return brokerProbed(index, ok, elapsed_ms, now_ms);
+}
+
+int8_t hostBrokerFailbackTarget() {
+  return brokerFailbackTarget();
+}
+
+uint32_t hostBrokerFailovers() {
+  return brokerFailovers();
+}
+
+uint32_t hostBrokerFailbacks() {
+  return brokerFailbacks();
+}
+
+void hostFilterBegin() {
+  filterBegin();
+}
+
+void hostFilterConfigure(uint8_t zone, float q_mA2, float r_mA2, float gate_sigma) {
+  filterConfigure(zone, q_mA2, r_mA2, gate_sigma);
+}
+
+float hostFilterUpdate(uint8_t zone, float current_mA) {
+  return filterUpdate(zone, current_mA);
+}
+
+void hostFilterStats(uint8_t zone, ZoneFilterStats* stats) {
+  *stats = filterStats(zone);
+}
+
+void hostWakePlan(const WakeState* state, WakePlan* plan) {
+  *plan = wakePlan(*state);
+}
+
+}
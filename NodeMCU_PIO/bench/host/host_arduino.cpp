@@ -0,0 +1,68 @@
+#include "host_arduino.h"
+
+#include <chrono>
+
+#define PIN_LOG_SIZE 32
+
+static uint64_t clock_us = 0;
+static std::chrono::steady_clock::time_point clock_set = std::chrono::steady_clock::now();
+
+static HostPinWrite pin_log[PIN_LOG_SIZE];
+static uint8_t pin_log_head = 0;
+static uint8_t pin_log_count = 0;
+
+static uint64_t elapsedNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clock_set)
+      .count();
+}
+
+uint32_t micros() {
+  return clock_us + elapsedNs() / 1000;
+}
+
+uint32_t millis() {
+  return (clock_us + elapsedNs() / 1000) / 1000;
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  uint64_t after_ns = elapsedNs();
+  if (pin_log_count == PIN_LOG_SIZE) {
+    // Keep the newest writes
+    pin_log_head = (pin_log_head + 1) % PIN_LOG_SIZE;
+    pin_log_count--;
+  }
+  HostPinWrite& write = pin_log[(pin_log_head + pin_log_count) % PIN_LOG_SIZE];
+  write.pin = pin;
+  write.level = level;
+  write.at_us = clock_us + after_ns / 1000;
+  write.after_ns = min(after_ns, (uint64_t)UINT32_MAX);
+  pin_log_count++;
+}
+
+size_t hostStrlcpy(char* dst, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size > 0) {
+    size_t n = min(length, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return length;
+}
+
+void hostSetMicros(uint64_t us) {
+  clock_us = us;
+  clock_set = std::chrono::steady_clock::now();
+}
+
+bool hostPopPinWrite(HostPinWrite* write) {
+  if (pin_log_count == 0) {
+    return false;
+  }
+  *write = pin_log[pin_log_head];
+  pin_log_head = (pin_log_head + 1) % PIN_LOG_SIZE;
+  pin_log_count--;
+  return true;
+}
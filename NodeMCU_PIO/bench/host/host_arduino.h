@@ -0,0 +1,26 @@
+#ifndef BENCH_HOST_HOST_ARDUINO_H
+#define BENCH_HOST_HOST_ARDUINO_H
+
+#include <Arduino.h>
+
+// Bench side of the host Arduino layer (host_arduino.cpp)
+
+struct HostPinWrite {
+  uint8_t pin;
+  uint8_t level;
+  uint32_t at_us;        // micros() at the write
+  uint32_t after_ns;     // real time from hostSetMicros() to the write
+};
+
+extern "C" {
+
+// Sets the clock. It then runs on in real time, so what a module measures
+// with micros() between two points is its own run time on the host.
+void hostSetMicros(uint64_t us);
+
+// Oldest logged pin write; false once the log is empty
+bool hostPopPinWrite(HostPinWrite* write);
+
+}
+
+#endif
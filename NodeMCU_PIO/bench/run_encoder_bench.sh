@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# Zone payload encoder comparison (include/zone_encoder.h)
+# Builds bench/encoder_bench.cpp once per ZONE_PAYLOAD policy and reports
+# code size and stack of the encoder, payload bytes and encode time for
+# single readings and batched windows. Sizes come from the ESP8266
+# toolchain when PlatformIO has installed it, otherwise from the host
+# compiler (relative comparison only). Encode times are host times.
+#
+# Usage: bench/run_encoder_bench.sh [rows...]    (default: 1 12)
+#        bench/run_encoder_bench.sh --dump <policy> <rows>
+# ZONE_FILTER=1 in the environment adds the filtered current to each row.
+
+set -e
+cd "$(dirname "$0")/.."
+
+OUT="${TMPDIR:-/tmp}/encoder_bench"
+mkdir -p "$OUT"
+POLICIES="json cbor packed csv"
+CXXFLAGS="-std=gnu++17 -O2 -Iinclude -Ibench/host -DZONE_FILTER=${ZONE_FILTER:-0}"
+XTENSA_CXX=$(ls ~/.platformio/packages/toolchain-xtensa/bin/xtensa-lx106-elf-g++ 2>/dev/null || true)
+
+policy_id() {
+    case "$1" in
+        json) echo 0 ;; cbor) echo 1 ;; packed) echo 2 ;; csv) echo 3 ;;
+    esac
+}
+
+build() {
+    g++ $CXXFLAGS -DZONE_PAYLOAD=$(policy_id "$1") bench/encoder_bench.cpp src/crc32.cpp -o "$OUT/bench_$1"
+}
+
+if [ "$1" == "--dump" ]; then
+    build "$2"
+    "$OUT/bench_$2" "${3:-12}" 1 dump
+    exit 0
+fi
+
+ROWS="${*:-1 12}"
+
+# Code size (text) and stack of encode() plus the policy it calls, from an
+# object compiled on its own
+measure() {
+    local cxx="$1" flags="$2" policy="$3"
+    $cxx $flags -DZONE_PAYLOAD=$(policy_id "$policy") -fstack-usage -c bench/encoder_bench.cpp \
+        -o "$OUT/size_$policy.o" 2>/dev/null
+    local text=0 size name
+    # Everything the encoder instantiates: encode(), the policy and the writer
+    while read -r _ size _ name; do
+        case "$name" in
+            encode\(*|*encodeZoneBatch*|*ZoneEncoder::*|PayloadWriter::*) text=$((text + 16#$size)) ;;
+        esac
+    done < <(nm -S -C "$OUT/size_$policy.o" | grep -i " [tw] ")
+    local stack=$(grep -E "encode\(|encodeZoneBatch|ZoneEncoder::encode" "$OUT/size_$policy.su" | \
+        awk -F'\t' '{s += $2} END {print s + 0}')
+    echo "$text $stack"
+}
+
+if [ -n "$XTENSA_CXX" ]; then
+    SIZE_CXX="$XTENSA_CXX"
+    SIZE_FLAGS="-std=gnu++17 -Os -mlongcalls -Iinclude -Ibench/host"
+    SIZE_TARGET="ESP8266 (xtensa, -Os)"
+else
+    SIZE_CXX="g++"
+    SIZE_FLAGS="$CXXFLAGS"
+    SIZE_TARGET="host (-O2)"
+fi
+
+echo ""
+echo "Zone Payload Encoders"
+echo "============================================================"
+echo "   Code size / stack: $SIZE_TARGET; encode time: host"
+printf "   %-7s %8s %7s %5s %8s %10s\n" policy "code B" "stack B" rows "bytes" "encode ns"
+for policy in $POLICIES; do
+    build "$policy"
+    read text stack <<< "$(measure "$SIZE_CXX" "$SIZE_FLAGS" "$policy")"
+    for rows in $ROWS; do
+        read name n bytes ns _ <<< "$("$OUT/bench_$policy" "$rows")"
+        printf "   %-7s %8s %7s %5s %8s %10s\n" "$policy" "$text" "$stack" "$n" "$bytes" "$ns"
+    done
+done
@@ -0,0 +1,54 @@
+#!/bin/bash
+
+# Fixed-point FFT benchmark (include/fft_fixed.h)
+# Builds bench/fft_bench.cpp once per RIPPLE_POINTS and reports code size,
+# RAM, time per transform and per two-channel ripple analysis, and the
+# ripple found in a synthetic burst (100 Hz / 5 counts on the bus voltage,
+# 437.5 Hz / 150 counts on the shunt). Code size comes from the ESP8266
+# toolchain when PlatformIO has installed it, otherwise from the host
+# compiler. Times are host times; a node measures its own and publishes
+# them as analyze_us with every ripple result.
+#
+# Usage: bench/run_fft_bench.sh [points...]    (default: 64 128 256 512 1024)
+
+set -e
+cd "$(dirname "$0")/.."
+
+OUT="${TMPDIR:-/tmp}/fft_bench"
+mkdir -p "$OUT"
+CXXFLAGS="-std=gnu++17 -O2 -Iinclude -Ibench/host"
+XTENSA_CXX=$(ls ~/.platformio/packages/toolchain-xtensa/bin/xtensa-lx106-elf-g++ 2>/dev/null || true)
+
+POINTS="${*:-64 128 256 512 1024}"
+
+if [ -n "$XTENSA_CXX" ]; then
+    SIZE_CXX="$XTENSA_CXX"
+    SIZE_FLAGS="-std=gnu++17 -Os -mlongcalls -Iinclude -Ibench/host"
+    SIZE_TARGET="ESP8266 (xtensa, -Os)"
+else
+    SIZE_CXX="g++"
+    SIZE_FLAGS="$CXXFLAGS"
+    SIZE_TARGET="host (-O2)"
+fi
+
+# Text of the FFT module, compiled on its own
+code_size() {
+    $SIZE_CXX $SIZE_FLAGS -DRIPPLE_POINTS=$1 -c src/fft_fixed.cpp -o "$OUT/size_$1.o" 2>/dev/null
+    local text=0 size
+    while read -r _ size _ _; do
+        text=$((text + 16#$size))
+    done < <(nm -S -C "$OUT/size_$1.o" | grep -i " [tw] ")
+    echo "$text"
+}
+
+echo ""
+echo "Fixed-Point FFT"
+echo "============================================================"
+echo "   Code size: $SIZE_TARGET; times: host; truth 100.00 Hz / 5.000, 437.50 Hz / 150.000"
+printf "   %6s %7s %6s %10s %10s %16s %17s\n" points "code B" "RAM B" "fft ns" "analyze ns" "voltage Hz/amp" "current Hz/amp"
+for n in $POINTS; do
+    g++ $CXXFLAGS -DRIPPLE_POINTS=$n bench/fft_bench.cpp src/fft_fixed.cpp -o "$OUT/bench_$n"
+    read points fft_ns analyze_ns ram v_Hz v_amp i_Hz i_amp _ <<< "$("$OUT/bench_$n")"
+    printf "   %6s %7s %6s %10s %10s %9s/%-6s %9s/%-7s\n" "$points" "$(code_size "$n")" "$ram" \
+        "$fft_ns" "$analyze_ns" "$v_Hz" "$v_amp" "$i_Hz" "$i_amp"
+done
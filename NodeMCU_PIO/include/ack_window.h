@@ -0,0 +1,51 @@
+#ifndef ACK_WINDOW_H
+#define ACK_WINDOW_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Application-level acknowledgements for zone data. PubSubClient only
+// publishes at QoS 0, so the backend acks every zone message on
+// <site>/<node>/ack and the node retransmits what isn't acked within
+// ACK_TIMEOUT_MS. At most ACK_WINDOW messages are in flight; samples stay
+// in the RTC buffer until every zone has them acked. A retransmission
+// repeats the sample sequence numbers, so the backend drops it as a
+// duplicate and just acks again.
+
+#define ACK_WINDOW_MAX 8
+
+struct AckStats {
+  uint32_t sent;
+  uint32_t acked;
+  uint32_t retransmits;
+  uint32_t last_rtt_ms;
+  uint32_t srtt_ms;      // smoothed round trip (RFC 6298 style, 1/8 gain)
+  uint32_t max_rtt_ms;
+};
+
+void ackWindowBegin(uint8_t window);
+void ackWindowSetSize(uint8_t window);
+uint8_t ackWindowSize();
+uint8_t ackWindowInFlight();
+bool ackWindowFull();
+
+// Registers a zone message covering first_seq..last_seq
+void ackWindowSent(uint8_t zone, uint32_t first_seq, uint32_t last_seq, uint32_t now_ms);
+
+// Marks the message ending at last_seq acked; false if it wasn't in flight
+bool ackWindowAck(uint8_t zone, uint32_t last_seq, uint32_t now_ms);
+
+// Finds an in-flight message whose ack timed out and restarts its timer.
+// Returns false when nothing is due.
+bool ackWindowDue(uint32_t now_ms, uint8_t* zone, uint32_t* first_seq, uint32_t* last_seq);
+
+// Highest sequence number below which everything of the zone was acked,
+// given the next sequence number it would send
+uint32_t ackWindowAckedThrough(uint8_t zone, uint32_t next_seq);
+
+// Drops everything in flight (e.g. a low-power window that timed out)
+void ackWindowReset();
+
+AckStats ackWindowStats();
+
+#endif
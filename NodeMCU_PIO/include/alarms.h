@@ -0,0 +1,49 @@
+#ifndef ALARMS_H
+#define ALARMS_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Per-zone alarm detection, evaluated on every sample. Each (zone, alarm)
+// pair is a latched state; a transition marks it dirty until it has been
+// published, so the broker's retained copy always ends up matching the
+// node even if a publish fails.
+
+enum AlarmType : uint8_t {
+  ALARM_OVER_VOLTAGE,
+  ALARM_SENSOR_ERROR,   // last I2C read of the INA219 failed
+  ALARM_ZONE_OFFLINE,   // ALARM_OFFLINE_READS consecutive failed reads
+  ALARM_TYPE_COUNT
+};
+
+struct AlarmState {
+  bool active;
+  bool dirty;
+  float value;          // reading that caused the last transition
+  uint32_t changed_ms;
+};
+
+void alarmsBegin();
+
+// Evaluates one sample; bus_V is ignored when read_ok is false
+void alarmsSample(uint8_t zone, bool read_ok, float bus_V);
+
+// True if any transition still has to be published
+bool alarmsPending();
+
+void alarmsMarkPublished(uint8_t zone, AlarmType type);
+
+AlarmState alarmState(uint8_t zone, AlarmType type);
+const char* alarmName(AlarmType type);
+
+// Latched states over a deep sleep (deep_sleep.h): a bit per zone and
+// alarm (zone * ALARM_TYPE_COUNT + type) for active and dirty, and the
+// failed read counts. Restored alarms take their value from bus_V, the
+// latest reading, as the one that caused the transition isn't kept.
+void alarmsSave(uint16_t* active, uint16_t* dirty, uint8_t* failed_reads);
+void alarmsRestore(uint16_t active, uint16_t dirty, const uint8_t* failed_reads, const float* bus_V);
+
+void alarmsSetOvervoltage(uint8_t zone, float trip_V);
+float alarmsOvervoltage(uint8_t zone);
+
+#endif
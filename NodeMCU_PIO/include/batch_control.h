@@ -0,0 +1,39 @@
+#ifndef BATCH_CONTROL_H
+#define BATCH_CONTROL_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Samples per zone message, adapted to the link at every publish slot.
+// Big batches cost latency but save per-message overhead (headers, acks,
+// radio time), which matters most when messages get lost or slow: a weak
+// link gets bigger, fewer messages, a good one gets back to near
+// real-time. zone-flow-monitor/simulate_batching.py runs this module on
+// the host against a simulated lossy link.
+
+enum LinkQuality : uint8_t {
+  LINK_GOOD,
+  LINK_FAIR,
+  LINK_POOR
+};
+
+struct BatchState {
+  uint8_t samples;
+  uint8_t min_samples;
+  uint8_t max_samples;
+  LinkQuality link;
+  uint32_t increases;
+  uint32_t decreases;
+};
+
+void batchBegin(uint8_t min_samples, uint8_t max_samples, uint8_t initial);
+
+// Feeds the smoothed ack RTT (0 before the first ack), the running
+// retransmit count and the RSSI; returns the samples for the next batch
+uint8_t batchUpdate(uint32_t srtt_ms, uint32_t retransmits, int32_t rssi);
+
+uint8_t batchSamples();
+BatchState batchState();
+const char* linkQualityName(LinkQuality link);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef BATTERY_GAUGE_H
+#define BATTERY_GAUGE_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// State of charge for zones of type "battery". Every current reading,
+// the fast protection pass included, is integrated (trapezoids over the
+// time between readings, in µA·s) so the count runs at the full read
+// rate rather than the sample grid. Positive current discharges; charge
+// going in counts at the charge efficiency.
+//
+// Coulomb counting drifts, so the open-circuit voltage corrects it: once
+// the current has stayed below rest_mA for rest_ms, the bus voltage is
+// taken as the OCV and the SoC is set from the zone's OCV curve, once
+// per rest period. After boot the SoC starts from the voltage as well,
+// unrested, until the first rest.
+
+#define BATTERY_OCV_POINTS 11   // OCV at 0, 10, ..., 100 % SoC
+
+struct BatteryConfig {
+  uint8_t type;              // ZoneType
+  uint8_t reserved[3];
+  float capacity_mAh;
+  float charge_efficiency;   // coulombic, 0..1
+  float rest_mA;
+  uint32_t rest_ms;
+  float ocv_V[BATTERY_OCV_POINTS];
+};
+
+enum ZoneType : uint8_t {
+  ZONE_TYPE_LOAD,
+  ZONE_TYPE_BATTERY
+};
+
+enum BatteryMode : uint8_t {
+  BATTERY_REST,
+  BATTERY_CHARGING,
+  BATTERY_DISCHARGING
+};
+
+// Where the count started from
+enum SocSource : uint8_t {
+  SOC_UNKNOWN,      // no reading yet
+  SOC_VOLTAGE,      // the voltage at boot, not rested
+  SOC_REST_OCV      // the last correction at rest
+};
+
+// One publish window of a battery zone
+struct BatteryWindow {
+  float soc;                 // 0..1
+  float remaining_mAh;
+  float mean_mA;             // net, + discharging
+  float discharged_mAh;      // this window
+  float charged_mAh;         // this window, before efficiency
+  float voltage_V;           // last reading
+  int32_t time_to_empty_s;   // -1 unless discharging
+  int32_t time_to_full_s;    // -1 unless charging
+  BatteryMode mode;
+  SocSource source;
+  uint32_t corrections;
+  float last_correction;     // SoC step of the last OCV correction
+};
+
+void batteryBegin();
+void batteryConfigure(uint8_t zone, const BatteryConfig& config);
+bool batteryZone(uint8_t zone);
+
+// Feeds one reading; now_us must keep counting across light sleep
+// (powerClockMicros())
+void batterySample(uint8_t zone, float current_mA, float bus_V, uint64_t now_us);
+
+// The zone had no reading: the gap isn't integrated
+void batteryNoReading(uint8_t zone);
+
+// Closes the publish window of every battery zone
+void batteryWindowClose();
+const BatteryWindow& batteryLatest(uint8_t zone);
+
+// SoC (0..1) for an open-circuit voltage on the zone's curve
+float batteryOcvSoc(uint8_t zone, float ocv_V);
+
+const char* batteryModeName(BatteryMode mode);
+const char* socSourceName(SocSource source);
+
+#endif
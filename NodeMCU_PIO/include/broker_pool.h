@@ -0,0 +1,73 @@
+#ifndef BROKER_POOL_H
+#define BROKER_POOL_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Ordered broker list with per-broker health. The first broker is the
+// preferred one; the others are fallbacks in order.
+//
+// Every connect attempt updates the broker's connect latency and failure
+// rate (both smoothed, 1/4 gain). A failed attempt backs the broker off,
+// BROKER_BACKOFF_MS doubling per consecutive failure, so the next attempt
+// goes to the next broker straight away. Brokers whose failure rate is at
+// BROKER_UNHEALTHY_RATE or above are only tried when no healthy one is
+// available, so a flapping primary doesn't keep winning.
+//
+// While connected to anything but the first healthy broker in order, the
+// better brokers are probed; BROKER_FAILBACK_PROBES good probes in a row
+// mean it's time to move back.
+
+#define BROKER_MAX 3
+#define BROKER_SERVER_MAX 40
+
+struct BrokerHealth {
+  char server[BROKER_SERVER_MAX];
+  uint16_t port;
+  uint32_t attempts;          // connects and probes
+  uint32_t failures;
+  float failure_rate;
+  uint32_t connect_ms;        // smoothed, successful attempts only
+  uint32_t last_connect_ms;
+  uint8_t consecutive_failures;
+  uint8_t good_probes;
+  uint32_t retry_at_ms;       // backed off until
+  uint32_t connects;          // sessions started on this broker
+};
+
+// Takes the list in preference order. A broker that stays in the list
+// keeps its history, and stays active if it was; brokerActive() is -1
+// afterwards if the active one was dropped.
+void brokerPoolSet(const char* const* servers, const uint16_t* ports, uint8_t count);
+uint8_t brokerCount();
+const BrokerHealth& brokerHealth(uint8_t index);
+
+// The broker to connect to next
+uint8_t brokerNext(uint32_t now_ms);
+
+// How long to wait before the next attempt: 0 while some broker isn't
+// backed off, else until the first one is available again
+uint32_t brokerRetryDelay(uint32_t now_ms);
+
+// Records a connect attempt; a success makes the broker the active one
+void brokerAttempted(uint8_t index, bool ok, uint32_t elapsed_ms, uint32_t now_ms);
+void brokerDisconnected();
+
+// Index of the connected broker, or -1
+int8_t brokerActive();
+
+// A broker better than the active one that is due for a probe, or -1
+int8_t brokerFailbackCandidate(uint32_t now_ms);
+
+// Records a probe; returns true once the broker has enough good probes
+// in a row to move back to it, which makes it the failback target
+bool brokerProbed(uint8_t index, bool ok, uint32_t elapsed_ms, uint32_t now_ms);
+
+// The broker to move back to, or -1; brokerNext() returns it until the
+// next connect attempt
+int8_t brokerFailbackTarget();
+
+uint32_t brokerFailovers();   // sessions started on a non-preferred broker
+uint32_t brokerFailbacks();
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <Arduino.h>
+
+// CRC-32 (IEEE 802.3, as zlib.crc32 in Python). Pass the previous result
+// to continue over several buffers; start from 0.
+uint32_t crc32Update(uint32_t crc, const void* data, size_t length);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef DEEP_SLEEP_H
+#define DEEP_SLEEP_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Deep-sleep cycling for DEEP_SLEEP_MODE builds. The chip resets on every
+// wake, so what has to outlive a sleep is saved to a record at the end of
+// RTC user memory before sleeping and restored in setup(): the clock, the
+// next tick and the site grid's timebase, the boot id and publish sequence
+// numbers, the latched alarms and the wake counters. The sample ring
+// (sample_buffer.h) is in RTC memory already and is kept as it is.
+//
+// Wakes that only sample start with the radio disabled. The radio can't be
+// enabled again without a reset, so the wake that publishes is chosen when
+// going to sleep before it. GPIO16 (D0) has to be wired to RST.
+
+// Carried from one wake to the next
+#define DEEP_SLEEP_RADIO 0x1          // WiFi is available on this wake
+#define DEEP_SLEEP_WINDOW_FAILED 0x2  // the last publish window failed
+#define DEEP_SLEEP_ECHO_DUE 0x4       // the config echo hasn't gone out
+
+struct DeepSleepStats {
+  uint32_t wakes;         // since power-on
+  uint32_t radio_wakes;
+  uint32_t awake_ms;      // summed over all wakes, without ROM boot time
+};
+
+// Reads the record; true if this boot is a wake from deep sleep with a
+// valid one. Anything else (power-on, crash, flashing) starts afresh.
+bool deepSleepBegin();
+
+// Hands the saved state back to the modules. Call once they have all been
+// begun; does nothing on a fresh start.
+void deepSleepRestore();
+
+// Flags the last sleep was entered with; a fresh start has the radio and
+// a config echo due
+uint8_t deepSleepFlags();
+
+// Power-clock time the current wake was planned for. A wake that comes
+// well before it (the sleep timer runs a few percent off) sleeps again.
+uint64_t deepSleepPlannedWakeUs();
+
+// Saves the state and sleeps until wake_us on the power clock, or for a
+// minimal sleep if that has passed. Does not return.
+void deepSleepUntil(uint64_t wake_us, uint8_t flags);
+
+DeepSleepStats deepSleepStats();
+
+#endif
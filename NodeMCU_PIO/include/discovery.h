@@ -0,0 +1,41 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <Arduino.h>
+#include <Adafruit_INA219.h>
+#include "node_config.h"
+
+// INA219 discovery by address scan. Zones whose sensor answers are
+// attached (begin() plus the zone's measurement profile); the rest are
+// detached and cost no bus time until a later scan finds them again. The
+// node keeps running with whatever subset responds.
+
+// INA219 address range selectable with A0/A1
+#define INA219_FIRST_ADDRESS 0x40
+#define INA219_LAST_ADDRESS 0x4F
+
+void discoveryBegin(Adafruit_INA219* const* sensors, const uint8_t* addresses);
+
+// Probes every INA219 address and attaches configured zones that answer.
+// Returns the number of zones attached by this scan.
+uint8_t discoveryScan();
+
+bool zoneAttached(uint8_t zone);
+uint8_t zonesAttached();
+void zoneDetach(uint8_t zone);
+
+// Re-runs begin() and the profile on every attached sensor, e.g. after a
+// bus recovery
+void discoveryReinit();
+
+// Bitmask of responding INA219 addresses not assigned to any zone
+// (bit n = INA219_FIRST_ADDRESS + n)
+uint16_t discoveryUnassigned();
+
+uint8_t zoneAddress(uint8_t zone);
+uint32_t discoveryLastScanUs();
+
+// True once after every attach/detach, for republishing the zone list
+bool discoveryTakeChanged();
+
+#endif
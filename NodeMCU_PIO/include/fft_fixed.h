@@ -0,0 +1,40 @@
+#ifndef FFT_FIXED_H
+#define FFT_FIXED_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Fixed-point radix-2 FFT of RIPPLE_POINTS int16 samples, no floats in the
+// transform. Twiddles are Q15; the data is block floating point: before a
+// stage that could overflow, the whole block is halved and the exponent
+// counted, so a small ripple keeps its resolution and a large one doesn't
+// wrap.
+//
+// rippleAnalyze() gets two real channels out of one complex transform (one
+// as the real part, one as the imaginary part), which halves the work and
+// the RAM of two real transforms.
+
+static_assert(RIPPLE_POINTS >= 64 && RIPPLE_POINTS <= 1024 && (RIPPLE_POINTS & (RIPPLE_POINTS - 1)) == 0,
+              "RIPPLE_POINTS must be a power of two from 64 to 1024");
+
+// Dominant AC component of one channel, in the channel's raw counts
+struct RippleTone {
+  float mean;            // DC level
+  float rms;             // AC RMS, every frequency up to Nyquist
+  float peak_to_peak;
+  float freq_Hz;         // dominant ripple, interpolated between bins
+  float amplitude;       // its peak amplitude
+};
+
+// Builds the quarter-wave sine table
+void fftBegin();
+
+// In-place forward transform; returns how many times the block was halved
+// (the output is the DFT divided by 2^exponent)
+uint8_t fftTransform(int16_t* re, int16_t* im);
+
+// Analyzes two channels sampled together at sample_rate_Hz; both arrays
+// are overwritten by the transform
+void rippleAnalyze(int16_t* a, int16_t* b, float sample_rate_Hz, RippleTone* tone_a, RippleTone* tone_b);
+
+#endif
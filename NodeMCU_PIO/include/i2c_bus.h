@@ -0,0 +1,46 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Shared I2C bus for the INA219s: clock selection, stuck-bus recovery and
+// per-device transaction statistics. Devices are indexed by zone.
+//
+// The bus runs at I2C_CLOCK_HZ (400 kHz fast mode by default) and falls
+// back to 100 kHz for good if the error rate at fast mode says the wiring
+// can't take it. A device that keeps failing is backed off for
+// I2C_BACKOFF_MS so it doesn't eat bus time on every pass; a read skipped
+// for the back-off isn't a failed read for the alarms.
+
+struct I2cDeviceStats {
+  uint32_t transactions;
+  uint32_t errors;
+  uint32_t total_us;
+  uint16_t max_us;
+  uint16_t last_us;
+  uint8_t consecutive_errors;
+};
+
+// Applies clock and clock-stretch limit. Call after the sensors' begin(),
+// which re-runs Wire.begin() and resets the clock.
+void i2cBusBegin();
+
+// Records one timed transaction for a device
+void i2cBusRecord(uint8_t device, uint32_t elapsed_us, bool ok);
+
+// False while a failing device is backed off
+bool i2cDeviceReady(uint8_t device);
+
+// True if SDA or SCL is held low after a transaction
+bool i2cBusStuck();
+
+// Clocks a stuck slave free, issues a STOP and restarts the driver.
+// Returns true if both lines are released afterwards.
+bool i2cBusRecover();
+
+I2cDeviceStats i2cDeviceStats(uint8_t device);
+uint32_t i2cBusClock();
+uint32_t i2cBusRecoveries();
+
+#endif
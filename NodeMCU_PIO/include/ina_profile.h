@@ -0,0 +1,91 @@
+#ifndef INA_PROFILE_H
+#define INA_PROFILE_H
+
+#include <Arduino.h>
+#include <Adafruit_INA219.h>
+#include "node_config.h"
+
+// Per-zone INA219 measurement profiles: calibration range, ADC resolution
+// and hardware averaging. begin() leaves every sensor at 32 V / 2 A, 12-bit,
+// one sample; a profile trades range for resolution on light zones and
+// conversion time for noise rejection on noisy ones.
+//
+// Averaging makes a conversion take longer (up to 68 ms per channel at 128
+// samples). The read passes use inaConversionReady() so a zone isn't read
+// again before it has produced a new result.
+
+// The bus range stays at 32 V in all of them (the 16V_400mA name is the
+// driver calibration's), so a zone on a battery bus can range down safely.
+enum InaRange : uint8_t {
+  INA_RANGE_16V_400MA,   // PGA /1 (40 mV shunt), 50 uA/bit
+  INA_RANGE_32V_1A,      // PGA /8 (320 mV), 40 uA/bit
+  INA_RANGE_32V_2A,      // PGA /8 (320 mV), 100 uA/bit (begin() default)
+  INA_RANGE_COUNT
+};
+
+struct InaProfile {
+  InaRange range;
+  uint8_t adc_bits;      // 9..12, only with adc_samples == 1
+  uint8_t adc_samples;   // 1, 2, 4 ... 128 (12-bit averaged)
+};
+
+void inaProfileBegin(Adafruit_INA219* const* sensors, const uint8_t* addresses);
+
+// Smallest range that covers expected_mA with the given averaging
+InaProfile inaProfileForLoad(float expected_mA, uint8_t adc_samples);
+
+// Validates and stores a profile. Returns false for an invalid profile.
+bool inaProfileSet(uint8_t zone, const InaProfile& profile);
+
+// Programs the stored profile into an attached sensor (after begin(), which
+// resets it, or after inaProfileSet()). Returns false on a bus error.
+bool inaProfileApply(uint8_t zone);
+
+// Single samples at adc_bits (9..12) on both channels, for a burst of raw
+// reads (ripple_monitor.h); inaProfileApply() puts the profile back
+bool inaProfileFast(uint8_t zone, uint8_t adc_bits);
+
+InaProfile inaProfile(uint8_t zone);
+const char* inaRangeName(InaRange range);
+float inaRangeMax_mA(InaRange range);
+
+// Reads the bus voltage register in place of getBusVoltage_V(), which
+// drops its OVF bit: set when the current or power calculation overflowed
+// and those registers hold clipped values. Returns false on a bus error.
+bool inaReadBus(uint8_t zone, float* bus_V, bool* overflow);
+
+// False for a reading no INA219 at the zone's range can produce: NaN, or
+// beyond the shunt, bus or power full scale (a corrupted read)
+bool inaReadingInRange(uint8_t zone, float current_mA, float bus_V, float power_mW);
+
+// Time for one shunt + bus conversion cycle with the zone's profile
+uint32_t inaConversionUs(uint8_t zone);
+uint32_t inaMaxConversionUs();
+
+// True once a fresh conversion is due since the zone was last read;
+// marks the zone read when it returns true
+bool inaConversionReady(uint8_t zone, uint32_t now_us);
+
+// Auto-ranging: a reading at AUTORANGE_UP_FRACTION of the range (the PGA
+// or current register is about to clip) jumps straight to the widest range,
+// so a surge costs at most one conversion. A zone steps down one range at
+// a time once AUTORANGE_DOWN_SAMPLES consecutive readings fit within
+// AUTORANGE_DOWN_FRACTION of the next smaller range. Returns true if the
+// reading switched the range.
+bool inaAutoRange(uint8_t zone, float current_mA, uint32_t now_us);
+void inaAutoRangeEnable(uint8_t zone, bool enabled);
+bool inaAutoRangeEnabled(uint8_t zone);
+uint32_t inaRangeSwitches(uint8_t zone);
+
+// True while conversions may still straddle the last range switch;
+// readings taken then are tagged so aggregation can leave them out
+bool inaRangeSettling(uint8_t zone, uint32_t now_us);
+
+// Noise floor, estimated from successive differences of the current
+// readings so a slowly varying load doesn't count as noise. Restarts when
+// the zone's profile changes.
+void inaNoiseSample(uint8_t zone, float current_mA);
+float inaNoiseFloor_mA(uint8_t zone);
+uint32_t inaNoiseSamples(uint8_t zone);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef LOCAL_SERVER_H
+#define LOCAL_SERVER_H
+
+#include <Arduino.h>
+#include "node_config.h"
+#include "sample_buffer.h"
+
+// Local HTTP access to a node's readings that doesn't depend on the
+// broker or backend being up:
+//   GET /latest   latest publish window aggregate per zone (JSON)
+//   GET /events   Server-Sent Events: "sample" every tick, "window" at
+//                 every publish slot
+// The server is asynchronous (ESPAsyncWebServer), so requests are served
+// from the TCP stack's callbacks and never block sampling. SSE events are
+// only queued; a sample is dropped rather than queued behind a slow client
+// once LOCAL_SSE_MAX_QUEUE events are waiting on average.
+
+struct LocalServerStats {
+  uint8_t clients;
+  uint32_t requests;
+  uint32_t events;
+  uint32_t dropped;      // samples not queued because clients lagged
+  uint32_t rejected;     // SSE clients turned away over LOCAL_SSE_MAX_CLIENTS
+};
+
+void localServerBegin(const char* node_id, const char* const* zone_ids);
+
+// Streams one tick of readings; late_us is how far behind the grid it was taken
+void localServerSample(uint32_t tick, uint32_t late_us, const ZoneData* data,
+                       const PackedSample& sample);
+
+// Rebuilds /latest from the window aggregates and announces it on /events
+void localServerWindowClosed();
+
+LocalServerStats localServerStats();
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "node_config.h"
+
+// Network client under PubSubClient: plain TCP, or TLS through BearSSL when
+// built with MQTT_TLS. The broker certificate is pinned by SHA-1
+// fingerprint instead of validated against a CA, so no trust store or
+// wall-clock time is needed; a second fingerprint allows rotating the
+// broker certificate. The TLS session is kept in RAM (it survives light
+// sleep) and offered on every reconnect, so after the first full handshake
+// the broker can resume it by session id and skip the key exchange.
+// MQTT_SN builds don't use it: mqttsn_client.h has its own UDP socket,
+// and only the port and the connect and publish figures come from here.
+
+struct TransportStats {
+  bool tls;
+  uint32_t connects;
+  uint32_t failures;
+  uint32_t resumed;            // handshakes that resumed the previous session
+  uint32_t last_connect_ms;
+  uint32_t max_connect_ms;
+  uint32_t free_heap;          // before the last connect
+  uint32_t handshake_min_heap; // lowest free heap during the last connect
+  int32_t last_error;          // BearSSL error of the last failed connect
+  uint8_t fingerprint;         // index of the pinned fingerprint in use
+  uint32_t publishes;
+  uint32_t publish_us;         // total time spent in publish()
+  uint32_t publish_max_us;
+};
+
+Client& transportClient();
+
+// Pins the broker certificate; ignored without MQTT_TLS
+void transportBegin(const char* const* fingerprints, uint8_t count);
+
+uint16_t transportPort();
+
+// Bracket PubSubClient::connect() so the handshake gets measured
+void transportConnectStart();
+void transportConnectDone(bool ok);
+
+void transportPublished(uint32_t elapsed_us);
+
+TransportStats transportStats();
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef MQTTSN_CLIENT_H
+#define MQTTSN_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <lwip/ip_addr.h>
+#include "node_config.h"
+#include "node_identity.h"
+
+// MQTT-SN 1.2 over UDP for MQTT_SN builds, towards a gateway
+// (zone-flow-monitor/mqttsn_gateway.py) that bridges to the MQTT broker.
+// It has the part of the PubSubClient interface main.cpp uses, so it takes
+// the place of the MQTT client without changes to the publishing code.
+//
+// Messages go out QoS 0: one datagram each, no connection to hold. Zone
+// data is still acked by the backend (ack_window.h), which covers a lost
+// datagram the same way as a lost TCP session. Keepalive is by PINGREQ
+// as in PubSubClient: a ping unanswered for a keepalive period drops the
+// session.
+//
+// The node's own topics use predefined topic ids instead of topic names,
+// relative to its topic root <site>/<node>/. The gateway learns the root
+// from the will topic (<root>/status) at CONNECT:
+//
+//   0x0001 status       0x0005 config
+//   0x0002 zones        0x0006 config/set
+//   0x0003 diagnostics  0x0007 ack
+//   0x0004 profiles     0x0008 schedule
+//   0x0009 time         0x000A time/req
+//   0x0N00 + k          zone N (1-based): k 0 data, 1 control,
+//                       2 protection, 3 battery, 4 ripple
+//
+// Any other topic (alarms, provisioning, the fleet config) is registered
+// by name once per session and then sent by the id the gateway assigned.
+
+// state(), with PubSubClient's values
+#define MQTTSN_CONNECTION_TIMEOUT -4
+#define MQTTSN_CONNECTION_LOST -3
+#define MQTTSN_CONNECT_FAILED -2
+#define MQTTSN_DISCONNECTED -1
+#define MQTTSN_CONNECTED 0
+
+struct MqttSnStats {
+  uint32_t datagrams_out;
+  uint32_t bytes_out;
+  uint32_t datagrams_in;
+  uint32_t bytes_in;
+  uint32_t registrations;  // topics registered by name
+};
+
+class MqttSnClient {
+ public:
+  typedef void (*Callback)(char* topic, uint8_t* payload, unsigned int length);
+
+  MqttSnClient& setServer(const char* host, uint16_t port);
+  MqttSnClient& setCallback(Callback callback);
+  MqttSnClient& setKeepAlive(uint16_t seconds);
+  MqttSnClient& setSocketTimeout(uint16_t seconds);
+  bool setBufferSize(uint16_t size);
+
+  bool connect(const char* id, const char* will_topic, uint8_t will_qos, bool will_retain,
+               const char* will_message);
+  void disconnect();
+  bool connected();
+  int state();
+  bool loop();
+
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  bool subscribe(const char* topic);
+
+  // Pings a gateway from a separate socket, without touching the session.
+  // Nothing waits: probeStart() looks the name up and sends the ping once
+  // it resolves, probeAnswered() checks for the PINGRESP, and the caller
+  // gives up by probeStop(). probeStart() is false if the probe couldn't
+  // start.
+  bool probeStart(const char* host, uint16_t port);
+  bool probeAnswered();
+  void probeStop();
+
+  MqttSnStats stats() const;
+
+ private:
+  struct Topic {
+    char name[TOPIC_LEN];
+    uint16_t id;      // 0 until registered or subscribed
+    uint16_t msg_id;  // of the pending SUBSCRIBE
+  };
+
+  size_t frame(uint8_t type, size_t body);
+  bool send(size_t length);
+  int receive();
+  void handle(uint8_t type, uint8_t* body, size_t length);
+  bool await(uint8_t type, size_t id_at, uint16_t id, uint32_t wait_ms);
+  uint16_t predefinedId(const char* topic) const;
+  bool predefinedName(uint16_t id, char* out, size_t size) const;
+  Topic* findTopic(const char* name);
+  Topic* addTopic(const char* name);
+  uint16_t registerTopic(const char* name);
+  uint16_t nextMsgId();
+  static void probeResolved(const char* name, const ip_addr_t* address, void* arg);
+
+  WiFiUDP udp;
+  bool udp_open = false;
+  const char* host = nullptr;
+  uint16_t port = 0;
+  IPAddress gateway;
+  Callback callback = nullptr;
+  uint8_t* buffer = nullptr;
+  uint16_t buffer_size = 0;
+  uint32_t keepalive_ms = 15000;
+  uint32_t timeout_ms = 15000;
+  int state_ = MQTTSN_DISCONNECTED;
+  bool ping_outstanding = false;
+  uint32_t last_in_ms = 0;
+  uint32_t last_out_ms = 0;
+  uint16_t msg_id = 0;
+  char root[TOPIC_LEN];
+  size_t root_len = 0;
+  Topic topics[MQTTSN_TOPICS];
+  uint8_t topic_count = 0;
+  uint8_t reply[8];  // start of the last body receive() handled
+  MqttSnStats counters = {};
+
+  enum ProbeState : uint8_t { PROBE_IDLE, PROBE_RESOLVING, PROBE_RESOLVED, PROBE_PINGED, PROBE_FAILED };
+  WiFiUDP probe_socket;
+  const char* probe_host = nullptr;
+  IPAddress probe_address;
+  uint16_t probe_port = 0;
+  volatile ProbeState probe_state = PROBE_IDLE;
+};
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef NODE_CONFIG_H
+#define NODE_CONFIG_H
+
+// Compile-time node settings shared by the firmware modules.
+// Anything marked #ifndef can be overridden from build_flags in platformio.ini.
+
+// Number of INA219 zones wired to this node
+#define ZONE_COUNT 3
+
+// Deep-sleep mode, for zones that only need slow data: the chip sleeps
+// between sample ticks and wakes through a reset, with its state kept in
+// RTC memory (deep_sleep.h), and WiFi comes up every SAMPLES_PER_PUBLISH
+// wakes. Monitoring only: relays aren't held and nothing is integrated
+// through a sleep, so load shedding and battery zones need one of the
+// other modes. Builds on low-power mode; enabled by the
+// nodemcuv2_deepsleep environment.
+#ifndef DEEP_SLEEP_MODE
+#define DEEP_SLEEP_MODE 0
+#endif
+
+// Low-power mode: radio off between publish windows, CPU light-sleeps
+// between sample ticks. Enabled by the nodemcuv2_lowpower environment.
+#ifndef LOW_POWER_MODE
+#define LOW_POWER_MODE DEEP_SLEEP_MODE
+#endif
+
+#if DEEP_SLEEP_MODE && !LOW_POWER_MODE
+#error "DEEP_SLEEP_MODE builds on LOW_POWER_MODE"
+#endif
+
+// A deep-sleep wake this close to its tick waits for it awake rather than
+// sleeping again
+#ifndef DEEP_SLEEP_POLL_MS
+#define DEEP_SLEEP_POLL_MS 300
+#endif
+
+// Sample grid period
+#ifndef SAMPLE_INTERVAL_MS
+#if DEEP_SLEEP_MODE
+#define SAMPLE_INTERVAL_MS 60000
+#else
+#define SAMPLE_INTERVAL_MS 5000
+#endif
+#endif
+
+// Samples buffered before each publish window; the publish period is
+// SAMPLES_PER_PUBLISH sample intervals, with each node publishing at its
+// own phase within it (publish_schedule.h). The low-power and deep-sleep
+// defaults shrink to the RTC sample buffer (sample_buffer.h) where that
+// holds fewer, as it does with ZONE_FILTER.
+#ifndef SAMPLES_PER_PUBLISH
+#if DEEP_SLEEP_MODE
+#define SAMPLES_PER_PUBLISH SAMPLE_BUFFER_CAP(10)
+#elif LOW_POWER_MODE
+#define SAMPLES_PER_PUBLISH SAMPLE_BUFFER_CAP(12)
+#else
+#define SAMPLES_PER_PUBLISH 1
+#endif
+#endif
+
+// How long a publish window may spend bringing WiFi up before giving up
+// (samples stay buffered for the next window)
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#endif
+
+// Overcurrent protection defaults, per zone (updatable over MQTT)
+#ifndef PROTECTION_TRIP_MA
+#define PROTECTION_TRIP_MA 2000.0f
+#endif
+#ifndef PROTECTION_RESET_MA
+#define PROTECTION_RESET_MA 1800.0f
+#endif
+#ifndef PROTECTION_HOLDOFF_MS
+#define PROTECTION_HOLDOFF_MS 200
+#endif
+#ifndef PROTECTION_RECLOSE_MS
+#define PROTECTION_RECLOSE_MS 30000
+#endif
+
+// Protection evaluates a current-only read of every zone at this period,
+// independently of the sample grid. Low-power builds only evaluate the
+// grid samples since the CPU sleeps between ticks.
+#ifndef PROTECTION_INTERVAL_MS
+#define PROTECTION_INTERVAL_MS 50
+#endif
+
+// GPIO level that keeps a zone's load connected
+#ifndef RELAY_CONNECTED_LEVEL
+#define RELAY_CONNECTED_LEVEL HIGH
+#endif
+
+// Alarm thresholds
+#ifndef ALARM_OVERVOLTAGE_V
+#define ALARM_OVERVOLTAGE_V 25.0f
+#endif
+#ifndef ALARM_OVERVOLTAGE_BAND_V
+#define ALARM_OVERVOLTAGE_BAND_V 0.5f
+#endif
+// Consecutive failed sensor reads before a zone is reported offline (reads
+// skipped while the sensor is in its I2C back-off don't count)
+#ifndef ALARM_OFFLINE_READS
+#define ALARM_OFFLINE_READS 3
+#endif
+
+// I2C bus: 400 kHz fast mode unless the wiring needs 100 kHz
+#ifndef I2C_CLOCK_HZ
+#define I2C_CLOCK_HZ 400000
+#endif
+#ifndef I2C_STRETCH_LIMIT_US
+#define I2C_STRETCH_LIMIT_US 1000
+#endif
+// Consecutive failed transactions before a sensor is left alone for a while
+#ifndef I2C_BACKOFF_ERRORS
+#define I2C_BACKOFF_ERRORS 3
+#endif
+#ifndef I2C_BACKOFF_MS
+#define I2C_BACKOFF_MS 5000
+#endif
+
+// Diagnostics (bus statistics) are published every this many sample ticks
+#ifndef DIAGNOSTICS_EVERY_TICKS
+#define DIAGNOSTICS_EVERY_TICKS 12
+#endif
+
+// While a zone is detached, the bus is rescanned every this many sample
+// ticks so a replugged sensor is picked up again
+#ifndef DISCOVERY_EVERY_TICKS
+#define DISCOVERY_EVERY_TICKS 6
+#endif
+
+// Default INA219 hardware averaging (1..128 samples) for every zone's
+// profile; the range comes from the zone's expected load in main.cpp
+#ifndef ZONE_ADC_SAMPLES
+#define ZONE_ADC_SAMPLES 1
+#endif
+
+// INA219 auto-ranging (per zone, can be changed with "auto_range" on the
+// zone's control topic). Up at this fraction of the range's full scale,
+// down after this many readings below the fraction of the smaller range.
+#ifndef AUTORANGE_DEFAULT
+#define AUTORANGE_DEFAULT 1
+#endif
+#ifndef AUTORANGE_UP_FRACTION
+#define AUTORANGE_UP_FRACTION 0.9f
+#endif
+#ifndef AUTORANGE_DOWN_FRACTION
+#define AUTORANGE_DOWN_FRACTION 0.7f
+#endif
+#ifndef AUTORANGE_DOWN_SAMPLES
+#define AUTORANGE_DOWN_SAMPLES 8
+#endif
+
+// MQTT topics are <SITE_ID>/<node id>/...; the node id is provisioned in
+// flash or derived from the chip id (node_identity.h)
+#ifndef SITE_ID
+#define SITE_ID "site1"
+#endif
+
+// Flash-emulated EEPROM shared by the persistent settings
+#ifndef EEPROM_SIZE
+#define EEPROM_SIZE 512
+#endif
+
+// Zone data is acked by the backend on <site>/<node>/ack: at most
+// ACK_WINDOW zone messages are unacked at a time, and one is sent again
+// when its ack hasn't arrived after ACK_TIMEOUT_MS
+#ifndef ACK_WINDOW
+#define ACK_WINDOW 4
+#endif
+#ifndef ACK_TIMEOUT_MS
+#define ACK_TIMEOUT_MS 2000
+#endif
+
+// Adaptive batching: the samples per publish follow the link. A weak link
+// (ack RTT or RSSI past the poor thresholds, or a retransmit) doubles the
+// batch; BATCH_GOOD_SLOTS good slots in a row halve it, and a fair link
+// holds it. The batch stays within BATCH_MIN/MAX_LATENCY_MS of sampling.
+#ifndef BATCH_ADAPTIVE
+#define BATCH_ADAPTIVE 1
+#endif
+#ifndef BATCH_MIN_LATENCY_MS
+#define BATCH_MIN_LATENCY_MS (SAMPLE_INTERVAL_MS * SAMPLES_PER_PUBLISH)
+#endif
+#ifndef BATCH_MAX_LATENCY_MS
+#define BATCH_MAX_LATENCY_MS 60000
+#endif
+#ifndef BATCH_RTT_GOOD_MS
+#define BATCH_RTT_GOOD_MS 100
+#endif
+#ifndef BATCH_RTT_POOR_MS
+#define BATCH_RTT_POOR_MS 500
+#endif
+#ifndef BATCH_RSSI_GOOD
+#define BATCH_RSSI_GOOD -67
+#endif
+#ifndef BATCH_RSSI_POOR
+#define BATCH_RSSI_POOR -80
+#endif
+#ifndef BATCH_GOOD_SLOTS
+#define BATCH_GOOD_SLOTS 3
+#endif
+
+// Local HTTP/SSE server for readings without the broker (local_server.h);
+// off in low-power mode, where the radio is down between publish windows
+#ifndef LOCAL_SERVER
+#define LOCAL_SERVER !LOW_POWER_MODE
+#endif
+#ifndef LOCAL_SERVER_PORT
+#define LOCAL_SERVER_PORT 80
+#endif
+#ifndef LOCAL_SSE_MAX_CLIENTS
+#define LOCAL_SSE_MAX_CLIENTS 4
+#endif
+#ifndef LOCAL_SSE_MAX_QUEUE
+#define LOCAL_SSE_MAX_QUEUE 4
+#endif
+
+// MQTT over TLS (BearSSL) with the broker certificate pinned by
+// fingerprint (mqtt_transport.h); plain TCP otherwise
+#ifndef MQTT_TLS
+#define MQTT_TLS 0
+#endif
+#ifndef MQTT_PORT
+#define MQTT_PORT 1883
+#endif
+#ifndef MQTT_TLS_PORT
+#define MQTT_TLS_PORT 8883
+#endif
+
+// MQTT-SN over UDP through a gateway instead of MQTT over TCP
+// (mqttsn_client.h); excludes MQTT_TLS. The gateway's UDP port is
+// MQTTSN_PORT, the same number as the broker's TCP port by default.
+#ifndef MQTT_SN
+#define MQTT_SN 0
+#endif
+#ifndef MQTTSN_PORT
+#define MQTTSN_PORT 1883
+#endif
+#ifndef MQTTSN_TOPICS
+#define MQTTSN_TOPICS 20              // topics registered by name per session
+#endif
+#ifndef MQTTSN_RETRIES
+#define MQTTSN_RETRIES 3              // sends of a REGISTER or SUBSCRIBE within the socket timeout
+#endif
+#if MQTT_SN && MQTT_TLS
+#error "MQTT_SN and MQTT_TLS can't be combined"
+#endif
+
+// Zone data payload encoding (zone_encoder.h): ZONE_PAYLOAD_JSON (0),
+// ZONE_PAYLOAD_CBOR (1), ZONE_PAYLOAD_PACKED (2) or ZONE_PAYLOAD_CSV (3)
+#ifndef ZONE_PAYLOAD
+#define ZONE_PAYLOAD 0
+#endif
+
+// Per-zone Kalman filter of the current (zone_filter.h). Adds a filtered
+// current to every reading and payload, at 2 bytes per zone and buffered
+// sample: the RTC ring holds 11 samples instead of 15 (8 instead of 11 in
+// deep-sleep builds), which an explicit SAMPLES_PER_PUBLISH has to fit. q,
+// r and the gate are per zone in the runtime config; these are the
+// defaults.
+#ifndef ZONE_FILTER
+#define ZONE_FILTER 0
+#endif
+#ifndef ZONE_FILTER_Q_MA2
+#define ZONE_FILTER_Q_MA2 4.0f        // process noise, mA² per sample
+#endif
+#ifndef ZONE_FILTER_R_MA2
+#define ZONE_FILTER_R_MA2 100.0f      // measurement noise, mA²; 0 disables
+#endif
+#ifndef ZONE_FILTER_GATE_SIGMA
+#define ZONE_FILTER_GATE_SIGMA 4.0f   // load step threshold; 0 disables
+#endif
+
+// Battery zones (battery_gauge.h). A zone is a load unless its runtime
+// config sets "type": "battery"; these are the defaults for the battery
+// settings, for a 12 V lead-acid bank. The OCV curve is the rested
+// terminal voltage at 0, 10, ..., 100 % state of charge.
+#ifndef BATTERY_CAPACITY_MAH
+#define BATTERY_CAPACITY_MAH 100000.0f
+#endif
+#ifndef BATTERY_CHARGE_EFFICIENCY
+#define BATTERY_CHARGE_EFFICIENCY 0.95f
+#endif
+#ifndef BATTERY_REST_MA
+#define BATTERY_REST_MA 50.0f         // below this the battery is at rest
+#endif
+#ifndef BATTERY_REST_MS
+#define BATTERY_REST_MS 1800000UL     // rest before the voltage is the OCV
+#endif
+#ifndef BATTERY_OCV_V
+#define BATTERY_OCV_V {11.31f, 11.51f, 11.66f, 11.81f, 11.96f, 12.10f, 12.24f, 12.37f, 12.50f, 12.62f, 12.73f}
+#endif
+
+// Ripple diagnostics (ripple_monitor.h): every RIPPLE_EVERY_TICKS ticks
+// one zone in turn is read RIPPLE_POINTS times at RIPPLE_SAMPLE_US, bus
+// voltage and shunt, and a fixed-point FFT finds the dominant ripple.
+// Normal mode only; the zone's profile is at RIPPLE_ADC_BITS for the burst
+// so a conversion keeps up with the reads.
+#ifndef RIPPLE_ANALYSIS
+#define RIPPLE_ANALYSIS 0
+#endif
+#ifndef RIPPLE_POINTS
+#define RIPPLE_POINTS 256             // power of two, 64..1024; 4 bytes each
+#endif
+#ifndef RIPPLE_SAMPLE_US
+#define RIPPLE_SAMPLE_US 400          // two register reads at 400 kHz fit
+#endif
+#ifndef RIPPLE_ADC_BITS
+#define RIPPLE_ADC_BITS 10            // 148 us per channel
+#endif
+#ifndef RIPPLE_EVERY_TICKS
+#define RIPPLE_EVERY_TICKS 60
+#endif
+#ifndef INA_SHUNT_OHMS
+#define INA_SHUNT_OHMS 0.1f           // the breakout's, as the driver's calibrations assume
+#endif
+
+// Shared sample grid (time_sync.h): the backend's clock from its beacons
+// on <site>/time and replies to the node's requests. Corrections up to
+// TIME_SYNC_STEP_US move the grid at once; larger ones, after
+// TIME_SYNC_STEP_SAMPLES samples agree, renumber the ticks once the buffer
+// has drained.
+#ifndef TIME_SYNC_WINDOW
+#define TIME_SYNC_WINDOW 8            // offset samples in the fit
+#endif
+#ifndef TIME_SYNC_REQUEST_MS
+#define TIME_SYNC_REQUEST_MS 600000UL // round-trip requests, and on every connect
+#endif
+#ifndef TIME_SYNC_MIN_SPAN_MS
+#define TIME_SYNC_MIN_SPAN_MS 60000   // samples spread over this before drift is fitted
+#endif
+#ifndef TIME_SYNC_STEP_US
+#define TIME_SYNC_STEP_US 50000
+#endif
+#ifndef TIME_SYNC_STEP_SAMPLES
+#define TIME_SYNC_STEP_SAMPLES 3
+#endif
+#ifndef TIME_SYNC_MAX_DRIFT_PPM
+#define TIME_SYNC_MAX_DRIFT_PPM 500   // crystal and light-sleep RTC error bound
+#endif
+#ifndef TIME_SYNC_HOLDOVER_PPM
+#define TIME_SYNC_HOLDOVER_PPM 20     // drift uncertainty while no samples come in
+#endif
+
+// Broker failover (broker_pool.h): the config's mqtt_server first, then
+// its mqtt_backups in order. A dead broker is noticed within two
+// keepalives and each broker tried costs at most the connect timeout, so
+// with the defaults the node is on a backup within ~14 s, well inside what
+// the sample buffer holds. The preferred broker is probed with a bare TCP
+// connect while on a backup, and taken back after consecutive good probes.
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S 5
+#endif
+#ifndef BROKER_CONNECT_TIMEOUT_MS
+#define BROKER_CONNECT_TIMEOUT_MS 2000
+#endif
+#ifndef BROKER_BACKOFF_MS
+#define BROKER_BACKOFF_MS 5000        // doubles per consecutive failure
+#endif
+#ifndef BROKER_BACKOFF_MAX_MS
+#define BROKER_BACKOFF_MAX_MS 30000
+#endif
+#ifndef BROKER_UNHEALTHY_RATE
+#define BROKER_UNHEALTHY_RATE 0.5f    // failure rate that demotes a broker
+#endif
+#ifndef BROKER_FAILBACK_PROBE_MS
+#define BROKER_FAILBACK_PROBE_MS 30000
+#endif
+#ifndef BROKER_FAILBACK_PROBES
+#define BROKER_FAILBACK_PROBES 2
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef NODE_IDENTITY_H
+#define NODE_IDENTITY_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Node identity and MQTT topic root. The node id is the one provisioned in
+// flash if there is one, otherwise "esp-<chip id>". Topics follow
+// <site>/<node>/... and are built once at boot, so a provisioned id takes
+// effect after a restart. The MQTT client id always comes from the chip id
+// and stays unique even if two boards are provisioned with the same name.
+
+#define NODE_ID_MAX 24
+#define TOPIC_LEN 64
+// Longest suffix the node builds a topic with: alarms/zoneN/sensor_error
+#define TOPIC_SUFFIX_MAX 25
+
+// Identity record at the start of the EEPROM
+#define IDENTITY_EEPROM_OFFSET 0
+#define IDENTITY_EEPROM_SIZE 32
+
+void identityBegin();
+
+const char* nodeId();
+const char* siteId();
+const char* clientId();
+uint32_t chipId();
+bool identityProvisioned();
+
+// Builds "<site>/<node>/<suffix>"
+void buildTopic(char* out, size_t size, const char* suffix);
+
+// Stores a node id in flash for the next boot; an empty id clears it.
+// Returns false for an id that isn't usable in a topic: characters other
+// than letters, digits, '-' and '_', a name the site-level topics use
+// (config, time, provision), or one too long for every topic to fit in
+// TOPIC_LEN.
+bool identityProvision(const char* node_id);
+
+#endif
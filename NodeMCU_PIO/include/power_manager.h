@@ -0,0 +1,67 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+
+// Sample-grid timing plus radio (modem) sleep and CPU light sleep.
+//
+// Ticks are scheduled at fixed multiples of the sample interval on the grid
+// clock, so wake-up latency or a slow publish window never shifts the grid;
+// ticks that are overrun are skipped and counted instead. The grid clock is
+// the power clock from boot until a timebase maps it onto the backend's
+// clock (time_sync.h), which puts every node's ticks on one site-wide grid.
+
+struct PowerStats {
+  uint64_t uptime_us;
+  uint64_t light_sleep_us;   // time spent in forced light sleep
+  uint64_t radio_on_us;      // time the WiFi radio was powered
+  uint32_t missed_ticks;
+  uint32_t max_late_us;      // worst tick lateness behind the grid
+};
+
+void powerBegin(uint32_t sample_interval_ms);
+
+// Moves to a new sample interval; the next tick is the first slot of the
+// new grid after now. Tick indices are only comparable within one grid.
+void powerSetInterval(uint32_t sample_interval_ms);
+
+// Boot-relative time that keeps counting across light sleep
+uint64_t powerClockMicros();
+
+// Maps the power clock onto the grid clock from now on:
+//   grid = clock + offset_us + drift_ppb * (clock - ref_us) / 1e9
+// With renumber the next tick becomes the first slot of the new grid after
+// now (as with a new interval); otherwise the tick count carries on, for a
+// correction well inside an interval.
+void powerSetTimebase(int64_t offset_us, int32_t drift_ppb, uint64_t ref_us, bool renumber);
+
+// Grid-clock time now, and at a power-clock time
+uint64_t powerGridMicros();
+uint64_t powerGridAt(uint64_t clock_us);
+
+// Returns true once per grid tick and stores the tick index
+bool powerTickDue(uint32_t* tick);
+
+// How far behind the grid the last tick fired (sampling jitter)
+uint32_t powerTickLateUs();
+
+// Light-sleeps until shortly before the next tick. The radio must be off.
+void powerSleepUntilNextTick();
+
+// Index of the next tick, and its time on the power clock
+uint32_t powerNextTick();
+uint64_t powerNextTickUs();
+
+// Continues the clock and the grid after a deep-sleep reset (deep_sleep.h):
+// clock_us is the power-clock time now, next_tick the saved next tick
+void powerResume(uint64_t clock_us, uint32_t next_tick);
+
+// Brings WiFi up and waits for an association, at most timeout_ms
+bool powerRadioOn(const char* ssid, const char* password, uint32_t timeout_ms);
+
+// Disconnects and powers the radio down (modem sleep)
+void powerRadioOff();
+
+PowerStats powerStats();
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PROTECTION_H
+#define PROTECTION_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Local overcurrent load-shedding. Every current sample is evaluated on the
+// node and the zone relay is driven in the same call, so shedding never
+// waits for the broker. Events are queued and published afterwards.
+//
+// Per zone: a sample at or above trip_mA arms the trip; it fires once the
+// current has stayed at or above reset_mA for holdoff_ms (dropping below
+// reset_mA disarms it). A shed zone recloses after reclose_ms, or stays
+// shed until a reset command when reclose_ms is 0.
+
+struct ProtectionSettings {
+  float trip_mA;         // 0 disables protection for the zone
+  float reset_mA;
+  uint32_t holdoff_ms;
+  uint32_t reclose_ms;
+};
+
+enum ProtectionState : uint8_t {
+  PROTECTION_NORMAL,
+  PROTECTION_PENDING,
+  PROTECTION_SHED
+};
+
+struct ProtectionEvent {
+  uint8_t zone;
+  bool shed;             // false for a reclose
+  float current_mA;
+  uint32_t at_ms;
+  uint32_t latency_us;   // sample start to relay write
+};
+
+void protectionBegin(const uint8_t* relay_pins);
+
+// Evaluates one current sample taken at sampled_us (micros()) and actuates
+// the relay if needed
+void protectionSample(uint8_t zone, float current_mA, uint32_t sampled_us);
+
+void protectionConfigure(uint8_t zone, const ProtectionSettings& settings);
+ProtectionSettings protectionSettings(uint8_t zone);
+ProtectionState protectionState(uint8_t zone);
+
+// Recloses a shed zone immediately
+void protectionReset(uint8_t zone);
+
+bool protectionPopEvent(ProtectionEvent* event);
+
+#endif
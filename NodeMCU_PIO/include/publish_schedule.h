@@ -0,0 +1,26 @@
+#ifndef PUBLISH_SCHEDULE_H
+#define PUBLISH_SCHEDULE_H
+
+#include <Arduino.h>
+
+// Phase-staggered publish slots. Nodes that boot together sample on the
+// same grid; publishing at a per-node phase offset within the publish
+// period spreads their messages out instead of hitting the broker in one
+// burst. The phase is derived from the chip id unless one is assigned.
+
+void scheduleBegin(uint32_t period_ms, uint32_t chip_id);
+
+// True once per period, as soon as now_ms has passed the node's slot
+bool schedulePublishDue(uint64_t now_ms);
+
+// Assigns a phase (taken modulo the period); the next slot moves with it
+void scheduleSetPhase(uint32_t phase_ms);
+
+// Changes the period, keeping the phase at the same fraction of it; the
+// next slot is the first of the new period after now_ms
+void scheduleSetPeriod(uint32_t period_ms, uint64_t now_ms);
+
+uint32_t schedulePhase();
+uint32_t schedulePeriod();
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RIPPLE_MONITOR_H
+#define RIPPLE_MONITOR_H
+
+#include <Arduino.h>
+#include "fft_fixed.h"
+#include "node_config.h"
+
+// Ripple diagnostics for RIPPLE_ANALYSIS builds. A burst reads one zone's
+// shunt and bus voltage registers RIPPLE_POINTS times on a RIPPLE_SAMPLE_US
+// grid, with the zone's ADC at RIPPLE_ADC_BITS single samples so every read
+// sees a fresh conversion, then runs both channels through one fixed-point
+// FFT (fft_fixed.h). Converter ripple above the Nyquist rate (1.25 kHz at
+// the defaults) folds back into the band; the frequency is then an alias,
+// the amplitude and RMS still hold.
+//
+// A burst blocks the loop, ~100 ms at the defaults: the other zones'
+// protection waits, as during a slow publish. Bursts are sampled with
+// interrupts on, so WiFi can make samples late; max_late_us says how much.
+
+struct RippleResult {
+  bool valid;
+  uint32_t at_ms;            // millis() at the burst
+  float sample_rate_Hz;      // achieved, first to last sample
+  uint32_t max_late_us;      // worst sample behind the grid
+  uint32_t analyze_us;       // windowing, transform and peak search
+  RippleTone voltage;        // V
+  RippleTone current;        // mA
+};
+
+void rippleBegin(const uint8_t* addresses);
+
+// Takes and analyzes a burst on an attached zone, then restores its
+// profile. Returns false on a bus error or while the device is backed off
+// (i2c_bus.h).
+bool rippleBurst(uint8_t zone);
+
+const RippleResult& rippleLatest(uint8_t zone);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "battery_gauge.h"
+#include "node_config.h"
+#include "node_identity.h"
+
+// Settings that can change without a reflash. The node_config.h defines
+// are the defaults; the block is stored in EEPROM after the identity
+// record with a CRC-32, and updated through <site>/<node>/config/set or the
+// fleet-wide <site>/config/set. An update is validated as a whole and
+// staged; the main loop applies it between two ticks and echoes the
+// result retained on <site>/<node>/config. The zone control topics still
+// adjust protection live, on top of the stored thresholds.
+//
+// Versioning: fields are only ever appended. A block written by older
+// firmware loads its fields and keeps the defaults for the newer ones; a
+// newer block loads the fields this firmware knows.
+
+#define CONFIG_EEPROM_OFFSET (IDENTITY_EEPROM_OFFSET + IDENTITY_EEPROM_SIZE)
+#define CONFIG_VERSION 4   // 2: filters, 3: batteries, 4: backup brokers
+#define CONFIG_SERVER_MAX 40
+#define CONFIG_BACKUP_BROKERS 2
+
+struct ZoneConfig {
+  float trip_mA;
+  float reset_mA;
+  uint32_t holdoff_ms;
+  uint32_t reclose_ms;
+  float overvoltage_V;
+};
+
+// zone_filter.h tuning; used by ZONE_FILTER builds, stored either way
+struct ZoneFilterConfig {
+  float q_mA2;
+  float r_mA2;
+  float gate_sigma;
+};
+
+// Fallback after mqtt_server (broker_pool.h); an empty server is unused
+struct BrokerConfig {
+  char server[CONFIG_SERVER_MAX];
+  uint16_t port;
+};
+
+struct RuntimeConfig {
+  uint32_t sample_interval_ms;
+  uint32_t batch_min_latency_ms;
+  uint32_t batch_max_latency_ms;
+  uint16_t samples_per_publish;      // initial batch, and the batch if not adaptive
+  uint16_t diagnostics_every_ticks;
+  uint8_t ack_window;
+  uint8_t reserved;
+  uint16_t mqtt_port;
+  char mqtt_server[CONFIG_SERVER_MAX];
+  ZoneConfig zones[ZONE_COUNT];
+  ZoneFilterConfig filters[ZONE_COUNT];
+  BatteryConfig batteries[ZONE_COUNT];   // battery_gauge.h
+  BrokerConfig backups[CONFIG_BACKUP_BROKERS];
+};
+
+enum ConfigSource : uint8_t {
+  CONFIG_DEFAULTS,    // nothing valid stored
+  CONFIG_STORED,
+  CONFIG_MIGRATED     // stored by firmware with a different CONFIG_VERSION
+};
+
+// Loads the stored block, or the defaults with the given broker. Call
+// after identityBegin(), which opens the EEPROM.
+void configBegin(const char* default_mqtt_server, uint16_t default_mqtt_port);
+
+// The active configuration
+const RuntimeConfig& config();
+ConfigSource configSource();
+const char* configSourceName(ConfigSource source);
+uint32_t configRevision();    // bumped by every stored change
+
+// Applies the fields present in a JSON update on top of the staged (or
+// else active) configuration. {"command": "defaults"} stages the
+// defaults. Returns an error message, or nullptr once staged.
+const char* configStage(JsonVariantConst update);
+
+// The staged configuration, if an update is waiting
+bool configPending();
+const RuntimeConfig& configStaged();
+
+// Makes the staged configuration active and stores it if it differs;
+// returns false if it was the same as the active one
+bool configCommit();
+
+// Writes the active configuration, version and revision
+void configToJson(JsonObject out);
+
+#endif
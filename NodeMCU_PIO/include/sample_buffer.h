@@ -0,0 +1,111 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Sensor readings for one zone
+struct ZoneData {
+  float current_mA;
+  float power_mW;
+  float busvoltage;
+  float current_filt_mA;   // zone_filter.h; the raw current without ZONE_FILTER
+  uint8_t range;           // InaRange (ina_profile.h) the reading was taken at
+};
+
+// INA219 current register counts per mA at each InaRange: 50, 40 and
+// 100 uA per count. The power register counts 20 current LSBs.
+inline constexpr float RANGE_COUNTS_PER_MA[] = {20.0f, 25.0f, 10.0f};
+#define RANGE_POWER_LSBS 20.0f
+
+// Fixed-point zone reading as stored in RTC memory, at the sensor's own
+// resolution for the range it was read at
+struct PackedZone {
+  int16_t current;       // current LSBs of the range
+  uint16_t bus;          // 4 mV (INA219 bus LSB) in bits 0-12, range in bits 13-14
+  uint16_t power;        // power LSBs of the range
+#if ZONE_FILTER
+  int16_t current_filt;  // current LSBs of the range
+#endif
+};
+
+#define PACKED_BUS_MASK 0x1FFF
+#define PACKED_RANGE_SHIFT 13
+
+// One tick of readings for every zone
+struct PackedSample {
+  uint32_t tick;         // index on the sample grid
+  PackedZone zone[ZONE_COUNT];
+  uint16_t flags;        // ZONE_FLAG_BITS status bits per zone, SAMPLE_FLAG_SHARED_GRID
+#if ZONE_FILTER
+  uint16_t reserved;     // 4-byte alignment
+#endif
+};
+
+static_assert(sizeof(PackedSample) % 4 == 0, "RTC slots must be 4-byte aligned");
+
+// Per-zone status bits in PackedSample::flags. A sample with any of
+// ZONE_FLAGS_INVALID set carries no usable reading; it is still published
+// (unless the zone is detached) so the backend sees the fault.
+#define ZONE_FLAG_BITS 5
+#define ZONE_FLAG_NO_READING 0x1    // zone detached
+#define ZONE_FLAG_RANGE_SWITCH 0x2  // taken across an INA219 range switch
+#define ZONE_FLAG_I2C_ERROR 0x4     // a register read failed on the bus
+#define ZONE_FLAG_OVERFLOW 0x8      // INA219 math overflow (OVF): current and power clipped
+#define ZONE_FLAG_OUT_OF_RANGE 0x10 // a value the sensor can't measure (NaN, beyond full scale)
+#define ZONE_FLAGS_INVALID (ZONE_FLAG_NO_READING | ZONE_FLAG_I2C_ERROR | ZONE_FLAG_OVERFLOW | \
+                            ZONE_FLAG_OUT_OF_RANGE)
+
+// The tick is on the site-wide grid (time_sync.h), not the boot-relative one
+#define SAMPLE_FLAG_SHARED_GRID 0x8000
+
+static_assert(ZONE_COUNT * ZONE_FLAG_BITS <= 15, "zone flags don't fit in PackedSample::flags");
+
+inline uint8_t zoneFlags(const PackedSample& sample, uint8_t zone) {
+  return (sample.flags >> (zone * ZONE_FLAG_BITS)) & ((1 << ZONE_FLAG_BITS) - 1);
+}
+
+inline void setZoneFlag(PackedSample& sample, uint8_t zone, uint8_t flag) {
+  sample.flags |= flag << (zone * ZONE_FLAG_BITS);
+}
+
+// Ring of samples kept in RTC user memory so it survives light sleep, deep
+// sleep and soft resets. The first 128 bytes of RTC user memory are left
+// for OTA, and in DEEP_SLEEP_MODE the last ones for the deep-sleep record.
+#if DEEP_SLEEP_MODE
+#define DEEP_SLEEP_RTC_BYTES 96
+#else
+#define DEEP_SLEEP_RTC_BYTES 0
+#endif
+#define SAMPLE_BUFFER_CAPACITY ((512 - 128 - 16 - DEEP_SLEEP_RTC_BYTES) / sizeof(PackedSample))
+// n, or the capacity if that is smaller (SAMPLES_PER_PUBLISH defaults)
+#define SAMPLE_BUFFER_CAP(n) ((n) < SAMPLE_BUFFER_CAPACITY ? (size_t)(n) : SAMPLE_BUFFER_CAPACITY)
+
+static_assert(SAMPLES_PER_PUBLISH <= SAMPLE_BUFFER_CAPACITY,
+              "SAMPLES_PER_PUBLISH does not fit in the RTC sample buffer");
+
+// Validates the RTC ring, clearing it if the magic does not match or
+// keep_existing is false. Returns the number of samples kept.
+uint8_t sampleBufferBegin(bool keep_existing);
+
+// Appends a sample, dropping the oldest one when the ring is full.
+void sampleBufferPush(const PackedSample& sample);
+
+// Copies the i-th oldest buffered sample into out.
+bool sampleBufferPeek(uint8_t i, PackedSample* out);
+
+// Removes the n oldest samples (after they were published).
+void sampleBufferDrop(uint8_t n);
+
+uint8_t sampleBufferCount();
+uint32_t sampleBufferOverflows();
+
+// Sequence number of the i-th oldest buffered sample: samples are numbered
+// in push order from sampleBufferBegin(), so overwritten ones show up as a
+// gap and a republished one repeats its number
+uint32_t sampleBufferSeq(uint8_t i);
+
+PackedZone packZone(const ZoneData& data);
+ZoneData unpackZone(const PackedZone& packed);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+// Publish stamping: a random boot id, a 64-bit boot-relative millisecond
+// clock that keeps counting across light sleep, and a sequence number per
+// publish stream. (boot_id, stream, seq) identifies a message, so the
+// backend can tell gaps, duplicates and reordering apart, and uptime_ms at
+// send time lets it estimate device-to-ingest latency.
+
+enum PublishStream : uint8_t {
+  STREAM_ALARMS,
+  STREAM_PROTECTION,
+  STREAM_DIAGNOSTICS,
+  STREAM_PROFILES,
+  STREAM_ZONES,
+  STREAM_BATTERY,
+  STREAM_RIPPLE,
+  STREAM_COUNT
+};
+// Zone data is sequenced per sample by the sample buffer, not here
+
+// Draws the boot id from the hardware RNG
+void telemetryBegin();
+
+uint32_t telemetryBootId();
+uint64_t telemetryUptimeMs();
+
+// Sequence number for the next message on a stream, starting at 0
+uint32_t telemetryNextSeq(PublishStream stream);
+
+// Carry the boot id and sequence numbers over a deep sleep (deep_sleep.h),
+// so the backend sees one boot across wakes. seq holds STREAM_COUNT values.
+void telemetrySave(uint32_t* boot_id, uint32_t* seq);
+void telemetryRestore(uint32_t boot_id, const uint32_t* seq);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Site-wide sample grid. The backend publishes its clock (microseconds
+// since a site epoch) as a beacon on <site>/time, and answers a request on
+// <site>/<node>/time/req on <site>/<node>/time with the request's send time
+// echoed. Each message is a sample of the offset between the backend clock
+// and the power clock: a reply is taken at the middle of its round trip,
+// and half the round trip is the one-way delay a beacon is corrected by.
+// Offset and drift are a least-squares fit over the last TIME_SYNC_WINDOW
+// samples.
+//
+// The fit sets the power manager's timebase, so tick n is due at n sample
+// intervals after the site epoch on every node, and the backend joins
+// zones across nodes by tick index. Corrections up to TIME_SYNC_STEP_US
+// move the grid at once. The first sync and later steps renumber the
+// ticks, so they wait for timeSyncApplyStep(), which main calls once the
+// sample buffer has drained; a batch never mixes two grids.
+
+struct TimeSyncStats {
+  bool synced;            // ticks are on the site grid
+  int32_t error_us;       // estimated grid error now; -1 unsynced
+  int64_t offset_us;      // backend clock - power clock, now
+  int32_t drift_ppb;
+  uint32_t rtt_us;        // last request round trip
+  uint32_t beacons;
+  uint32_t replies;
+  uint32_t rejected;      // samples off the fit by more than TIME_SYNC_STEP_US
+  uint32_t steps;
+  uint32_t epoch_s;       // site epoch of the backend clock, Unix time
+};
+
+// Kept across deep sleep (deep_sleep.h)
+struct TimeSyncSaved {
+  int64_t offset_us;      // at the power-clock time it was saved
+  int32_t drift_ppb;
+  int32_t error_us;       // -1 unsynced
+};
+
+void timeSyncBegin();
+
+// A beacon or reply; received_us is the power clock when it came in,
+// taken before anything else is done with the message
+void timeSyncMessage(const byte* message, unsigned int length, uint64_t received_us);
+
+// Writes a request when one is due: after timeSyncConnected(), then every
+// TIME_SYNC_REQUEST_MS. Returns the length, 0 if none is due.
+size_t timeSyncRequest(char* out, size_t size);
+
+// A new broker session; the next request goes out at once
+void timeSyncConnected();
+
+// True while a first sync or a step waits to renumber the ticks
+bool timeSyncStepPending();
+void timeSyncApplyStep();
+
+bool timeSyncSynced();
+int32_t timeSyncErrorUs();
+TimeSyncStats timeSyncStats();
+
+void timeSyncSave(TimeSyncSaved* out);
+// clock_us: the power-clock time of the save
+void timeSyncRestore(const TimeSyncSaved& saved, uint64_t clock_us);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef WAKE_PLAN_H
+#define WAKE_PLAN_H
+
+#include <Arduino.h>
+#include "deep_sleep.h"
+#include "node_config.h"
+
+// What a DEEP_SLEEP_MODE wake does next, decided apart from the hardware
+// so zone-flow-monitor/simulate_deep_sleep.py runs the same planning as
+// sleepDeep() in main.cpp. Times are on the power clock.
+//
+// A wake that comes well before its planned time sleeps again, and one
+// within DEEP_SLEEP_POLL_MS of its tick stays up to sample it. A radio
+// wake then opens its publish window. Every other wake sleeps until the
+// next tick, taking the radio on the node's publish tick. An alarm gets a
+// radio wake at once unless the last window failed: retries stay at the
+// radio wakes, so a missing AP doesn't keep the radio busy. The exception
+// is the wake that fills the buffer, which gets one more try before
+// samples are overwritten.
+
+enum WakeAction : uint8_t {
+  WAKE_SAMPLE,   // the next tick is close: sample it awake
+  WAKE_PUBLISH,  // open this wake's publish window, then plan again
+  WAKE_SLEEP     // sleep until wake_us (0: a minimal sleep) with flags
+};
+
+struct WakeState {
+  uint64_t now_us;
+  uint64_t planned_us;         // deepSleepPlannedWakeUs()
+  uint64_t next_tick_us;
+  uint32_t next_tick;
+  uint32_t samples_per_publish;
+  uint32_t phase_tick;         // the node's publish phase, in ticks
+  uint8_t flags;               // deepSleepFlags()
+  bool window_done;            // this wake's window has run
+  bool window_failed;
+  bool echo_due;               // the config echo hasn't gone out
+  bool alarms_pending;
+  bool filled;                 // this wake filled the sample buffer
+};
+
+struct WakePlan {
+  WakeAction action;
+  uint8_t flags;
+  uint64_t wake_us;
+};
+
+WakePlan wakePlan(const WakeState& state);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef WINDOW_AGGREGATE_H
+#define WINDOW_AGGREGATE_H
+
+#include <Arduino.h>
+#include "node_config.h"
+#include "sample_buffer.h"
+
+// Per-zone min/mean/max over a publish window. Samples are added as they
+// are taken; at the publish slot the open window becomes the latest one.
+// Invalid samples (ZONE_FLAGS_INVALID) and those taken across a range
+// switch are counted as skipped instead of aggregated; invalid counts the
+// former alone.
+
+struct FieldStats {
+  float min;
+  float max;
+  float sum;
+};
+
+struct ZoneAggregate {
+  uint16_t count;
+  uint16_t skipped;
+  uint16_t invalid;
+  uint32_t first_tick;
+  uint32_t last_tick;
+  FieldStats current_mA;
+  FieldStats voltage_V;
+  FieldStats power_mW;
+};
+
+void aggregateSample(uint8_t zone, uint32_t tick, const ZoneData& data, uint8_t flags);
+
+// Closes the open window; it becomes the latest and a new one opens
+void aggregateClose();
+
+const ZoneAggregate& aggregateLatest(uint8_t zone);
+
+inline float fieldMean(const FieldStats& f, uint16_t count) {
+  return count ? f.sum / count : 0;
+}
+
+#endif
@@ -0,0 +1,558 @@
+#ifndef ZONE_ENCODER_H
+#define ZONE_ENCODER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "node_config.h"
+#include "sample_buffer.h"
+
+// Zone data payload encoders. The layout of a zone message is a policy
+// chosen at compile time (ZONE_PAYLOAD in node_config.h); every policy
+// walks the same field descriptor of ZoneData, and only the selected one
+// is instantiated, so a build carries a single encoder.
+//
+//   JSON    the original document: latest reading at top level, batched
+//           rows under "samples", range-switch rows by index; on the site
+//           grid also the latest tick, the interval and the sync error
+//   CBOR    the same document in CBOR (RFC 8949), floats as float32
+//   PACKED  fixed-point binary: 36-byte header plus the range name, then
+//           9 bytes per row at the RTC buffer's resolution (11 and version
+//           8 with ZONE_FILTER); node and zone come from the topic
+//   CSV     a "#" metadata line, then one line per row
+//
+// Row timestamps are tick * interval_ms: milliseconds since boot, or since
+// the site epoch once the node's ticks are on the site grid (time_sync.h).
+//
+// Every payload ends in a fixed-size trailer with the CRC-32 of all bytes
+// before it, so the backend can drop a corrupted message before parsing
+// it. Rows with ZONE_FLAGS_INVALID set are sent with their flags (listed
+// by index in the JSON and CBOR forms) rather than left out.
+//
+// zone-flow-monitor/zone_payload.py decodes all four into the JSON form.
+// Strings are written unescaped: node ids are restricted to [A-Za-z0-9_-]
+// and the other strings are constants.
+
+// How each ZoneData field is encoded
+struct ZoneField {
+  const char* name;
+  float ZoneData::*value;
+  uint8_t decimals;      // text encodings; covers the finest stored resolution
+  float lsb;             // packed encoding: units per count, or current LSBs
+                         // of the row's range per count where ranged
+  bool ranged;
+  bool is_signed;
+};
+
+inline constexpr ZoneField ZONE_FIELDS[] = {
+  {"current_mA", &ZoneData::current_mA, 2, 1.0f, true, true},
+  {"voltage_V", &ZoneData::busvoltage, 3, 0.004f, false, false},
+  {"power_mW", &ZoneData::power_mW, 1, RANGE_POWER_LSBS, true, false},
+#if ZONE_FILTER
+  {"current_filt_mA", &ZoneData::current_filt_mA, 2, 1.0f, true, true},
+#endif
+};
+inline constexpr uint8_t ZONE_FIELD_COUNT = sizeof(ZONE_FIELDS) / sizeof(ZONE_FIELDS[0]);
+
+// One buffered sample of a zone with a reading
+struct ZoneRow {
+  uint32_t tick;
+  ZoneData data;
+  uint8_t flags;         // ZONE_FLAG_* of the zone
+};
+
+// Everything a zone message carries besides the rows. The last row is the
+// latest reading; a message covering more than one sample (first_seq <
+// seq) lists its rows, which may be fewer where the zone had no reading.
+struct ZoneBatch {
+  const char* node_id;
+  const char* zone_id;
+  const char* range;
+  uint32_t boot_id;
+  uint32_t first_seq;
+  uint32_t seq;
+  uint64_t uptime_ms;
+  uint32_t interval_ms;  // tick -> timestamp
+  int32_t sync_error_us; // ticks on the site grid, to within this; -1 boot-relative
+  uint8_t count;
+};
+
+// Bounded output buffer; writes past the end are counted, not stored
+class PayloadWriter {
+ public:
+  PayloadWriter(uint8_t* buf, size_t size) : buf_(buf), size_(size), pos_(0) {}
+
+  void byte(uint8_t b) {
+    if (pos_ < size_) {
+      buf_[pos_] = b;
+    }
+    pos_++;
+  }
+
+  void bytes(const void* data, size_t n) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < n; i++) {
+      byte(p[i]);
+    }
+  }
+
+  void str(const char* s) {
+    bytes(s, strlen(s));
+  }
+
+  void le(uint64_t v, uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+      byte(v >> (8 * i));
+    }
+  }
+
+  // Eight lowercase hex digits
+  void hex32(uint32_t v) {
+    for (int8_t shift = 28; shift >= 0; shift -= 4) {
+      byte("0123456789abcdef"[(v >> shift) & 0xF]);
+    }
+  }
+
+  void uint(uint64_t v) {
+    char digits[20];
+    uint8_t n = 0;
+    do {
+      digits[n++] = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    while (n) {
+      byte(digits[--n]);
+    }
+  }
+
+  // Decimal with a fixed number of decimals, rounded; no float printf
+  void fixed(float v, uint8_t decimals) {
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) {
+      scale *= 10;
+    }
+    int64_t scaled = (int64_t)(v * scale + (v < 0 ? -0.5f : 0.5f));
+    if (scaled < 0) {
+      byte('-');
+      scaled = -scaled;
+    }
+    uint((uint64_t)scaled / scale);
+    if (decimals == 0) {
+      return;
+    }
+    byte('.');
+    uint32_t frac = (uint64_t)scaled % scale;
+    for (uint32_t div = scale / 10; div > 0; div /= 10) {
+      byte('0' + (frac / div) % 10);
+    }
+  }
+
+  size_t length() const { return pos_; }
+  bool overflow() const { return pos_ > size_; }
+
+ private:
+  uint8_t* buf_;
+  size_t size_;
+  size_t pos_;
+};
+
+inline uint64_t rowTimestamp(const ZoneBatch& b, const ZoneRow& row) {
+  return (uint64_t)row.tick * b.interval_ms;
+}
+
+inline uint8_t invalidRows(const ZoneBatch& b, const ZoneRow* rows) {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < b.count; i++) {
+    n += (rows[i].flags & ZONE_FLAGS_INVALID) ? 1 : 0;
+  }
+  return n;
+}
+
+struct JsonZoneEncoder {
+  static constexpr const char* NAME = "json";
+
+  static void key(PayloadWriter& w, const char* k) {
+    w.byte(',');
+    w.byte('"');
+    w.str(k);
+    w.str("\":");
+  }
+
+  static void text(PayloadWriter& w, const char* k, const char* v) {
+    key(w, k);
+    w.byte('"');
+    w.str(v);
+    w.byte('"');
+  }
+
+  static void encode(PayloadWriter& w, const ZoneBatch& b, const ZoneRow* rows) {
+    const ZoneRow& latest = rows[b.count - 1];
+    w.str("{\"node_id\":\"");
+    w.str(b.node_id);
+    w.byte('"');
+    text(w, "zone_id", b.zone_id);
+    key(w, "timestamp");
+    w.uint(rowTimestamp(b, latest));
+    for (const ZoneField& f : ZONE_FIELDS) {
+      key(w, f.name);
+      w.fixed(latest.data.*f.value, f.decimals);
+    }
+    text(w, "range", b.range);
+    key(w, "boot_id");
+    w.uint(b.boot_id);
+    key(w, "seq");
+    w.uint(b.seq);
+    key(w, "uptime_ms");
+    w.uint(b.uptime_ms);
+    bool batched = b.first_seq != b.seq;
+    if (batched) {
+      key(w, "first_seq");
+      w.uint(b.first_seq);
+    }
+    if (b.sync_error_us >= 0) {
+      key(w, "tick");
+      w.uint(latest.tick);
+      key(w, "interval_ms");
+      w.uint(b.interval_ms);
+      key(w, "sync_error_us");
+      w.uint(b.sync_error_us);
+    }
+    if (latest.flags & ZONE_FLAG_RANGE_SWITCH) {
+      key(w, "range_switch");
+      w.str("true");
+    }
+    if (latest.flags & ZONE_FLAGS_INVALID) {
+      key(w, "flags");
+      w.uint(latest.flags & ZONE_FLAGS_INVALID);
+    }
+
+    if (batched) {
+      key(w, "samples");
+      w.byte('[');
+      for (uint8_t i = 0; i < b.count; i++) {
+        w.str(i ? ",[" : "[");
+        w.uint(rowTimestamp(b, rows[i]));
+        for (const ZoneField& f : ZONE_FIELDS) {
+          w.byte(',');
+          w.fixed(rows[i].data.*f.value, f.decimals);
+        }
+        w.byte(']');
+      }
+      w.byte(']');
+
+      bool first = true;
+      for (uint8_t i = 0; i < b.count; i++) {
+        if (!(rows[i].flags & ZONE_FLAG_RANGE_SWITCH)) {
+          continue;
+        }
+        if (first) {
+          key(w, "range_switch_rows");
+          w.byte('[');
+        } else {
+          w.byte(',');
+        }
+        w.uint(i);
+        first = false;
+      }
+      if (!first) {
+        w.byte(']');
+      }
+
+      // [index, flags] of every invalid row
+      if (invalidRows(b, rows)) {
+        key(w, "invalid_rows");
+        w.byte('[');
+        first = true;
+        for (uint8_t i = 0; i < b.count; i++) {
+          if (rows[i].flags & ZONE_FLAGS_INVALID) {
+            w.str(first ? "[" : ",[");
+            w.uint(i);
+            w.byte(',');
+            w.uint(rows[i].flags & ZONE_FLAGS_INVALID);
+            w.byte(']');
+            first = false;
+          }
+        }
+        w.byte(']');
+      }
+    }
+  }
+
+  // ,"crc32":"<8 hex>"} closes the document
+  static void trailer(PayloadWriter& w, uint32_t crc) {
+    key(w, "crc32");
+    w.byte('"');
+    w.hex32(crc);
+    w.str("\"}");
+  }
+};
+
+struct CborZoneEncoder {
+  static constexpr const char* NAME = "cbor";
+
+  // Major type plus argument in the shortest form
+  static void head(PayloadWriter& w, uint8_t major, uint64_t v) {
+    major <<= 5;
+    if (v < 24) {
+      w.byte(major | v);
+    } else if (v <= 0xFF) {
+      w.byte(major | 24);
+      w.byte(v);
+    } else if (v <= 0xFFFF) {
+      w.byte(major | 25);
+      w.byte(v >> 8);
+      w.byte(v);
+    } else if (v <= 0xFFFFFFFF) {
+      w.byte(major | 26);
+      for (int8_t i = 3; i >= 0; i--) {
+        w.byte(v >> (8 * i));
+      }
+    } else {
+      w.byte(major | 27);
+      for (int8_t i = 7; i >= 0; i--) {
+        w.byte(v >> (8 * i));
+      }
+    }
+  }
+
+  static void text(PayloadWriter& w, const char* s) {
+    size_t n = strlen(s);
+    head(w, 3, n);
+    w.bytes(s, n);
+  }
+
+  static void number(PayloadWriter& w, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    w.byte(0xFA);
+    for (int8_t i = 3; i >= 0; i--) {
+      w.byte(bits >> (8 * i));
+    }
+  }
+
+  static void encode(PayloadWriter& w, const ZoneBatch& b, const ZoneRow* rows) {
+    const ZoneRow& latest = rows[b.count - 1];
+    uint8_t switch_rows = 0;
+    for (uint8_t i = 0; i < b.count; i++) {
+      switch_rows += (rows[i].flags & ZONE_FLAG_RANGE_SWITCH) ? 1 : 0;
+    }
+    bool batched = b.first_seq != b.seq;
+    bool latest_switch = latest.flags & ZONE_FLAG_RANGE_SWITCH;
+    uint8_t latest_invalid = latest.flags & ZONE_FLAGS_INVALID;
+    uint8_t invalid_rows = invalidRows(b, rows);
+    // The trailer is the last entry
+    bool site_grid = b.sync_error_us >= 0;
+    uint8_t entries = 8 + ZONE_FIELD_COUNT + (batched ? 2 : 0) + (site_grid ? 3 : 0) +
+                      (latest_switch ? 1 : 0) +
+                      (latest_invalid ? 1 : 0) + (batched && switch_rows ? 1 : 0) +
+                      (batched && invalid_rows ? 1 : 0);
+
+    head(w, 5, entries);
+    text(w, "node_id");
+    text(w, b.node_id);
+    text(w, "zone_id");
+    text(w, b.zone_id);
+    text(w, "timestamp");
+    head(w, 0, rowTimestamp(b, latest));
+    for (const ZoneField& f : ZONE_FIELDS) {
+      text(w, f.name);
+      number(w, latest.data.*f.value);
+    }
+    text(w, "range");
+    text(w, b.range);
+    text(w, "boot_id");
+    head(w, 0, b.boot_id);
+    text(w, "seq");
+    head(w, 0, b.seq);
+    text(w, "uptime_ms");
+    head(w, 0, b.uptime_ms);
+    if (batched) {
+      text(w, "first_seq");
+      head(w, 0, b.first_seq);
+    }
+    if (site_grid) {
+      text(w, "tick");
+      head(w, 0, latest.tick);
+      text(w, "interval_ms");
+      head(w, 0, b.interval_ms);
+      text(w, "sync_error_us");
+      head(w, 0, b.sync_error_us);
+    }
+    if (latest_switch) {
+      text(w, "range_switch");
+      w.byte(0xF5);
+    }
+    if (latest_invalid) {
+      text(w, "flags");
+      head(w, 0, latest_invalid);
+    }
+    if (!batched) {
+      return;
+    }
+
+    text(w, "samples");
+    head(w, 4, b.count);
+    for (uint8_t i = 0; i < b.count; i++) {
+      head(w, 4, 1 + ZONE_FIELD_COUNT);
+      head(w, 0, rowTimestamp(b, rows[i]));
+      for (const ZoneField& f : ZONE_FIELDS) {
+        number(w, rows[i].data.*f.value);
+      }
+    }
+    if (switch_rows) {
+      text(w, "range_switch_rows");
+      head(w, 4, switch_rows);
+      for (uint8_t i = 0; i < b.count; i++) {
+        if (rows[i].flags & ZONE_FLAG_RANGE_SWITCH) {
+          head(w, 0, i);
+        }
+      }
+    }
+    if (invalid_rows) {
+      text(w, "invalid_rows");
+      head(w, 4, invalid_rows);
+      for (uint8_t i = 0; i < b.count; i++) {
+        if (rows[i].flags & ZONE_FLAGS_INVALID) {
+          head(w, 4, 2);
+          head(w, 0, i);
+          head(w, 0, rows[i].flags & ZONE_FLAGS_INVALID);
+        }
+      }
+    }
+  }
+
+  // "crc32": uint32 in its 4-byte form, 11 bytes
+  static void trailer(PayloadWriter& w, uint32_t crc) {
+    text(w, "crc32");
+    w.byte(0x1A);
+    for (int8_t i = 3; i >= 0; i--) {
+      w.byte(crc >> (8 * i));
+    }
+  }
+};
+
+// Little-endian layout:
+//   u8 magic 0xB5, u8 version (7, or 8 with current_filt_mA; 1 and 2 had
+//   no CRC, 3 and 4 no sync error, 5 and 6 fixed 0.1 mA / 1 mV / 2 mW
+//   counts), u8 rows, u32 boot_id, u32 first_seq, u32 seq, u64 uptime_ms,
+//   u32 first tick, u32 interval_ms, i32 sync_error_us, u8 range length +
+//   range name
+//   per row: u16 tick offset, then each field as 16-bit counts of its lsb
+//   (signed where is_signed), then u8 flags in bits 0-4 and the row's
+//   InaRange in bits 5-6
+//   u32 CRC-32
+struct PackedZoneEncoder {
+  static constexpr const char* NAME = "packed";
+  static constexpr uint8_t MAGIC = 0xB5;
+  static constexpr uint8_t VERSION = ZONE_FILTER ? 8 : 7;
+
+  static void encode(PayloadWriter& w, const ZoneBatch& b, const ZoneRow* rows) {
+    w.byte(MAGIC);
+    w.byte(VERSION);
+    w.byte(b.count);
+    w.le(b.boot_id, 4);
+    w.le(b.first_seq, 4);
+    w.le(b.seq, 4);
+    w.le(b.uptime_ms, 8);
+    w.le(rows[0].tick, 4);
+    w.le(b.interval_ms, 4);
+    w.le((uint32_t)b.sync_error_us, 4);
+    uint8_t range_len = strlen(b.range);
+    w.byte(range_len);
+    w.bytes(b.range, range_len);
+
+    for (uint8_t i = 0; i < b.count; i++) {
+      const ZoneData& data = rows[i].data;
+      w.le(rows[i].tick - rows[0].tick, 2);
+      for (const ZoneField& f : ZONE_FIELDS) {
+        float counts = data.*f.value / f.lsb * (f.ranged ? RANGE_COUNTS_PER_MA[data.range] : 1.0f);
+        int32_t v = (int32_t)(counts + (counts < 0 ? -0.5f : 0.5f));
+        v = f.is_signed ? constrain(v, (int32_t)INT16_MIN, (int32_t)INT16_MAX)
+                        : constrain(v, (int32_t)0, (int32_t)UINT16_MAX);
+        w.le((uint16_t)v, 2);
+      }
+      w.byte(rows[i].flags | data.range << ZONE_FLAG_BITS);
+    }
+  }
+
+  static void trailer(PayloadWriter& w, uint32_t crc) {
+    w.le(crc, 4);
+  }
+};
+
+// #node_id,zone_id,range,boot_id,first_seq,seq,uptime_ms[,interval_ms,sync_error_us]
+// timestamp,current_mA,voltage_V,power_mW[,current_filt_mA],flags   (one line per row)
+// #crc32,<8 hex>
+struct CsvZoneEncoder {
+  static constexpr const char* NAME = "csv";
+
+  static void encode(PayloadWriter& w, const ZoneBatch& b, const ZoneRow* rows) {
+    w.byte('#');
+    w.str(b.node_id);
+    w.byte(',');
+    w.str(b.zone_id);
+    w.byte(',');
+    w.str(b.range);
+    w.byte(',');
+    w.uint(b.boot_id);
+    w.byte(',');
+    w.uint(b.first_seq);
+    w.byte(',');
+    w.uint(b.seq);
+    w.byte(',');
+    w.uint(b.uptime_ms);
+    // On the site grid
+    if (b.sync_error_us >= 0) {
+      w.byte(',');
+      w.uint(b.interval_ms);
+      w.byte(',');
+      w.uint(b.sync_error_us);
+    }
+    for (uint8_t i = 0; i < b.count; i++) {
+      w.byte('\n');
+      w.uint(rowTimestamp(b, rows[i]));
+      for (const ZoneField& f : ZONE_FIELDS) {
+        w.byte(',');
+        w.fixed(rows[i].data.*f.value, f.decimals);
+      }
+      w.byte(',');
+      w.uint(rows[i].flags);
+    }
+  }
+
+  static void trailer(PayloadWriter& w, uint32_t crc) {
+    w.str("\n#crc32,");
+    w.hex32(crc);
+  }
+};
+
+// Encodes a batch of at least one row and its CRC trailer; returns the
+// payload length, or 0 if it didn't fit
+template <typename Encoder>
+size_t encodeZoneBatch(const ZoneBatch& batch, const ZoneRow* rows, uint8_t* out, size_t size) {
+  PayloadWriter w(out, size);
+  Encoder::encode(w, batch, rows);
+  if (w.overflow()) {
+    return 0;
+  }
+  Encoder::trailer(w, crc32Update(0, out, w.length()));
+  return w.overflow() ? 0 : w.length();
+}
+
+#define ZONE_PAYLOAD_JSON 0
+#define ZONE_PAYLOAD_CBOR 1
+#define ZONE_PAYLOAD_PACKED 2
+#define ZONE_PAYLOAD_CSV 3
+
+#if ZONE_PAYLOAD == ZONE_PAYLOAD_CBOR
+using ZoneEncoder = CborZoneEncoder;
+#elif ZONE_PAYLOAD == ZONE_PAYLOAD_PACKED
+using ZoneEncoder = PackedZoneEncoder;
+#elif ZONE_PAYLOAD == ZONE_PAYLOAD_CSV
+using ZoneEncoder = CsvZoneEncoder;
+#else
+using ZoneEncoder = JsonZoneEncoder;
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ZONE_FILTER_H
+#define ZONE_FILTER_H
+
+#include <Arduino.h>
+#include "node_config.h"
+
+// Per-zone Kalman filter of the current reading, run at the sample rate in
+// fixed point (estimate in 1/256 mA, variances in 1/256 mA², gain Q16).
+//
+// The load is modelled as a random walk: q is how far (as a variance, mA²)
+// the true current may move between two samples, r the variance of the
+// reading around it (INA219 noise plus switching ripple). The gain settles
+// where the q/r ratio puts it; a larger q follows changes faster and
+// smooths less. A reading more than gate_sigma standard deviations off the
+// prediction is held back: alone it is a spike and dropped, and if the
+// next one is off to the same side it is a real load step, and the
+// estimate jumps to it instead of lagging behind. r = 0 passes readings
+// through.
+//
+// zone-flow-monitor/evaluate_filter.py runs this module, built for the
+// host, over recorded traces to pick q and r.
+
+// Largest q, r and gate_sigma² (mA²): their Q8 values, and p + q + r in
+// an update, stay well within 32 bits
+#define FILTER_MAX_MA2 1e6f
+
+struct ZoneFilterStats {
+  uint32_t updates;
+  uint32_t outliers;     // readings off the gate
+  uint32_t steps;        // of those, taken as load steps
+  float gain;            // last Kalman gain, 0..1
+};
+
+void filterBegin();
+void filterConfigure(uint8_t zone, float q_mA2, float r_mA2, float gate_sigma);
+
+// Feeds a reading and returns the filtered current
+float filterUpdate(uint8_t zone, float current_mA);
+
+// The current estimate without feeding the reading, for one that can't be
+// trusted (taken across a range switch); the reading itself before the
+// first update
+float filterHold(uint8_t zone, float current_mA);
+
+// Forgets the estimate, e.g. when the zone's sensor drops off the bus
+void filterReset(uint8_t zone);
+
+ZoneFilterStats filterStats(uint8_t zone);
+
+#endif
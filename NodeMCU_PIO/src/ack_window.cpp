@@ -0,0 +1,111 @@
+#include "ack_window.h"
+
+struct InFlight {
+  bool used;
+  uint8_t zone;
+  uint8_t retries;
+  uint32_t first_seq;
+  uint32_t last_seq;
+  uint32_t first_sent_ms;
+  uint32_t sent_ms;
+};
+
+static InFlight slots[ACK_WINDOW_MAX];
+static uint8_t window_size = 1;
+static uint8_t in_flight = 0;
+static AckStats stats;
+
+void ackWindowBegin(uint8_t window) {
+  ackWindowSetSize(window);
+  ackWindowReset();
+  stats = {0, 0, 0, 0, 0, 0};
+}
+
+void ackWindowSetSize(uint8_t window) {
+  window_size = constrain(window, (uint8_t)1, (uint8_t)ACK_WINDOW_MAX);
+}
+
+uint8_t ackWindowSize() {
+  return window_size;
+}
+
+uint8_t ackWindowInFlight() {
+  return in_flight;
+}
+
+bool ackWindowFull() {
+  return in_flight >= window_size;
+}
+
+void ackWindowSent(uint8_t zone, uint32_t first_seq, uint32_t last_seq, uint32_t now_ms) {
+  stats.sent++;
+  for (uint8_t i = 0; i < ACK_WINDOW_MAX; i++) {
+    if (!slots[i].used) {
+      slots[i] = {true, zone, 0, first_seq, last_seq, now_ms, now_ms};
+      in_flight++;
+      return;
+    }
+  }
+}
+
+bool ackWindowAck(uint8_t zone, uint32_t last_seq, uint32_t now_ms) {
+  for (uint8_t i = 0; i < ACK_WINDOW_MAX; i++) {
+    InFlight& s = slots[i];
+    if (!s.used || s.zone != zone || s.last_seq != last_seq) {
+      continue;
+    }
+    s.used = false;
+    in_flight--;
+    stats.acked++;
+
+    // Karn's rule: only unambiguous (never retransmitted) samples feed the RTT
+    if (s.retries == 0) {
+      uint32_t rtt = now_ms - s.first_sent_ms;
+      stats.last_rtt_ms = rtt;
+      stats.srtt_ms = stats.srtt_ms == 0 ? rtt : (7 * stats.srtt_ms + rtt) / 8;
+      stats.max_rtt_ms = max(stats.max_rtt_ms, rtt);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ackWindowDue(uint32_t now_ms, uint8_t* zone, uint32_t* first_seq, uint32_t* last_seq) {
+  for (uint8_t i = 0; i < ACK_WINDOW_MAX; i++) {
+    InFlight& s = slots[i];
+    if (!s.used || now_ms - s.sent_ms < ACK_TIMEOUT_MS) {
+      continue;
+    }
+    s.sent_ms = now_ms;
+    if (s.retries < 255) {
+      s.retries++;
+    }
+    stats.retransmits++;
+    *zone = s.zone;
+    *first_seq = s.first_seq;
+    *last_seq = s.last_seq;
+    return true;
+  }
+  return false;
+}
+
+uint32_t ackWindowAckedThrough(uint8_t zone, uint32_t next_seq) {
+  uint32_t oldest_unacked = next_seq;
+  for (uint8_t i = 0; i < ACK_WINDOW_MAX; i++) {
+    if (slots[i].used && slots[i].zone == zone && slots[i].first_seq < oldest_unacked) {
+      oldest_unacked = slots[i].first_seq;
+    }
+  }
+  return oldest_unacked;
+}
+
+void ackWindowReset() {
+  for (uint8_t i = 0; i < ACK_WINDOW_MAX; i++) {
+    slots[i].used = false;
+  }
+  in_flight = 0;
+}
+
+AckStats ackWindowStats() {
+  return stats;
+}
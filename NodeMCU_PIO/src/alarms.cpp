@@ -0,0 +1,135 @@
+#include "alarms.h"
+
+struct ZoneAlarms {
+  AlarmState state[ALARM_TYPE_COUNT];
+  float overvoltage_V;
+  uint8_t failed_reads;
+};
+
+static_assert(ZONE_COUNT * ALARM_TYPE_COUNT <= 16, "alarm states don't fit the deep-sleep bitmaps");
+
+static ZoneAlarms zones[ZONE_COUNT];
+static uint8_t dirty_count = 0;
+
+static void setAlarm(uint8_t zone, AlarmType type, bool active, float value) {
+  AlarmState& s = zones[zone].state[type];
+  if (s.active == active) {
+    return;
+  }
+  s.active = active;
+  s.value = value;
+  s.changed_ms = millis();
+  if (!s.dirty) {
+    s.dirty = true;
+    dirty_count++;
+  }
+}
+
+void alarmsBegin() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    for (uint8_t t = 0; t < ALARM_TYPE_COUNT; t++) {
+      zones[z].state[t] = {false, false, 0, 0};
+    }
+    zones[z].overvoltage_V = ALARM_OVERVOLTAGE_V;
+    zones[z].failed_reads = 0;
+  }
+  dirty_count = 0;
+}
+
+void alarmsSample(uint8_t zone, bool read_ok, float bus_V) {
+  ZoneAlarms& a = zones[zone];
+
+  if (!read_ok) {
+    if (a.failed_reads < 255) {
+      a.failed_reads++;
+    }
+    setAlarm(zone, ALARM_SENSOR_ERROR, true, a.failed_reads);
+    if (a.failed_reads >= ALARM_OFFLINE_READS) {
+      setAlarm(zone, ALARM_ZONE_OFFLINE, true, a.failed_reads);
+    }
+    return;
+  }
+
+  a.failed_reads = 0;
+  setAlarm(zone, ALARM_SENSOR_ERROR, false, 0);
+  setAlarm(zone, ALARM_ZONE_OFFLINE, false, 0);
+
+  // Raise at the threshold, clear once the bus is back below the band
+  if (bus_V >= a.overvoltage_V) {
+    setAlarm(zone, ALARM_OVER_VOLTAGE, true, bus_V);
+  } else if (bus_V < a.overvoltage_V - ALARM_OVERVOLTAGE_BAND_V) {
+    setAlarm(zone, ALARM_OVER_VOLTAGE, false, bus_V);
+  }
+}
+
+bool alarmsPending() {
+  return dirty_count > 0;
+}
+
+void alarmsMarkPublished(uint8_t zone, AlarmType type) {
+  AlarmState& s = zones[zone].state[type];
+  if (s.dirty) {
+    s.dirty = false;
+    dirty_count--;
+  }
+}
+
+AlarmState alarmState(uint8_t zone, AlarmType type) {
+  return zones[zone].state[type];
+}
+
+const char* alarmName(AlarmType type) {
+  switch (type) {
+    case ALARM_OVER_VOLTAGE:
+      return "over_voltage";
+    case ALARM_SENSOR_ERROR:
+      return "sensor_error";
+    case ALARM_ZONE_OFFLINE:
+      return "zone_offline";
+    default:
+      return "unknown";
+  }
+}
+
+void alarmsSave(uint16_t* active, uint16_t* dirty, uint8_t* failed_reads) {
+  *active = 0;
+  *dirty = 0;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    for (uint8_t t = 0; t < ALARM_TYPE_COUNT; t++) {
+      uint16_t bit = 1 << (z * ALARM_TYPE_COUNT + t);
+      if (zones[z].state[t].active) {
+        *active |= bit;
+      }
+      if (zones[z].state[t].dirty) {
+        *dirty |= bit;
+      }
+    }
+    failed_reads[z] = zones[z].failed_reads;
+  }
+}
+
+void alarmsRestore(uint16_t active, uint16_t dirty, const uint8_t* failed_reads, const float* bus_V) {
+  dirty_count = 0;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    zones[z].failed_reads = failed_reads[z];
+    for (uint8_t t = 0; t < ALARM_TYPE_COUNT; t++) {
+      uint16_t bit = 1 << (z * ALARM_TYPE_COUNT + t);
+      AlarmState& s = zones[z].state[t];
+      s.active = active & bit;
+      s.dirty = dirty & bit;
+      s.value = t == ALARM_OVER_VOLTAGE ? bus_V[z] : failed_reads[z];
+      s.changed_ms = millis();
+      if (s.dirty) {
+        dirty_count++;
+      }
+    }
+  }
+}
+
+void alarmsSetOvervoltage(uint8_t zone, float trip_V) {
+  zones[zone].overvoltage_V = trip_V;
+}
+
+float alarmsOvervoltage(uint8_t zone) {
+  return zones[zone].overvoltage_V;
+}
@@ -0,0 +1,69 @@
+#include "batch_control.h"
+
+static BatchState state;
+static uint32_t last_retransmits = 0;
+static uint8_t good_slots = 0;
+
+void batchBegin(uint8_t min_samples, uint8_t max_samples, uint8_t initial) {
+  state.min_samples = max(min_samples, (uint8_t)1);
+  state.max_samples = max(max_samples, state.min_samples);
+  state.samples = constrain(initial, state.min_samples, state.max_samples);
+  state.link = LINK_FAIR;
+  state.increases = 0;
+  state.decreases = 0;
+  good_slots = 0;
+}
+
+uint8_t batchUpdate(uint32_t srtt_ms, uint32_t retransmits, int32_t rssi) {
+  bool lost = retransmits != last_retransmits;
+  last_retransmits = retransmits;
+
+  if (lost || srtt_ms > BATCH_RTT_POOR_MS || rssi < BATCH_RSSI_POOR) {
+    state.link = LINK_POOR;
+  } else if (srtt_ms <= BATCH_RTT_GOOD_MS && rssi >= BATCH_RSSI_GOOD) {
+    state.link = LINK_GOOD;
+  } else {
+    state.link = LINK_FAIR;
+  }
+
+  // Back off at once, come back only after a run of good slots, so a
+  // flapping link doesn't bounce between real-time and large batches
+  if (state.link == LINK_POOR) {
+    good_slots = 0;
+    uint8_t samples = min((uint16_t)(state.samples * 2), (uint16_t)state.max_samples);
+    if (samples != state.samples) {
+      state.samples = samples;
+      state.increases++;
+    }
+  } else if (state.link == LINK_GOOD) {
+    if (++good_slots >= BATCH_GOOD_SLOTS) {
+      good_slots = 0;
+      if (state.samples > state.min_samples) {
+        state.samples = max((uint8_t)(state.samples / 2), state.min_samples);
+        state.decreases++;
+      }
+    }
+  } else {
+    good_slots = 0;
+  }
+  return state.samples;
+}
+
+uint8_t batchSamples() {
+  return state.samples;
+}
+
+BatchState batchState() {
+  return state;
+}
+
+const char* linkQualityName(LinkQuality link) {
+  switch (link) {
+    case LINK_GOOD:
+      return "good";
+    case LINK_FAIR:
+      return "fair";
+    default:
+      return "poor";
+  }
+}
@@ -0,0 +1,176 @@
+#include "battery_gauge.h"
+
+#define UAS_PER_MAH 3600000.0  // µA·s in a mAh
+
+struct Gauge {
+  BatteryConfig config;
+  bool primed;           // has a previous reading to integrate from
+  uint64_t last_us;
+  float last_mA;
+  float last_V;
+  int64_t charge_uAs;    // remaining charge
+  int64_t capacity_uAs;
+  SocSource source;
+  uint64_t rest_since_us;
+  bool resting;
+  bool rest_corrected;
+  uint32_t corrections;
+  float last_correction;
+  // Open window
+  int64_t discharged_uAs;
+  int64_t charged_uAs;
+  uint64_t window_us;
+};
+
+static Gauge gauges[ZONE_COUNT];
+static BatteryWindow latest[ZONE_COUNT];
+
+void batteryBegin() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    gauges[z] = {};
+    latest[z] = {};
+    latest[z].time_to_empty_s = -1;
+    latest[z].time_to_full_s = -1;
+  }
+}
+
+void batteryConfigure(uint8_t zone, const BatteryConfig& config) {
+  Gauge& g = gauges[zone];
+  float soc = g.capacity_uAs > 0 ? (double)g.charge_uAs / g.capacity_uAs : 0;
+  g.config = config;
+  g.capacity_uAs = (int64_t)(config.capacity_mAh * UAS_PER_MAH);
+  // Keep the SoC across a capacity change
+  g.charge_uAs = (int64_t)(soc * g.capacity_uAs);
+}
+
+bool batteryZone(uint8_t zone) {
+  return gauges[zone].config.type == ZONE_TYPE_BATTERY && gauges[zone].capacity_uAs > 0;
+}
+
+float batteryOcvSoc(uint8_t zone, float ocv_V) {
+  const float* ocv = gauges[zone].config.ocv_V;
+  if (ocv_V <= ocv[0]) {
+    return 0;
+  }
+  for (uint8_t i = 1; i < BATTERY_OCV_POINTS; i++) {
+    if (ocv_V < ocv[i]) {
+      float span = ocv[i] - ocv[i - 1];
+      float frac = span > 0 ? (ocv_V - ocv[i - 1]) / span : 0;
+      return (i - 1 + frac) / (BATTERY_OCV_POINTS - 1);
+    }
+  }
+  return 1;
+}
+
+static void setSoc(Gauge& g, float soc) {
+  g.charge_uAs = (int64_t)(constrain(soc, 0.0f, 1.0f) * g.capacity_uAs);
+}
+
+void batterySample(uint8_t zone, float current_mA, float bus_V, uint64_t now_us) {
+  if (!batteryZone(zone)) {
+    return;
+  }
+  Gauge& g = gauges[zone];
+  if (g.source == SOC_UNKNOWN) {
+    setSoc(g, batteryOcvSoc(zone, bus_V));
+    g.source = SOC_VOLTAGE;
+  }
+
+  if (g.primed && now_us > g.last_us) {
+    uint64_t dt_us = now_us - g.last_us;
+    // Trapezoid: mean of the two readings over the gap, µA·s
+    int64_t uAs = (int64_t)((g.last_mA + current_mA) * 500.0 * (double)dt_us / 1e6);
+    if (uAs >= 0) {
+      g.discharged_uAs += uAs;
+      g.charge_uAs -= uAs;
+    } else {
+      g.charged_uAs -= uAs;
+      g.charge_uAs -= (int64_t)(uAs * g.config.charge_efficiency);
+    }
+    g.charge_uAs = constrain(g.charge_uAs, (int64_t)0, g.capacity_uAs);
+    g.window_us += dt_us;
+  }
+
+  // Rest: after rest_ms below rest_mA the terminal voltage is the OCV
+  bool rest = fabsf(current_mA) < g.config.rest_mA;
+  if (rest && !g.resting) {
+    g.rest_since_us = now_us;
+    g.rest_corrected = false;
+  }
+  g.resting = rest;
+  if (rest && !g.rest_corrected && now_us - g.rest_since_us >= (uint64_t)g.config.rest_ms * 1000) {
+    float before = (float)((double)g.charge_uAs / g.capacity_uAs);
+    float soc = batteryOcvSoc(zone, bus_V);
+    setSoc(g, soc);
+    g.last_correction = soc - before;
+    g.corrections++;
+    g.rest_corrected = true;
+    g.source = SOC_REST_OCV;
+  }
+
+  g.primed = true;
+  g.last_us = now_us;
+  g.last_mA = current_mA;
+  g.last_V = bus_V;
+}
+
+void batteryNoReading(uint8_t zone) {
+  gauges[zone].primed = false;
+  gauges[zone].resting = false;
+}
+
+void batteryWindowClose() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (!batteryZone(z)) {
+      continue;
+    }
+    Gauge& g = gauges[z];
+    BatteryWindow& w = latest[z];
+    w.soc = (float)((double)g.charge_uAs / g.capacity_uAs);
+    w.remaining_mAh = g.charge_uAs / UAS_PER_MAH;
+    w.discharged_mAh = g.discharged_uAs / UAS_PER_MAH;
+    w.charged_mAh = g.charged_uAs / UAS_PER_MAH;
+    // Net mean current over the window, mA
+    w.mean_mA = g.window_us ? (double)(g.discharged_uAs - g.charged_uAs) * 1000.0 / g.window_us : 0;
+    w.voltage_V = g.last_V;
+    w.time_to_empty_s = -1;
+    w.time_to_full_s = -1;
+    if (fabsf(w.mean_mA) < g.config.rest_mA) {
+      w.mode = BATTERY_REST;
+    } else if (w.mean_mA > 0) {
+      w.mode = BATTERY_DISCHARGING;
+      w.time_to_empty_s = w.remaining_mAh / w.mean_mA * 3600.0f;
+    } else {
+      w.mode = BATTERY_CHARGING;
+      float rate_mA = -w.mean_mA * g.config.charge_efficiency;
+      w.time_to_full_s = (g.config.capacity_mAh - w.remaining_mAh) / rate_mA * 3600.0f;
+    }
+    w.source = g.source;
+    w.corrections = g.corrections;
+    w.last_correction = g.last_correction;
+
+    g.discharged_uAs = 0;
+    g.charged_uAs = 0;
+    g.window_us = 0;
+  }
+}
+
+const BatteryWindow& batteryLatest(uint8_t zone) {
+  return latest[zone];
+}
+
+const char* batteryModeName(BatteryMode mode) {
+  switch (mode) {
+    case BATTERY_CHARGING: return "charging";
+    case BATTERY_DISCHARGING: return "discharging";
+    default: return "rest";
+  }
+}
+
+const char* socSourceName(SocSource source) {
+  switch (source) {
+    case SOC_VOLTAGE: return "voltage";
+    case SOC_REST_OCV: return "rest_ocv";
+    default: return "unknown";
+  }
+}
@@ -0,0 +1,194 @@
+#include "broker_pool.h"
+
+#define HEALTH_GAIN 0.25f
+
+static BrokerHealth brokers[BROKER_MAX];
+static uint32_t probe_at_ms[BROKER_MAX];
+static uint8_t count = 0;
+static int8_t active = -1;
+static int8_t last_session = -1;
+static int8_t failback_to = -1;
+static uint32_t failovers = 0;
+static uint32_t failbacks = 0;
+
+void brokerPoolSet(const char* const* servers, const uint16_t* ports, uint8_t n) {
+  BrokerHealth old[BROKER_MAX];
+  memcpy(old, brokers, sizeof(old));
+  int8_t old_active = active;
+  count = 0;
+  active = -1;
+  for (uint8_t i = 0; i < n && count < BROKER_MAX; i++) {
+    if (servers[i] == nullptr || servers[i][0] == '\0' || ports[i] == 0) {
+      continue;
+    }
+    BrokerHealth kept = {};
+    for (uint8_t j = 0; j < BROKER_MAX; j++) {
+      if (strcmp(old[j].server, servers[i]) == 0 && old[j].port == ports[i]) {
+        kept = old[j];
+        if (j == old_active) {
+          active = count;
+        }
+        break;
+      }
+    }
+    strlcpy(kept.server, servers[i], sizeof(kept.server));
+    kept.port = ports[i];
+    brokers[count] = kept;
+    probe_at_ms[count] = 0;
+    count++;
+  }
+  for (uint8_t i = count; i < BROKER_MAX; i++) {
+    brokers[i] = {};
+  }
+  last_session = active;
+  failback_to = -1;
+}
+
+uint8_t brokerCount() {
+  return count;
+}
+
+const BrokerHealth& brokerHealth(uint8_t index) {
+  return brokers[index];
+}
+
+static bool available(uint8_t i, uint32_t now_ms) {
+  return (int32_t)(now_ms - brokers[i].retry_at_ms) >= 0;
+}
+
+static bool healthy(uint8_t i) {
+  return brokers[i].failure_rate < BROKER_UNHEALTHY_RATE;
+}
+
+uint8_t brokerNext(uint32_t now_ms) {
+  if (failback_to >= 0) {
+    return failback_to;
+  }
+  // Healthy ones in order, then the least failing, then the one whose
+  // back-off ends first
+  int8_t fallback = -1;
+  for (uint8_t i = 0; i < count; i++) {
+    if (!available(i, now_ms)) {
+      continue;
+    }
+    if (healthy(i)) {
+      return i;
+    }
+    if (fallback < 0 || brokers[i].failure_rate < brokers[fallback].failure_rate) {
+      fallback = i;
+    }
+  }
+  if (fallback >= 0) {
+    return fallback;
+  }
+  uint8_t soonest = 0;
+  for (uint8_t i = 1; i < count; i++) {
+    if ((int32_t)(brokers[i].retry_at_ms - brokers[soonest].retry_at_ms) < 0) {
+      soonest = i;
+    }
+  }
+  return soonest;
+}
+
+uint32_t brokerRetryDelay(uint32_t now_ms) {
+  uint32_t wait = UINT32_MAX;
+  for (uint8_t i = 0; i < count; i++) {
+    if (available(i, now_ms)) {
+      return 0;
+    }
+    wait = min(wait, brokers[i].retry_at_ms - now_ms);
+  }
+  return count ? wait : BROKER_BACKOFF_MS;
+}
+
+static void record(BrokerHealth& b, bool ok, uint32_t elapsed_ms) {
+  b.attempts++;
+  b.failure_rate += HEALTH_GAIN * ((ok ? 0.0f : 1.0f) - b.failure_rate);
+  if (ok) {
+    b.connect_ms = b.connect_ms ? b.connect_ms + (int32_t)(elapsed_ms - b.connect_ms) / 4 : elapsed_ms;
+    b.last_connect_ms = elapsed_ms;
+    b.consecutive_failures = 0;
+  } else {
+    b.failures++;
+    b.consecutive_failures = min(b.consecutive_failures + 1, 255);
+  }
+}
+
+static void backOff(BrokerHealth& b, uint32_t now_ms) {
+  uint32_t backoff = BROKER_BACKOFF_MS;
+  for (uint8_t i = 1; i < b.consecutive_failures && backoff < BROKER_BACKOFF_MAX_MS; i++) {
+    backoff *= 2;
+  }
+  b.retry_at_ms = now_ms + min(backoff, (uint32_t)BROKER_BACKOFF_MAX_MS);
+}
+
+void brokerAttempted(uint8_t index, bool ok, uint32_t elapsed_ms, uint32_t now_ms) {
+  BrokerHealth& b = brokers[index];
+  record(b, ok, elapsed_ms);
+  failback_to = -1;
+  if (!ok) {
+    backOff(b, now_ms);
+    return;
+  }
+  b.retry_at_ms = now_ms;
+  b.good_probes = 0;
+  b.connects++;
+  if (last_session >= 0 && index > last_session) {
+    failovers++;
+  } else if (last_session >= 0 && index < last_session) {
+    failbacks++;
+  }
+  active = index;
+  last_session = index;
+  for (uint8_t i = 0; i < count; i++) {
+    probe_at_ms[i] = now_ms + BROKER_FAILBACK_PROBE_MS;
+    brokers[i].good_probes = 0;
+  }
+}
+
+void brokerDisconnected() {
+  active = -1;
+}
+
+int8_t brokerActive() {
+  return active;
+}
+
+int8_t brokerFailbackCandidate(uint32_t now_ms) {
+  for (int8_t i = 0; i < active; i++) {
+    if ((int32_t)(now_ms - probe_at_ms[i]) >= 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool brokerProbed(uint8_t index, bool ok, uint32_t elapsed_ms, uint32_t now_ms) {
+  BrokerHealth& b = brokers[index];
+  record(b, ok, elapsed_ms);
+  probe_at_ms[index] = now_ms + BROKER_FAILBACK_PROBE_MS;
+  if (!ok) {
+    b.good_probes = 0;
+    backOff(b, now_ms);
+    return false;
+  }
+  b.retry_at_ms = now_ms;
+  b.good_probes = min(b.good_probes + 1, 255);
+  if (b.good_probes < BROKER_FAILBACK_PROBES) {
+    return false;
+  }
+  failback_to = index;
+  return true;
+}
+
+int8_t brokerFailbackTarget() {
+  return failback_to;
+}
+
+uint32_t brokerFailovers() {
+  return failovers;
+}
+
+uint32_t brokerFailbacks() {
+  return failbacks;
+}
@@ -0,0 +1,129 @@
+#include "deep_sleep.h"
+
+#if DEEP_SLEEP_MODE
+
+extern "C" {
+#include "user_interface.h"
+}
+
+#include "alarms.h"
+#include "power_manager.h"
+#include "sample_buffer.h"
+#include "telemetry.h"
+#include "time_sync.h"
+
+// The record takes the last DEEP_SLEEP_RTC_BYTES of RTC user memory, after
+// the sample ring
+#define RTC_RECORD_BLOCK ((512 - DEEP_SLEEP_RTC_BYTES) / 4)
+#define RTC_RECORD_MAGIC 0x50454544ul  // "DEEP"
+// Shortest sleep asked of the SDK, for an immediate radio wake
+#define MIN_SLEEP_US 10000
+
+struct DeepSleepRecord {
+  uint32_t magic;
+  uint32_t boot_id;
+  uint64_t clock_us;      // power clock when going to sleep
+  uint32_t sleep_us;      // as asked of the SDK
+  uint32_t rtc_cycles;    // system_get_rtc_time() when going to sleep
+  TimeSyncSaved sync;
+  uint32_t next_tick;
+  uint32_t wakes;
+  uint32_t radio_wakes;
+  uint32_t awake_ms;
+  uint32_t seq[STREAM_COUNT];
+  uint16_t alarms_active;
+  uint16_t alarms_dirty;
+  uint8_t failed_reads[ZONE_COUNT];
+  uint8_t flags;
+};
+
+static_assert(sizeof(DeepSleepRecord) <= DEEP_SLEEP_RTC_BYTES,
+              "deep-sleep record outgrew its RTC memory");
+
+static DeepSleepRecord record;
+static bool resumed = false;
+
+bool deepSleepBegin() {
+  const rst_info* info = ESP.getResetInfoPtr();
+  ESP.rtcUserMemoryRead(RTC_RECORD_BLOCK, (uint32_t*)&record, sizeof(record));
+  resumed = info->reason == REASON_DEEP_SLEEP_AWAKE && record.magic == RTC_RECORD_MAGIC;
+  if (!resumed) {
+    memset(&record, 0, sizeof(record));
+    record.flags = DEEP_SLEEP_RADIO | DEEP_SLEEP_ECHO_DUE;
+  }
+  record.wakes++;
+  if (record.flags & DEEP_SLEEP_RADIO) {
+    record.radio_wakes++;
+  }
+  return resumed;
+}
+
+void deepSleepRestore() {
+  if (!resumed) {
+    return;
+  }
+
+  // The RTC counter keeps running through deep sleep and also covers the
+  // boot since; if it reads far off the planned sleep it was reset, and
+  // the plan is taken instead
+  uint32_t cal = system_rtc_clock_cali_proc();
+  uint64_t measured_us = ((uint64_t)(system_get_rtc_time() - record.rtc_cycles) * cal) >> 12;
+  uint64_t now = record.clock_us + record.sleep_us + micros64();
+  if (measured_us > record.sleep_us / 2 && measured_us < (uint64_t)record.sleep_us * 2) {
+    now = record.clock_us + measured_us;
+  }
+  powerResume(now, record.next_tick);
+  timeSyncRestore(record.sync, record.clock_us);
+  telemetryRestore(record.boot_id, record.seq);
+
+  // The newest sample has the latest bus voltages
+  float bus_V[ZONE_COUNT] = {0};
+  PackedSample sample;
+  if (sampleBufferPeek(sampleBufferCount() - 1, &sample)) {
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+      bus_V[z] = unpackZone(sample.zone[z]).busvoltage;
+    }
+  }
+  alarmsRestore(record.alarms_active, record.alarms_dirty, record.failed_reads, bus_V);
+}
+
+uint8_t deepSleepFlags() {
+  return record.flags;
+}
+
+uint64_t deepSleepPlannedWakeUs() {
+  return record.clock_us + record.sleep_us;
+}
+
+void deepSleepUntil(uint64_t wake_us, uint8_t flags) {
+  uint64_t now = powerClockMicros();
+  uint64_t sleep_us = wake_us > now + MIN_SLEEP_US ? wake_us - now : MIN_SLEEP_US;
+
+  record.magic = RTC_RECORD_MAGIC;
+  telemetrySave(&record.boot_id, record.seq);
+  alarmsSave(&record.alarms_active, &record.alarms_dirty, record.failed_reads);
+  record.next_tick = powerNextTick();
+  timeSyncSave(&record.sync);
+  record.awake_ms += millis();
+  record.flags = flags;
+  record.sleep_us = sleep_us;
+  record.rtc_cycles = system_get_rtc_time();
+  record.clock_us = powerClockMicros();
+  ESP.rtcUserMemoryWrite(RTC_RECORD_BLOCK, (uint32_t*)&record, sizeof(record));
+
+  Serial.print("Deep sleep ");
+  Serial.print((uint32_t)(sleep_us / 1000));
+  Serial.println(flags & DEEP_SLEEP_RADIO ? "ms, radio on wake" : "ms");
+  Serial.flush();
+  ESP.deepSleep(sleep_us, flags & DEEP_SLEEP_RADIO ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+}
+
+DeepSleepStats deepSleepStats() {
+  DeepSleepStats stats;
+  stats.wakes = record.wakes;
+  stats.radio_wakes = record.radio_wakes;
+  stats.awake_ms = record.awake_ms + millis();
+  return stats;
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "discovery.h"
+
+#include <Wire.h>
+
+#include "i2c_bus.h"
+#include "ina_profile.h"
+
+static Adafruit_INA219* const* zone_sensors;
+static const uint8_t* zone_addresses;
+static bool attached[ZONE_COUNT];
+static uint16_t unassigned = 0;
+static uint32_t last_scan_us = 0;
+static bool changed = true;
+
+static bool probe(uint8_t address) {
+  Wire.beginTransmission(address);
+  return Wire.endTransmission() == 0;
+}
+
+static int8_t zoneForAddress(uint8_t address) {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (zone_addresses[z] == address) {
+      return z;
+    }
+  }
+  return -1;
+}
+
+void discoveryBegin(Adafruit_INA219* const* sensors, const uint8_t* addresses) {
+  zone_sensors = sensors;
+  zone_addresses = addresses;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    attached[z] = false;
+  }
+}
+
+uint8_t discoveryScan() {
+  uint32_t start = micros();
+  uint8_t newly_attached = 0;
+  uint16_t found_unassigned = 0;
+
+  for (uint8_t address = INA219_FIRST_ADDRESS; address <= INA219_LAST_ADDRESS; address++) {
+    int8_t zone = zoneForAddress(address);
+    if (zone >= 0 && attached[zone]) {
+      continue;
+    }
+    if (!probe(address)) {
+      continue;
+    }
+    if (zone < 0) {
+      found_unassigned |= 1 << (address - INA219_FIRST_ADDRESS);
+      continue;
+    }
+
+    if (zone_sensors[zone]->begin() && inaProfileApply(zone)) {
+      attached[zone] = true;
+      changed = true;
+      newly_attached++;
+      Serial.print("INA219 attached: zone");
+      Serial.print(zone + 1);
+      Serial.print(" (0x");
+      Serial.print(address, HEX);
+      Serial.println(")");
+    }
+  }
+
+  // begin() restarts Wire, which resets the bus clock
+  if (newly_attached > 0) {
+    i2cBusBegin();
+  }
+  if (found_unassigned != unassigned) {
+    unassigned = found_unassigned;
+    changed = true;
+  }
+  last_scan_us = micros() - start;
+  return newly_attached;
+}
+
+bool zoneAttached(uint8_t zone) {
+  return attached[zone];
+}
+
+uint8_t zonesAttached() {
+  uint8_t count = 0;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    count += attached[z] ? 1 : 0;
+  }
+  return count;
+}
+
+void zoneDetach(uint8_t zone) {
+  if (!attached[zone]) {
+    return;
+  }
+  attached[zone] = false;
+  changed = true;
+  Serial.print("INA219 detached: zone");
+  Serial.println(zone + 1);
+}
+
+void discoveryReinit() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (attached[z]) {
+      zone_sensors[z]->begin();
+      inaProfileApply(z);
+    }
+  }
+  i2cBusBegin();
+}
+
+uint16_t discoveryUnassigned() {
+  return unassigned;
+}
+
+uint8_t zoneAddress(uint8_t zone) {
+  return zone_addresses[zone];
+}
+
+uint32_t discoveryLastScanUs() {
+  return last_scan_us;
+}
+
+bool discoveryTakeChanged() {
+  bool was_changed = changed;
+  changed = false;
+  return was_changed;
+}
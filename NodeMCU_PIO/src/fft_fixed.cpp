@@ -0,0 +1,196 @@
+#include "fft_fixed.h"
+
+#include <math.h>
+
+#define N RIPPLE_POINTS
+#define QUARTER (N / 4)
+// Inputs and every stage stay below this, so a butterfly (at most twice
+// the complex magnitude) can't leave int16
+#define BLOCK_LIMIT 8192
+
+static int16_t sine[QUARTER + 1];   // sin(2π k / N), Q15
+static uint8_t log2_points;
+
+void fftBegin() {
+  for (uint16_t k = 0; k <= QUARTER; k++) {
+    sine[k] = (int16_t)lroundf(min(32767.0f, 32768.0f * sinf(2.0f * (float)M_PI * k / N)));
+  }
+  log2_points = 0;
+  while ((1u << log2_points) < N) {
+    log2_points++;
+  }
+}
+
+// sin and cos of 2π k / N from the quarter wave
+static int16_t sinQ15(uint16_t k) {
+  k &= N - 1;
+  if (k <= QUARTER) {
+    return sine[k];
+  }
+  if (k <= 2 * QUARTER) {
+    return sine[2 * QUARTER - k];
+  }
+  if (k <= 3 * QUARTER) {
+    return -sine[k - 2 * QUARTER];
+  }
+  return -sine[N - k];
+}
+
+static int16_t cosQ15(uint16_t k) {
+  return sinQ15(k + QUARTER);
+}
+
+static uint16_t bitReverse(uint16_t i) {
+  uint16_t r = 0;
+  for (uint8_t b = 0; b < log2_points; b++) {
+    r = (r << 1) | (i & 1);
+    i >>= 1;
+  }
+  return r;
+}
+
+static int16_t blockMax(const int16_t* re, const int16_t* im) {
+  int16_t m = 0;
+  for (uint16_t i = 0; i < N; i++) {
+    m = max(m, (int16_t)abs(re[i]));
+    m = max(m, (int16_t)abs(im[i]));
+  }
+  return m;
+}
+
+uint8_t fftTransform(int16_t* re, int16_t* im) {
+  for (uint16_t i = 0; i < N; i++) {
+    uint16_t j = bitReverse(i);
+    if (j > i) {
+      int16_t t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+
+  uint8_t exponent = 0;
+  for (uint16_t len = 2; len <= N; len <<= 1) {
+    if (blockMax(re, im) >= BLOCK_LIMIT) {
+      for (uint16_t i = 0; i < N; i++) {
+        re[i] >>= 1;
+        im[i] >>= 1;
+      }
+      exponent++;
+    }
+    uint16_t half = len / 2;
+    uint16_t step = N / len;
+    for (uint16_t m = 0; m < half; m++) {
+      // e^(-2πj m/len)
+      int32_t wr = cosQ15(m * step);
+      int32_t wi = -sinQ15(m * step);
+      for (uint16_t i = m; i < N; i += len) {
+        uint16_t j = i + half;
+        int16_t tr = (int16_t)((wr * re[j] - wi * im[j] + (1 << 14)) >> 15);
+        int16_t ti = (int16_t)((wr * im[j] + wi * re[j] + (1 << 14)) >> 15);
+        re[j] = re[i] - tr;
+        im[j] = im[i] - ti;
+        re[i] += tr;
+        im[i] += ti;
+      }
+    }
+  }
+  return exponent;
+}
+
+// Removes the mean, measures the AC level, scales the channel to just
+// under BLOCK_LIMIT and applies a Hann window. Returns the scale as a
+// power of two (negative: shifted right).
+static int8_t prepare(int16_t* x, RippleTone* tone) {
+  int32_t sum = 0;
+  for (uint16_t i = 0; i < N; i++) {
+    sum += x[i];
+  }
+  int32_t mean = sum / N;
+  int64_t sum_sq = 0;
+  int32_t lo = INT32_MAX;
+  int32_t hi = INT32_MIN;
+  for (uint16_t i = 0; i < N; i++) {
+    int32_t d = x[i] - mean;
+    sum_sq += (int64_t)d * d;
+    lo = min(lo, d);
+    hi = max(hi, d);
+  }
+  tone->mean = (float)sum / N;
+  tone->rms = sqrtf((float)sum_sq / N);
+  tone->peak_to_peak = (float)(hi - lo);
+
+  int32_t peak = max(-lo, hi);
+  int8_t shift = 0;
+  while (peak != 0 && (peak << 1) < BLOCK_LIMIT && shift < 14) {
+    peak <<= 1;
+    shift++;
+  }
+  while (peak >= BLOCK_LIMIT) {
+    peak >>= 1;
+    shift--;
+  }
+  for (uint16_t i = 0; i < N; i++) {
+    int32_t d = x[i] - mean;
+    d = shift >= 0 ? d << shift : d >> -shift;
+    // Hann: (1 - cos) / 2
+    int32_t w = (32767 - cosQ15(i)) >> 1;
+    x[i] = (int16_t)((d * w + (1 << 14)) >> 15);
+  }
+  return shift;
+}
+
+// Squared magnitude of bin k of channel a (the real part) or b (the
+// imaginary part), times 4: Z[k] ± conj(Z[N-k]) without the halving
+static uint64_t binPower(const int16_t* a, const int16_t* b, uint16_t k, bool second) {
+  int32_t re, im;
+  if (!second) {
+    re = (int32_t)a[k] + a[N - k];
+    im = (int32_t)b[k] - b[N - k];
+  } else {
+    re = (int32_t)b[k] + b[N - k];
+    im = (int32_t)a[N - k] - a[k];
+  }
+  return (uint64_t)((int64_t)re * re) + (uint64_t)((int64_t)im * im);
+}
+
+static void findTone(const int16_t* a, const int16_t* b, bool second, int8_t shift, uint8_t exponent,
+                     float sample_rate_Hz, RippleTone* tone) {
+  uint16_t best = 1;
+  uint64_t best_power = 0;
+  for (uint16_t k = 1; k < N / 2; k++) {
+    uint64_t power = binPower(a, b, k, second);
+    if (power > best_power) {
+      best_power = power;
+      best = k;
+    }
+  }
+  if (best_power == 0) {
+    tone->freq_Hz = 0;
+    tone->amplitude = 0;
+    return;
+  }
+
+  // Parabolic interpolation over the magnitudes around the peak
+  float m0 = sqrtf((float)best_power);
+  float ml = best > 1 ? sqrtf((float)binPower(a, b, best - 1, second)) : 0;
+  float mr = best < N / 2 - 1 ? sqrtf((float)binPower(a, b, best + 1, second)) : 0;
+  float denom = ml - 2 * m0 + mr;
+  float p = denom != 0 ? 0.5f * (ml - mr) / denom : 0;
+  float peak = m0 - 0.25f * (ml - mr) * p;
+
+  tone->freq_Hz = (best + p) * sample_rate_Hz / N;
+  // peak is 2|X|; a tone of amplitude A gives |X| = A N / 4 under Hann,
+  // and the transform ran on the channel scaled by 2^shift / 2^exponent
+  tone->amplitude = 2.0f * peak / N * ldexpf(1.0f, exponent - shift);
+}
+
+void rippleAnalyze(int16_t* a, int16_t* b, float sample_rate_Hz, RippleTone* tone_a, RippleTone* tone_b) {
+  int8_t shift_a = prepare(a, tone_a);
+  int8_t shift_b = prepare(b, tone_b);
+  uint8_t exponent = fftTransform(a, b);
+  findTone(a, b, false, shift_a, exponent, sample_rate_Hz, tone_a);
+  findTone(a, b, true, shift_b, exponent, sample_rate_Hz, tone_b);
+}
@@ -0,0 +1,124 @@
+#include "i2c_bus.h"
+
+#include <Wire.h>
+
+#define I2C_STANDARD_HZ 100000
+// Half an SCL period at 100 kHz for the bit-banged recovery sequence
+#define RECOVERY_HALF_PERIOD_US 5
+// Fast mode is abandoned if this many of the last window transactions failed
+#define FALLBACK_WINDOW 64
+#define FALLBACK_ERRORS 8
+
+static I2cDeviceStats stats[ZONE_COUNT];
+static uint32_t backoff_until_ms[ZONE_COUNT];
+static uint32_t clock_hz = I2C_CLOCK_HZ;
+static uint32_t recoveries = 0;
+
+static uint8_t window_transactions = 0;
+static uint8_t window_errors = 0;
+
+static void applyClock() {
+  Wire.setClock(clock_hz);
+  // Bound how long a slave may stretch SCL so one sensor can't stall the bus
+  Wire.setClockStretchLimit(I2C_STRETCH_LIMIT_US);
+}
+
+void i2cBusBegin() {
+  applyClock();
+}
+
+void i2cBusRecord(uint8_t device, uint32_t elapsed_us, bool ok) {
+  I2cDeviceStats& s = stats[device];
+  s.transactions++;
+  s.total_us += elapsed_us;
+  s.last_us = elapsed_us > 0xFFFF ? 0xFFFF : elapsed_us;
+  if (s.last_us > s.max_us) {
+    s.max_us = s.last_us;
+  }
+
+  if (ok) {
+    s.consecutive_errors = 0;
+  } else {
+    s.errors++;
+    if (s.consecutive_errors < 255) {
+      s.consecutive_errors++;
+    }
+    if (s.consecutive_errors >= I2C_BACKOFF_ERRORS) {
+      backoff_until_ms[device] = millis() + I2C_BACKOFF_MS;
+    }
+  }
+
+  if (clock_hz > I2C_STANDARD_HZ) {
+    window_errors += ok ? 0 : 1;
+    if (++window_transactions == FALLBACK_WINDOW) {
+      if (window_errors >= FALLBACK_ERRORS) {
+        clock_hz = I2C_STANDARD_HZ;
+        applyClock();
+        Serial.println("I2C: too many errors in fast mode, falling back to 100 kHz");
+      }
+      window_transactions = 0;
+      window_errors = 0;
+    }
+  }
+}
+
+bool i2cDeviceReady(uint8_t device) {
+  if (backoff_until_ms[device] == 0) {
+    return true;
+  }
+  if ((int32_t)(millis() - backoff_until_ms[device]) < 0) {
+    return false;
+  }
+  // Give it another try; the next failure backs it off again
+  backoff_until_ms[device] = 0;
+  return true;
+}
+
+bool i2cBusStuck() {
+  return Wire.status() != I2C_OK;
+}
+
+bool i2cBusRecover() {
+  recoveries++;
+
+  // Open-drain emulation: OUTPUT LOW pulls a line down, INPUT_PULLUP releases it
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  delayMicroseconds(RECOVERY_HALF_PERIOD_US);
+
+  // A slave stuck mid-byte releases SDA within nine clocks
+  for (uint8_t i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+    pinMode(SCL, OUTPUT);
+    digitalWrite(SCL, LOW);
+    delayMicroseconds(RECOVERY_HALF_PERIOD_US);
+    pinMode(SCL, INPUT_PULLUP);
+    delayMicroseconds(RECOVERY_HALF_PERIOD_US);
+  }
+
+  // STOP condition: SDA rises while SCL is high
+  pinMode(SDA, OUTPUT);
+  digitalWrite(SDA, LOW);
+  delayMicroseconds(RECOVERY_HALF_PERIOD_US);
+  pinMode(SCL, INPUT_PULLUP);
+  delayMicroseconds(RECOVERY_HALF_PERIOD_US);
+  pinMode(SDA, INPUT_PULLUP);
+  delayMicroseconds(RECOVERY_HALF_PERIOD_US);
+
+  bool released = digitalRead(SDA) == HIGH && digitalRead(SCL) == HIGH;
+
+  Wire.begin(SDA, SCL);
+  applyClock();
+  return released;
+}
+
+I2cDeviceStats i2cDeviceStats(uint8_t device) {
+  return stats[device];
+}
+
+uint32_t i2cBusClock() {
+  return clock_hz;
+}
+
+uint32_t i2cBusRecoveries() {
+  return recoveries;
+}
@@ -0,0 +1,323 @@
+#include "ina_profile.h"
+
+#include <Wire.h>
+
+// Bus voltage register: voltage in bits 15-3 at 4 mV, math overflow in bit 0
+#define INA219_BUS_VOLTAGE_SHIFT 3
+#define INA219_BUS_OVF 0x0001
+#define INA219_BUS_LSB_V 0.004f
+// Readings this far past a full scale are taken as corrupted
+#define FULL_SCALE_MARGIN 1.05f
+
+// Configuration register fields
+#define INA219_CONFIG_BADC_SHIFT 7
+#define INA219_CONFIG_SADC_SHIFT 3
+#define INA219_CONFIG_ADC_MASK 0x0F
+#define INA219_CONFIG_BRNG_32V 0x2000
+
+struct ZoneProfile {
+  InaProfile profile;
+  uint32_t last_read_us;
+  float last_mA;
+  float sum_sq_diff;
+  uint32_t samples;
+  bool auto_range;
+  uint8_t low_readings;
+  uint32_t switch_us;    // 0 when not settling
+  uint32_t switches;
+};
+
+static Adafruit_INA219* const* zone_sensors;
+static const uint8_t* zone_addresses;
+static ZoneProfile zones[ZONE_COUNT];
+
+// BADC/SADC code: 0x0-0x3 single sample at 9-12 bits, 0x9-0xF 12-bit
+// averaged over 2-128 samples
+static uint8_t adcCode(const InaProfile& p) {
+  if (p.adc_samples <= 1) {
+    return p.adc_bits - 9;
+  }
+  uint8_t code = 0x8;
+  for (uint8_t n = p.adc_samples; n > 1; n >>= 1) {
+    code++;
+  }
+  return code;
+}
+
+// Datasheet conversion time for one channel
+static uint32_t channelConversionUs(const InaProfile& p) {
+  static const uint16_t single_us[] = {84, 148, 276, 532};
+  if (p.adc_samples <= 1) {
+    return single_us[p.adc_bits - 9];
+  }
+  return 532UL * p.adc_samples;
+}
+
+static bool validProfile(const InaProfile& p) {
+  if (p.range >= INA_RANGE_COUNT) {
+    return false;
+  }
+  if (p.adc_samples <= 1) {
+    return p.adc_bits >= 9 && p.adc_bits <= 12;
+  }
+  // Averaging is only available at 12 bits, in powers of two up to 128
+  return p.adc_bits == 12 && p.adc_samples <= 128 && (p.adc_samples & (p.adc_samples - 1)) == 0;
+}
+
+static bool readConfig(uint8_t address, uint16_t* value) {
+  Wire.beginTransmission(address);
+  Wire.write(INA219_REG_CONFIG);
+  if (Wire.endTransmission() != 0 || Wire.requestFrom(address, (uint8_t)2) != 2) {
+    return false;
+  }
+  *value = Wire.read() << 8;
+  *value |= Wire.read();
+  return true;
+}
+
+static bool writeConfig(uint8_t address, uint16_t value) {
+  Wire.beginTransmission(address);
+  Wire.write(INA219_REG_CONFIG);
+  Wire.write(value >> 8);
+  Wire.write(value & 0xFF);
+  return Wire.endTransmission() == 0;
+}
+
+// Sets both channels' ADC fields and the 32 V bus range, keeping the PGA
+// and mode
+static bool writeAdcCode(uint8_t address, uint8_t code) {
+  uint16_t config;
+  if (!readConfig(address, &config)) {
+    return false;
+  }
+  config &= ~((INA219_CONFIG_ADC_MASK << INA219_CONFIG_BADC_SHIFT) |
+              (INA219_CONFIG_ADC_MASK << INA219_CONFIG_SADC_SHIFT));
+  config |= (code << INA219_CONFIG_BADC_SHIFT) | (code << INA219_CONFIG_SADC_SHIFT) | INA219_CONFIG_BRNG_32V;
+  return writeConfig(address, config);
+}
+
+static void resetNoise(ZoneProfile& z) {
+  z.sum_sq_diff = 0;
+  z.samples = 0;
+  z.last_read_us = 0;
+}
+
+void inaProfileBegin(Adafruit_INA219* const* sensors, const uint8_t* addresses) {
+  zone_sensors = sensors;
+  zone_addresses = addresses;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    zones[z].profile = {INA_RANGE_32V_2A, 12, 1};
+    zones[z].auto_range = AUTORANGE_DEFAULT;
+    zones[z].low_readings = 0;
+    zones[z].switch_us = 0;
+    zones[z].switches = 0;
+    resetNoise(zones[z]);
+  }
+}
+
+InaProfile inaProfileForLoad(float expected_mA, uint8_t adc_samples) {
+  InaProfile p = {INA_RANGE_32V_2A, 12, adc_samples};
+  for (uint8_t r = 0; r < INA_RANGE_COUNT; r++) {
+    if (expected_mA <= inaRangeMax_mA((InaRange)r)) {
+      p.range = (InaRange)r;
+      break;
+    }
+  }
+  return p;
+}
+
+bool inaProfileSet(uint8_t zone, const InaProfile& profile) {
+  if (!validProfile(profile)) {
+    return false;
+  }
+  zones[zone].profile = profile;
+  resetNoise(zones[zone]);
+  return true;
+}
+
+bool inaProfileApply(uint8_t zone) {
+  const InaProfile& p = zones[zone].profile;
+  Adafruit_INA219* sensor = zone_sensors[zone];
+
+  // The driver's calibration sets the PGA and its current/power scaling.
+  // The 400 mA one also sets a 16 V bus range, which would clip a higher
+  // bus, so BRNG goes back to 32 V along with the ADC fields.
+  switch (p.range) {
+    case INA_RANGE_16V_400MA:
+      sensor->setCalibration_16V_400mA();
+      break;
+    case INA_RANGE_32V_1A:
+      sensor->setCalibration_32V_1A();
+      break;
+    default:
+      sensor->setCalibration_32V_2A();
+      break;
+  }
+
+  // ...and always 12-bit single samples, so patch the ADC fields afterwards
+  return writeAdcCode(zone_addresses[zone], adcCode(p));
+}
+
+bool inaProfileFast(uint8_t zone, uint8_t adc_bits) {
+  return writeAdcCode(zone_addresses[zone], adcCode({zones[zone].profile.range, adc_bits, 1}));
+}
+
+InaProfile inaProfile(uint8_t zone) {
+  return zones[zone].profile;
+}
+
+const char* inaRangeName(InaRange range) {
+  switch (range) {
+    case INA_RANGE_16V_400MA:
+      return "16V_400mA";
+    case INA_RANGE_32V_1A:
+      return "32V_1A";
+    case INA_RANGE_32V_2A:
+      return "32V_2A";
+    default:
+      return "unknown";
+  }
+}
+
+float inaRangeMax_mA(InaRange range) {
+  switch (range) {
+    case INA_RANGE_16V_400MA:
+      return 400.0f;
+    case INA_RANGE_32V_1A:
+      return 1000.0f;
+    default:
+      return 2000.0f;
+  }
+}
+
+bool inaReadBus(uint8_t zone, float* bus_V, bool* overflow) {
+  uint8_t address = zone_addresses[zone];
+  Wire.beginTransmission(address);
+  Wire.write(INA219_REG_BUSVOLTAGE);
+  if (Wire.endTransmission() != 0 || Wire.requestFrom(address, (uint8_t)2) != 2) {
+    return false;
+  }
+  uint16_t value = Wire.read() << 8;
+  value |= Wire.read();
+  *bus_V = (value >> INA219_BUS_VOLTAGE_SHIFT) * INA219_BUS_LSB_V;
+  *overflow = value & INA219_BUS_OVF;
+  return true;
+}
+
+bool inaReadingInRange(uint8_t zone, float current_mA, float bus_V, float power_mW) {
+  if (isnan(current_mA) || isnan(bus_V) || isnan(power_mW)) {
+    return false;
+  }
+  // Shunt full scale over the 0.1 ohm shunt: 40 mV at PGA /1, 320 mV at /8;
+  // the bus range is 32 V at every profile
+  bool low = zones[zone].profile.range == INA_RANGE_16V_400MA;
+  float current_fs = (low ? 400.0f : 3200.0f) * FULL_SCALE_MARGIN;
+  float bus_fs = 32.0f * FULL_SCALE_MARGIN;
+  return fabsf(current_mA) <= current_fs && bus_V <= bus_fs && power_mW >= 0 &&
+         power_mW <= current_fs * bus_fs;
+}
+
+uint32_t inaConversionUs(uint8_t zone) {
+  // Continuous mode converts shunt and bus back to back
+  return 2 * channelConversionUs(zones[zone].profile);
+}
+
+uint32_t inaMaxConversionUs() {
+  uint32_t longest = 0;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    longest = max(longest, inaConversionUs(z));
+  }
+  return longest;
+}
+
+bool inaConversionReady(uint8_t zone, uint32_t now_us) {
+  ZoneProfile& z = zones[zone];
+  if (z.last_read_us != 0 && now_us - z.last_read_us < inaConversionUs(zone)) {
+    return false;
+  }
+  z.last_read_us = now_us;
+  return true;
+}
+
+bool inaAutoRange(uint8_t zone, float current_mA, uint32_t now_us) {
+  ZoneProfile& z = zones[zone];
+  if (!z.auto_range) {
+    return false;
+  }
+
+  float magnitude = fabsf(current_mA);
+  InaRange range = z.profile.range;
+  InaRange target = range;
+  if (range != INA_RANGE_32V_2A && magnitude >= AUTORANGE_UP_FRACTION * inaRangeMax_mA(range)) {
+    target = INA_RANGE_32V_2A;
+    z.low_readings = 0;
+  } else if (range > 0 && magnitude < AUTORANGE_DOWN_FRACTION * inaRangeMax_mA((InaRange)(range - 1))) {
+    if (++z.low_readings >= AUTORANGE_DOWN_SAMPLES) {
+      target = (InaRange)(range - 1);
+      z.low_readings = 0;
+    }
+  } else {
+    z.low_readings = 0;
+  }
+
+  if (target == range) {
+    return false;
+  }
+  z.profile.range = target;
+  resetNoise(z);
+  inaProfileApply(zone);
+  // Hold off the fast pass until a conversion under the new range is done
+  z.last_read_us = now_us;
+  z.switch_us = now_us | 1;  // never 0, which means settled
+  z.switches++;
+  return true;
+}
+
+void inaAutoRangeEnable(uint8_t zone, bool enabled) {
+  zones[zone].auto_range = enabled;
+  zones[zone].low_readings = 0;
+}
+
+bool inaAutoRangeEnabled(uint8_t zone) {
+  return zones[zone].auto_range;
+}
+
+uint32_t inaRangeSwitches(uint8_t zone) {
+  return zones[zone].switches;
+}
+
+bool inaRangeSettling(uint8_t zone, uint32_t now_us) {
+  ZoneProfile& z = zones[zone];
+  if (z.switch_us == 0) {
+    return false;
+  }
+  // The conversion running at the switch mixes both ranges; the next is clean
+  if (now_us - z.switch_us < 2 * inaConversionUs(zone)) {
+    return true;
+  }
+  z.switch_us = 0;
+  return false;
+}
+
+void inaNoiseSample(uint8_t zone, float current_mA) {
+  ZoneProfile& z = zones[zone];
+  if (z.samples > 0) {
+    float d = current_mA - z.last_mA;
+    z.sum_sq_diff += d * d;
+  }
+  z.last_mA = current_mA;
+  z.samples++;
+}
+
+float inaNoiseFloor_mA(uint8_t zone) {
+  const ZoneProfile& z = zones[zone];
+  if (z.samples < 2) {
+    return 0;
+  }
+  // Var(x[i] - x[i-1]) is twice the white-noise variance
+  return sqrtf(z.sum_sq_diff / (2.0f * (z.samples - 1)));
+}
+
+uint32_t inaNoiseSamples(uint8_t zone) {
+  return zones[zone].samples;
+}
@@ -0,0 +1,110 @@
+#include "local_server.h"
+
+#if LOCAL_SERVER
+
+#include <ArduinoJson.h>
+#include <ESPAsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+
+#include "telemetry.h"
+#include "window_aggregate.h"
+
+static AsyncWebServer server(LOCAL_SERVER_PORT);
+static AsyncEventSource events("/events");
+
+static const char* node;
+static const char* const* zones;
+static LocalServerStats stats;
+
+// /latest as served; rebuilt at every publish slot, not per request
+static char latest_json[1024] = "{}";
+
+static void fieldJson(JsonObject parent, const char* name, const FieldStats& f, uint16_t count) {
+  JsonObject field = parent.createNestedObject(name);
+  field["min"] = f.min;
+  field["mean"] = fieldMean(f, count);
+  field["max"] = f.max;
+}
+
+static void onEventsConnect(AsyncEventSourceClient* client) {
+  // The new client is already counted
+  if (events.count() > LOCAL_SSE_MAX_CLIENTS) {
+    stats.rejected++;
+    client->close();
+    return;
+  }
+  client->send(latest_json, "window", millis(), 1000);
+}
+
+void localServerBegin(const char* node_id, const char* const* zone_ids) {
+  node = node_id;
+  zones = zone_ids;
+
+  events.onConnect(onEventsConnect);
+  server.addHandler(&events);
+  server.on("/latest", HTTP_GET, [](AsyncWebServerRequest* request) {
+    stats.requests++;
+    request->send(200, "application/json", latest_json);
+  });
+  server.begin();
+}
+
+void localServerSample(uint32_t tick, uint32_t late_us, const ZoneData* data,
+                       const PackedSample& sample) {
+  if (events.count() == 0) {
+    return;
+  }
+  if (events.avgPacketsWaiting() > LOCAL_SSE_MAX_QUEUE) {
+    stats.dropped++;
+    return;
+  }
+
+  // Compact rows: [current_mA, voltage_V, power_mW, flags] per zone
+  StaticJsonDocument<384> doc;
+  doc["tick"] = tick;
+  doc["late_us"] = late_us;
+  JsonArray rows = doc.createNestedArray("zones");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    JsonArray row = rows.createNestedArray();
+    row.add(data[z].current_mA);
+    row.add(data[z].busvoltage);
+    row.add(data[z].power_mW);
+    row.add(zoneFlags(sample, z));
+  }
+  char buf[256];
+  serializeJson(doc, buf, sizeof(buf));
+  events.send(buf, "sample", tick);
+  stats.events++;
+}
+
+void localServerWindowClosed() {
+  DynamicJsonDocument doc(1536);
+  doc["node_id"] = node;
+  doc["uptime_ms"] = telemetryUptimeMs();
+  JsonObject out = doc.createNestedObject("zones");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    const ZoneAggregate& a = aggregateLatest(z);
+    JsonObject zone = out.createNestedObject(zones[z]);
+    zone["count"] = a.count;
+    zone["skipped"] = a.skipped;
+    zone["invalid"] = a.invalid;
+    zone["first_tick"] = a.first_tick;
+    zone["last_tick"] = a.last_tick;
+    if (a.count > 0) {
+      fieldJson(zone, "current_mA", a.current_mA, a.count);
+      fieldJson(zone, "voltage_V", a.voltage_V, a.count);
+      fieldJson(zone, "power_mW", a.power_mW, a.count);
+    }
+  }
+  serializeJson(doc, latest_json, sizeof(latest_json));
+  if (events.count() > 0) {
+    events.send(latest_json, "window", millis());
+  }
+}
+
+LocalServerStats localServerStats() {
+  stats.clients = events.count();
+  return stats;
+}
+
+#endif
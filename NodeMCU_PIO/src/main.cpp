@@ -3,38 +3,120 @@
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <ESPAsyncTCP.h>
+#include <Wire.h>
+
+#include "ack_window.h"
+#include "alarms.h"
+#include "batch_control.h"
+#include "broker_pool.h"
+#include "battery_gauge.h"
+#include "deep_sleep.h"
+#include "discovery.h"
+#include "i2c_bus.h"
+#include "ina_profile.h"
+#include "local_server.h"
+#include "mqtt_transport.h"
+#include "mqttsn_client.h"
+#include "node_identity.h"
+#include "node_config.h"
+#include "power_manager.h"
+#include "protection.h"
+#include "publish_schedule.h"
+#include "ripple_monitor.h"
+#include "runtime_config.h"
+#include "sample_buffer.h"
+#include "telemetry.h"
+#include "time_sync.h"
+#include "wake_plan.h"
+#include "window_aggregate.h"
+#include "zone_encoder.h"
+#include "zone_filter.h"
 
 // Replace the next variables with your SSID/Password combination
 const char* ssid = "DakshNET 2.4";
 const char* password = "9650349609";
 
-// Add your MQTT Broker IP address
+// Add your MQTT Broker IP address (the default; see runtime_config.h)
 const char* mqtt_server = "192.168.0.139";
 
+// SHA-1 fingerprints of the broker certificate for MQTT_TLS builds, as
+// printed by zone-flow-monitor/setup_tls_broker.sh. Add the next
+// certificate's fingerprint here before rotating it on the broker.
+const char* mqtt_fingerprints[] = {
+  "00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00",
+};
+
 // INA219 sensor instances for three zones
 Adafruit_INA219 ina219_zone1(0x40);  // Default address (A0=GND, A1=GND)
 Adafruit_INA219 ina219_zone2(0x41);  // A0=VDD, A1=GND
 Adafruit_INA219 ina219_zone3(0x44);  // A0=GND, A1=VDD
 
+Adafruit_INA219* zone_sensors[ZONE_COUNT] = {&ina219_zone1, &ina219_zone2, &ina219_zone3};
+const uint8_t zone_addresses[ZONE_COUNT] = {0x40, 0x41, 0x44};
+// Expected peak load per zone; picks the smallest INA219 range that covers it
+const float zone_expected_mA[ZONE_COUNT] = {2000.0f, 2000.0f, 2000.0f};
+const char* zone_ids[ZONE_COUNT] = {"zone1", "zone2", "zone3"};
+
+// MQTT topics under <site>/<node>/, built once at boot by buildTopics()
+char zone_topics[ZONE_COUNT][TOPIC_LEN];
+char zone_control_topics[ZONE_COUNT][TOPIC_LEN];
+char zone_protection_topics[ZONE_COUNT][TOPIC_LEN];
+char zone_battery_topics[ZONE_COUNT][TOPIC_LEN];
+char zone_ripple_topics[ZONE_COUNT][TOPIC_LEN];
+char zones_topic[TOPIC_LEN];
+char diagnostics_topic[TOPIC_LEN];
+char profiles_topic[TOPIC_LEN];
+char schedule_topic[TOPIC_LEN];
+char provision_topic[TOPIC_LEN];
+char status_topic[TOPIC_LEN];
+char ack_topic[TOPIC_LEN];
+char config_topic[TOPIC_LEN];
+char config_set_topic[TOPIC_LEN];
+char fleet_config_topic[TOPIC_LEN];
+char time_topic[TOPIC_LEN];
+char time_request_topic[TOPIC_LEN];
+char site_time_topic[TOPIC_LEN];
+
+// Last will, set by the broker on <site>/<node>/status if the node drops
+char offline_status[64];
+
+// Load-shedding relay outputs, one per zone (D1/D2 are the I2C bus)
+const uint8_t zone_relay_pins[ZONE_COUNT] = {D5, D6, D7};
+
 // WiFi and MQTT client objects
-WiFiClient espClient;
-PubSubClient client(espClient);
+#if MQTT_SN
+MqttSnClient client;
+#else
+PubSubClient client(transportClient());
+#endif
+
+// Payload buffer, sized for a full publish window of batched samples, the
+// config echo with every zone a battery and diagnostics with every broker
+char msg[2048];
+
+// Latest sensor readings for all three zones
+ZoneData zone_data[ZONE_COUNT];
 
 // Timing
-long lastMsg = 0;
-char msg[200];
-int value = 0;
-
-// Sensor readings for all three zones
-struct ZoneData {
-  float current_mA;
-  float power_mW;
-  float busvoltage;
-};
+unsigned long lastReconnectAttempt = 0;
+unsigned long reconnectWait = 0;        // from the broker pool's back-off
+unsigned long lastProtectionCheck = 0;  // also drives alarm detection
+unsigned long startup_ms = 0;           // end of setup()
+unsigned long first_sample_ms = 0;      // first tick sampled, 0 until then
 
-ZoneData zone1_data = {0, 0, 0};
-ZoneData zone2_data = {0, 0, 0};
-ZoneData zone3_data = {0, 0, 0};
+// Zone data sending: every zone sends its samples up to send_through_seq
+// (exclusive), set at each publish slot; next_send_seq is the first sample
+// of the zone that hasn't gone out yet
+uint32_t next_send_seq[ZONE_COUNT];
+uint32_t send_through_seq = 0;
+
+// The active config goes out retained once connected, after boot and after
+// every change
+bool config_echo_due = true;
+
+// Sample buffer overflows when this deep-sleep wake started
+uint32_t wake_overflows = 0;
  
 void setup_wifi() {
   delay(10);
@@ -56,7 +138,141 @@ void setup_wifi() {
   Serial.println(WiFi.localIP());
 }
 
+// Control payload on <site>/<node>/zoneN/control, e.g.
+//   {"trip_mA": 2500, "reset_mA": 2200, "holdoff_ms": 200, "reclose_ms": 30000,
+//    "overvoltage_V": 25.0, "range_mA": 400, "adc_bits": 12, "adc_samples": 16,
+//    "auto_range": true}
+// Omitted fields keep their current value. {"command": "reset"} recloses a
+// shed zone. Publish thresholds retained so low-power nodes pick them up at
+// their next publish window.
+void handleZoneControl(uint8_t zone, byte* message, unsigned int length) {
+  StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeJson(doc, message, length);
+  if (error) {
+    Serial.print("Invalid control payload: ");
+    Serial.println(error.c_str());
+    return;
+  }
+
+  const char* command = doc["command"] | "";
+  if (strcmp(command, "reset") == 0) {
+    protectionReset(zone);
+    return;
+  }
+
+  ProtectionSettings settings = protectionSettings(zone);
+  settings.trip_mA = doc["trip_mA"] | settings.trip_mA;
+  settings.reset_mA = doc["reset_mA"] | settings.reset_mA;
+  settings.holdoff_ms = doc["holdoff_ms"] | settings.holdoff_ms;
+  settings.reclose_ms = doc["reclose_ms"] | settings.reclose_ms;
+  protectionConfigure(zone, settings);
+  alarmsSetOvervoltage(zone, doc["overvoltage_V"] | alarmsOvervoltage(zone));
+
+  if (doc.containsKey("range_mA") || doc.containsKey("adc_bits") || doc.containsKey("adc_samples")) {
+    InaProfile profile = inaProfile(zone);
+    // Only the range: resolution and averaging stay as set
+    if (doc.containsKey("range_mA")) {
+      profile.range = inaProfileForLoad(doc["range_mA"], profile.adc_samples).range;
+    }
+    profile.adc_bits = doc["adc_bits"] | profile.adc_bits;
+    profile.adc_samples = doc["adc_samples"] | profile.adc_samples;
+    if (!inaProfileSet(zone, profile)) {
+      Serial.println("Invalid INA219 profile");
+    } else if (zoneAttached(zone)) {
+      inaProfileApply(zone);
+    }
+  }
+  inaAutoRangeEnable(zone, doc["auto_range"] | inaAutoRangeEnabled(zone));
+
+  Serial.print("Protection ");
+  Serial.print(zone_ids[zone]);
+  Serial.print(": trip ");
+  Serial.print(settings.trip_mA);
+  Serial.print("mA, reset ");
+  Serial.print(settings.reset_mA);
+  Serial.print("mA, hold-off ");
+  Serial.print(settings.holdoff_ms);
+  Serial.println("ms");
+}
+
+// Phase assignment on <site>/<node>/schedule, e.g. {"phase_ms": 1250}. Publish it
+// retained; without one the node keeps the phase derived from its chip id.
+void handleSchedule(byte* message, unsigned int length) {
+  StaticJsonDocument<64> doc;
+  if (deserializeJson(doc, message, length) || !doc.containsKey("phase_ms")) {
+    Serial.println("Invalid schedule payload");
+    return;
+  }
+  scheduleSetPhase(doc["phase_ms"]);
+  Serial.print("Publish phase set to ");
+  Serial.print(schedulePhase());
+  Serial.println("ms");
+}
+
+// Node id provisioning on <site>/provision/<chip id>, e.g.
+// {"node_id": "pump-room"}. Published retained, it follows the board across
+// reflashes; the node stores it and restarts to rebuild its topics.
+void handleProvision(byte* message, unsigned int length) {
+  StaticJsonDocument<96> doc;
+  if (deserializeJson(doc, message, length)) {
+    Serial.println("Invalid provisioning payload");
+    return;
+  }
+  const char* id = doc["node_id"] | "";
+  if (strcmp(id, identityProvisioned() ? nodeId() : "") == 0) {
+    return;
+  }
+  if (!identityProvision(id)) {
+    Serial.print("Rejected node id: ");
+    Serial.println(id);
+    return;
+  }
+  Serial.print("Node id provisioned: ");
+  Serial.print(id[0] ? id : "(chip id)");
+  Serial.println(", restarting");
+  client.disconnect();
+  delay(100);
+  ESP.restart();
+}
+
+// Ack from the backend for the zone message ending at "seq"
+void handleAck(byte* message, unsigned int length) {
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, message, length)) {
+    return;
+  }
+  const char* zone_id = doc["zone_id"] | "";
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (strcmp(zone_id, zone_ids[z]) == 0) {
+      ackWindowAck(z, doc["seq"] | 0UL, millis());
+    }
+  }
+}
+
+// Config update on <site>/<node>/config/set, or <site>/config/set for the
+// whole site, e.g. {"sample_interval_ms": 2000, "zones": [{"trip_mA": 2500}]}.
+// Omitted fields keep their value; see runtime_config.h. The update is
+// staged here and applied between two ticks by applyPendingConfig().
+void handleConfig(byte* message, unsigned int length) {
+  DynamicJsonDocument doc(1536);
+  DeserializationError error = deserializeJson(doc, message, length);
+  if (error) {
+    Serial.print("Invalid config payload: ");
+    Serial.println(error.c_str());
+    return;
+  }
+  const char* rejected = configStage(doc.as<JsonVariantConst>());
+  if (rejected) {
+    Serial.print("Config rejected: ");
+    Serial.println(rejected);
+    return;
+  }
+  Serial.println("Config update staged");
+}
+
 void callback(char* topic, byte* message, unsigned int length) {
+  // Before the serial output, which takes milliseconds
+  uint64_t received_us = powerClockMicros();
   Serial.print("Message arrived on topic: ");
   Serial.print(topic);
   Serial.print(". Message: ");
@@ -68,138 +284,1377 @@ void callback(char* topic, byte* message, unsigned int length) {
   }
   Serial.println();
   
-  // Add any control logic here if needed in the future
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (strcmp(topic, zone_control_topics[z]) == 0) {
+      handleZoneControl(z, message, length);
+    }
+  }
+  if (strcmp(topic, schedule_topic) == 0) {
+    handleSchedule(message, length);
+  }
+  if (strcmp(topic, provision_topic) == 0) {
+    handleProvision(message, length);
+  }
+  if (strcmp(topic, ack_topic) == 0) {
+    handleAck(message, length);
+  }
+  if (strcmp(topic, config_set_topic) == 0 || strcmp(topic, fleet_config_topic) == 0) {
+    handleConfig(message, length);
+  }
+  if (strcmp(topic, time_topic) == 0 || strcmp(topic, site_time_topic) == 0) {
+    timeSyncMessage(message, length, received_us);
+  }
 }
 
-void reconnect() {
-  // Loop until we're reconnected
-  while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
-    // Attempt to connect
-    if (client.connect("NodeMCU_Node1_Zone1")) {
-      Serial.println("connected");
-      // Subscribe to control topics if needed
-      // client.subscribe("/node1/zone1/control");
-    } else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" try again in 5 seconds");
-      // Wait 5 seconds before retrying
-      delay(5000);
-    }
+// A subscription that fails drops the session, so the next connect makes
+// them all again rather than running without a control topic
+bool subscribeControlTopics() {
+  const char* const topics[] = {schedule_topic, provision_topic, ack_topic, fleet_config_topic,
+                                config_set_topic, time_topic, site_time_topic};
+  bool ok = true;
+  for (uint8_t z = 0; z < ZONE_COUNT && ok; z++) {
+    ok = client.subscribe(zone_control_topics[z]);
+  }
+  for (uint8_t i = 0; i < sizeof(topics) / sizeof(topics[0]) && ok; i++) {
+    ok = client.subscribe(topics[i]);
   }
+  if (!ok) {
+    Serial.println("Subscribe failed, dropping the session");
+    client.disconnect();
+    brokerDisconnected();
+  }
+  return ok;
 }
 
-void setup() {
-  Serial.begin(115200);
-  
-  // Initialize all three INA219 sensors
-  if (!ina219_zone1.begin()) {
-    Serial.println("Failed to find INA219 chip for Zone 1 (0x40)");
-    while (1) {
-      delay(10);
-    }
+// Publishes through PubSubClient and accounts the time it took, which is
+// where TLS adds its per-message cost
+bool mqttPublish(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+  uint32_t start = micros();
+  bool ok = client.publish(topic, payload, length, retained);
+  transportPublished(micros() - start);
+  return ok;
+}
+
+bool mqttPublish(const char* topic, const char* payload, bool retained = false) {
+  return mqttPublish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+// Publishes the retained node status: "online" after connecting, or
+// "sleeping" before a low-power node closes its window on purpose (a clean
+// disconnect doesn't fire the last will)
+void publishStatus(const char* state) {
+  StaticJsonDocument<256> doc;
+  doc["node_id"] = nodeId();
+  doc["state"] = state;
+  doc["client_id"] = clientId();
+  doc["ip"] = WiFi.localIP().toString();
+  doc["rssi"] = WiFi.RSSI();
+  doc["publish_period_ms"] = schedulePeriod();
+  doc["boot_id"] = telemetryBootId();
+  doc["uptime_ms"] = telemetryUptimeMs();
+  // Zone payloads end in a CRC-32 trailer (zone_encoder.h)
+  doc["payload_crc"] = true;
+
+  serializeJson(doc, msg, sizeof(msg));
+  mqttPublish(status_topic, msg, true);
+}
+
+// Connects to the broker the pool picks, with the retained offline status
+// as last will, and announces the node as online
+bool connectBroker() {
+  uint8_t index = brokerNext(millis());
+  const BrokerHealth& broker = brokerHealth(index);
+  client.setServer(broker.server, broker.port);
+  uint32_t start = millis();
+  transportConnectStart();
+  bool ok = client.connect(clientId(), status_topic, 1, true, offline_status);
+  transportConnectDone(ok);
+  brokerAttempted(index, ok, millis() - start, millis());
+  Serial.print(ok ? "Broker " : "Broker failed ");
+  Serial.print(broker.server);
+  Serial.print(":");
+  Serial.println(broker.port);
+  if (!ok) {
+    return false;
   }
-  
-  if (!ina219_zone2.begin()) {
-    Serial.println("Failed to find INA219 chip for Zone 2 (0x41)");
-    while (1) {
-      delay(10);
+  publishStatus("online");
+  timeSyncConnected();
+  return true;
+}
+
+// Round-trip time request (time_sync.h), after connecting and then every
+// TIME_SYNC_REQUEST_MS
+void requestTime() {
+  char request[48];
+  size_t length = timeSyncRequest(request, sizeof(request));
+  if (length > 0) {
+    mqttPublish(time_request_topic, (const uint8_t*)request, length, false);
+  }
+}
+
+// One attempt per broker, for a publish window
+bool connectAnyBroker() {
+  for (uint8_t i = 0; i < brokerCount(); i++) {
+    if (connectBroker()) {
+      return true;
     }
   }
-  
-  if (!ina219_zone3.begin()) {
-    Serial.println("Failed to find INA219 chip for Zone 3 (0x44)");
-    while (1) {
-      delay(10);
+  return false;
+}
+
+// Failback probe in flight, started and finished by probeFailback()
+int8_t probe_index = -1;
+uint32_t probe_start = 0;
+#if !MQTT_SN
+AsyncClient probe_tcp;
+volatile int8_t probe_tcp_result = -1;  // from its callbacks: 1 connected, 0 failed
+#endif
+
+bool startProbe(const BrokerHealth& broker) {
+#if MQTT_SN
+  return client.probeStart(broker.server, broker.port);
+#else
+  probe_tcp_result = -1;
+  probe_tcp.onConnect([](void*, AsyncClient*) { probe_tcp_result = 1; });
+  probe_tcp.onError([](void*, AsyncClient*, int8_t) { probe_tcp_result = 0; });
+  return probe_tcp.connect(broker.server, broker.port);
+#endif
+}
+
+// 1 if the probe was answered, 0 if it failed, -1 while it is pending
+int8_t probeResult() {
+#if MQTT_SN
+  return client.probeAnswered() ? 1 : -1;
+#else
+  return probe_tcp_result;
+#endif
+}
+
+void stopProbe() {
+#if MQTT_SN
+  client.probeStop();
+#else
+  probe_tcp.close(true);
+#endif
+  probe_index = -1;
+}
+
+// While on a fallback broker, probes a better one with a bare TCP connect,
+// or a ping to an MQTT-SN gateway (it doesn't disturb the session); enough
+// good probes set a failback. Each call starts a probe or checks on the
+// one in flight, so the loop, and with it the protection pass, never waits
+// for a broker; returns true while a probe is in flight.
+bool probeFailback() {
+  if (probe_index < 0) {
+    int8_t index = brokerFailbackCandidate(millis());
+    if (index < 0 || brokerFailbackTarget() >= 0) {
+      return false;
+    }
+    probe_start = millis();
+    if (!startProbe(brokerHealth(index))) {
+      stopProbe();
+      brokerProbed(index, false, 0, millis());
+      return false;
     }
+    probe_index = index;
+    return true;
+  }
+  int8_t result = probeResult();
+  uint32_t elapsed = millis() - probe_start;
+  if (result < 0 && elapsed < BROKER_CONNECT_TIMEOUT_MS) {
+    return true;
+  }
+  int8_t index = probe_index;
+  stopProbe();
+  if (brokerProbed(index, result > 0, elapsed, millis())) {
+    Serial.print("Broker back: ");
+    Serial.println(brokerHealth(index).server);
+  }
+  return false;
+}
+
+void reconnect() {
+  // One attempt per pass so sampling and protection keep running; the next
+  // broker is tried on the next pass, and only when all are backed off
+  // does the node wait
+  if (lastReconnectAttempt != 0 && millis() - lastReconnectAttempt < reconnectWait) {
+    return;
+  }
+  lastReconnectAttempt = millis();
+
+  Serial.print("Attempting MQTT connection...");
+  // Attempt to connect
+  if (connectBroker() && subscribeControlTopics()) {
+    Serial.println("connected");
+  } else {
+    reconnectWait = brokerRetryDelay(millis());
+    Serial.print("failed, rc=");
+    Serial.print(client.state());
+    Serial.print(" next try in ");
+    Serial.print(reconnectWait);
+    Serial.println("ms");
+  }
+}
+
+// Builds every topic from the site and node id
+void buildTopics() {
+  char suffix[32];
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    buildTopic(zone_topics[z], TOPIC_LEN, zone_ids[z]);
+    snprintf(suffix, sizeof(suffix), "%s/control", zone_ids[z]);
+    buildTopic(zone_control_topics[z], TOPIC_LEN, suffix);
+    snprintf(suffix, sizeof(suffix), "%s/protection", zone_ids[z]);
+    buildTopic(zone_protection_topics[z], TOPIC_LEN, suffix);
+    snprintf(suffix, sizeof(suffix), "%s/battery", zone_ids[z]);
+    buildTopic(zone_battery_topics[z], TOPIC_LEN, suffix);
+    snprintf(suffix, sizeof(suffix), "%s/ripple", zone_ids[z]);
+    buildTopic(zone_ripple_topics[z], TOPIC_LEN, suffix);
+  }
+  buildTopic(zones_topic, TOPIC_LEN, "zones");
+  buildTopic(diagnostics_topic, TOPIC_LEN, "diagnostics");
+  buildTopic(profiles_topic, TOPIC_LEN, "profiles");
+  buildTopic(schedule_topic, TOPIC_LEN, "schedule");
+  buildTopic(status_topic, TOPIC_LEN, "status");
+  buildTopic(ack_topic, TOPIC_LEN, "ack");
+  buildTopic(config_topic, TOPIC_LEN, "config");
+  buildTopic(config_set_topic, TOPIC_LEN, "config/set");
+  buildTopic(time_topic, TOPIC_LEN, "time");
+  buildTopic(time_request_topic, TOPIC_LEN, "time/req");
+  snprintf(fleet_config_topic, TOPIC_LEN, "%s/config/set", siteId());
+  snprintf(site_time_topic, TOPIC_LEN, "%s/time", siteId());
+  snprintf(offline_status, sizeof(offline_status), "{\"node_id\":\"%s\",\"state\":\"offline\"}", nodeId());
+  snprintf(provision_topic, TOPIC_LEN, "%s/provision/%06x", siteId(), chipId());
+}
+
+// Protection and alarm thresholds, filters and battery gauges from the config
+void configureZones() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    const ZoneConfig& zc = config().zones[z];
+    protectionConfigure(z, {zc.trip_mA, zc.reset_mA, zc.holdoff_ms, zc.reclose_ms});
+    alarmsSetOvervoltage(z, zc.overvoltage_V);
+#if ZONE_FILTER
+    const ZoneFilterConfig& fc = config().filters[z];
+    filterConfigure(z, fc.q_mA2, fc.r_mA2, fc.gate_sigma);
+#endif
+    batteryConfigure(z, config().batteries[z]);
   }
+}
+
+// mqtt_server, then the backups, in that order
+void configureBrokers() {
+  const RuntimeConfig& cfg = config();
+  const char* servers[1 + CONFIG_BACKUP_BROKERS] = {cfg.mqtt_server};
+  uint16_t ports[1 + CONFIG_BACKUP_BROKERS] = {cfg.mqtt_port};
+  for (uint8_t i = 0; i < CONFIG_BACKUP_BROKERS; i++) {
+    servers[1 + i] = cfg.backups[i].server;
+    ports[1 + i] = cfg.backups[i].port;
+  }
+  // A probe in flight is for an index of the old list
+  if (probe_index >= 0) {
+    stopProbe();
+  }
+  brokerPoolSet(servers, ports, 1 + CONFIG_BACKUP_BROKERS);
+}
+
+// Batch bounds in samples from the configured latency bounds, capped at
+// the sample buffer before they are narrowed to batchBegin()'s bytes
+void beginBatching() {
+  const RuntimeConfig& cfg = config();
+  const uint32_t capacity = SAMPLE_BUFFER_CAPACITY;
+  batchBegin(min(capacity, cfg.batch_min_latency_ms / cfg.sample_interval_ms),
+             min(capacity, cfg.batch_max_latency_ms / cfg.sample_interval_ms),
+             min(capacity, (uint32_t)cfg.samples_per_publish));
+}
+
+void setup() {
+  Serial.begin(115200);
+  telemetryBegin();
+#if DEEP_SLEEP_MODE
+  bool resumed = deepSleepBegin();
+#else
+  bool resumed = false;
+#endif
+  identityBegin();
+  configBegin(mqtt_server, transportPort());
+  buildTopics();
+  Serial.println();
+  Serial.print("Node ");
+  Serial.print(nodeId());
+  Serial.print(identityProvisioned() ? " (provisioned)" : " (from chip id)");
+  Serial.print(", topics under ");
+  Serial.print(siteId());
+  Serial.print("/");
+  Serial.println(nodeId());
+  Serial.print("Config revision ");
+  Serial.print(configRevision());
+  Serial.print(" (");
+  Serial.print(configSourceName(configSource()));
+  Serial.println(")");
+
+#if LOW_POWER_MODE
+  // Keep the radio off until the first publish window, and don't rewrite
+  // the WiFi config in flash on every reconnect
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_OFF);
+  WiFi.forceSleepBegin();
+#endif
+
+  // Relays start connected; protection runs before WiFi is up
+  protectionBegin(zone_relay_pins);
+  alarmsBegin();
+  filterBegin();
+  batteryBegin();
+  configureZones();
   
-  Serial.println("All INA219 sensors initialized - Node1 with 3 zones ready");
+  // Attach whichever INA219s answer; missing zones are retried later
+  Wire.begin();
+  i2cBusBegin();
+  inaProfileBegin(zone_sensors, zone_addresses);
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    inaProfileSet(z, inaProfileForLoad(zone_expected_mA[z], ZONE_ADC_SAMPLES));
+  }
+  discoveryBegin(zone_sensors, zone_addresses);
+  discoveryScan();
+#if RIPPLE_ANALYSIS
+  rippleBegin(zone_addresses);
+#endif
+
+  Serial.print("INA219 sensors initialized - ");
+  Serial.print(zonesAttached());
+  Serial.print("/");
+  Serial.print(ZONE_COUNT);
+  Serial.print(" zones ready (scan ");
+  Serial.print(discoveryLastScanUs());
+  Serial.println("us)");
   
+  // A deep-sleep wake carries on with the samples of the wakes before
+  sampleBufferBegin(resumed);
+#if DEEP_SLEEP_MODE
+  wake_overflows = sampleBufferOverflows();
+#endif
+  ackWindowBegin(config().ack_window);
+
   // Setup WiFi and MQTT
+#if !LOW_POWER_MODE
   setup_wifi();
-  client.setServer(mqtt_server, 1883);
+#if LOCAL_SERVER
+  localServerBegin(nodeId(), zone_ids);
+  Serial.print("Local readings on http://");
+  Serial.print(WiFi.localIP());
+  Serial.println("/latest and /events");
+#endif
+#endif
+  transportBegin(mqtt_fingerprints, sizeof(mqtt_fingerprints) / sizeof(mqtt_fingerprints[0]));
+  configureBrokers();
+  transportClient().setTimeout(BROKER_CONNECT_TIMEOUT_MS);
+  client.setSocketTimeout(max(1, BROKER_CONNECT_TIMEOUT_MS / 1000));
+  client.setKeepAlive(MQTT_KEEPALIVE_S);
   client.setCallback(callback);
+  client.setBufferSize(sizeof(msg) + 128);
+
+  powerBegin(config().sample_interval_ms);
+  timeSyncBegin();
+  beginBatching();
+  scheduleBegin(config().sample_interval_ms * batchSamples(), chipId());
+#if DEEP_SLEEP_MODE
+  deepSleepRestore();
+  config_echo_due = deepSleepFlags() & DEEP_SLEEP_ECHO_DUE;
+#endif
+
+  startup_ms = millis();
+  Serial.print("Startup took ");
+  Serial.print(startup_ms);
+  Serial.println("ms");
 }
+
+// Times one INA219 register read and feeds the bus statistics. Once a
+// read of the zone failed, the rest of the pass leaves the device alone.
+float timedRead(uint8_t zone, float (Adafruit_INA219::*read)(), bool& ok) {
+  if (!ok) {
+    return 0;
+  }
+  uint32_t start = micros();
+  float value = (zone_sensors[zone]->*read)();
+  ok = zone_sensors[zone]->success();
+  i2cBusRecord(zone, micros() - start, ok);
+  return value;
+}
+
+// The bus voltage and its overflow bit, timed like timedRead()
+float timedBusRead(uint8_t zone, bool& ok, bool& overflow) {
+  if (!ok) {
+    return 0;
+  }
+  float bus_V = 0;
+  uint32_t start = micros();
+  ok = inaReadBus(zone, &bus_V, &overflow);
+  i2cBusRecord(zone, micros() - start, ok);
+  return bus_V;
+}
+
+// Frees a stuck bus and re-initializes the sensors (begin() reprograms the
+// calibration register, which a glitch may have reset)
+void recoverBus() {
+  bool released = i2cBusRecover();
+  discoveryReinit();
+
+  Serial.print("I2C bus recovery #");
+  Serial.print(i2cBusRecoveries());
+  Serial.println(released ? ": bus released" : ": lines still held low");
+}
+
+// A sensor that stopped answering for ALARM_OFFLINE_READS reads is dropped
+// from the read passes until a rescan finds it again
+void detachIfOffline(uint8_t zone) {
+  if (alarmState(zone, ALARM_ZONE_OFFLINE).active) {
+    zoneDetach(zone);
+  }
+}
+
+// Reads every zone and appends one tick to the sample buffer
+void sampleZones(uint32_t tick) {
+#if LOW_POWER_MODE
+  // Wake the INA219s and let the slowest profile finish a fresh conversion
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (zoneAttached(z)) {
+      zone_sensors[z]->powerSave(false);
+    }
+  }
+  delay(inaMaxConversionUs() / 1000 + 1);
+#endif
+
+  PackedSample sample;
+  sample.tick = tick;
+  sample.flags = timeSyncSynced() ? SAMPLE_FLAG_SHARED_GRID : 0;
+  bool all_ok = true;
+
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (!zoneAttached(z)) {
+      zone_data[z] = {};
+      filterReset(z);
+      batteryNoReading(z);
+      sample.zone[z] = packZone(zone_data[z]);
+      setZoneFlag(sample, z, ZONE_FLAG_NO_READING);
+      continue;
+    }
+
+    // A device backed off after I2C errors isn't read this tick, and that
+    // isn't another failed read: the back-off would run into the offline
+    // alarm within a few passes otherwise
+    bool ready = i2cDeviceReady(z);
+    bool ok = ready;
+    uint32_t sampled_us = micros();
+    bool settling = inaRangeSettling(z, sampled_us);
+    zone_data[z].range = inaProfile(z).range;
+    zone_data[z].current_mA = timedRead(z, &Adafruit_INA219::getCurrent_mA, ok);
+    if (ok) {
+#if !DEEP_SLEEP_MODE
+      protectionSample(z, zone_data[z].current_mA, sampled_us);
+#endif
+#if LOW_POWER_MODE
+      if (!settling) {
+        inaNoiseSample(z, zone_data[z].current_mA);
+      }
+#endif
+    }
+    zone_data[z].power_mW = timedRead(z, &Adafruit_INA219::getPower_mW, ok);
+    bool overflow = false;
+    zone_data[z].busvoltage = timedBusRead(z, ok, overflow);
+    if (!ok) {
+      zone_data[z] = {};
+      setZoneFlag(sample, z, ZONE_FLAG_I2C_ERROR);
+      if (ready) {
+        alarmsSample(z, false, 0);
+      }
+      batteryNoReading(z);
+    } else if (!inaReadingInRange(z, zone_data[z].current_mA, zone_data[z].busvoltage,
+                                  zone_data[z].power_mW)) {
+      // A corrupted read: kept out of the alarms, the gauge and auto-ranging
+      setZoneFlag(sample, z, ZONE_FLAG_OUT_OF_RANGE);
+      batteryNoReading(z);
+    } else {
+      alarmsSample(z, true, zone_data[z].busvoltage);
+      if (overflow) {
+        // Clipped current; auto-ranging widens the range for the next one
+        setZoneFlag(sample, z, ZONE_FLAG_OVERFLOW);
+        batteryNoReading(z);
+      } else {
+        batterySample(z, zone_data[z].current_mA, zone_data[z].busvoltage, powerClockMicros());
+      }
+      if (inaAutoRange(z, zone_data[z].current_mA, micros()) || settling) {
+        // Either clipped (which triggered the switch) or straddling one
+        setZoneFlag(sample, z, ZONE_FLAG_RANGE_SWITCH);
+      }
+    }
+#if ZONE_FILTER
+    // Only clean readings feed the filter; the others keep its estimate
+    zone_data[z].current_filt_mA = zoneFlags(sample, z) == 0
+        ? filterUpdate(z, zone_data[z].current_mA)
+        : filterHold(z, zone_data[z].current_mA);
+#else
+    zone_data[z].current_filt_mA = zone_data[z].current_mA;
+#endif
+    sample.zone[z] = packZone(zone_data[z]);
+    detachIfOffline(z);
+    all_ok = all_ok && ok;
+  }
+
+#if LOW_POWER_MODE
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (zoneAttached(z)) {
+      zone_sensors[z]->powerSave(true);
+    }
+  }
+#endif
+
+  if (!all_ok && i2cBusStuck()) {
+    recoverBus();
+  }
+
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    aggregateSample(z, tick, zone_data[z], zoneFlags(sample, z));
+  }
+#if LOCAL_SERVER
+  localServerSample(tick, powerTickLateUs(), zone_data, sample);
+#endif
+  sampleBufferPush(sample);
+}
+
+#if !LOW_POWER_MODE
+// Fast pass over every zone for overcurrent protection and alarms. A zone
+// whose averaging profile hasn't produced a new conversion yet is skipped,
+// and so is one whose device is in its I2C back-off, without counting a
+// failed read.
+void checkZones() {
+  bool all_ok = true;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    uint32_t sampled_us = micros();
+    if (!zoneAttached(z) || !inaConversionReady(z, sampled_us) || !i2cDeviceReady(z)) {
+      continue;
+    }
+    bool ok = true;
+    float current_mA = timedRead(z, &Adafruit_INA219::getCurrent_mA, ok);
+    if (ok) {
+      protectionSample(z, current_mA, sampled_us);
+      if (!inaRangeSettling(z, sampled_us)) {
+        inaNoiseSample(z, current_mA);
+      }
+      inaAutoRange(z, current_mA, micros());
+    }
+    float bus_V = timedRead(z, &Adafruit_INA219::getBusVoltage_V, ok);
+    alarmsSample(z, ok, bus_V);
+    // Battery zones count charge at this rate rather than per tick
+    if (ok) {
+      batterySample(z, current_mA, bus_V, powerClockMicros());
+    } else {
+      batteryNoReading(z);
+    }
+    detachIfOffline(z);
+    all_ok = all_ok && ok;
+  }
+
+  if (!all_ok && i2cBusStuck()) {
+    recoverBus();
+  }
+}
+#endif
  
-void publishZoneData(const char* zone_id, const char* topic, ZoneData& data, long timestamp) {
-  // Create JSON payload
-  DynamicJsonDocument doc(256);
-  doc["node_id"] = "node1";
-  doc["zone_id"] = zone_id;
-  doc["timestamp"] = timestamp;
-  doc["current_mA"] = data.current_mA;
-  doc["voltage_V"] = data.busvoltage;
-  doc["power_mW"] = data.power_mW;
-  
-  // Serialize JSON to string
-  serializeJson(doc, msg);
-  
-  // Publish JSON to MQTT
-  client.publish(topic, msg);
+// Adds the boot id, sequence number and send time every publish carries
+void stampPublish(JsonDocument& doc, uint32_t seq) {
+  doc["boot_id"] = telemetryBootId();
+  doc["seq"] = seq;
+  doc["uptime_ms"] = telemetryUptimeMs();
+}
+
+enum ZonePublish : uint8_t {
+  ZONE_PUBLISH_SENT,
+  ZONE_PUBLISH_EMPTY,    // no reading of the zone left in the range
+  ZONE_PUBLISH_FAILED
+};
+
+// Publishes one zone's buffered samples first_seq..last_seq. Samples the
+// ring has overwritten since are left out.
+ZonePublish publishZoneData(uint8_t zone, uint32_t first_seq, uint32_t last_seq) {
+  uint8_t count = sampleBufferCount();
+  uint32_t base = sampleBufferSeq(0);
+  if (count == 0 || last_seq < base) {
+    return ZONE_PUBLISH_EMPTY;
+  }
+  uint8_t first = first_seq < base ? 0 : first_seq - base;
+  uint8_t last = min((uint32_t)(count - 1), last_seq - base);
+
+  // Rows of an attached zone, invalid ones flagged, oldest first; the last
+  // one is the latest reading. A time sync step waits for an empty buffer,
+  // so the rows are all on one grid.
+  ZoneRow rows[SAMPLE_BUFFER_CAPACITY];
+  uint8_t count_rows = 0;
+  PackedSample sample;
+  for (uint8_t i = first; i <= last; i++) {
+    sampleBufferPeek(i, &sample);
+    uint8_t flags = zoneFlags(sample, zone);
+    if (!(flags & ZONE_FLAG_NO_READING)) {
+      rows[count_rows++] = {sample.tick, unpackZone(sample.zone[zone]), flags};
+    }
+  }
+  // Nothing to report for a detached zone
+  if (count_rows == 0) {
+    return ZONE_PUBLISH_EMPTY;
+  }
+
+  // Zone messages are sequenced by sample; a batch covers first_seq..seq,
+  // and the backend acks it by seq
+  ZoneBatch batch;
+  batch.node_id = nodeId();
+  batch.zone_id = zone_ids[zone];
+  batch.range = inaRangeName(inaProfile(zone).range);
+  batch.boot_id = telemetryBootId();
+  batch.first_seq = base + first;
+  batch.seq = base + last;
+  batch.uptime_ms = telemetryUptimeMs();
+  batch.interval_ms = config().sample_interval_ms;
+  batch.count = count_rows;
+  batch.sync_error_us = (sample.flags & SAMPLE_FLAG_SHARED_GRID) ? timeSyncErrorUs() : -1;
+
+  size_t length = encodeZoneBatch<ZoneEncoder>(batch, rows, (uint8_t*)msg, sizeof(msg) - 1);
+  if (length == 0) {
+    Serial.print("Zone payload too large for ");
+    Serial.println(zone_ids[zone]);
+    return ZONE_PUBLISH_FAILED;
+  }
+  msg[length] = '\0';
+
+  // Retained, so a backend that (re)connects gets the last reading at once
+  bool ok = mqttPublish(zone_topics[zone], (const uint8_t*)msg, length, true);
   
   // Debug output
   Serial.print("Published ");
-  Serial.print(zone_id);
-  Serial.print(" JSON: ");
+  Serial.print(zone_ids[zone]);
+  Serial.print(" ");
+  Serial.print(ZoneEncoder::NAME);
+  Serial.print(" (");
+  Serial.print(length);
+  Serial.print(" bytes)");
+#if ZONE_PAYLOAD == ZONE_PAYLOAD_JSON || ZONE_PAYLOAD == ZONE_PAYLOAD_CSV
+  Serial.print(": ");
+  Serial.print(msg);
+#endif
+  Serial.println();
+  return ok ? ZONE_PUBLISH_SENT : ZONE_PUBLISH_FAILED;
+}
+
+// Publishes every alarm transition as a retained message on
+// <site>/<node>/alarms/zoneN/<alarm>, so the broker always holds the current state
+void publishAlarms() {
+  if (!alarmsPending()) {
+    return;
+  }
+  char topic[TOPIC_LEN];
+  char suffix[40];
+  for (uint8_t z = 0; z < ZONE_COUNT && client.connected(); z++) {
+    for (uint8_t t = 0; t < ALARM_TYPE_COUNT; t++) {
+      AlarmState state = alarmState(z, (AlarmType)t);
+      if (!state.dirty) {
+        continue;
+      }
+
+      StaticJsonDocument<256> doc;
+      doc["node_id"] = nodeId();
+      doc["zone_id"] = zone_ids[z];
+      doc["alarm"] = alarmName((AlarmType)t);
+      doc["active"] = state.active;
+      doc["value"] = state.value;
+      if (t == ALARM_OVER_VOLTAGE) {
+        doc["threshold"] = alarmsOvervoltage(z);
+      }
+      doc["timestamp"] = state.changed_ms;
+      stampPublish(doc, telemetryNextSeq(STREAM_ALARMS));
+
+      serializeJson(doc, msg, sizeof(msg));
+      snprintf(suffix, sizeof(suffix), "alarms/%s/%s", zone_ids[z], alarmName((AlarmType)t));
+      buildTopic(topic, sizeof(topic), suffix);
+      if (mqttPublish(topic, msg, true)) {
+        alarmsMarkPublished(z, (AlarmType)t);
+      }
+
+      Serial.print("Alarm: ");
+      Serial.println(msg);
+    }
+  }
+}
+
+// Publishes the retained zone list on <site>/<node>/zones: which configured zones
+// have a sensor attached, INA219s answering at unassigned addresses, and
+// how long startup and the first sample took
+void publishZones() {
+  StaticJsonDocument<512> doc;
+  doc["node_id"] = nodeId();
+  JsonArray zones = doc.createNestedArray("zones");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    JsonObject zone = zones.createNestedObject();
+    zone["zone_id"] = zone_ids[z];
+    zone["address"] = zoneAddress(z);
+    zone["attached"] = zoneAttached(z);
+  }
+  JsonArray unassigned = doc.createNestedArray("unassigned");
+  uint16_t found = discoveryUnassigned();
+  for (uint8_t i = 0; i <= INA219_LAST_ADDRESS - INA219_FIRST_ADDRESS; i++) {
+    if (found & (1 << i)) {
+      unassigned.add(INA219_FIRST_ADDRESS + i);
+    }
+  }
+  doc["startup_ms"] = startup_ms;
+  doc["first_sample_ms"] = first_sample_ms;
+  doc["scan_us"] = discoveryLastScanUs();
+  doc["publish_period_ms"] = schedulePeriod();
+  doc["phase_ms"] = schedulePhase();
+  stampPublish(doc, telemetryNextSeq(STREAM_ZONES));
+
+  serializeJson(doc, msg, sizeof(msg));
+  mqttPublish(zones_topic, msg, true);
+  Serial.print("Zones: ");
   Serial.println(msg);
 }
 
+// Publishes bus clock, recovery count, per-sensor transaction stats, the
+// zone data ack window, batching, sample jitter, local server load and
+// MQTT transport (TLS handshake) cost
+void publishI2cStats() {
+  DynamicJsonDocument doc(2048);
+  doc["node_id"] = nodeId();
+  doc["i2c_clock_hz"] = i2cBusClock();
+  doc["i2c_recoveries"] = i2cBusRecoveries();
+  JsonObject devices = doc.createNestedObject("i2c");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    I2cDeviceStats stats = i2cDeviceStats(z);
+    JsonObject device = devices.createNestedObject(zone_ids[z]);
+    device["transactions"] = stats.transactions;
+    device["errors"] = stats.errors;
+    device["avg_us"] = stats.transactions ? stats.total_us / stats.transactions : 0;
+    device["max_us"] = stats.max_us;
+    device["last_us"] = stats.last_us;
+    // Samples of the last publish window left out of its aggregate
+    device["invalid_samples"] = aggregateLatest(z).invalid;
+  }
+  AckStats acks = ackWindowStats();
+  JsonObject ack = doc.createNestedObject("ack");
+  ack["window"] = ackWindowSize();
+  ack["in_flight"] = ackWindowInFlight();
+  ack["sent"] = acks.sent;
+  ack["acked"] = acks.acked;
+  ack["retransmits"] = acks.retransmits;
+  ack["rtt_ms"] = acks.last_rtt_ms;
+  ack["srtt_ms"] = acks.srtt_ms;
+  ack["max_rtt_ms"] = acks.max_rtt_ms;
+  BatchState batch = batchState();
+  JsonObject batching = doc.createNestedObject("batch");
+  batching["samples"] = batch.samples;
+  batching["period_ms"] = schedulePeriod();
+  batching["link"] = linkQualityName(batch.link);
+  batching["rssi"] = WiFi.RSSI();
+  batching["increases"] = batch.increases;
+  batching["decreases"] = batch.decreases;
+  TransportStats transport = transportStats();
+  JsonObject mqtt = doc.createNestedObject("transport");
+  mqtt["tls"] = transport.tls;
+  mqtt["connects"] = transport.connects;
+  mqtt["failures"] = transport.failures;
+  mqtt["resumed"] = transport.resumed;
+  mqtt["connect_ms"] = transport.last_connect_ms;
+  mqtt["max_connect_ms"] = transport.max_connect_ms;
+  mqtt["free_heap"] = transport.free_heap;
+  mqtt["handshake_min_heap"] = transport.handshake_min_heap;
+  mqtt["last_error"] = transport.last_error;
+  mqtt["fingerprint"] = transport.fingerprint;
+  mqtt["publish_avg_us"] = transport.publishes ? transport.publish_us / transport.publishes : 0;
+  mqtt["publish_max_us"] = transport.publish_max_us;
+  mqtt["broker"] = brokerActive();
+  mqtt["failovers"] = brokerFailovers();
+  mqtt["failbacks"] = brokerFailbacks();
+  JsonArray brokers = mqtt.createNestedArray("brokers");
+  for (uint8_t i = 0; i < brokerCount(); i++) {
+    const BrokerHealth& b = brokerHealth(i);
+    JsonObject broker = brokers.createNestedObject();
+    broker["server"] = (const char*)b.server;
+    broker["port"] = b.port;
+    broker["attempts"] = b.attempts;
+    broker["failures"] = b.failures;
+    broker["failure_rate"] = b.failure_rate;
+    broker["connect_ms"] = b.connect_ms;
+  }
+#if MQTT_SN
+  MqttSnStats sn = client.stats();
+  JsonObject mqttsn = mqtt.createNestedObject("mqtt_sn");
+  mqttsn["datagrams_out"] = sn.datagrams_out;
+  mqttsn["bytes_out"] = sn.bytes_out;
+  mqttsn["datagrams_in"] = sn.datagrams_in;
+  mqttsn["bytes_in"] = sn.bytes_in;
+  mqttsn["registrations"] = sn.registrations;
+#endif
+  TimeSyncStats sync = timeSyncStats();
+  JsonObject time_sync = doc.createNestedObject("time_sync");
+  time_sync["synced"] = sync.synced;
+  time_sync["error_us"] = sync.error_us;
+  time_sync["offset_us"] = sync.offset_us;
+  time_sync["drift_ppb"] = sync.drift_ppb;
+  time_sync["rtt_us"] = sync.rtt_us;
+  time_sync["beacons"] = sync.beacons;
+  time_sync["replies"] = sync.replies;
+  time_sync["rejected"] = sync.rejected;
+  time_sync["steps"] = sync.steps;
+  time_sync["epoch_s"] = sync.epoch_s;
+#if DEEP_SLEEP_MODE
+  DeepSleepStats sleep = deepSleepStats();
+  JsonObject deep = doc.createNestedObject("deep_sleep");
+  deep["wakes"] = sleep.wakes;
+  deep["radio_wakes"] = sleep.radio_wakes;
+  deep["awake_avg_ms"] = sleep.awake_ms / sleep.wakes;
+#endif
+  doc["tick_late_us"] = powerTickLateUs();
+  doc["tick_max_late_us"] = powerStats().max_late_us;
+#if LOCAL_SERVER
+  LocalServerStats local = localServerStats();
+  JsonObject server = doc.createNestedObject("local_server");
+  server["clients"] = local.clients;
+  server["requests"] = local.requests;
+  server["events"] = local.events;
+  server["dropped"] = local.dropped;
+  server["rejected"] = local.rejected;
+#endif
+#if ZONE_FILTER
+  JsonArray filter = doc.createNestedArray("filter");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    ZoneFilterStats fs = filterStats(z);
+    JsonObject f = filter.createNestedObject();
+    f["zone_id"] = zone_ids[z];
+    f["gain"] = fs.gain;
+    f["outliers"] = fs.outliers;
+    f["steps"] = fs.steps;
+    f["updates"] = fs.updates;
+  }
+#endif
+  stampPublish(doc, telemetryNextSeq(STREAM_DIAGNOSTICS));
+
+  serializeJson(doc, msg, sizeof(msg));
+  mqttPublish(diagnostics_topic, msg);
+  Serial.print("Diagnostics: ");
+  Serial.println(msg);
+}
+
+// Publishes each zone's INA219 profile with its conversion time and the
+// noise floor measured under it, so profiles can be compared from data
+void publishProfiles() {
+  DynamicJsonDocument doc(768);
+  doc["node_id"] = nodeId();
+  JsonObject profiles = doc.createNestedObject("profiles");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    InaProfile profile = inaProfile(z);
+    JsonObject entry = profiles.createNestedObject(zone_ids[z]);
+    entry["range"] = inaRangeName(profile.range);
+    entry["adc_bits"] = profile.adc_bits;
+    entry["adc_samples"] = profile.adc_samples;
+    entry["conversion_us"] = inaConversionUs(z);
+    entry["noise_mA"] = inaNoiseFloor_mA(z);
+    entry["noise_samples"] = inaNoiseSamples(z);
+    entry["auto_range"] = inaAutoRangeEnabled(z);
+    entry["range_switches"] = inaRangeSwitches(z);
+  }
+  stampPublish(doc, telemetryNextSeq(STREAM_PROFILES));
+
+  serializeJson(doc, msg, sizeof(msg));
+  mqttPublish(profiles_topic, msg);
+  Serial.print("Profiles: ");
+  Serial.println(msg);
+}
+
+// Publishes queued shed/reclose events after the relays were driven
+void publishProtectionEvents() {
+  ProtectionEvent event;
+  while (client.connected() && protectionPopEvent(&event)) {
+    StaticJsonDocument<256> doc;
+    doc["node_id"] = nodeId();
+    doc["zone_id"] = zone_ids[event.zone];
+    doc["event"] = event.shed ? "shed" : "reclose";
+    doc["timestamp"] = event.at_ms;
+    doc["current_mA"] = event.current_mA;
+    doc["trip_mA"] = protectionSettings(event.zone).trip_mA;
+    doc["latency_us"] = event.latency_us;
+    stampPublish(doc, telemetryNextSeq(STREAM_PROTECTION));
+
+    serializeJson(doc, msg, sizeof(msg));
+    mqttPublish(zone_protection_topics[event.zone], msg);
+
+    Serial.print("Protection event: ");
+    Serial.println(msg);
+  }
+}
+
+// State of charge of every battery zone for the window just closed,
+// retained on <site>/<node>/<zone>/battery
+void publishBattery() {
+  for (uint8_t z = 0; z < ZONE_COUNT && client.connected(); z++) {
+    if (!batteryZone(z)) {
+      continue;
+    }
+    const BatteryWindow& w = batteryLatest(z);
+    StaticJsonDocument<512> doc;
+    doc["node_id"] = nodeId();
+    doc["zone_id"] = zone_ids[z];
+    doc["soc_pct"] = w.soc * 100.0f;
+    doc["remaining_mAh"] = w.remaining_mAh;
+    doc["capacity_mAh"] = config().batteries[z].capacity_mAh;
+    doc["state"] = batteryModeName(w.mode);
+    doc["current_mA"] = w.mean_mA;
+    doc["voltage_V"] = w.voltage_V;
+    doc["discharged_mAh"] = w.discharged_mAh;
+    doc["charged_mAh"] = w.charged_mAh;
+    if (w.time_to_empty_s >= 0) {
+      doc["time_to_empty_s"] = w.time_to_empty_s;
+    }
+    if (w.time_to_full_s >= 0) {
+      doc["time_to_full_s"] = w.time_to_full_s;
+    }
+    doc["soc_source"] = socSourceName(w.source);
+    doc["corrections"] = w.corrections;
+    if (w.corrections > 0) {
+      doc["last_correction_pct"] = w.last_correction * 100.0f;
+    }
+    stampPublish(doc, telemetryNextSeq(STREAM_BATTERY));
+
+    serializeJson(doc, msg, sizeof(msg));
+    mqttPublish(zone_battery_topics[z], msg, true);
+  }
+}
+
+#if RIPPLE_ANALYSIS
+// Levels and amplitude in the unit of the enclosing key
+void rippleToJson(JsonObject out, const RippleTone& tone) {
+  out["mean"] = tone.mean;
+  out["rms"] = tone.rms;
+  out["peak_to_peak"] = tone.peak_to_peak;
+  out["dominant_Hz"] = tone.freq_Hz;
+  out["dominant_amplitude"] = tone.amplitude;
+}
+
+// Bursts the next attached zone in turn and publishes its ripple on
+// <site>/<node>/<zone>/ripple
+void runRipple() {
+  static uint8_t next_zone = 0;
+  for (uint8_t i = 0; i < ZONE_COUNT; i++) {
+    uint8_t z = (next_zone + i) % ZONE_COUNT;
+    if (!zoneAttached(z)) {
+      continue;
+    }
+    next_zone = z + 1;
+    if (!rippleBurst(z)) {
+      Serial.print("Ripple burst failed on zone");
+      Serial.println(z + 1);
+      return;
+    }
+    if (!client.connected()) {
+      return;
+    }
+    const RippleResult& r = rippleLatest(z);
+    StaticJsonDocument<512> doc;
+    doc["node_id"] = nodeId();
+    doc["zone_id"] = zone_ids[z];
+    doc["points"] = RIPPLE_POINTS;
+    doc["sample_rate_Hz"] = r.sample_rate_Hz;
+    doc["resolution_Hz"] = r.sample_rate_Hz / RIPPLE_POINTS;
+    doc["max_late_us"] = r.max_late_us;
+    doc["analyze_us"] = r.analyze_us;
+    rippleToJson(doc.createNestedObject("voltage_V"), r.voltage);
+    rippleToJson(doc.createNestedObject("current_mA"), r.current);
+    stampPublish(doc, telemetryNextSeq(STREAM_RIPPLE));
+
+    serializeJson(doc, msg, sizeof(msg));
+    mqttPublish(zone_ripple_topics[z], msg);
+    Serial.print("Ripple: ");
+    Serial.println(msg);
+    return;
+  }
+}
+#endif
+
+// Publish slot: everything buffered so far is due to go out, and the
+// window aggregates and battery windows roll over
+void queueBuffered() {
+  send_through_seq = sampleBufferSeq(sampleBufferCount());
+  aggregateClose();
+  batteryWindowClose();
+  publishBattery();
+#if LOCAL_SERVER
+  localServerWindowClosed();
+#endif
+}
+
+// Re-sizes the batch from the ack RTT, retransmits and RSSI seen so far;
+// the publish period follows it
+void adaptBatch() {
+#if BATCH_ADAPTIVE
+  if (!client.connected()) {
+    return;
+  }
+  AckStats acks = ackWindowStats();
+  uint32_t period = batchUpdate(acks.srtt_ms, acks.retransmits, WiFi.RSSI()) * config().sample_interval_ms;
+  if (period != schedulePeriod()) {
+    scheduleSetPeriod(period, telemetryUptimeMs());
+    Serial.print("Batch: ");
+    Serial.print(batchSamples());
+    Serial.print(" samples per publish, link ");
+    Serial.println(linkQualityName(batchState().link));
+  }
+#endif
+}
+
+bool sendsPending() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (next_send_seq[z] < send_through_seq) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Moves to the failback broker once nothing is in flight, so the move
+// costs no retransmissions. The fallback's retained status is cleared
+// rather than left saying online.
+void failBack() {
+  if (brokerFailbackTarget() < 0 || !client.connected() || sendsPending() || ackWindowInFlight() > 0) {
+    return;
+  }
+  Serial.print("Failing back to ");
+  Serial.println(brokerHealth(brokerFailbackTarget()).server);
+  mqttPublish(status_topic, (const uint8_t*)"", 0, true);
+  client.disconnect();
+  brokerDisconnected();
+  lastReconnectAttempt = 0;
+}
+
+// Resends zone messages whose ack timed out, sends queued samples while
+// the ack window has room, and drops samples every zone has had acked
+void pumpPublishes() {
+  uint32_t now = millis();
+  uint8_t zone;
+  uint32_t first_seq, last_seq;
+  while (client.connected() && ackWindowDue(now, &zone, &first_seq, &last_seq)) {
+    if (publishZoneData(zone, first_seq, last_seq) == ZONE_PUBLISH_EMPTY) {
+      // Overwritten in the ring meanwhile; nothing left to deliver
+      ackWindowAck(zone, last_seq, now);
+    }
+  }
+
+  for (uint8_t z = 0; z < ZONE_COUNT && client.connected() && !ackWindowFull(); z++) {
+    if (next_send_seq[z] >= send_through_seq) {
+      continue;
+    }
+    ZonePublish result = publishZoneData(z, next_send_seq[z], send_through_seq - 1);
+    if (result == ZONE_PUBLISH_FAILED) {
+      break;
+    }
+    if (result == ZONE_PUBLISH_SENT) {
+      ackWindowSent(z, next_send_seq[z], send_through_seq - 1, now);
+    }
+    next_send_seq[z] = send_through_seq;
+  }
+
+  uint32_t base = sampleBufferSeq(0);
+  uint32_t acked = ackWindowAckedThrough(0, next_send_seq[0]);
+  for (uint8_t z = 1; z < ZONE_COUNT; z++) {
+    acked = min(acked, ackWindowAckedThrough(z, next_send_seq[z]));
+  }
+  if (acked > base) {
+    sampleBufferDrop(min((uint32_t)sampleBufferCount(), acked - base));
+  }
+}
+
+// Echoes the active config, retained, on <site>/<node>/config
+void publishConfig() {
+  DynamicJsonDocument doc(2048);
+  configToJson(doc.to<JsonObject>());
+  doc["node_id"] = nodeId();
+  doc["boot_id"] = telemetryBootId();
+  serializeJson(doc, msg, sizeof(msg));
+  if (mqttPublish(config_topic, msg, true)) {
+    config_echo_due = false;
+  }
+}
+
+// A first sync or a clock step renumbers the ticks; like a new sample
+// interval it waits until the buffered samples have gone out
+void applyTimeSyncStep() {
+  if (timeSyncStepPending() && sampleBufferCount() == 0) {
+    timeSyncApplyStep();
+  }
+}
+
+// Applies a staged config between two ticks, so a tick never runs with
+// half of it. A new sample interval waits until the buffer has drained:
+// buffered samples are timestamped from their tick on the current grid.
+void applyPendingConfig() {
+  if (!configPending()) {
+    return;
+  }
+  RuntimeConfig old = config();
+  const RuntimeConfig& next = configStaged();
+  if (next.sample_interval_ms != old.sample_interval_ms && sampleBufferCount() > 0) {
+    return;
+  }
+  if (!configCommit()) {
+    return;
+  }
+
+  const RuntimeConfig& cfg = config();
+  configureZones();
+  ackWindowSetSize(cfg.ack_window);
+  if (cfg.sample_interval_ms != old.sample_interval_ms) {
+    powerSetInterval(cfg.sample_interval_ms);
+  }
+  if (cfg.sample_interval_ms != old.sample_interval_ms ||
+      cfg.samples_per_publish != old.samples_per_publish ||
+      cfg.batch_min_latency_ms != old.batch_min_latency_ms ||
+      cfg.batch_max_latency_ms != old.batch_max_latency_ms) {
+    beginBatching();
+    scheduleSetPeriod(cfg.sample_interval_ms * batchSamples(), telemetryUptimeMs());
+  }
+  if (strcmp(cfg.mqtt_server, old.mqtt_server) != 0 || cfg.mqtt_port != old.mqtt_port ||
+      memcmp(cfg.backups, old.backups, sizeof(cfg.backups)) != 0) {
+    configureBrokers();
+    // Off a broker that left the list; the next attempt goes by the new one
+    if (client.connected() && brokerActive() < 0) {
+      client.disconnect();
+    }
+  }
+  config_echo_due = true;
+
+  Serial.print("Config revision ");
+  Serial.print(configRevision());
+  Serial.print(" applied: sample interval ");
+  Serial.print(cfg.sample_interval_ms);
+  Serial.print("ms, broker ");
+  Serial.print(cfg.mqtt_server);
+  Serial.print(":");
+  Serial.println(cfg.mqtt_port);
+}
+
+#if LOW_POWER_MODE
+// Brings the radio up, flushes the buffer in one MQTT session and powers
+// the radio back down. On failure the samples wait for the next window.
+bool publishWindow() {
+  bool ok = false;
+  // Pick up retained control messages (protection thresholds), and the
+  // time reply on a local network
+  if (powerRadioOn(ssid, password, WIFI_CONNECT_TIMEOUT_MS) &&
+      connectAnyBroker() && subscribeControlTopics()) {
+    requestTime();
+    unsigned long start = millis();
+    while (millis() - start < 100) {
+      client.loop();
+      delay(5);
+    }
+
+    // A config staged in the last window was applied since; echo it now
+    if (config_echo_due) {
+      publishConfig();
+    }
+    publishAlarms();
+    if (discoveryTakeChanged()) {
+      publishZones();
+    }
+    // Stay up for the acks; whatever is still unacked after a timeout is
+    // sent again in the next window
+    queueBuffered();
+    unsigned long sent_at = millis();
+    do {
+      client.loop();
+      pumpPublishes();
+      delay(5);
+    } while ((sendsPending() || ackWindowInFlight() > 0) && client.connected() &&
+             millis() - sent_at < ACK_TIMEOUT_MS);
+    adaptBatch();
+    publishProtectionEvents();
+    publishI2cStats();
+    publishProfiles();
+    // A failback found here takes effect at the next window
+    while (probeFailback()) {
+      delay(5);
+    }
+    publishStatus("sleeping");
+    client.loop();
+    transportClient().flush();
+    client.disconnect();
+    brokerDisconnected();
+    ok = true;
+  } else {
+    Serial.print("Publish window failed, rc=");
+    Serial.print(client.state());
+    Serial.print(", buffered samples: ");
+    Serial.println(sampleBufferCount());
+  }
+  powerRadioOff();
+
+  PowerStats stats = powerStats();
+  Serial.print("Duty: light sleep ");
+  Serial.print(100.0 * stats.light_sleep_us / stats.uptime_us);
+  Serial.print("%, radio on ");
+  Serial.print(100.0 * stats.radio_on_us / stats.uptime_us);
+  Serial.print("%, missed ticks ");
+  Serial.println(stats.missed_ticks);
+  return ok;
+}
+#endif
+
+#if DEEP_SLEEP_MODE
+// Where this wake stands, for wakePlan()
+WakeState wakeState(bool window_done, bool window_failed) {
+  const RuntimeConfig& cfg = config();
+  WakeState s;
+  s.now_us = powerClockMicros();
+  s.planned_us = deepSleepPlannedWakeUs();
+  s.next_tick_us = powerNextTickUs();
+  s.next_tick = powerNextTick();
+  s.samples_per_publish = cfg.samples_per_publish;
+  s.phase_tick = schedulePhase() / cfg.sample_interval_ms;
+  s.flags = deepSleepFlags();
+  s.window_done = window_done;
+  s.window_failed = window_failed;
+  s.echo_due = config_echo_due;
+  s.alarms_pending = alarmsPending();
+  s.filled = sampleBufferCount() >= SAMPLE_BUFFER_CAPACITY && sampleBufferOverflows() == wake_overflows;
+  return s;
+}
+
+// Ends a wake as wakePlan() decides: returns to sample a close tick, or
+// publishes if this wake has the radio and sleeps
+void sleepDeep() {
+  static bool window_done = false;
+  static bool window_failed = false;
+  WakePlan plan = wakePlan(wakeState(window_done, window_failed));
+  if (plan.action == WAKE_PUBLISH) {
+    window_done = true;
+    window_failed = !publishWindow();
+    // A config received in the window would be lost with the reset
+    applyPendingConfig();
+    applyTimeSyncStep();
+    // The window may have run into the next tick
+    plan = wakePlan(wakeState(window_done, window_failed));
+  }
+  if (plan.action == WAKE_SLEEP) {
+    deepSleepUntil(plan.wake_us, plan.flags);
+  }
+}
+#endif
+
 void loop() {
+#if !LOW_POWER_MODE
+  if (millis() - lastProtectionCheck >= PROTECTION_INTERVAL_MS) {
+    lastProtectionCheck = millis();
+    checkZones();
+  }
+
   if (!client.connected()) {
+    if (brokerActive() >= 0) {
+      // Session lost: try again straight away, the next broker if this
+      // one doesn't answer
+      brokerDisconnected();
+      lastReconnectAttempt = 0;
+    }
     reconnect();
   }
   client.loop();
+  publishAlarms();
+  publishProtectionEvents();
+  if (config_echo_due && client.connected()) {
+    publishConfig();
+  }
+  if (client.connected()) {
+    requestTime();
+  }
+#endif
 
-  long now = millis();
-  if (now - lastMsg > 5000) {  // Publish every 5 seconds
-    lastMsg = now;
-    
-    // Read all INA219 sensor values
-    zone1_data.current_mA = ina219_zone1.getCurrent_mA();
-    zone1_data.power_mW = ina219_zone1.getPower_mW();
-    zone1_data.busvoltage = ina219_zone1.getBusVoltage_V();
-    
-    zone2_data.current_mA = ina219_zone2.getCurrent_mA();
-    zone2_data.power_mW = ina219_zone2.getPower_mW();
-    zone2_data.busvoltage = ina219_zone2.getBusVoltage_V();
-    
-    zone3_data.current_mA = ina219_zone3.getCurrent_mA();
-    zone3_data.power_mW = ina219_zone3.getPower_mW();
-    zone3_data.busvoltage = ina219_zone3.getBusVoltage_V();
-    
-    // Publish data for all three zones
-    publishZoneData("zone1", "/node1/zone1", zone1_data, now);
-    publishZoneData("zone2", "/node1/zone2", zone2_data, now);
-    publishZoneData("zone3", "/node1/zone3", zone3_data, now);
+  // Between ticks: the last one is done, the next one starts on the new config
+  applyPendingConfig();
+  applyTimeSyncStep();
+
+  uint32_t tick;
+  if (powerTickDue(&tick)) {
+    if (zonesAttached() < ZONE_COUNT && tick % DISCOVERY_EVERY_TICKS == 0) {
+      discoveryScan();
+    }
+    sampleZones(tick);
+    if (first_sample_ms == 0) {
+      first_sample_ms = millis();
+      Serial.print("First sample after ");
+      Serial.print(first_sample_ms);
+      Serial.println("ms");
+    }
+
+#if DEEP_SLEEP_MODE
+    // Windows open on radio wakes only, at the end of the wake (sleepDeep)
+#elif LOW_POWER_MODE
+    // Publish slots are only checked at ticks, so the phase is effectively
+    // rounded up to the sample grid. Alarms open a window straight away,
+    // and a full buffer does rather than overwrite samples. After a failed
+    // window only the slots retry, as in sleepDeep(), so a missing AP or
+    // broker doesn't keep the radio on at every tick; the tick that fills
+    // the buffer still gets its one try.
+    static bool window_failed = false;
+    static uint32_t failed_overflows = 0;
+    bool slot_due = schedulePublishDue(telemetryUptimeMs());
+    bool full = sampleBufferCount() >= SAMPLE_BUFFER_CAPACITY &&
+                (!window_failed || sampleBufferOverflows() == failed_overflows);
+    if (slot_due || full || (alarmsPending() && !window_failed)) {
+      window_failed = !publishWindow();
+      failed_overflows = sampleBufferOverflows();
+    }
+#else
+    if (tick % config().diagnostics_every_ticks == 0 && client.connected()) {
+      publishI2cStats();
+      publishProfiles();
+    }
+#if RIPPLE_ANALYSIS
+    if (tick % RIPPLE_EVERY_TICKS == 0) {
+      runRipple();
+    }
+#endif
+#endif
     
     // Summary debug output
-    Serial.println("=== All Zones Published ===");
-    Serial.print("Zone1: ");
-    Serial.print(zone1_data.current_mA);
-    Serial.print("mA, ");
-    Serial.print(zone1_data.busvoltage);
-    Serial.print("V, ");
-    Serial.print(zone1_data.power_mW);
-    Serial.println("mW");
-    
-    Serial.print("Zone2: ");
-    Serial.print(zone2_data.current_mA);
-    Serial.print("mA, ");
-    Serial.print(zone2_data.busvoltage);
-    Serial.print("V, ");
-    Serial.print(zone2_data.power_mW);
-    Serial.println("mW");
-    
-    Serial.print("Zone3: ");
-    Serial.print(zone3_data.current_mA);
-    Serial.print("mA, ");
-    Serial.print(zone3_data.busvoltage);
-    Serial.print("V, ");
-    Serial.print(zone3_data.power_mW);
-    Serial.println("mW");
+    Serial.println("=== All Zones Sampled ===");
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+      Serial.print("Zone");
+      Serial.print(z + 1);
+      Serial.print(": ");
+      Serial.print(zone_data[z].current_mA);
+      Serial.print("mA, ");
+      Serial.print(zone_data[z].busvoltage);
+      Serial.print("V, ");
+      Serial.print(zone_data[z].power_mW);
+      Serial.println("mW");
+    }
     Serial.println("===========================");
     Serial.println();
   }
-}
\ No newline at end of file
+
+#if DEEP_SLEEP_MODE
+  sleepDeep();
+#elif LOW_POWER_MODE
+  powerSleepUntilNextTick();
+#else
+  // Samples wait for this node's publish slot, then go out as the ack
+  // window allows
+  if (schedulePublishDue(telemetryUptimeMs())) {
+    queueBuffered();
+    adaptBatch();
+  }
+  pumpPublishes();
+  if (client.connected()) {
+    probeFailback();
+    failBack();
+  }
+
+  // After the tick so the first list already carries first_sample_ms
+  if (client.connected() && discoveryTakeChanged()) {
+    publishZones();
+  }
+#endif
+}
@@ -0,0 +1,107 @@
+#include "mqtt_transport.h"
+
+#include <ESP8266WiFi.h>
+
+#if MQTT_TLS
+#include <WiFiClientSecureBearSSL.h>
+#include <umm_malloc/umm_malloc.h>
+
+static BearSSL::WiFiClientSecure& secureClient() {
+  static BearSSL::WiFiClientSecure secure;
+  return secure;
+}
+
+static BearSSL::Session session;
+static const char* const* pins = nullptr;
+static uint8_t pin_count = 0;
+static uint8_t session_id[32];
+static uint8_t session_id_len = 0;
+#endif
+
+static TransportStats stats;
+static uint32_t connect_start_ms = 0;
+
+Client& transportClient() {
+#if MQTT_TLS
+  return secureClient();
+#else
+  static WiFiClient plain;
+  return plain;
+#endif
+}
+
+void transportBegin(const char* const* fingerprints, uint8_t count) {
+  stats.tls = MQTT_TLS;
+#if MQTT_TLS
+  pins = fingerprints;
+  pin_count = count;
+  stats.fingerprint = 0;
+  if (pin_count > 0) {
+    secureClient().setFingerprint(pins[0]);
+  }
+  secureClient().setSession(&session);
+#endif
+}
+
+uint16_t transportPort() {
+#if MQTT_TLS
+  return MQTT_TLS_PORT;
+#elif MQTT_SN
+  return MQTTSN_PORT;
+#else
+  return MQTT_PORT;
+#endif
+}
+
+void transportConnectStart() {
+  connect_start_ms = millis();
+  stats.free_heap = ESP.getFreeHeap();
+#if MQTT_TLS
+  umm_free_heap_size_min_reset();
+  br_ssl_session_parameters* params = session.getSession();
+  session_id_len = params->session_id_len;
+  memcpy(session_id, params->session_id, session_id_len);
+#endif
+}
+
+void transportConnectDone(bool ok) {
+  uint32_t elapsed = millis() - connect_start_ms;
+#if MQTT_TLS
+  stats.handshake_min_heap = umm_free_heap_size_min();
+#else
+  stats.handshake_min_heap = min(stats.free_heap, ESP.getFreeHeap());
+#endif
+  if (!ok) {
+    stats.failures++;
+#if MQTT_TLS
+    stats.last_error = secureClient().getLastSSLError();
+    // Try the next pin in case the broker certificate was rotated
+    if (stats.last_error == BR_ERR_X509_NOT_TRUSTED && pin_count > 1) {
+      stats.fingerprint = (stats.fingerprint + 1) % pin_count;
+      secureClient().setFingerprint(pins[stats.fingerprint]);
+    }
+#endif
+    return;
+  }
+  stats.connects++;
+  stats.last_connect_ms = elapsed;
+  stats.max_connect_ms = max(stats.max_connect_ms, elapsed);
+#if MQTT_TLS
+  // The broker echoes the offered session id only when it resumes it
+  br_ssl_session_parameters* params = session.getSession();
+  if (session_id_len > 0 && params->session_id_len == session_id_len &&
+      memcmp(params->session_id, session_id, session_id_len) == 0) {
+    stats.resumed++;
+  }
+#endif
+}
+
+void transportPublished(uint32_t elapsed_us) {
+  stats.publishes++;
+  stats.publish_us += elapsed_us;
+  stats.publish_max_us = max(stats.publish_max_us, elapsed_us);
+}
+
+TransportStats transportStats() {
+  return stats;
+}
@@ -0,0 +1,609 @@
+#include "mqttsn_client.h"
+
+#if MQTT_SN
+
+#include <ESP8266WiFi.h>
+#include <lwip/dns.h>
+
+// Message types
+#define SN_CONNECT 0x04
+#define SN_CONNACK 0x05
+#define SN_WILLTOPICREQ 0x06
+#define SN_WILLTOPIC 0x07
+#define SN_WILLMSGREQ 0x08
+#define SN_WILLMSG 0x09
+#define SN_REGISTER 0x0A
+#define SN_REGACK 0x0B
+#define SN_PUBLISH 0x0C
+#define SN_PUBACK 0x0D
+#define SN_SUBSCRIBE 0x12
+#define SN_SUBACK 0x13
+#define SN_PINGREQ 0x16
+#define SN_PINGRESP 0x17
+#define SN_DISCONNECT 0x18
+
+// Flags
+#define SN_FLAG_RETAIN 0x10
+#define SN_FLAG_WILL 0x08
+#define SN_FLAG_CLEAN 0x04
+#define SN_TOPIC_NORMAL 0x00
+#define SN_TOPIC_PREDEFINED 0x01
+#define SN_QOS(flags) (((flags) >> 5) & 0x03)
+
+#define SN_PROTOCOL_ID 0x01
+#define SN_DEFAULT_BUFFER 256
+
+static const char* const NODE_TOPICS[] = {
+  "status", "zones", "diagnostics", "profiles", "config", "config/set", "ack", "schedule",
+  "time", "time/req",
+};
+static const uint8_t NODE_TOPIC_COUNT = sizeof(NODE_TOPICS) / sizeof(NODE_TOPICS[0]);
+static const char* const ZONE_TOPICS[] = {"", "control", "protection", "battery", "ripple"};
+static const uint8_t ZONE_TOPIC_COUNT = sizeof(ZONE_TOPICS) / sizeof(ZONE_TOPICS[0]);
+
+static uint16_t getWord(const uint8_t* p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint8_t* putWord(uint8_t* p, uint16_t value) {
+  p[0] = value >> 8;
+  p[1] = value & 0xFF;
+  return p + 2;
+}
+
+MqttSnClient& MqttSnClient::setServer(const char* server, uint16_t server_port) {
+  host = server;
+  port = server_port;
+  return *this;
+}
+
+MqttSnClient& MqttSnClient::setCallback(Callback cb) {
+  callback = cb;
+  return *this;
+}
+
+MqttSnClient& MqttSnClient::setKeepAlive(uint16_t seconds) {
+  keepalive_ms = seconds * 1000UL;
+  return *this;
+}
+
+MqttSnClient& MqttSnClient::setSocketTimeout(uint16_t seconds) {
+  timeout_ms = seconds * 1000UL;
+  return *this;
+}
+
+bool MqttSnClient::setBufferSize(uint16_t size) {
+  uint8_t* resized = (uint8_t*)realloc(buffer, size);
+  if (resized == nullptr) {
+    return false;
+  }
+  buffer = resized;
+  buffer_size = size;
+  return true;
+}
+
+// Writes the header of a message with a body of the given size; returns
+// the header size, 0 if the message doesn't fit the buffer
+size_t MqttSnClient::frame(uint8_t type, size_t body) {
+  size_t total = body + 2;
+  if (total > 255) {
+    total = body + 4;
+  }
+  if (total > buffer_size || total > 0xFFFF) {
+    return 0;
+  }
+  if (total > 255) {
+    buffer[0] = 0x01;
+    putWord(buffer + 1, total);
+    buffer[3] = type;
+    return 4;
+  }
+  buffer[0] = total;
+  buffer[1] = type;
+  return 2;
+}
+
+bool MqttSnClient::send(size_t length) {
+  if (!udp.beginPacket(gateway, port)) {
+    return false;
+  }
+  udp.write(buffer, length);
+  bool ok = udp.endPacket();
+  if (ok) {
+    counters.datagrams_out++;
+    counters.bytes_out += length;
+    last_out_ms = millis();
+  }
+  return ok;
+}
+
+// Reads and handles one datagram from the gateway; returns its message
+// type (0: nothing), with the first bytes of its body in reply
+int MqttSnClient::receive() {
+  int size = udp.parsePacket();
+  if (size <= 0) {
+    return 0;
+  }
+  if (udp.remoteIP() != gateway || udp.remotePort() != port || size > buffer_size) {
+    return 0;
+  }
+  size = udp.read(buffer, size);
+  size_t header = buffer[0] == 0x01 ? 4 : 2;
+  size_t length = header == 4 ? getWord(buffer + 1) : buffer[0];
+  if (size < (int)header || length < header || length > (size_t)size) {
+    return 0;
+  }
+  counters.datagrams_in++;
+  counters.bytes_in += length;
+  last_in_ms = millis();
+  uint8_t type = buffer[header - 1];
+  memcpy(reply, buffer + header, min(sizeof(reply), length - header));
+  handle(type, buffer + header, length - header);
+  return type;
+}
+
+void MqttSnClient::handle(uint8_t type, uint8_t* body, size_t length) {
+  switch (type) {
+    case SN_PUBLISH: {
+      if (length < 5) {
+        return;
+      }
+      uint8_t flags = body[0];
+      uint16_t topic_id = getWord(body + 1);
+      uint16_t publish_msg_id = getWord(body + 3);
+      char topic[TOPIC_LEN];
+      topic[0] = '\0';
+      if ((flags & 0x03) == SN_TOPIC_PREDEFINED) {
+        predefinedName(topic_id, topic, sizeof(topic));
+      } else {
+        for (uint8_t i = 0; i < topic_count; i++) {
+          if (topics[i].id == topic_id) {
+            strlcpy(topic, topics[i].name, sizeof(topic));
+            break;
+          }
+        }
+      }
+      if (topic[0] != '\0' && callback) {
+        callback(topic, body + 5, length - 5);
+      }
+      if (SN_QOS(flags) == 1) {
+        size_t at = frame(SN_PUBACK, 5);
+        uint8_t* p = putWord(putWord(buffer + at, topic_id), publish_msg_id);
+        *p = topic[0] != '\0' ? 0x00 : 0x02;  // 2: invalid topic id
+        send(at + 5);
+      }
+      break;
+    }
+    case SN_REGISTER: {
+      // Topic ids the gateway assigns on its own, e.g. for wildcards
+      if (length < 5) {
+        return;
+      }
+      uint16_t topic_id = getWord(body);
+      uint16_t register_msg_id = getWord(body + 2);
+      char name[TOPIC_LEN];
+      size_t name_len = min(length - 4, sizeof(name) - 1);
+      memcpy(name, body + 4, name_len);
+      name[name_len] = '\0';
+      Topic* t = findTopic(name);
+      if (t == nullptr) {
+        t = addTopic(name);
+      }
+      if (t) {
+        t->id = topic_id;
+      }
+      size_t at = frame(SN_REGACK, 5);
+      uint8_t* p = putWord(putWord(buffer + at, topic_id), register_msg_id);
+      *p = t ? 0x00 : 0x01;  // 1: congestion
+      send(at + 5);
+      break;
+    }
+    case SN_SUBACK: {
+      if (length < 6) {
+        return;
+      }
+      uint16_t subscribe_msg_id = getWord(body + 3);
+      for (uint8_t i = 0; i < topic_count; i++) {
+        if (topics[i].msg_id == subscribe_msg_id) {
+          topics[i].msg_id = 0;
+          if (body[5] == 0x00) {
+            topics[i].id = getWord(body + 1);
+          }
+          break;
+        }
+      }
+      break;
+    }
+    case SN_PINGREQ: {
+      size_t at = frame(SN_PINGRESP, 0);
+      send(at);
+      break;
+    }
+    case SN_PINGRESP:
+      ping_outstanding = false;
+      break;
+    case SN_DISCONNECT:
+      if (state_ == MQTTSN_CONNECTED) {
+        state_ = MQTTSN_CONNECTION_LOST;
+      }
+      break;
+  }
+}
+
+// Handles datagrams until the ack of the given type for msg id arrives
+// (its msg id at id_at in the body) or wait_ms runs out
+bool MqttSnClient::await(uint8_t type, size_t id_at, uint16_t id, uint32_t wait_ms) {
+  uint32_t start = millis();
+  while (millis() - start < wait_ms) {
+    int received = receive();
+    if (received == type && getWord(reply + id_at) == id) {
+      return true;
+    }
+    if (received == SN_DISCONNECT) {
+      return false;
+    }
+    if (received == 0) {
+      delay(1);
+    }
+  }
+  return false;
+}
+
+uint16_t MqttSnClient::predefinedId(const char* topic) const {
+  if (root_len == 0 || strncmp(topic, root, root_len) != 0) {
+    return 0;
+  }
+  const char* suffix = topic + root_len;
+  for (uint8_t i = 0; i < NODE_TOPIC_COUNT; i++) {
+    if (strcmp(suffix, NODE_TOPICS[i]) == 0) {
+      return i + 1;
+    }
+  }
+  if (strncmp(suffix, "zone", 4) != 0 || !isdigit(suffix[4])) {
+    return 0;
+  }
+  char* rest;
+  unsigned long zone = strtoul(suffix + 4, &rest, 10);
+  if (zone == 0 || zone > 0xFF) {
+    return 0;
+  }
+  if (*rest == '\0') {
+    return zone << 8;
+  }
+  if (*rest != '/') {
+    return 0;
+  }
+  for (uint8_t k = 1; k < ZONE_TOPIC_COUNT; k++) {
+    if (strcmp(rest + 1, ZONE_TOPICS[k]) == 0) {
+      return zone << 8 | k;
+    }
+  }
+  return 0;
+}
+
+bool MqttSnClient::predefinedName(uint16_t id, char* out, size_t size) const {
+  if (id >= 1 && id <= NODE_TOPIC_COUNT) {
+    snprintf(out, size, "%s%s", root, NODE_TOPICS[id - 1]);
+    return true;
+  }
+  uint8_t k = id & 0xFF;
+  if (id < 0x100 || k >= ZONE_TOPIC_COUNT) {
+    return false;
+  }
+  snprintf(out, size, "%szone%u%s%s", root, id >> 8, k ? "/" : "", ZONE_TOPICS[k]);
+  return true;
+}
+
+MqttSnClient::Topic* MqttSnClient::findTopic(const char* name) {
+  for (uint8_t i = 0; i < topic_count; i++) {
+    if (strcmp(topics[i].name, name) == 0) {
+      return &topics[i];
+    }
+  }
+  return nullptr;
+}
+
+MqttSnClient::Topic* MqttSnClient::addTopic(const char* name) {
+  if (topic_count >= MQTTSN_TOPICS) {
+    return nullptr;
+  }
+  Topic& t = topics[topic_count++];
+  strlcpy(t.name, name, sizeof(t.name));
+  t.id = 0;
+  t.msg_id = 0;
+  return &t;
+}
+
+uint16_t MqttSnClient::nextMsgId() {
+  if (++msg_id == 0) {
+    msg_id = 1;
+  }
+  return msg_id;
+}
+
+// REGISTER/REGACK for a topic without a predefined id, sent up to
+// MQTTSN_RETRIES times until the REGACK with its msg id arrives; 0 if it
+// failed
+uint16_t MqttSnClient::registerTopic(const char* name) {
+  Topic* t = findTopic(name);
+  if (t == nullptr) {
+    t = addTopic(name);
+  }
+  if (t == nullptr) {
+    return 0;
+  }
+  size_t name_len = strlen(name);
+  uint16_t id = nextMsgId();
+  for (uint8_t attempt = 0; attempt < MQTTSN_RETRIES; attempt++) {
+    // Replies land in the buffer, so every send frames the request again
+    size_t at = frame(SN_REGISTER, 4 + name_len);
+    if (at == 0) {
+      return 0;
+    }
+    uint8_t* p = putWord(putWord(buffer + at, 0), id);
+    memcpy(p, name, name_len);
+    if (!send(at + 4 + name_len)) {
+      return 0;
+    }
+    if (!await(SN_REGACK, 2, id, timeout_ms / MQTTSN_RETRIES)) {
+      continue;
+    }
+    if (reply[4] != 0x00) {
+      return 0;
+    }
+    t->id = getWord(reply);
+    counters.registrations++;
+    return t->id;
+  }
+  return 0;
+}
+
+bool MqttSnClient::connect(const char* id, const char* will_topic, uint8_t will_qos, bool will_retain,
+                           const char* will_message) {
+  if (buffer == nullptr && !setBufferSize(SN_DEFAULT_BUFFER)) {
+    state_ = MQTTSN_CONNECT_FAILED;
+    return false;
+  }
+  if (host == nullptr || !WiFi.hostByName(host, gateway)) {
+    state_ = MQTTSN_CONNECT_FAILED;
+    return false;
+  }
+  if (!udp_open) {
+    udp_open = udp.begin(0);
+  }
+  // Stale datagrams from a previous session
+  while (udp.parsePacket() > 0) {
+  }
+
+  topic_count = 0;
+  root_len = 0;
+  root[0] = '\0';
+  const char* slash = will_topic ? strrchr(will_topic, '/') : nullptr;
+  if (slash && (size_t)(slash - will_topic) + 1 < sizeof(root)) {
+    root_len = slash - will_topic + 1;
+    memcpy(root, will_topic, root_len);
+    root[root_len] = '\0';
+  }
+
+  size_t id_len = strlen(id);
+  size_t at = frame(SN_CONNECT, 4 + id_len);
+  uint8_t* p = buffer + at;
+  *p++ = (will_topic ? SN_FLAG_WILL : 0) | SN_FLAG_CLEAN;
+  *p++ = SN_PROTOCOL_ID;
+  p = putWord(p, keepalive_ms / 1000);
+  memcpy(p, id, id_len);
+  state_ = MQTTSN_DISCONNECTED;
+  if (!send(at + 4 + id_len)) {
+    state_ = MQTTSN_CONNECT_FAILED;
+    return false;
+  }
+
+  uint32_t start = millis();
+  while (millis() - start < timeout_ms) {
+    int type = receive();
+    if (type == SN_WILLTOPICREQ) {
+      size_t topic_len = strlen(will_topic);
+      at = frame(SN_WILLTOPIC, 1 + topic_len);
+      buffer[at] = (will_qos & 0x03) << 5 | (will_retain ? SN_FLAG_RETAIN : 0);
+      memcpy(buffer + at + 1, will_topic, topic_len);
+      send(at + 1 + topic_len);
+    } else if (type == SN_WILLMSGREQ) {
+      size_t message_len = strlen(will_message);
+      at = frame(SN_WILLMSG, message_len);
+      memcpy(buffer + at, will_message, message_len);
+      send(at + message_len);
+    } else if (type == SN_CONNACK) {
+      if (reply[0] != 0x00) {
+        state_ = MQTTSN_CONNECT_FAILED;
+        return false;
+      }
+      state_ = MQTTSN_CONNECTED;
+      ping_outstanding = false;
+      last_in_ms = last_out_ms = millis();
+      return true;
+    } else if (type == 0) {
+      delay(1);
+    }
+  }
+  state_ = MQTTSN_CONNECTION_TIMEOUT;
+  return false;
+}
+
+void MqttSnClient::disconnect() {
+  if (state_ == MQTTSN_CONNECTED) {
+    send(frame(SN_DISCONNECT, 0));
+  }
+  state_ = MQTTSN_DISCONNECTED;
+}
+
+bool MqttSnClient::connected() {
+  return state_ == MQTTSN_CONNECTED;
+}
+
+int MqttSnClient::state() {
+  return state_;
+}
+
+bool MqttSnClient::loop() {
+  if (!connected()) {
+    return false;
+  }
+  // A few datagrams per pass, so a burst doesn't hold up sampling
+  for (uint8_t i = 0; i < 4 && receive() > 0; i++) {
+  }
+  if (!connected()) {
+    return false;
+  }
+  uint32_t now = millis();
+  if (now - last_in_ms > keepalive_ms || now - last_out_ms > keepalive_ms) {
+    if (ping_outstanding) {
+      state_ = MQTTSN_CONNECTION_TIMEOUT;
+      return false;
+    }
+    send(frame(SN_PINGREQ, 0));
+    last_in_ms = now;
+    ping_outstanding = true;
+  }
+  return true;
+}
+
+bool MqttSnClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  uint8_t topic_type = SN_TOPIC_PREDEFINED;
+  uint16_t topic_id = predefinedId(topic);
+  if (topic_id == 0) {
+    topic_type = SN_TOPIC_NORMAL;
+    Topic* t = findTopic(topic);
+    topic_id = t && t->id ? t->id : registerTopic(topic);
+  }
+  if (topic_id == 0) {
+    return false;
+  }
+  size_t at = frame(SN_PUBLISH, 5 + length);
+  if (at == 0) {
+    return false;
+  }
+  uint8_t* p = buffer + at;
+  *p++ = (retained ? SN_FLAG_RETAIN : 0) | topic_type;
+  p = putWord(p, topic_id);
+  p = putWord(p, 0);  // msg id, unused at QoS 0
+  memcpy(p, payload, length);
+  return send(at + 5 + length);
+}
+
+// SUBSCRIBE/SUBACK, retried the same way; false if no SUBACK came or the
+// gateway refused
+bool MqttSnClient::subscribe(const char* topic) {
+  if (!connected()) {
+    return false;
+  }
+  uint16_t topic_id = predefinedId(topic);
+  Topic* t = nullptr;
+  if (topic_id == 0) {
+    // By name: the SUBACK brings the id publishes will arrive with
+    t = findTopic(topic);
+    if (t == nullptr) {
+      t = addTopic(topic);
+    }
+    if (t == nullptr) {
+      return false;
+    }
+  }
+  size_t topic_len = strlen(topic);
+  uint16_t id = nextMsgId();
+  if (t) {
+    t->msg_id = id;
+  }
+  for (uint8_t attempt = 0; attempt < MQTTSN_RETRIES; attempt++) {
+    size_t at = frame(SN_SUBSCRIBE, t ? 3 + topic_len : 5);
+    if (at == 0) {
+      return false;
+    }
+    uint8_t* p = buffer + at;
+    *p++ = t ? SN_TOPIC_NORMAL : SN_TOPIC_PREDEFINED;
+    p = putWord(p, id);
+    size_t length = at + 5;
+    if (t) {
+      memcpy(p, topic, topic_len);
+      length = at + 3 + topic_len;
+    } else {
+      putWord(p, topic_id);
+    }
+    if (!send(length)) {
+      return false;
+    }
+    if (await(SN_SUBACK, 3, id, timeout_ms / MQTTSN_RETRIES)) {
+      return reply[5] == 0x00;
+    }
+  }
+  return false;
+}
+
+// Runs in the network stack once the probe's name is looked up; only the
+// lookup of the current probe counts
+void MqttSnClient::probeResolved(const char* name, const ip_addr_t* address, void* arg) {
+  MqttSnClient* self = (MqttSnClient*)arg;
+  if (self->probe_state != PROBE_RESOLVING || self->probe_host == nullptr ||
+      strcmp(name, self->probe_host) != 0) {
+    return;
+  }
+  if (address == nullptr) {
+    self->probe_state = PROBE_FAILED;
+    return;
+  }
+  self->probe_address = IPAddress(address);
+  self->probe_state = PROBE_RESOLVED;
+}
+
+bool MqttSnClient::probeStart(const char* server, uint16_t server_port) {
+  probeStop();
+  if (!probe_socket.begin(0)) {
+    return false;
+  }
+  probe_host = server;
+  probe_port = server_port;
+  probe_state = PROBE_RESOLVING;
+  ip_addr_t address;
+  err_t err = dns_gethostbyname(server, &address, probeResolved, this);
+  if (err == ERR_OK) {
+    probe_address = IPAddress(&address);
+    probe_state = PROBE_RESOLVED;
+  } else if (err != ERR_INPROGRESS) {
+    probeStop();
+    return false;
+  }
+  return true;
+}
+
+bool MqttSnClient::probeAnswered() {
+  if (probe_state == PROBE_RESOLVED) {
+    const uint8_t ping[] = {0x02, SN_PINGREQ};
+    probe_state = PROBE_FAILED;
+    if (probe_socket.beginPacket(probe_address, probe_port)) {
+      probe_socket.write(ping, sizeof(ping));
+      if (probe_socket.endPacket()) {
+        probe_state = PROBE_PINGED;
+      }
+    }
+    return false;
+  }
+  uint8_t response[2];
+  return probe_state == PROBE_PINGED && probe_socket.parsePacket() == 2 &&
+         probe_socket.remoteIP() == probe_address && probe_socket.read(response, 2) == 2 &&
+         response[1] == SN_PINGRESP;
+}
+
+void MqttSnClient::probeStop() {
+  if (probe_state != PROBE_IDLE) {
+    probe_socket.stop();
+    probe_state = PROBE_IDLE;
+  }
+}
+
+MqttSnStats MqttSnClient::stats() const {
+  return counters;
+}
+
+#endif
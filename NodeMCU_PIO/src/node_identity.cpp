@@ -0,0 +1,96 @@
+#include "node_identity.h"
+
+#include <EEPROM.h>
+
+#define IDENTITY_MAGIC 0x4E4F4449ul  // "IDON"
+
+struct IdentityRecord {
+  uint32_t magic;
+  char node_id[NODE_ID_MAX + 1];
+};
+
+static_assert(sizeof(IdentityRecord) <= IDENTITY_EEPROM_SIZE, "identity record too large");
+static_assert(sizeof(SITE_ID "/esp-xxxxxx/") + TOPIC_SUFFIX_MAX <= TOPIC_LEN,
+              "SITE_ID too long for the node's topics");
+
+// <site>/config/set, <site>/time and <site>/provision/<chip> are site-level
+// topics; a node by one of these names would publish on top of them
+static const char* const reserved_ids[] = {"config", "time", "provision"};
+
+static char node_id[NODE_ID_MAX + 1];
+static char client_id[24];
+static bool provisioned = false;
+
+// Topic level characters only: no separators or wildcards. Every topic
+// <site>/<node>/<suffix> has to fit, or it would be cut short.
+static bool validNodeId(const char* id) {
+  size_t len = strlen(id);
+  if (len > NODE_ID_MAX || strlen(SITE_ID) + len + TOPIC_SUFFIX_MAX + 2 >= TOPIC_LEN) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    char c = id[i];
+    if (!isalnum(c) && c != '-' && c != '_') {
+      return false;
+    }
+  }
+  for (const char* reserved : reserved_ids) {
+    if (strcmp(id, reserved) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void identityBegin() {
+  snprintf(client_id, sizeof(client_id), "microgrid-%06x", ESP.getChipId());
+
+  EEPROM.begin(EEPROM_SIZE);
+  IdentityRecord record;
+  EEPROM.get(IDENTITY_EEPROM_OFFSET, record);
+  record.node_id[NODE_ID_MAX] = '\0';
+
+  provisioned = record.magic == IDENTITY_MAGIC && record.node_id[0] != '\0' &&
+                validNodeId(record.node_id);
+  if (provisioned) {
+    strcpy(node_id, record.node_id);
+  } else {
+    snprintf(node_id, sizeof(node_id), "esp-%06x", ESP.getChipId());
+  }
+}
+
+const char* nodeId() {
+  return node_id;
+}
+
+const char* siteId() {
+  return SITE_ID;
+}
+
+const char* clientId() {
+  return client_id;
+}
+
+uint32_t chipId() {
+  return ESP.getChipId();
+}
+
+bool identityProvisioned() {
+  return provisioned;
+}
+
+void buildTopic(char* out, size_t size, const char* suffix) {
+  snprintf(out, size, "%s/%s/%s", SITE_ID, node_id, suffix);
+}
+
+bool identityProvision(const char* id) {
+  if (!validNodeId(id)) {
+    return false;
+  }
+  IdentityRecord record;
+  memset(&record, 0, sizeof(record));
+  record.magic = id[0] != '\0' ? IDENTITY_MAGIC : 0;
+  strncpy(record.node_id, id, NODE_ID_MAX);
+  EEPROM.put(IDENTITY_EEPROM_OFFSET, record);
+  return EEPROM.commit();
+}
@@ -0,0 +1,189 @@
+#include "power_manager.h"
+
+#include <ESP8266WiFi.h>
+
+extern "C" {
+#include "user_interface.h"
+}
+
+// Wake this long before a tick; the remainder is polled in loop()
+#define WAKE_MARGIN_US 3000
+// Shorter sleeps are not worth the light-sleep entry/exit cost
+#define MIN_SLEEP_US 10000
+
+static uint32_t interval_us = 0;
+static uint32_t next_tick = 0;
+static uint32_t missed_ticks = 0;
+static uint32_t last_late_us = 0;
+static uint32_t max_late_us = 0;
+
+// micros64() does not advance while the CPU clock is gated in light sleep,
+// so the slept time is measured on the RTC clock and added back here.
+static uint64_t sleep_offset_us = 0;
+static uint64_t light_sleep_us = 0;
+
+// Grid clock = power clock + offset + drift since ref (powerSetTimebase())
+static int64_t grid_offset_us = 0;
+static int32_t grid_drift_ppb = 0;
+static uint64_t grid_ref_us = 0;
+
+static bool radio_on = false;
+static uint64_t radio_on_since_us = 0;
+static uint64_t radio_on_us = 0;
+
+void powerBegin(uint32_t sample_interval_ms) {
+  interval_us = sample_interval_ms * 1000UL;
+  next_tick = 0;
+  missed_ticks = 0;
+  radio_on = WiFi.status() == WL_CONNECTED;
+  radio_on_since_us = powerClockMicros();
+}
+
+void powerSetInterval(uint32_t sample_interval_ms) {
+  interval_us = sample_interval_ms * 1000UL;
+  next_tick = powerGridMicros() / interval_us + 1;
+}
+
+uint64_t powerClockMicros() {
+  return micros64() + sleep_offset_us;
+}
+
+void powerSetTimebase(int64_t offset_us, int32_t drift_ppb, uint64_t ref_us, bool renumber) {
+  grid_offset_us = offset_us;
+  grid_drift_ppb = drift_ppb;
+  grid_ref_us = ref_us;
+  if (renumber) {
+    next_tick = powerGridMicros() / interval_us + 1;
+  }
+}
+
+uint64_t powerGridAt(uint64_t clock_us) {
+  int64_t since_us = clock_us - grid_ref_us;
+  return clock_us + grid_offset_us + since_us * grid_drift_ppb / 1000000000LL;
+}
+
+uint64_t powerGridMicros() {
+  return powerGridAt(powerClockMicros());
+}
+
+bool powerTickDue(uint32_t* tick) {
+  uint64_t now = powerGridMicros();
+  if (now < (uint64_t)next_tick * interval_us) {
+    return false;
+  }
+
+  // Fire the latest grid slot reached; anything in between was overrun
+  uint32_t current = now / interval_us;
+  missed_ticks += current - next_tick;
+  last_late_us = now - (uint64_t)current * interval_us;
+  max_late_us = max(max_late_us, last_late_us);
+  *tick = current;
+  next_tick = current + 1;
+  return true;
+}
+
+uint32_t powerTickLateUs() {
+  return last_late_us;
+}
+
+uint32_t powerNextTick() {
+  return next_tick;
+}
+
+uint64_t powerNextTickUs() {
+  // The grid runs drift_ppb faster than the power clock; the tick is at
+  // most an interval away, so the product stays in range
+  uint64_t now = powerClockMicros();
+  int64_t ahead_us = (int64_t)((uint64_t)next_tick * interval_us) - (int64_t)powerGridAt(now);
+  return now + ahead_us * 1000000000LL / (1000000000LL + grid_drift_ppb);
+}
+
+void powerResume(uint64_t clock_us, uint32_t tick) {
+  sleep_offset_us = clock_us - micros64();
+  next_tick = tick;
+  radio_on_since_us = powerClockMicros();
+}
+
+static void onLightSleepWake() {
+}
+
+static void lightSleep(uint32_t sleep_us) {
+  uint32_t rtc_before = system_get_rtc_time();
+  uint64_t cpu_before = micros64();
+
+  wifi_set_opmode_current(NULL_MODE);
+  wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+  wifi_fpm_open();
+  wifi_fpm_set_wakeup_cb(onLightSleepWake);
+  wifi_fpm_do_sleep(sleep_us);
+  // The SDK enters light sleep inside this delay and wakes on the timer
+  delay(sleep_us / 1000 + 1);
+  wifi_fpm_close();
+
+  // RTC calibration is microseconds per RTC cycle in Q12 fixed point
+  uint32_t cal = system_rtc_clock_cali_proc();
+  uint64_t slept_us = ((uint64_t)(system_get_rtc_time() - rtc_before) * cal) >> 12;
+  uint64_t cpu_us = micros64() - cpu_before;
+  if (slept_us > cpu_us) {
+    sleep_offset_us += slept_us - cpu_us;
+  }
+  light_sleep_us += slept_us;
+}
+
+void powerSleepUntilNextTick() {
+  if (radio_on) {
+    return;
+  }
+
+  uint64_t due = powerNextTickUs();
+  uint64_t now = powerClockMicros();
+  if (due < now + WAKE_MARGIN_US + MIN_SLEEP_US) {
+    return;
+  }
+  lightSleep(due - now - WAKE_MARGIN_US);
+}
+
+bool powerRadioOn(const char* ssid, const char* password, uint32_t timeout_ms) {
+  if (!radio_on) {
+    radio_on = true;
+    radio_on_since_us = powerClockMicros();
+    WiFi.forceSleepWake();
+    delay(1);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(ssid, password);
+  }
+
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED) {
+    if (millis() - start > timeout_ms) {
+      return false;
+    }
+    delay(50);
+  }
+  return true;
+}
+
+void powerRadioOff() {
+  if (!radio_on) {
+    return;
+  }
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  WiFi.forceSleepBegin();
+  delay(1);
+  radio_on = false;
+  radio_on_us += powerClockMicros() - radio_on_since_us;
+}
+
+PowerStats powerStats() {
+  PowerStats stats;
+  stats.uptime_us = powerClockMicros();
+  stats.light_sleep_us = light_sleep_us;
+  stats.radio_on_us = radio_on_us;
+  if (radio_on) {
+    stats.radio_on_us += stats.uptime_us - radio_on_since_us;
+  }
+  stats.missed_ticks = missed_ticks;
+  stats.max_late_us = max_late_us;
+  return stats;
+}
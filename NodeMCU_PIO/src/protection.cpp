@@ -0,0 +1,128 @@
+#include "protection.h"
+
+#define EVENT_QUEUE_SIZE 8
+
+struct ZoneProtection {
+  ProtectionSettings settings;
+  ProtectionState state;
+  uint32_t since_ms;     // entered PENDING or SHED
+  uint8_t relay_pin;
+};
+
+static ZoneProtection zones[ZONE_COUNT];
+
+static ProtectionEvent events[EVENT_QUEUE_SIZE];
+static uint8_t event_head = 0;
+static uint8_t event_count = 0;
+
+static void pushEvent(uint8_t zone, bool shed, float current_mA, uint32_t now_ms,
+                      uint32_t latency_us) {
+  if (event_count == EVENT_QUEUE_SIZE) {
+    // Keep the newest events
+    event_head = (event_head + 1) % EVENT_QUEUE_SIZE;
+    event_count--;
+  }
+  ProtectionEvent& event = events[(event_head + event_count) % EVENT_QUEUE_SIZE];
+  event.zone = zone;
+  event.shed = shed;
+  event.current_mA = current_mA;
+  event.at_ms = now_ms;
+  event.latency_us = latency_us;
+  event_count++;
+}
+
+static void writeRelay(uint8_t zone, bool connected) {
+  digitalWrite(zones[zone].relay_pin,
+               connected ? RELAY_CONNECTED_LEVEL : !RELAY_CONNECTED_LEVEL);
+}
+
+void protectionBegin(const uint8_t* relay_pins) {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    zones[z].settings.trip_mA = PROTECTION_TRIP_MA;
+    zones[z].settings.reset_mA = PROTECTION_RESET_MA;
+    zones[z].settings.holdoff_ms = PROTECTION_HOLDOFF_MS;
+    zones[z].settings.reclose_ms = PROTECTION_RECLOSE_MS;
+    zones[z].state = PROTECTION_NORMAL;
+    zones[z].since_ms = 0;
+    zones[z].relay_pin = relay_pins[z];
+
+    pinMode(relay_pins[z], OUTPUT);
+    writeRelay(z, true);
+  }
+}
+
+void protectionSample(uint8_t zone, float current_mA, uint32_t sampled_us) {
+  ZoneProtection& p = zones[zone];
+  uint32_t now = millis();
+
+  switch (p.state) {
+    case PROTECTION_NORMAL:
+      if (p.settings.trip_mA <= 0 || current_mA < p.settings.trip_mA) {
+        return;
+      }
+      p.state = PROTECTION_PENDING;
+      p.since_ms = now;
+      break;
+
+    case PROTECTION_PENDING:
+      if (current_mA < p.settings.reset_mA) {
+        p.state = PROTECTION_NORMAL;
+        return;
+      }
+      break;
+
+    case PROTECTION_SHED:
+      if (p.settings.reclose_ms > 0 && now - p.since_ms >= p.settings.reclose_ms) {
+        writeRelay(zone, true);
+        p.state = PROTECTION_NORMAL;
+        pushEvent(zone, false, current_mA, now, micros() - sampled_us);
+      }
+      return;
+  }
+
+  if (now - p.since_ms >= p.settings.holdoff_ms) {
+    writeRelay(zone, false);
+    p.state = PROTECTION_SHED;
+    p.since_ms = now;
+    pushEvent(zone, true, current_mA, now, micros() - sampled_us);
+  }
+}
+
+void protectionConfigure(uint8_t zone, const ProtectionSettings& settings) {
+  zones[zone].settings = settings;
+  // Keep the hysteresis band the right way round
+  if (zones[zone].settings.reset_mA > settings.trip_mA) {
+    zones[zone].settings.reset_mA = settings.trip_mA;
+  }
+  if (zones[zone].state == PROTECTION_PENDING) {
+    zones[zone].state = PROTECTION_NORMAL;
+  }
+}
+
+ProtectionSettings protectionSettings(uint8_t zone) {
+  return zones[zone].settings;
+}
+
+ProtectionState protectionState(uint8_t zone) {
+  return zones[zone].state;
+}
+
+void protectionReset(uint8_t zone) {
+  if (zones[zone].state != PROTECTION_SHED) {
+    return;
+  }
+  uint32_t start = micros();
+  writeRelay(zone, true);
+  zones[zone].state = PROTECTION_NORMAL;
+  pushEvent(zone, false, 0, millis(), micros() - start);
+}
+
+bool protectionPopEvent(ProtectionEvent* event) {
+  if (event_count == 0) {
+    return false;
+  }
+  *event = events[event_head];
+  event_head = (event_head + 1) % EVENT_QUEUE_SIZE;
+  event_count--;
+  return true;
+}
@@ -0,0 +1,51 @@
+#include "publish_schedule.h"
+
+static uint32_t period_ms = 1;
+static uint32_t phase_ms = 0;
+static uint64_t next_slot_ms = 0;
+
+// Index of the next slot not yet reached at now_ms
+static uint64_t slotAfter(uint64_t now_ms) {
+  if (now_ms < phase_ms) {
+    return 0;
+  }
+  return (now_ms - phase_ms) / period_ms + 1;
+}
+
+void scheduleBegin(uint32_t period, uint32_t chip_id) {
+  period_ms = period;
+  // Fibonacci hashing spreads neighbouring chip ids across the period
+  uint32_t hash = chip_id * 2654435761u;
+  phase_ms = ((uint64_t)hash * period_ms) >> 32;
+  next_slot_ms = phase_ms;
+}
+
+bool schedulePublishDue(uint64_t now_ms) {
+  if (now_ms < next_slot_ms) {
+    return false;
+  }
+  // A late check fires once and realigns to the next slot
+  next_slot_ms = slotAfter(now_ms) * period_ms + phase_ms;
+  return true;
+}
+
+void scheduleSetPhase(uint32_t phase) {
+  phase_ms = phase % period_ms;
+  // Move the pending slot within its period
+  uint64_t slot_start = next_slot_ms - (next_slot_ms % period_ms);
+  next_slot_ms = slot_start + phase_ms;
+}
+
+void scheduleSetPeriod(uint32_t period, uint64_t now_ms) {
+  phase_ms = (uint64_t)phase_ms * period / period_ms;
+  period_ms = period;
+  next_slot_ms = slotAfter(now_ms) * period_ms + phase_ms;
+}
+
+uint32_t schedulePhase() {
+  return phase_ms;
+}
+
+uint32_t schedulePeriod() {
+  return period_ms;
+}
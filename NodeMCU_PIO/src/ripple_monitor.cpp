@@ -0,0 +1,96 @@
+#include "ripple_monitor.h"
+
+#include <Adafruit_INA219.h>
+#include <Wire.h>
+
+#include "i2c_bus.h"
+#include "ina_profile.h"
+
+#define BUS_LSB_V 0.004f
+#define SHUNT_LSB_MA (0.01f / INA_SHUNT_OHMS)   // 10 µV across the shunt
+
+static const uint8_t* zone_addresses;
+static RippleResult results[ZONE_COUNT];
+// Raw counts of one burst; the transform runs in place on them
+static int16_t bus[RIPPLE_POINTS];
+static int16_t shunt[RIPPLE_POINTS];
+
+void rippleBegin(const uint8_t* addresses) {
+  zone_addresses = addresses;
+  fftBegin();
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    results[z] = {};
+  }
+}
+
+// One register read, counted in the device's bus statistics
+static bool readRegister(uint8_t zone, uint8_t reg, uint16_t* value) {
+  uint8_t address = zone_addresses[zone];
+  uint32_t start = micros();
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  bool ok = Wire.endTransmission() == 0 && Wire.requestFrom(address, (uint8_t)2) == 2;
+  if (ok) {
+    *value = Wire.read() << 8;
+    *value |= Wire.read();
+  }
+  i2cBusRecord(zone, micros() - start, ok);
+  return ok;
+}
+
+static void scaleTone(RippleTone* tone, float lsb) {
+  tone->mean *= lsb;
+  tone->rms *= lsb;
+  tone->peak_to_peak *= lsb;
+  tone->amplitude *= lsb;
+}
+
+bool rippleBurst(uint8_t zone) {
+  // A backed-off device isn't burst
+  if (!i2cDeviceReady(zone)) {
+    return false;
+  }
+  bool ok = inaProfileFast(zone, RIPPLE_ADC_BITS);
+  // Let the conversion started under the old setting finish
+  delay(2);
+
+  uint32_t start = micros();
+  uint32_t first_us = start;
+  uint32_t last_us = start;
+  uint32_t max_late = 0;
+  for (uint16_t n = 0; n < RIPPLE_POINTS && ok; n++) {
+    uint32_t due = start + (uint32_t)n * RIPPLE_SAMPLE_US;
+    while ((int32_t)(micros() - due) < 0) {
+    }
+    last_us = micros();
+    if (n == 0) {
+      first_us = last_us;
+    }
+    max_late = max(max_late, last_us - due);
+    uint16_t shunt_raw, bus_raw;
+    ok = readRegister(zone, INA219_REG_SHUNTVOLTAGE, &shunt_raw) &&
+         readRegister(zone, INA219_REG_BUSVOLTAGE, &bus_raw);
+    shunt[n] = (int16_t)shunt_raw;
+    bus[n] = (int16_t)(bus_raw >> 3);   // bits 15..3, 4 mV
+  }
+  ok = inaProfileApply(zone) && ok;
+  if (!ok) {
+    return false;
+  }
+
+  RippleResult& r = results[zone];
+  r.at_ms = millis();
+  r.max_late_us = max_late;
+  r.sample_rate_Hz = last_us > first_us ? (RIPPLE_POINTS - 1) * 1e6f / (last_us - first_us) : 0;
+  uint32_t analyze_start = micros();
+  rippleAnalyze(bus, shunt, r.sample_rate_Hz, &r.voltage, &r.current);
+  r.analyze_us = micros() - analyze_start;
+  scaleTone(&r.voltage, BUS_LSB_V);
+  scaleTone(&r.current, SHUNT_LSB_MA);
+  r.valid = true;
+  return true;
+}
+
+const RippleResult& rippleLatest(uint8_t zone) {
+  return results[zone];
+}
@@ -0,0 +1,391 @@
+#include "runtime_config.h"
+
+#include <EEPROM.h>
+
+#include "ack_window.h"
+#include "crc32.h"
+#include "sample_buffer.h"
+#include "zone_filter.h"
+
+#define CONFIG_MAGIC 0x4E474643ul  // "CFGN"
+
+struct ConfigHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;       // bytes of RuntimeConfig that follow
+  uint32_t revision;
+  uint32_t crc;        // over the header up to here and the block
+};
+
+#define CONFIG_SPACE (EEPROM_SIZE - CONFIG_EEPROM_OFFSET - sizeof(ConfigHeader))
+
+static_assert(sizeof(RuntimeConfig) <= CONFIG_SPACE, "runtime config too large for the EEPROM");
+
+static RuntimeConfig active;
+static RuntimeConfig staged;
+static RuntimeConfig defaults;
+static bool pending = false;
+static uint32_t revision = 0;
+static ConfigSource source = CONFIG_DEFAULTS;
+
+// Every key configStage() understands; anything else is refused, so a
+// typo doesn't go unnoticed
+static const char* const CONFIG_KEYS[] = {
+  "sample_interval_ms", "batch_min_latency_ms", "batch_max_latency_ms", "samples_per_publish",
+  "diagnostics_every_ticks", "ack_window", "mqtt_server", "mqtt_port", "mqtt_backups", "zones",
+  "command",
+};
+static const char* const ZONE_KEYS[] = {
+  "trip_mA", "reset_mA", "holdoff_ms", "reclose_ms", "overvoltage_V",
+  "filter_q_mA2", "filter_r_mA2", "filter_gate_sigma",
+  "type", "capacity_mAh", "charge_efficiency", "rest_mA", "rest_ms", "ocv_V",
+};
+
+static bool knownKeys(JsonObjectConst object, const char* const* keys, size_t count) {
+  for (JsonPairConst pair : object) {
+    bool known = false;
+    for (size_t i = 0; i < count && !known; i++) {
+      known = strcmp(pair.key().c_str(), keys[i]) == 0;
+    }
+    if (!known) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static const char* zoneTypeName(uint8_t type) {
+  return type == ZONE_TYPE_BATTERY ? "battery" : "load";
+}
+
+// "host" or "host:port"; the port defaults to the primary broker's
+static bool parseBroker(const char* text, uint16_t default_port, BrokerConfig* out) {
+  const char* colon = strrchr(text, ':');
+  size_t host_len = colon ? (size_t)(colon - text) : strlen(text);
+  if (host_len == 0 || host_len >= CONFIG_SERVER_MAX) {
+    return false;
+  }
+  memcpy(out->server, text, host_len);
+  out->server[host_len] = '\0';
+  out->port = default_port;
+  if (colon) {
+    long port = strtol(colon + 1, nullptr, 10);
+    if (port <= 0 || port > 65535) {
+      return false;
+    }
+    out->port = port;
+  }
+  return true;
+}
+
+static uint32_t headerCrc(const ConfigHeader& header, const uint8_t* block) {
+  uint32_t crc = crc32Update(0, &header, offsetof(ConfigHeader, crc));
+  return crc32Update(crc, block, header.size);
+}
+
+static void store() {
+  ConfigHeader header;
+  header.magic = CONFIG_MAGIC;
+  header.version = CONFIG_VERSION;
+  header.size = sizeof(RuntimeConfig);
+  header.revision = revision;
+  header.crc = headerCrc(header, (const uint8_t*)&active);
+
+  EEPROM.put(CONFIG_EEPROM_OFFSET, header);
+  EEPROM.put(CONFIG_EEPROM_OFFSET + sizeof(ConfigHeader), active);
+  EEPROM.commit();
+}
+
+void configBegin(const char* default_mqtt_server, uint16_t default_mqtt_port) {
+  memset(&defaults, 0, sizeof(defaults));
+  defaults.sample_interval_ms = SAMPLE_INTERVAL_MS;
+  defaults.batch_min_latency_ms = BATCH_MIN_LATENCY_MS;
+  defaults.batch_max_latency_ms = BATCH_MAX_LATENCY_MS;
+  defaults.samples_per_publish = SAMPLES_PER_PUBLISH;
+  defaults.diagnostics_every_ticks = DIAGNOSTICS_EVERY_TICKS;
+  defaults.ack_window = ACK_WINDOW;
+  defaults.mqtt_port = default_mqtt_port;
+  strlcpy(defaults.mqtt_server, default_mqtt_server, sizeof(defaults.mqtt_server));
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    defaults.zones[z] = {PROTECTION_TRIP_MA, PROTECTION_RESET_MA, PROTECTION_HOLDOFF_MS,
+                         PROTECTION_RECLOSE_MS, ALARM_OVERVOLTAGE_V};
+    defaults.filters[z] = {ZONE_FILTER_Q_MA2, ZONE_FILTER_R_MA2, ZONE_FILTER_GATE_SIGMA};
+    BatteryConfig& b = defaults.batteries[z];
+    const float ocv[BATTERY_OCV_POINTS] = BATTERY_OCV_V;
+    b.type = ZONE_TYPE_LOAD;
+    b.capacity_mAh = BATTERY_CAPACITY_MAH;
+    b.charge_efficiency = BATTERY_CHARGE_EFFICIENCY;
+    b.rest_mA = BATTERY_REST_MA;
+    b.rest_ms = BATTERY_REST_MS;
+    memcpy(b.ocv_V, ocv, sizeof(ocv));
+  }
+  active = defaults;
+  pending = false;
+  source = CONFIG_DEFAULTS;
+  revision = 0;
+
+  ConfigHeader header;
+  EEPROM.get(CONFIG_EEPROM_OFFSET, header);
+  if (header.magic != CONFIG_MAGIC || header.size > CONFIG_SPACE) {
+    return;
+  }
+  uint8_t block[CONFIG_SPACE];
+  for (uint16_t i = 0; i < header.size; i++) {
+    block[i] = EEPROM.read(CONFIG_EEPROM_OFFSET + sizeof(ConfigHeader) + i);
+  }
+  if (headerCrc(header, block) != header.crc) {
+    Serial.println("Stored config failed its CRC, using defaults");
+    return;
+  }
+  memcpy(&active, block, min((size_t)header.size, sizeof(RuntimeConfig)));
+  active.mqtt_server[CONFIG_SERVER_MAX - 1] = '\0';
+  for (uint8_t i = 0; i < CONFIG_BACKUP_BROKERS; i++) {
+    active.backups[i].server[CONFIG_SERVER_MAX - 1] = '\0';
+  }
+  revision = header.revision;
+  source = header.version == CONFIG_VERSION ? CONFIG_STORED : CONFIG_MIGRATED;
+}
+
+const RuntimeConfig& config() {
+  return active;
+}
+
+ConfigSource configSource() {
+  return source;
+}
+
+const char* configSourceName(ConfigSource s) {
+  switch (s) {
+    case CONFIG_STORED: return "stored";
+    case CONFIG_MIGRATED: return "migrated";
+    default: return "defaults";
+  }
+}
+
+uint32_t configRevision() {
+  return revision;
+}
+
+static const char* validate(const RuntimeConfig& c) {
+  if (c.sample_interval_ms < 100 || c.sample_interval_ms > 3600000UL) {
+    return "sample_interval_ms out of range";
+  }
+  if (c.samples_per_publish < 1 || c.samples_per_publish > SAMPLE_BUFFER_CAPACITY) {
+    return "samples_per_publish out of range";
+  }
+  if (c.batch_max_latency_ms < c.batch_min_latency_ms) {
+    return "batch_max_latency_ms below batch_min_latency_ms";
+  }
+  // The smallest batch has to fit in the sample buffer
+  if (c.batch_min_latency_ms / c.sample_interval_ms > SAMPLE_BUFFER_CAPACITY) {
+    return "batch_min_latency_ms spans more samples than the buffer holds";
+  }
+  if (c.diagnostics_every_ticks < 1) {
+    return "diagnostics_every_ticks out of range";
+  }
+  if (c.ack_window < 1 || c.ack_window > ACK_WINDOW_MAX) {
+    return "ack_window out of range";
+  }
+  if (c.mqtt_server[0] == '\0' || c.mqtt_port == 0) {
+    return "invalid broker";
+  }
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (c.zones[z].trip_mA <= 0 || c.zones[z].reset_mA >= c.zones[z].trip_mA) {
+      return "reset_mA must be below trip_mA";
+    }
+    const ZoneFilterConfig& f = c.filters[z];
+    if (!(f.q_mA2 >= 0) || !(f.r_mA2 >= 0) || !(f.gate_sigma >= 0) || f.q_mA2 > FILTER_MAX_MA2 ||
+        f.r_mA2 > FILTER_MAX_MA2 || f.gate_sigma * f.gate_sigma > FILTER_MAX_MA2) {
+      return "filter settings out of range";
+    }
+    const BatteryConfig& b = c.batteries[z];
+    if (b.type > ZONE_TYPE_BATTERY) {
+      return "unknown zone type";
+    }
+    if (!(b.capacity_mAh > 0) || !(b.charge_efficiency > 0) || b.charge_efficiency > 1 ||
+        !(b.rest_mA >= 0)) {
+      return "battery settings out of range";
+    }
+    for (uint8_t i = 1; i < BATTERY_OCV_POINTS; i++) {
+      if (!(b.ocv_V[i] > b.ocv_V[i - 1])) {
+        return "ocv_V must rise with the state of charge";
+      }
+    }
+  }
+  return nullptr;
+}
+
+const char* configStage(JsonVariantConst update) {
+  JsonObjectConst object = update.as<JsonObjectConst>();
+  if (object.isNull()) {
+    return "not an object";
+  }
+  if (!knownKeys(object, CONFIG_KEYS, sizeof(CONFIG_KEYS) / sizeof(CONFIG_KEYS[0]))) {
+    return "unknown key";
+  }
+
+  RuntimeConfig next = pending ? staged : active;
+  const char* command = object["command"] | "";
+  if (strcmp(command, "defaults") == 0) {
+    next = defaults;
+  } else if (command[0] != '\0') {
+    return "unknown command";
+  }
+
+  next.sample_interval_ms = object["sample_interval_ms"] | next.sample_interval_ms;
+  next.batch_min_latency_ms = object["batch_min_latency_ms"] | next.batch_min_latency_ms;
+  next.batch_max_latency_ms = object["batch_max_latency_ms"] | next.batch_max_latency_ms;
+  next.samples_per_publish = object["samples_per_publish"] | next.samples_per_publish;
+  next.diagnostics_every_ticks = object["diagnostics_every_ticks"] | next.diagnostics_every_ticks;
+  next.ack_window = object["ack_window"] | next.ack_window;
+  next.mqtt_port = object["mqtt_port"] | next.mqtt_port;
+  if (object.containsKey("mqtt_server")) {
+    const char* server = object["mqtt_server"] | "";
+    if (strlen(server) >= CONFIG_SERVER_MAX) {
+      return "mqtt_server too long";
+    }
+    strlcpy(next.mqtt_server, server, sizeof(next.mqtt_server));
+  }
+  // The whole fallback list, in order; [] removes it
+  if (object.containsKey("mqtt_backups")) {
+    JsonArrayConst backups = object["mqtt_backups"];
+    if (backups.isNull() || backups.size() > CONFIG_BACKUP_BROKERS) {
+      return "mqtt_backups must be a list of at most 2 brokers";
+    }
+    memset(next.backups, 0, sizeof(next.backups));
+    for (size_t i = 0; i < backups.size(); i++) {
+      const char* broker = backups[i] | "";
+      if (!parseBroker(broker, next.mqtt_port, &next.backups[i])) {
+        return "invalid broker in mqtt_backups";
+      }
+    }
+  }
+
+  // "zones" is an array in zone order; null entries leave a zone alone
+  JsonArrayConst zones = object["zones"];
+  if (zones.size() > ZONE_COUNT) {
+    return "too many zones";
+  }
+  for (size_t z = 0; z < zones.size(); z++) {
+    JsonObjectConst zone = zones[z];
+    if (zone.isNull()) {
+      continue;
+    }
+    if (!knownKeys(zone, ZONE_KEYS, sizeof(ZONE_KEYS) / sizeof(ZONE_KEYS[0]))) {
+      return "unknown zone key";
+    }
+    ZoneConfig& zc = next.zones[z];
+    zc.trip_mA = zone["trip_mA"] | zc.trip_mA;
+    zc.reset_mA = zone["reset_mA"] | zc.reset_mA;
+    zc.holdoff_ms = zone["holdoff_ms"] | zc.holdoff_ms;
+    zc.reclose_ms = zone["reclose_ms"] | zc.reclose_ms;
+    zc.overvoltage_V = zone["overvoltage_V"] | zc.overvoltage_V;
+    ZoneFilterConfig& fc = next.filters[z];
+    fc.q_mA2 = zone["filter_q_mA2"] | fc.q_mA2;
+    fc.r_mA2 = zone["filter_r_mA2"] | fc.r_mA2;
+    fc.gate_sigma = zone["filter_gate_sigma"] | fc.gate_sigma;
+    BatteryConfig& bc = next.batteries[z];
+    if (zone.containsKey("type")) {
+      const char* type = zone["type"] | "";
+      if (strcmp(type, "battery") == 0) {
+        bc.type = ZONE_TYPE_BATTERY;
+      } else if (strcmp(type, "load") == 0) {
+        bc.type = ZONE_TYPE_LOAD;
+      } else {
+        return "unknown zone type";
+      }
+    }
+    bc.capacity_mAh = zone["capacity_mAh"] | bc.capacity_mAh;
+    bc.charge_efficiency = zone["charge_efficiency"] | bc.charge_efficiency;
+    bc.rest_mA = zone["rest_mA"] | bc.rest_mA;
+    bc.rest_ms = zone["rest_ms"] | bc.rest_ms;
+    if (zone.containsKey("ocv_V")) {
+      JsonArrayConst ocv = zone["ocv_V"];
+      if (ocv.size() != BATTERY_OCV_POINTS) {
+        return "ocv_V needs 11 points, 0 to 100 %";
+      }
+      for (uint8_t i = 0; i < BATTERY_OCV_POINTS; i++) {
+        bc.ocv_V[i] = ocv[i] | 0.0f;
+      }
+    }
+  }
+
+  const char* error = validate(next);
+  if (error) {
+    return error;
+  }
+  staged = next;
+  pending = true;
+  return nullptr;
+}
+
+bool configPending() {
+  return pending;
+}
+
+const RuntimeConfig& configStaged() {
+  return pending ? staged : active;
+}
+
+bool configCommit() {
+  if (!pending) {
+    return false;
+  }
+  pending = false;
+  // Retained updates come back at every connect; don't wear the flash
+  // rewriting the same block
+  if (memcmp(&staged, &active, sizeof(RuntimeConfig)) == 0) {
+    return false;
+  }
+  active = staged;
+  revision++;
+  source = CONFIG_STORED;
+  store();
+  return true;
+}
+
+void configToJson(JsonObject out) {
+  out["version"] = CONFIG_VERSION;
+  out["revision"] = revision;
+  out["source"] = configSourceName(source);
+  out["sample_interval_ms"] = active.sample_interval_ms;
+  out["batch_min_latency_ms"] = active.batch_min_latency_ms;
+  out["batch_max_latency_ms"] = active.batch_max_latency_ms;
+  out["samples_per_publish"] = active.samples_per_publish;
+  out["diagnostics_every_ticks"] = active.diagnostics_every_ticks;
+  out["ack_window"] = active.ack_window;
+  out["mqtt_server"] = (const char*)active.mqtt_server;
+  out["mqtt_port"] = active.mqtt_port;
+  JsonArray backups = out.createNestedArray("mqtt_backups");
+  for (uint8_t i = 0; i < CONFIG_BACKUP_BROKERS; i++) {
+    if (active.backups[i].server[0] != '\0') {
+      char broker[CONFIG_SERVER_MAX + 8];
+      snprintf(broker, sizeof(broker), "%s:%u", active.backups[i].server, active.backups[i].port);
+      backups.add(broker);
+    }
+  }
+  JsonArray zones = out.createNestedArray("zones");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    JsonObject zone = zones.createNestedObject();
+    zone["trip_mA"] = active.zones[z].trip_mA;
+    zone["reset_mA"] = active.zones[z].reset_mA;
+    zone["holdoff_ms"] = active.zones[z].holdoff_ms;
+    zone["reclose_ms"] = active.zones[z].reclose_ms;
+    zone["overvoltage_V"] = active.zones[z].overvoltage_V;
+    zone["filter_q_mA2"] = active.filters[z].q_mA2;
+    zone["filter_r_mA2"] = active.filters[z].r_mA2;
+    zone["filter_gate_sigma"] = active.filters[z].gate_sigma;
+    const BatteryConfig& b = active.batteries[z];
+    zone["type"] = zoneTypeName(b.type);
+    if (b.type == ZONE_TYPE_BATTERY) {
+      zone["capacity_mAh"] = b.capacity_mAh;
+      zone["charge_efficiency"] = b.charge_efficiency;
+      zone["rest_mA"] = b.rest_mA;
+      zone["rest_ms"] = b.rest_ms;
+      JsonArray ocv = zone.createNestedArray("ocv_V");
+      for (uint8_t i = 0; i < BATTERY_OCV_POINTS; i++) {
+        ocv.add(b.ocv_V[i]);
+      }
+    }
+  }
+}
@@ -0,0 +1,130 @@
+#include "sample_buffer.h"
+
+#include "ina_profile.h"
+
+// RTC user memory is addressed in 4-byte blocks
+#define RTC_HEADER_BLOCK 32
+#define RTC_SLOT_BLOCK (RTC_HEADER_BLOCK + sizeof(RtcHeader) / 4)
+#define RTC_SLOT_BLOCKS (sizeof(PackedSample) / 4)
+#define RTC_MAGIC 0x5242554Eul  // "NUBR": readings at the range's LSB
+
+static_assert(sizeof(RANGE_COUNTS_PER_MA) / sizeof(RANGE_COUNTS_PER_MA[0]) == INA_RANGE_COUNT,
+              "RANGE_COUNTS_PER_MA needs an entry per InaRange");
+
+struct RtcHeader {
+  uint32_t magic;
+  uint8_t head;
+  uint8_t count;
+  uint16_t slot_size;
+  uint32_t overflows;
+  uint32_t pushed;       // samples pushed since the ring was cleared
+};
+
+static RtcHeader header;
+
+static void writeHeader() {
+  ESP.rtcUserMemoryWrite(RTC_HEADER_BLOCK, (uint32_t*)&header, sizeof(header));
+}
+
+uint8_t sampleBufferBegin(bool keep_existing) {
+  ESP.rtcUserMemoryRead(RTC_HEADER_BLOCK, (uint32_t*)&header, sizeof(header));
+
+  bool valid = header.magic == RTC_MAGIC &&
+               header.slot_size == sizeof(PackedSample) &&
+               header.head < SAMPLE_BUFFER_CAPACITY &&
+               header.count <= SAMPLE_BUFFER_CAPACITY;
+
+  if (!keep_existing || !valid) {
+    header.magic = RTC_MAGIC;
+    header.head = 0;
+    header.count = 0;
+    header.slot_size = sizeof(PackedSample);
+    header.overflows = 0;
+    header.pushed = 0;
+    writeHeader();
+  }
+  return header.count;
+}
+
+void sampleBufferPush(const PackedSample& sample) {
+  uint8_t slot = (header.head + header.count) % SAMPLE_BUFFER_CAPACITY;
+  if (header.count == SAMPLE_BUFFER_CAPACITY) {
+    // Full: overwrite the oldest sample
+    header.head = (header.head + 1) % SAMPLE_BUFFER_CAPACITY;
+    header.overflows++;
+  } else {
+    header.count++;
+  }
+  header.pushed++;
+
+  ESP.rtcUserMemoryWrite(RTC_SLOT_BLOCK + slot * RTC_SLOT_BLOCKS,
+                         (uint32_t*)&sample, sizeof(PackedSample));
+  writeHeader();
+}
+
+bool sampleBufferPeek(uint8_t i, PackedSample* out) {
+  if (i >= header.count) {
+    return false;
+  }
+  uint8_t slot = (header.head + i) % SAMPLE_BUFFER_CAPACITY;
+  return ESP.rtcUserMemoryRead(RTC_SLOT_BLOCK + slot * RTC_SLOT_BLOCKS,
+                               (uint32_t*)out, sizeof(PackedSample));
+}
+
+void sampleBufferDrop(uint8_t n) {
+  if (n > header.count) {
+    n = header.count;
+  }
+  header.head = (header.head + n) % SAMPLE_BUFFER_CAPACITY;
+  header.count -= n;
+  writeHeader();
+}
+
+uint8_t sampleBufferCount() {
+  return header.count;
+}
+
+uint32_t sampleBufferOverflows() {
+  return header.overflows;
+}
+
+uint32_t sampleBufferSeq(uint8_t i) {
+  return header.pushed - header.count + i;
+}
+
+// Rounds to counts of the stored resolution. NaN, from a corrupted read
+// flagged out of range, is stored as 0.
+static long toCounts(float value, float scale, long lo, long hi) {
+  if (isnan(value)) {
+    return 0;
+  }
+  return lroundf(constrain(value * scale, (float)lo, (float)hi));
+}
+
+PackedZone packZone(const ZoneData& data) {
+  float per_mA = RANGE_COUNTS_PER_MA[data.range];
+  PackedZone packed;
+  packed.current = (int16_t)toCounts(data.current_mA, per_mA, -32768L, 32767L);
+  packed.bus = (uint16_t)toCounts(data.busvoltage, 250.0f, 0L, PACKED_BUS_MASK) |
+               data.range << PACKED_RANGE_SHIFT;
+  packed.power = (uint16_t)toCounts(data.power_mW, per_mA / RANGE_POWER_LSBS, 0L, 65535L);
+#if ZONE_FILTER
+  packed.current_filt = (int16_t)toCounts(data.current_filt_mA, per_mA, -32768L, 32767L);
+#endif
+  return packed;
+}
+
+ZoneData unpackZone(const PackedZone& packed) {
+  ZoneData data;
+  data.range = packed.bus >> PACKED_RANGE_SHIFT;
+  float per_mA = RANGE_COUNTS_PER_MA[data.range];
+  data.current_mA = packed.current / per_mA;
+  data.busvoltage = (packed.bus & PACKED_BUS_MASK) / 250.0f;
+  data.power_mW = packed.power * RANGE_POWER_LSBS / per_mA;
+#if ZONE_FILTER
+  data.current_filt_mA = packed.current_filt / per_mA;
+#else
+  data.current_filt_mA = data.current_mA;
+#endif
+  return data;
+}
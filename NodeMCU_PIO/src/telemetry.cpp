@@ -0,0 +1,35 @@
+#include "telemetry.h"
+
+#include "power_manager.h"
+
+static uint32_t boot_id = 0;
+static uint32_t next_seq[STREAM_COUNT];
+
+void telemetryBegin() {
+  boot_id = ESP.random();
+  for (uint8_t s = 0; s < STREAM_COUNT; s++) {
+    next_seq[s] = 0;
+  }
+}
+
+uint32_t telemetryBootId() {
+  return boot_id;
+}
+
+uint64_t telemetryUptimeMs() {
+  return powerClockMicros() / 1000;
+}
+
+uint32_t telemetryNextSeq(PublishStream stream) {
+  return next_seq[stream]++;
+}
+
+void telemetrySave(uint32_t* id, uint32_t* seq) {
+  *id = boot_id;
+  memcpy(seq, next_seq, sizeof(next_seq));
+}
+
+void telemetryRestore(uint32_t id, const uint32_t* seq) {
+  boot_id = id;
+  memcpy(next_seq, seq, sizeof(next_seq));
+}
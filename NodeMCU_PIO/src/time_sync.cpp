@@ -0,0 +1,252 @@
+#include "time_sync.h"
+
+#include <ArduinoJson.h>
+#include "power_manager.h"
+
+struct SyncSample {
+  uint64_t clock_us;      // power clock when the backend read its clock
+  int64_t offset_us;      // backend clock - power clock
+};
+
+static SyncSample samples[TIME_SYNC_WINDOW];
+static uint8_t sample_count = 0;
+static uint8_t sample_head = 0;
+
+// The fit: offset at fit_ref_us, and the drift since
+static bool fitted = false;
+static int64_t fit_offset_us = 0;
+static uint64_t fit_ref_us = 0;
+static int32_t fit_drift_ppb = 0;
+static uint32_t fit_rms_us = 0;
+
+static uint32_t rtt_us = 0;
+static uint32_t delay_us = 0;         // one-way, half the last round trip
+static uint64_t last_sample_us = 0;
+static uint32_t restored_error_us = 0;  // carried over a deep sleep until the next sample
+static uint8_t outliers = 0;
+static bool synced = false;
+static bool step_pending = false;
+
+static bool request_due = true;
+static uint64_t request_sent_us = 0;
+
+static uint32_t beacons = 0;
+static uint32_t replies = 0;
+static uint32_t rejected = 0;
+static uint32_t steps = 0;
+static uint32_t epoch_s = 0;
+
+static int64_t fitOffsetAt(uint64_t clock_us) {
+  return fit_offset_us + (int64_t)(clock_us - fit_ref_us) * fit_drift_ppb / 1000000000LL;
+}
+
+// Least squares over the window, relative to the newest sample so doubles
+// keep microseconds. The drift is only fitted once the samples span
+// TIME_SYNC_MIN_SPAN_MS; until then the last estimate holds.
+static void refit() {
+  const SyncSample& newest = samples[(sample_head + TIME_SYNC_WINDOW - 1) % TIME_SYNC_WINDOW];
+  double n = sample_count;
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  uint64_t oldest_us = newest.clock_us;
+  for (uint8_t i = 0; i < sample_count; i++) {
+    double x = (int64_t)(samples[i].clock_us - newest.clock_us) / 1e6;  // s
+    double y = samples[i].offset_us - newest.offset_us;                 // us
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    oldest_us = min(oldest_us, samples[i].clock_us);
+  }
+
+  // us per s: ppm
+  double drift_ppm = fit_drift_ppb / 1000.0;
+  if (sample_count >= 3 && newest.clock_us - oldest_us >= TIME_SYNC_MIN_SPAN_MS * 1000ULL) {
+    drift_ppm = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    drift_ppm = constrain(drift_ppm, -(double)TIME_SYNC_MAX_DRIFT_PPM, (double)TIME_SYNC_MAX_DRIFT_PPM);
+  }
+  double intercept = (sy - drift_ppm * sx) / n;
+
+  double squares = 0;
+  for (uint8_t i = 0; i < sample_count; i++) {
+    double x = (int64_t)(samples[i].clock_us - newest.clock_us) / 1e6;
+    double r = samples[i].offset_us - newest.offset_us - (intercept + drift_ppm * x);
+    squares += r * r;
+  }
+
+  fitted = true;
+  fit_ref_us = newest.clock_us;
+  fit_offset_us = newest.offset_us + llround(intercept);
+  fit_drift_ppb = lround(drift_ppm * 1000.0);
+  fit_rms_us = sqrt(squares / n);
+}
+
+// Moves the grid to the fit, or leaves that to timeSyncApplyStep() when the
+// ticks would be renumbered
+static void applyFit() {
+  uint64_t now = powerClockMicros();
+  int64_t offset = fitOffsetAt(now);
+  int64_t moved = (int64_t)(now + offset - powerGridMicros());
+  if (!synced || step_pending || llabs(moved) > TIME_SYNC_STEP_US) {
+    step_pending = true;
+    return;
+  }
+  powerSetTimebase(offset, fit_drift_ppb, now, false);
+}
+
+static void addSample(uint64_t clock_us, int64_t offset_us) {
+  if (fitted && llabs(offset_us - fitOffsetAt(clock_us)) > TIME_SYNC_STEP_US) {
+    // A delayed message, or a clock that stepped: the latter shows up as
+    // several in a row, and the fit starts over from here
+    rejected++;
+    if (++outliers < TIME_SYNC_STEP_SAMPLES) {
+      return;
+    }
+    sample_count = 0;
+    sample_head = 0;
+  }
+  outliers = 0;
+
+  samples[sample_head] = {clock_us, offset_us};
+  sample_head = (sample_head + 1) % TIME_SYNC_WINDOW;
+  sample_count = min(sample_count + 1, TIME_SYNC_WINDOW);
+  last_sample_us = clock_us;
+  restored_error_us = 0;
+  refit();
+  applyFit();
+}
+
+void timeSyncBegin() {
+  sample_count = 0;
+  sample_head = 0;
+  fitted = false;
+  synced = false;
+  step_pending = false;
+  request_due = true;
+}
+
+void timeSyncMessage(const byte* message, unsigned int length, uint64_t received_us) {
+  StaticJsonDocument<128> doc;
+  DeserializationError error = deserializeJson(doc, message, length);
+  if (error) {
+    Serial.print("Invalid time message: ");
+    Serial.println(error.c_str());
+    return;
+  }
+  uint64_t backend_us = doc["t_us"] | (uint64_t)0;
+  if (backend_us == 0) {
+    return;
+  }
+  epoch_s = doc["epoch_s"] | epoch_s;
+
+  // A reply to the last request measures the round trip; the backend read
+  // its clock about halfway through it. Replies to older requests are
+  // dropped.
+  uint64_t sent_us = doc["t1_us"] | (uint64_t)0;
+  if (sent_us != 0) {
+    if (sent_us != request_sent_us || received_us < sent_us) {
+      return;
+    }
+    rtt_us = min(received_us - sent_us, (uint64_t)UINT32_MAX);
+    delay_us = rtt_us / 2;
+    replies++;
+  } else {
+    beacons++;
+  }
+  uint64_t clock_us = received_us - delay_us;
+  addSample(clock_us, (int64_t)(backend_us - clock_us));
+}
+
+size_t timeSyncRequest(char* out, size_t size) {
+  uint64_t now = powerClockMicros();
+  if (!request_due && now - request_sent_us < TIME_SYNC_REQUEST_MS * 1000ULL) {
+    return 0;
+  }
+  request_due = false;
+  request_sent_us = now;
+
+  StaticJsonDocument<64> doc;
+  doc["t1_us"] = now;
+  return serializeJson(doc, out, size);
+}
+
+void timeSyncConnected() {
+  request_due = true;
+}
+
+bool timeSyncStepPending() {
+  return step_pending;
+}
+
+void timeSyncApplyStep() {
+  if (!step_pending) {
+    return;
+  }
+  uint64_t now = powerClockMicros();
+  int64_t moved = (int64_t)(now + fitOffsetAt(now) - powerGridMicros());
+  powerSetTimebase(fitOffsetAt(now), fit_drift_ppb, now, true);
+  step_pending = false;
+  synced = true;
+  steps++;
+
+  Serial.print("Time sync: grid moved ");
+  Serial.print((int32_t)constrain(moved / 1000, (int64_t)INT32_MIN, (int64_t)INT32_MAX));
+  Serial.print("ms, drift ");
+  Serial.print(fit_drift_ppb);
+  Serial.println("ppb");
+}
+
+bool timeSyncSynced() {
+  return synced;
+}
+
+// The fit's residual and the one-way delay, growing at the holdover drift
+// while no samples come in
+int32_t timeSyncErrorUs() {
+  if (!synced) {
+    return -1;
+  }
+  uint64_t age_us = powerClockMicros() - last_sample_us;
+  uint64_t error = (uint64_t)fit_rms_us + delay_us + restored_error_us +
+                   age_us * TIME_SYNC_HOLDOVER_PPM / 1000000;
+  return min(error, (uint64_t)INT32_MAX);
+}
+
+TimeSyncStats timeSyncStats() {
+  TimeSyncStats stats;
+  stats.synced = synced;
+  stats.error_us = timeSyncErrorUs();
+  stats.offset_us = fitted ? fitOffsetAt(powerClockMicros()) : 0;
+  stats.drift_ppb = fit_drift_ppb;
+  stats.rtt_us = rtt_us;
+  stats.beacons = beacons;
+  stats.replies = replies;
+  stats.rejected = rejected;
+  stats.steps = steps;
+  stats.epoch_s = epoch_s;
+  return stats;
+}
+
+// The grid as applied, not a fit still waiting for its step: the buffered
+// ticks are on that one
+void timeSyncSave(TimeSyncSaved* out) {
+  uint64_t now = powerClockMicros();
+  out->offset_us = (int64_t)(powerGridAt(now) - now);
+  out->drift_ppb = fit_drift_ppb;
+  out->error_us = timeSyncErrorUs();
+}
+
+void timeSyncRestore(const TimeSyncSaved& saved, uint64_t clock_us) {
+  if (saved.error_us < 0) {
+    return;
+  }
+  // The saved grid is the prior the next samples are checked against
+  synced = true;
+  fitted = true;
+  fit_offset_us = saved.offset_us;
+  fit_ref_us = clock_us;
+  fit_drift_ppb = saved.drift_ppb;
+  fit_rms_us = 0;
+  last_sample_us = clock_us;
+  restored_error_us = saved.error_us;
+  powerSetTimebase(saved.offset_us, saved.drift_ppb, clock_us, false);
+}
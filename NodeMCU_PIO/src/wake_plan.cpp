@@ -0,0 +1,36 @@
+#include "wake_plan.h"
+
+// Radio wakes come every samples_per_publish ticks, at the node's phase
+static bool radioTick(const WakeState& s, uint32_t tick) {
+  return tick % s.samples_per_publish == s.phase_tick % s.samples_per_publish;
+}
+
+WakePlan wakePlan(const WakeState& s) {
+  uint64_t poll_us = DEEP_SLEEP_POLL_MS * 1000ULL;
+  if (s.now_us + poll_us < s.planned_us) {
+    return {WAKE_SLEEP, s.flags, s.planned_us};
+  }
+  if (s.next_tick_us < s.now_us + poll_us) {
+    return {WAKE_SAMPLE, s.flags, 0};
+  }
+
+  bool radio = s.flags & DEEP_SLEEP_RADIO;
+  if (radio && !s.window_done) {
+    return {WAKE_PUBLISH, s.flags, 0};
+  }
+
+  uint8_t flags = s.flags & DEEP_SLEEP_WINDOW_FAILED;
+  if (s.window_done) {
+    flags = s.window_failed ? DEEP_SLEEP_WINDOW_FAILED : 0;
+  }
+  if (s.echo_due) {
+    flags |= DEEP_SLEEP_ECHO_DUE;
+  }
+  if (!radio && ((s.alarms_pending && !(flags & DEEP_SLEEP_WINDOW_FAILED)) || s.filled)) {
+    return {WAKE_SLEEP, (uint8_t)(flags | DEEP_SLEEP_RADIO), 0};
+  }
+  if (radioTick(s, s.next_tick)) {
+    flags |= DEEP_SLEEP_RADIO;
+  }
+  return {WAKE_SLEEP, flags, s.next_tick_us};
+}
@@ -0,0 +1,43 @@
+#include "window_aggregate.h"
+
+static ZoneAggregate open_window[ZONE_COUNT];
+static ZoneAggregate latest[ZONE_COUNT];
+
+static void addField(FieldStats& f, float value, bool first) {
+  if (first) {
+    f = {value, value, value};
+    return;
+  }
+  f.min = min(f.min, value);
+  f.max = max(f.max, value);
+  f.sum += value;
+}
+
+void aggregateSample(uint8_t zone, uint32_t tick, const ZoneData& data, uint8_t flags) {
+  ZoneAggregate& a = open_window[zone];
+  if (a.count == 0 && a.skipped == 0) {
+    a.first_tick = tick;
+  }
+  a.last_tick = tick;
+  if (flags & (ZONE_FLAGS_INVALID | ZONE_FLAG_RANGE_SWITCH)) {
+    a.skipped++;
+    a.invalid += (flags & ZONE_FLAGS_INVALID) ? 1 : 0;
+    return;
+  }
+  bool first = a.count == 0;
+  addField(a.current_mA, data.current_mA, first);
+  addField(a.voltage_V, data.busvoltage, first);
+  addField(a.power_mW, data.power_mW, first);
+  a.count++;
+}
+
+void aggregateClose() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    latest[z] = open_window[z];
+    open_window[z] = {};
+  }
+}
+
+const ZoneAggregate& aggregateLatest(uint8_t zone) {
+  return latest[zone];
+}
@@ -0,0 +1,93 @@
+#include "zone_filter.h"
+
+#define FILTER_FRAC 8          // fractional bits of the estimate and variances
+#define FILTER_ONE (1UL << 16) // gain of 1.0
+
+struct FilterState {
+  bool primed;
+  int32_t x;       // estimate, 1/256 mA
+  uint32_t p;      // estimate variance, 1/256 mA²
+  uint32_t q;
+  uint32_t r;
+  uint32_t gate2;  // gate_sigma², Q8
+  uint32_t gain;   // last gain, Q16
+  int8_t outlier;  // side of the last reading if it was off the gate
+  uint32_t updates;
+  uint32_t outliers;
+  uint32_t steps;
+};
+
+static FilterState filters[ZONE_COUNT];
+
+static uint32_t toFixed(float v) {
+  return (uint32_t)lroundf(max(v, 0.0f) * (1 << FILTER_FRAC));
+}
+
+void filterBegin() {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    filters[z] = {};
+  }
+}
+
+void filterConfigure(uint8_t zone, float q_mA2, float r_mA2, float gate_sigma) {
+  FilterState& f = filters[zone];
+  f.q = toFixed(q_mA2);
+  f.r = toFixed(r_mA2);
+  f.gate2 = toFixed(gate_sigma * gate_sigma);
+}
+
+float filterUpdate(uint8_t zone, float current_mA) {
+  FilterState& f = filters[zone];
+  int32_t z = lroundf(current_mA * (1 << FILTER_FRAC));
+  f.updates++;
+  if (!f.primed || f.r == 0) {
+    f.primed = true;
+    f.outlier = 0;
+    f.x = z;
+    f.p = f.r;
+    f.gain = FILTER_ONE;
+    return current_mA;
+  }
+
+  // Predict: the estimate stays, its uncertainty grows by q
+  uint32_t p = f.p + f.q;
+  int64_t y = (int64_t)z - f.x;          // innovation, Q8
+  uint64_t s = (uint64_t)p + f.r;        // its variance, Q8
+
+  // y² (Q16) against gate² (Q8) times s (Q8)
+  if (f.gate2 != 0 && (uint64_t)(y * y) > (uint64_t)f.gate2 * s) {
+    int8_t side = y > 0 ? 1 : -1;
+    f.outliers++;
+    if (f.outlier != side) {
+      f.outlier = side;
+      return (float)f.x / (1 << FILTER_FRAC);
+    }
+    f.outlier = 0;
+    f.steps++;
+    f.x = z;
+    f.p = f.r;
+    f.gain = FILTER_ONE;
+    return current_mA;
+  }
+  f.outlier = 0;
+
+  uint32_t k = ((uint64_t)p << 16) / s;
+  f.x += (int32_t)(((int64_t)k * y) >> 16);
+  f.p = ((uint64_t)(FILTER_ONE - k) * p) >> 16;
+  f.gain = k;
+  return (float)f.x / (1 << FILTER_FRAC);
+}
+
+float filterHold(uint8_t zone, float current_mA) {
+  const FilterState& f = filters[zone];
+  return f.primed ? (float)f.x / (1 << FILTER_FRAC) : current_mA;
+}
+
+void filterReset(uint8_t zone) {
+  filters[zone].primed = false;
+}
+
+ZoneFilterStats filterStats(uint8_t zone) {
+  const FilterState& f = filters[zone];
+  return {f.updates, f.outliers, f.steps, (float)f.gain / FILTER_ONE};
+}
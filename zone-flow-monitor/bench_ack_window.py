@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+Throughput and latency of acked zone data at different ack windows.
+
+Plays the node's side of the ack protocol (ack_window.h) against a local
+broker: zone messages stamped with boot_id/seq go out on
+<site>/<node>/zone1 with at most WINDOW of them unacked, and one is sent
+again when its ack on <site>/<node>/ack is late. The acks come from the
+running backend (mqtt_fastapi_server.py), or with --direct from a minimal
+acker in this script, which leaves only the broker in the path.
+
+--loss drops that fraction of first transmissions on purpose, so the
+retransmit path shows up in the figures.
+"""
+
+import argparse
+import json
+import random
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+import zone_payload
+
+SITE_ID = "site1"
+NODE_ID = "bench-ack"
+ZONE_ID = "zone1"
+
+
+class DirectAcker:
+    """Acks zone messages the way the backend does, without the backend."""
+
+    def __init__(self, broker, port):
+        self.client = mqtt.Client()
+        self.client.on_message = self._on_message
+        self.client.connect(broker, port, 60)
+        self.client.subscribe(f"{SITE_ID}/{NODE_ID}/{ZONE_ID}")
+        self.client.loop_start()
+
+    def _on_message(self, client, userdata, msg):
+        payload = json.loads(msg.payload)
+        client.publish(f"{SITE_ID}/{NODE_ID}/ack",
+                       json.dumps({"zone_id": payload["zone_id"], "seq": payload["seq"]}))
+
+    def stop(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+class AckWindowBench:
+    def __init__(self, args):
+        self.args = args
+        self.cond = threading.Condition()
+        self.in_flight = {}  # seq -> (first sent, last sent, retransmitted)
+        self.rtts = []
+        self.retransmits = 0
+
+    def _on_ack(self, client, userdata, msg):
+        ack = json.loads(msg.payload)
+        with self.cond:
+            entry = self.in_flight.pop(ack.get("seq"), None)
+            if entry is None:
+                return
+            # Karn's rule, as on the node: retransmitted messages have no clean RTT
+            if not entry[2]:
+                self.rtts.append((time.perf_counter() - entry[0]) * 1000.0)
+            self.cond.notify()
+
+    def _payload(self, seq):
+        return zone_payload.encode_json({
+            "node_id": NODE_ID, "zone_id": ZONE_ID, "timestamp": seq * 1000,
+            "current_mA": 100.0, "voltage_V": 12.0, "power_mW": 1200.0,
+            "boot_id": self.boot_id, "seq": seq, "uptime_ms": int(time.monotonic() * 1000),
+        })
+
+    def _send(self, client, seq, retransmit):
+        # A "lost" first transmission never reaches the broker
+        if retransmit or random.random() >= self.args.loss:
+            client.publish(f"{SITE_ID}/{NODE_ID}/{ZONE_ID}", self._payload(seq))
+
+    def run_window(self, window):
+        """Sends --messages messages with the given window; returns the result row."""
+        self.boot_id = random.getrandbits(32)
+        self.in_flight.clear()
+        self.rtts = []
+        self.retransmits = 0
+        timeout_s = self.args.ack_timeout_ms / 1000.0
+
+        client = mqtt.Client()
+        client.on_message = self._on_ack
+        client.connect(self.args.broker, self.args.port, 60)
+        client.subscribe(f"{SITE_ID}/{NODE_ID}/ack")
+        client.loop_start()
+        time.sleep(0.2)
+
+        start = time.perf_counter()
+        next_seq = 0
+        with self.cond:
+            while next_seq < self.args.messages or self.in_flight:
+                now = time.perf_counter()
+                for seq, (first, last, _) in list(self.in_flight.items()):
+                    if now - last >= timeout_s:
+                        self.in_flight[seq] = (first, now, True)
+                        self.retransmits += 1
+                        self._send(client, seq, True)
+                while next_seq < self.args.messages and len(self.in_flight) < window:
+                    self.in_flight[next_seq] = (time.perf_counter(), time.perf_counter(), False)
+                    self._send(client, next_seq, False)
+                    next_seq += 1
+                self.cond.wait(timeout_s / 4)
+        elapsed = time.perf_counter() - start
+
+        client.loop_stop()
+        client.disconnect()
+        rtts = sorted(self.rtts)
+
+        def pct(p):
+            return rtts[min(len(rtts) - 1, int(p / 100.0 * len(rtts)))] if rtts else float("nan")
+
+        return {
+            "window": window,
+            "msgs_per_s": self.args.messages / elapsed,
+            "p50": pct(50), "p95": pct(95), "p99": pct(99),
+            "retransmits": self.retransmits,
+        }
+
+    def run(self):
+        acker = DirectAcker(self.args.broker, self.args.port) if self.args.direct else None
+        try:
+            results = [self.run_window(w) for w in self.args.windows]
+        finally:
+            if acker:
+                acker.stop()
+        self.report(results)
+
+    def report(self, results):
+        print()
+        print("Acked Zone Data")
+        print("=" * 60)
+        print(f"   Acker: {'direct' if self.args.direct else 'backend'}, "
+              f"messages: {self.args.messages}, loss: {self.args.loss:.0%}, "
+              f"ack timeout: {self.args.ack_timeout_ms} ms")
+        print(f"   {'window':>6} {'msgs/s':>9} {'rtt p50':>9} {'p95':>9} {'p99':>9} {'retx':>6}")
+        for r in results:
+            print(f"   {r['window']:>6} {r['msgs_per_s']:>9.1f} {r['p50']:>7.1f}ms "
+                  f"{r['p95']:>7.1f}ms {r['p99']:>7.1f}ms {r['retransmits']:>6}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--messages", type=int, default=500)
+    parser.add_argument("--windows", type=int, nargs="+", default=[1, 4, 8])
+    parser.add_argument("--ack-timeout-ms", type=int, default=2000)
+    parser.add_argument("--loss", type=float, default=0.0,
+                        help="fraction of first transmissions to drop")
+    parser.add_argument("--direct", action="store_true",
+                        help="ack from this script instead of the backend")
+    AckWindowBench(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
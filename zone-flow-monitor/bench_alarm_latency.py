@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""
+End-to-end alarm latency benchmark against a local broker.
+
+Acts as a node: publishes alarm transitions the way the firmware does
+(retained, on <site>/<node>/alarms/<zone>/<alarm>) and times how long each one
+takes to come out of the backend's Server-Sent Events alarm stream. With
+--direct the backend is skipped and a plain MQTT subscriber is timed
+instead, which isolates the broker hop.
+
+On the node, detection adds up to one fast pass (PROTECTION_INTERVAL_MS,
+50 ms) before the publish; the report adds that budget to the measured
+percentiles and checks the total against the 200 ms target.
+
+Requires the broker and (without --direct) mqtt_fastapi_server.py running.
+"""
+
+import argparse
+import json
+import statistics
+import threading
+import time
+import urllib.request
+import uuid
+
+import paho.mqtt.client as mqtt
+
+BENCH_TOPIC = "site1/bench/alarms/zone1/bench"
+
+
+class AlarmLatencyBench:
+    def __init__(self, args):
+        self.args = args
+        self.run_id = uuid.uuid4().hex[:8]
+        self.latencies_ms = []
+        self.received = threading.Event()
+        self.lock = threading.Lock()
+
+    def _record(self, payload):
+        if payload.get("bench_id") != self.run_id:
+            return
+        latency = (time.time() - payload["bench_sent_at"]) * 1000.0
+        with self.lock:
+            self.latencies_ms.append(latency)
+        self.received.set()
+
+    def _read_stream(self):
+        """Read the backend SSE stream and record bench alarms."""
+        url = f"{self.args.api}/alarms/stream"
+        with urllib.request.urlopen(url, timeout=30) as stream:
+            for raw in stream:
+                line = raw.decode("utf-8").strip()
+                if line.startswith("data:"):
+                    self._record(json.loads(line[5:]))
+
+    def _on_direct_message(self, client, userdata, msg):
+        if msg.payload:
+            self._record(json.loads(msg.payload))
+
+    def run(self):
+        a = self.args
+        publisher = mqtt.Client()
+        publisher.connect(a.broker, a.port, 60)
+        publisher.loop_start()
+
+        if a.direct:
+            listener = mqtt.Client()
+            listener.on_message = self._on_direct_message
+            listener.connect(a.broker, a.port, 60)
+            listener.subscribe("site1/+/alarms/#", qos=1)
+            listener.loop_start()
+        else:
+            threading.Thread(target=self._read_stream, daemon=True).start()
+        # Let the subscription / stream settle before the first alarm
+        time.sleep(1.0)
+
+        path = "broker -> subscriber" if a.direct else "broker -> backend -> SSE"
+        print(f"[BENCH] {a.count} alarm transitions, {path}")
+        lost = 0
+        for i in range(a.count):
+            self.received.clear()
+            payload = {
+                "node_id": "bench",
+                "zone_id": "zone1",
+                "alarm": "bench",
+                "active": i % 2 == 0,
+                "value": i,
+                "timestamp": int(time.monotonic() * 1000),
+                "bench_id": self.run_id,
+                "bench_sent_at": time.time(),
+            }
+            publisher.publish(BENCH_TOPIC, json.dumps(payload), qos=1, retain=True)
+            if not self.received.wait(a.timeout):
+                lost += 1
+            time.sleep(a.interval)
+
+        # Remove the retained bench alarm from the broker
+        publisher.publish(BENCH_TOPIC, b"", qos=1, retain=True)
+        time.sleep(0.2)
+        publisher.loop_stop()
+        publisher.disconnect()
+        self.report(lost)
+
+    def report(self, lost):
+        a = self.args
+        samples = sorted(self.latencies_ms)
+        print()
+        print("Alarm Latency")
+        print("=" * 40)
+        if not samples:
+            print("[ERROR] No alarms received. Is the backend/broker running?")
+            return
+
+        def pct(p):
+            return samples[min(len(samples) - 1, int(p / 100.0 * len(samples)))]
+
+        print(f"   Received: {len(samples)}/{a.count} (lost {lost})")
+        print(f"   min {samples[0]:7.2f} ms   mean {statistics.mean(samples):7.2f} ms")
+        print(f"   p50 {pct(50):7.2f} ms   p95  {pct(95):7.2f} ms   p99 {pct(99):7.2f} ms")
+        print(f"   max {samples[-1]:7.2f} ms")
+        total = pct(95) + a.detect_ms
+        verdict = "OK" if total <= a.target_ms and lost == 0 else "OVER TARGET"
+        print(f"   p95 + node detection ({a.detect_ms:g} ms) = {total:.2f} ms "
+              f"vs {a.target_ms:g} ms target: {verdict}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--api", default="http://localhost:8000/api/v1")
+    parser.add_argument("--direct", action="store_true",
+                        help="time a plain MQTT subscriber instead of the backend stream")
+    parser.add_argument("--count", type=int, default=200)
+    parser.add_argument("--interval", type=float, default=0.05,
+                        help="seconds between transitions")
+    parser.add_argument("--timeout", type=float, default=2.0,
+                        help="seconds before a transition counts as lost")
+    parser.add_argument("--detect-ms", type=float, default=50.0,
+                        help="worst-case detection delay on the node")
+    parser.add_argument("--target-ms", type=float, default=200.0)
+    AlarmLatencyBench(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,350 @@
+#!/usr/bin/env python3
+"""
+Broker failover and failback with acked zone data, on one host.
+
+Starts two mosquitto instances (--ports, primary first) unless --no-spawn,
+and plays a node against them: one zone sample per --interval-ms, kept
+until acked and sent again when the ack is late (ack_window.h), on the
+broker the node's broker pool picks. The selection, its back-off and the
+probe-based failback are the node's own broker_pool.cpp, built for the
+host by firmware_host.py with the defaults from node_config.h (only the
+probe interval is shortened, --probe-s). Acks come from a minimal acker on
+each broker, or with --backend from mqtt_fastapi_server.py started with
+
+    MQTT_BROKERS=localhost:1883,localhost:1884
+
+After --before seconds the primary is stopped: killed, or with --hang
+frozen (SIGSTOP), which leaves the connection open so the loss is only
+noticed by the keepalive. It comes back after --outage seconds, and the
+run ends --after seconds later once everything is acked.
+
+Failover time is from the stop to the first ack through the backup,
+failback time from the restart to the first ack through the primary.
+Every sample produced must end up acked: lost must be 0.
+"""
+
+import argparse
+import ctypes
+import json
+import random
+import signal
+import socket
+import subprocess
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+import firmware_host
+import zone_payload
+
+SITE_ID = "site1"
+NODE_ID = "bench-failover"
+ZONE_ID = "zone1"
+
+# node_config.h defaults
+MQTT_KEEPALIVE_S = 5
+BROKER_CONNECT_TIMEOUT_MS = 2000
+BROKER_FAILBACK_PROBE_MS = 30000
+BROKER_FAILBACK_PROBES = 2
+
+
+def ms(t):
+    """Monotonic seconds as the node's millis()"""
+    return int(t * 1000) & 0xFFFFFFFF
+
+
+class BrokerPool:
+    """The firmware's broker pool over the bench brokers (all on localhost)."""
+
+    def __init__(self, lib, ports):
+        self.lib = lib
+        self.ports = ports
+        servers = (ctypes.c_char_p * len(ports))(*[b"localhost"] * len(ports))
+        lib.hostBrokerSet(servers, (ctypes.c_uint16 * len(ports))(*ports), len(ports))
+
+    def next(self, now):
+        return self.lib.hostBrokerNext(ms(now))
+
+    def retry_delay(self, now):
+        return self.lib.hostBrokerRetryDelay(ms(now)) / 1000.0
+
+    def attempted(self, i, ok, elapsed_ms, now):
+        self.lib.hostBrokerAttempted(i, ok, round(elapsed_ms), ms(now))
+
+    def disconnected(self):
+        self.lib.hostBrokerDisconnected()
+
+    @property
+    def active(self):
+        i = self.lib.hostBrokerActive()
+        return i if i >= 0 else None
+
+    def failback_candidate(self, now):
+        i = self.lib.hostBrokerFailbackCandidate(ms(now))
+        return i if i >= 0 else None
+
+    def probed(self, i, ok, elapsed_ms, now):
+        return self.lib.hostBrokerProbed(i, ok, round(elapsed_ms), ms(now))
+
+    @property
+    def failback_to(self):
+        i = self.lib.hostBrokerFailbackTarget()
+        return i if i >= 0 else None
+
+    @property
+    def failovers(self):
+        return self.lib.hostBrokerFailovers()
+
+    @property
+    def failbacks(self):
+        return self.lib.hostBrokerFailbacks()
+
+    def health(self, i):
+        health = firmware_host.BrokerHealth()
+        self.lib.hostBrokerHealth(i, ctypes.byref(health))
+        return health
+
+
+class DirectAcker:
+    """Acks zone messages the way the backend does, counting receipts."""
+
+    def __init__(self, port, receipts, lock):
+        self.port = port
+        self.receipts = receipts
+        self.lock = lock
+        self.client = mqtt.Client()
+        self.client.on_connect = lambda c, u, f, rc: c.subscribe(f"{SITE_ID}/{NODE_ID}/{ZONE_ID}")
+        self.client.on_message = self._on_message
+        self.client.connect_async("localhost", port, MQTT_KEEPALIVE_S)
+        self.client.loop_start()
+
+    def _on_message(self, client, userdata, msg):
+        payload = json.loads(msg.payload)
+        with self.lock:
+            self.receipts[payload["seq"]] = self.receipts.get(payload["seq"], 0) + 1
+        client.publish(f"{SITE_ID}/{NODE_ID}/ack",
+                       json.dumps({"zone_id": payload["zone_id"], "seq": payload["seq"]}))
+
+    def stop(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+class Node:
+    def __init__(self, args, pool):
+        self.args = args
+        self.pool = pool
+        self.cond = threading.Condition()
+        self.client = None
+        self.connected = False
+        self.boot_id = random.getrandbits(32)
+        self.next_seq = 0
+        self.unacked = {}  # seq -> last sent
+        self.acked_via = {}  # seq -> broker index the ack came through
+        self.reconnect_at = 0.0
+
+    def _on_connect(self, client, userdata, flags, rc):
+        with self.cond:
+            self.connected = rc == 0
+            self.cond.notify_all()
+
+    def _on_disconnect(self, client, userdata, rc):
+        with self.cond:
+            self.connected = False
+            self.cond.notify_all()
+
+    def _on_ack(self, client, userdata, msg):
+        seq = json.loads(msg.payload).get("seq")
+        with self.cond:
+            if self.unacked.pop(seq, None) is not None:
+                self.acked_via[seq] = (userdata, time.monotonic())
+
+    def _drop(self):
+        if self.client:
+            self.client.loop_stop()
+            self.client.disconnect()
+            self.client = None
+        self.connected = False
+        self.pool.disconnected()
+
+    def _connect(self, now):
+        i = self.pool.next(now)
+        client = mqtt.Client(userdata=i)
+        client.on_connect = self._on_connect
+        client.on_disconnect = self._on_disconnect
+        client.on_message = self._on_ack
+        start = time.monotonic()
+        ok = False
+        try:
+            client.connect("localhost", self.pool.ports[i], MQTT_KEEPALIVE_S)
+            client.loop_start()
+            with self.cond:
+                self.cond.wait_for(lambda: self.connected, BROKER_CONNECT_TIMEOUT_MS / 1000.0)
+                ok = self.connected
+        except OSError:
+            pass
+        elapsed_ms = (time.monotonic() - start) * 1000.0
+        self.pool.attempted(i, ok, elapsed_ms, time.monotonic())
+        if not ok:
+            client.loop_stop()
+            client.disconnect()
+            print(f"[NODE] Broker {i} (:{self.pool.ports[i]}) failed after {elapsed_ms:.0f} ms")
+            return
+        client.subscribe(f"{SITE_ID}/{NODE_ID}/ack")
+        self.client = client
+        print(f"[NODE] Connected to broker {i} (:{self.pool.ports[i]}) in {elapsed_ms:.0f} ms")
+
+    def _probe(self, now):
+        i = self.pool.failback_candidate(now)
+        if i is None:
+            return
+        start = time.monotonic()
+        try:
+            socket.create_connection(("localhost", self.pool.ports[i]),
+                                     BROKER_CONNECT_TIMEOUT_MS / 1000.0).close()
+            ok = True
+        except OSError:
+            ok = False
+        if self.pool.probed(i, ok, (time.monotonic() - start) * 1000.0, time.monotonic()):
+            print(f"[NODE] Broker {i} answered {BROKER_FAILBACK_PROBES} probes, failing back when idle")
+
+    def _payload(self, seq):
+        return zone_payload.encode_json({
+            "node_id": NODE_ID, "zone_id": ZONE_ID, "timestamp": seq * self.args.interval_ms,
+            "current_mA": 100.0, "voltage_V": 12.0, "power_mW": 1200.0,
+            "boot_id": self.boot_id, "seq": seq, "uptime_ms": int(time.monotonic() * 1000),
+        })
+
+    def step(self, produce):
+        """One pass of the node loop; returns True while samples are unacked."""
+        now = time.monotonic()
+        with self.cond:
+            if produce and now >= self.next_sample_at:
+                self.unacked[self.next_seq] = 0.0
+                self.next_seq += 1
+                self.next_sample_at += self.args.interval_ms / 1000.0
+            connected = self.connected
+        if self.client and not connected:
+            print(f"[NODE] Lost broker {self.pool.active}")
+            self._drop()
+        if not self.client:
+            if now >= self.reconnect_at:
+                self._connect(now)
+                if not self.client:
+                    self.reconnect_at = time.monotonic() + self.pool.retry_delay(time.monotonic())
+            return bool(self.unacked)
+        with self.cond:
+            due = [seq for seq, sent in self.unacked.items()
+                   if now - sent >= self.args.ack_timeout_ms / 1000.0]
+            for seq in due:
+                self.unacked[seq] = now
+        for seq in due:
+            self.client.publish(f"{SITE_ID}/{NODE_ID}/{ZONE_ID}", self._payload(seq))
+        self._probe(now)
+        # Fail back only when idle, so nothing in flight is sent twice
+        with self.cond:
+            idle = not self.unacked
+        if self.pool.failback_to is not None and idle:
+            print(f"[NODE] Failing back to broker {self.pool.failback_to}")
+            self._drop()
+        return bool(self.unacked)
+
+    def run(self, seconds, produce=True):
+        self.next_sample_at = getattr(self, "next_sample_at", time.monotonic())
+        end = time.monotonic() + seconds
+        while time.monotonic() < end:
+            self.step(produce)
+            time.sleep(0.02)
+
+    def drain(self, timeout):
+        end = time.monotonic() + timeout
+        while self.step(False) and time.monotonic() < end:
+            time.sleep(0.02)
+        self._drop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ports", type=int, nargs=2, default=[1883, 1884], help="primary, backup")
+    parser.add_argument("--no-spawn", action="store_true",
+                        help="use brokers already running (stopped and restarted by hand)")
+    parser.add_argument("--backend", action="store_true",
+                        help="ack from the backend instead of this script")
+    parser.add_argument("--hang", action="store_true", help="freeze the primary instead of killing it")
+    parser.add_argument("--interval-ms", type=int, default=200)
+    parser.add_argument("--ack-timeout-ms", type=int, default=2000)
+    parser.add_argument("--probe-s", type=float, default=BROKER_FAILBACK_PROBE_MS / 1000.0 / 10,
+                        help="failback probe interval (node default 30 s, shortened here)")
+    parser.add_argument("--before", type=float, default=5.0)
+    parser.add_argument("--outage", type=float, default=20.0)
+    parser.add_argument("--after", type=float, default=15.0)
+    args = parser.parse_args()
+
+    def spawn(port):
+        return subprocess.Popen(["mosquitto", "-p", str(port)],
+                                stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    brokers = [] if args.no_spawn else [spawn(p) for p in args.ports]
+    time.sleep(0.5)
+    receipts = {}
+    lock = threading.Lock()
+    ackers = [] if args.backend else [DirectAcker(p, receipts, lock) for p in args.ports]
+    lib = firmware_host.load(BROKER_FAILBACK_PROBE_MS=round(args.probe_s * 1000))
+    pool = BrokerPool(lib, args.ports)
+    node = Node(args, pool)
+    try:
+        node.run(args.before)
+        stopped_at = time.monotonic()
+        if brokers and args.hang:
+            brokers[0].send_signal(signal.SIGSTOP)
+        elif brokers:
+            brokers[0].kill()
+            brokers[0].wait()
+        print(f"[BENCH] Primary :{args.ports[0]} {'frozen' if args.hang else 'stopped'}")
+        node.run(args.outage)
+        restarted_at = time.monotonic()
+        if brokers and args.hang:
+            brokers[0].send_signal(signal.SIGCONT)
+        elif brokers:
+            brokers[0] = spawn(args.ports[0])
+        print(f"[BENCH] Primary :{args.ports[0]} back")
+        node.run(args.after)
+        node.drain(30.0)
+    finally:
+        for acker in ackers:
+            acker.stop()
+        for broker in brokers:
+            broker.send_signal(signal.SIGCONT)
+            broker.terminate()
+
+    via = node.acked_via
+    first_backup = min((t for i, t in via.values() if i == 1 and t >= stopped_at), default=None)
+    first_back = min((t for i, t in via.values() if i == 0 and t >= restarted_at), default=None)
+    lost = [seq for seq in range(node.next_seq) if seq not in via]
+
+    print()
+    print("Broker Failover")
+    print("=" * 60)
+    print(f"   Primary {'frozen' if args.hang else 'killed'} for {args.outage:g} s, "
+          f"sample interval {args.interval_ms} ms, acker: {'backend' if args.backend else 'direct'}")
+    print(f"   Samples: {node.next_seq}, acked: {len(via)}, lost: {len(lost)}")
+    if not args.backend:
+        print(f"   Duplicates at the backend: {sum(n - 1 for n in receipts.values() if n > 1)}")
+    print(f"   Failover: {first_backup - stopped_at:.1f} s" if first_backup else "   Failover: none")
+    print(f"   Failback: {first_back - restarted_at:.1f} s" if first_back else "   Failback: none")
+    print(f"   Failovers: {pool.failovers}, failbacks: {pool.failbacks}")
+    print(f"   {'broker':>8} {'attempts':>9} {'failures':>9} {'rate':>6} {'connect':>9}")
+    for i, port in enumerate(pool.ports):
+        b = pool.health(i)
+        print(f"   {':' + str(port):>8} {b.attempts:>9} {b.failures:>9} "
+              f"{b.failure_rate:>6.2f} {b.connect_ms:>7d}ms")
+    if lost:
+        print(f"   [WARNING] Lost samples: {lost[:10]}{' ...' if len(lost) > 10 else ''}")
+    else:
+        print("   [OK] No samples lost")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Load benchmark for the node's local HTTP/SSE server (local_server.h).
+
+For each client count, opens that many concurrent /events streams to the
+node, polls /latest alongside them, and records for every "sample" event
+how late the node took the sample behind its grid (late_us, measured on
+the node) and when it arrived here. Sampling jitter that grows with the
+client count means serving the streams is getting in the way of the
+sample ticks; missing event ids mean the node dropped samples for
+lagging clients.
+
+The node turns away clients over LOCAL_SSE_MAX_CLIENTS (4 by default);
+build with e.g. -DLOCAL_SSE_MAX_CLIENTS=16 to go further.
+"""
+
+import argparse
+import http.client
+import json
+import threading
+import time
+
+
+def pct(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))] if values else float("nan")
+
+
+class SseClient(threading.Thread):
+    """One /events stream; collects (tick, late_us, arrival_s) per sample."""
+
+    def __init__(self, host, port, stop):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.stop = stop
+        self.samples = []
+        self.connected = False
+        self.error = None
+
+    def run(self):
+        try:
+            conn = http.client.HTTPConnection(self.host, self.port, timeout=30)
+            conn.request("GET", "/events", headers={"Accept": "text/event-stream"})
+            resp = conn.getresponse()
+            self.connected = resp.status == 200
+            event = None
+            while not self.stop.is_set():
+                line = resp.fp.readline()
+                if not line:
+                    break
+                line = line.decode("utf-8").rstrip("\r\n")
+                if line.startswith("event:"):
+                    event = line[6:].strip()
+                elif line.startswith("data:") and event == "sample":
+                    data = json.loads(line[5:])
+                    self.samples.append((data["tick"], data["late_us"], time.monotonic()))
+            conn.close()
+        except Exception as e:
+            self.error = e
+
+
+class LocalSseBench:
+    def __init__(self, args):
+        self.args = args
+
+    def latest_ms(self, stop, out):
+        """Times GET /latest once a second while the streams run."""
+        while not stop.is_set():
+            start = time.perf_counter()
+            try:
+                conn = http.client.HTTPConnection(self.args.host, self.args.port, timeout=5)
+                conn.request("GET", "/latest")
+                conn.getresponse().read()
+                conn.close()
+                out.append((time.perf_counter() - start) * 1000.0)
+            except Exception:
+                pass
+            stop.wait(1.0)
+
+    def run_clients(self, n):
+        stop = threading.Event()
+        clients = [SseClient(self.args.host, self.args.port, stop) for _ in range(n)]
+        for c in clients:
+            c.start()
+        latest = []
+        poller = threading.Thread(target=self.latest_ms, args=(stop, latest), daemon=True)
+        poller.start()
+        time.sleep(self.args.duration)
+        stop.set()
+        for c in clients:
+            c.join(timeout=self.args.interval_ms / 1000.0 * 2 + 1)
+
+        streaming = [c for c in clients if c.samples]
+        late = [s[1] for c in streaming for s in c.samples]
+        # Arrival jitter: deviation of each inter-arrival from the tick spacing
+        arrival = []
+        missing = 0
+        for c in streaming:
+            for (t0, _, a0), (t1, _, a1) in zip(c.samples, c.samples[1:]):
+                missing += t1 - t0 - 1
+                arrival.append(abs((a1 - a0) * 1000.0 - (t1 - t0) * self.args.interval_ms))
+        return {
+            "clients": n, "streaming": len(streaming),
+            "events": sum(len(c.samples) for c in streaming), "missing": missing,
+            "late_p50": pct(late, 50), "late_p99": pct(late, 99), "late_max": max(late, default=0),
+            "arrival_p99": pct(arrival, 99), "latest_p50": pct(latest, 50),
+        }
+
+    def run(self):
+        results = []
+        for n in self.args.clients:
+            print(f"[BENCH] {n} SSE client(s) for {self.args.duration:.0f} s...")
+            results.append(self.run_clients(n))
+            time.sleep(2)
+        self.report(results)
+
+    def report(self, results):
+        print()
+        print("Local SSE Load")
+        print("=" * 78)
+        print(f"   Node: {self.args.host}:{self.args.port}, sample interval {self.args.interval_ms} ms")
+        print(f"   {'clients':>7} {'streaming':>9} {'events':>7} {'missing':>7} "
+              f"{'late p50':>10} {'late p99':>10} {'late max':>10} {'arr p99':>9} {'/latest':>8}")
+        for r in results:
+            print(f"   {r['clients']:>7} {r['streaming']:>9} {r['events']:>7} {r['missing']:>7} "
+                  f"{r['late_p50']:>8.0f}us {r['late_p99']:>8.0f}us {r['late_max']:>8.0f}us "
+                  f"{r['arrival_p99']:>7.1f}ms {r['latest_p50']:>6.1f}ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host", help="node IP address")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--clients", type=int, nargs="+", default=[1, 2, 4, 8])
+    parser.add_argument("--duration", type=float, default=60.0, help="seconds per client count")
+    parser.add_argument("--interval-ms", type=int, default=5000,
+                        help="the node's SAMPLE_INTERVAL_MS")
+    LocalSseBench(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+"""
+Bytes, packets and CPU per zone sample: MQTT over TCP against MQTT-SN
+over UDP (NodeMCU_PIO/include/mqttsn_client.h, mqttsn_gateway.py).
+
+Bytes and packets come from the wire formats: a zone message with its
+backend ack, keepalive pings, and with --low-power the session a node
+opens and closes every publish window, with IPv4, TCP (no options, one
+pure ACK per two segments, the ESP8266's lwIP MSS) and UDP headers. The
+payload is the node's JSON or packed zone message (zone_encoder.h) for
+each batch size; the backend's ack is the same either way.
+
+CPU is measured on the nodes: with --nodes, the diagnostics of running
+nodes (one built with MQTT_SN, one without) are read from the broker and
+their publish time per sample compared. The gateway prints its own CPU
+time per datagram.
+"""
+
+import argparse
+import json
+import math
+import struct
+import time
+
+IP, TCP, UDP = 20, 20, 8
+SITE_ID = "site1"
+
+
+def varint_len(n):
+    return 1 if n < 128 else 2 if n < 16384 else 3
+
+
+def mqtt_publish(topic, payload):
+    body = 2 + len(topic) + payload
+    return 1 + varint_len(body) + body
+
+
+def sn_frame(body):
+    return body + (2 if body + 2 <= 255 else 4)
+
+
+def zone_payload(encoding, node_id, rows):
+    if encoding == "packed":
+        return struct.calcsize("<BBBIIIQIIiB") + len("32V_2A") + rows * struct.calcsize("<HhHHB") + 4
+    doc = {"node_id": node_id, "zone_id": "zone1", "timestamp": 123456000, "current_mA": 1234.5,
+           "voltage_V": 12.345, "power_mW": 15240.0, "range": "32V_2A", "boot_id": 2882400001,
+           "seq": 12345, "uptime_ms": 123456789}
+    if rows > 1:
+        doc["first_seq"] = 12345 - rows + 1
+        doc["samples"] = [[123456000 - i * 5000, 1234.5, 12.345, 15240.0] for i in range(rows)]
+    doc["crc32"] = "0badc0de"
+    return len(json.dumps(doc, separators=(",", ":")))
+
+
+class Tally:
+    def __init__(self):
+        self.bytes = 0
+        self.packets = 0
+
+    def add(self, size, packets=1):
+        self.bytes += size
+        self.packets += packets
+
+
+def tcp_message(t, size, mss, replies=True):
+    """A message one way over TCP, with the other side's pure ACKs."""
+    segments = max(1, math.ceil(size / mss))
+    t.add(size + segments * (IP + TCP), segments)
+    if replies:
+        acks = math.ceil(segments / 2)
+        t.add(acks * (IP + TCP), acks)
+
+
+def udp_message(t, size):
+    fragments = max(1, math.ceil((size + UDP) / 1480))
+    t.add(size + UDP + fragments * IP, fragments)
+
+
+def window(args, transport, encoding, rows):
+    """Bytes and packets of one publish window of every zone."""
+    node_id = args.node_id
+    root = f"{SITE_ID}/{node_id}/"
+    payload = zone_payload(encoding, node_id, rows)
+    ack = len(json.dumps({"zone_id": "zone1", "seq": 12345}))
+    t = Tally()
+    for _ in range(args.zones):
+        if transport == "tcp":
+            tcp_message(t, mqtt_publish(root + "zone1", payload), args.mss)
+            tcp_message(t, mqtt_publish(root + "ack", ack), args.mss)
+        else:
+            udp_message(t, sn_frame(5 + payload))
+            udp_message(t, sn_frame(5 + ack))
+
+    period_s = rows * args.interval_ms / 1000.0
+    if args.low_power:
+        client_id = "esp-1a2b3c"
+        will = (root + "status", len(json.dumps({"node_id": node_id, "state": "offline"}, separators=(",", ":"))))
+        subscribed = [root + f"zone{z + 1}/control" for z in range(args.zones)] + \
+                     [root + "schedule", f"{SITE_ID}/provision/1a2b3c", root + "ack",
+                      f"{SITE_ID}/config/set", root + "config/set"]
+        if transport == "tcp":
+            t.add(2 * (IP + TCP + 4) + IP + TCP, 3)  # SYN, SYN-ACK with MSS option, ACK
+            connect = 10 + 2 + len(client_id) + 2 + len(will[0]) + 2 + will[1]
+            tcp_message(t, 1 + varint_len(connect) + connect, args.mss)
+            tcp_message(t, 4, args.mss)
+            for topic in subscribed:
+                tcp_message(t, 2 + 2 + 2 + len(topic) + 1, args.mss)
+                tcp_message(t, 5, args.mss)
+            tcp_message(t, 2, args.mss, replies=False)  # DISCONNECT
+            t.add(4 * (IP + TCP), 4)  # FIN, ACK both ways
+        else:
+            for size in (6 + len(client_id), 2, 3 + len(will[0]), 2, 2 + will[1], 3):
+                udp_message(t, size)  # CONNECT ... CONNACK
+            for topic in subscribed:
+                predefined = "/provision/" not in topic and topic != f"{SITE_ID}/config/set"
+                udp_message(t, 7 if predefined else sn_frame(3 + len(topic)))
+                udp_message(t, 8)
+            udp_message(t, 2)
+            udp_message(t, 2)  # DISCONNECT both ways
+    else:
+        # A ping whenever a keepalive period passes without traffic
+        pings = max(0, math.ceil(period_s / args.keepalive_s) - 1)
+        for _ in range(pings):
+            if transport == "tcp":
+                tcp_message(t, 2, args.mss)
+                tcp_message(t, 2, args.mss)
+            else:
+                udp_message(t, 2)
+                udp_message(t, 2)
+    return t, payload
+
+
+def model(args):
+    print()
+    print("Bytes and Packets per Sample")
+    print("=" * 78)
+    print(f"   {args.zones} zones, sample interval {args.interval_ms} ms, keepalive {args.keepalive_s} s, "
+          f"TCP MSS {args.mss}, {'session per window (low power)' if args.low_power else 'session kept'}")
+    print(f"   {'encoding':>8} {'batch':>5} {'payload':>8} {'tcp B':>8} {'pkts':>6} "
+          f"{'sn B':>8} {'pkts':>6} {'bytes':>7} {'packets':>8}")
+    for encoding in args.encodings:
+        for rows in args.batch:
+            samples = rows * args.zones
+            tcp, payload = window(args, "tcp", encoding, rows)
+            sn, _ = window(args, "sn", encoding, rows)
+            print(f"   {encoding:>8} {rows:>5} {payload:>7}B "
+                  f"{tcp.bytes / samples:>8.1f} {tcp.packets / samples:>6.2f} "
+                  f"{sn.bytes / samples:>8.1f} {sn.packets / samples:>6.2f} "
+                  f"{100.0 * (sn.bytes - tcp.bytes) / tcp.bytes:>6.0f}% "
+                  f"{100.0 * (sn.packets - tcp.packets) / tcp.packets:>7.0f}%")
+
+
+def nodes(args):
+    import paho.mqtt.client as mqtt
+
+    latest = {}
+
+    def on_message(client, userdata, msg):
+        latest[msg.topic.split("/")[1]] = json.loads(msg.payload)
+
+    client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(args.broker, args.port, 60)
+    for node_id in args.nodes:
+        client.subscribe(f"{SITE_ID}/{node_id}/diagnostics")
+    client.loop_start()
+    deadline = time.time() + args.wait
+    while time.time() < deadline and len(latest) < len(args.nodes):
+        time.sleep(0.5)
+    client.loop_stop()
+    client.disconnect()
+
+    print()
+    print("Publish CPU on the Nodes")
+    print("=" * 78)
+    print(f"   {'node':>16} {'transport':>9} {'publish':>9} {'max':>9} {'batch':>5} {'per sample':>11} "
+          f"{'datagrams out':>13}")
+    for node_id in args.nodes:
+        diag = latest.get(node_id)
+        if diag is None:
+            print(f"   [WARNING] No diagnostics from {node_id} within {args.wait:g} s")
+            continue
+        transport = diag.get("transport", {})
+        sn = transport.get("mqtt_sn")
+        samples = max(1, diag.get("batch", {}).get("samples", 1))
+        avg = transport.get("publish_avg_us", 0)
+        print(f"   {node_id:>16} {'mqtt-sn' if sn else 'tls' if transport.get('tls') else 'tcp':>9} "
+              f"{avg:>7}us {transport.get('publish_max_us', 0):>7}us {samples:>5} "
+              f"{avg / samples:>9.0f}us {sn['datagrams_out'] if sn else '-':>13}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--batch", type=int, nargs="+", default=[1, 5, 15], help="samples per zone message")
+    parser.add_argument("--encodings", nargs="+", default=["json", "packed"], choices=["json", "packed"])
+    parser.add_argument("--zones", type=int, default=3)
+    parser.add_argument("--interval-ms", type=int, default=5000)
+    parser.add_argument("--keepalive-s", type=int, default=5, help="MQTT_KEEPALIVE_S")
+    parser.add_argument("--mss", type=int, default=536, help="TCP MSS of the node's lwIP build")
+    parser.add_argument("--low-power", action="store_true", help="a session per publish window")
+    parser.add_argument("--node-id", default="esp-1a2b3c")
+    parser.add_argument("--nodes", nargs="+", help="node ids to read publish CPU from")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--wait", type=float, default=90.0, help="seconds to wait for diagnostics")
+    args = parser.parse_args()
+
+    model(args)
+    if args.nodes:
+        nodes(args)
+
+
+if __name__ == "__main__":
+    main()
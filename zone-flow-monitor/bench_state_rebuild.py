@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Time-to-full-state benchmark for retained node state.
+
+Seeds a broker with the retained topics a site of nodes leaves behind
+(status, last reading per zone, zone list, alarm state), then connects a
+fresh subscriber with the backend's subscriptions and times how long the
+broker takes to replay all of it. That is the floor for how quickly a
+restarted backend is back to full state; the backend reports its own
+figure under state_rebuild in /api/v1/status.
+
+The seeded topics are removed again unless --keep is given.
+"""
+
+import argparse
+import json
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+import zone_payload
+
+SITE_ID = "site1"
+ZONES = ["zone1", "zone2", "zone3"]
+ALARMS = ["over_voltage", "sensor_error", "zone_offline"]
+
+
+class StateRebuildBench:
+    def __init__(self, args):
+        self.args = args
+        self.expected = set()
+        self.received = set()
+        self.done = threading.Event()
+        self.lock = threading.Lock()
+
+    def _seed_topics(self):
+        """Retained topics and payloads for every simulated node."""
+        for n in range(self.args.nodes):
+            node_id = f"bench-{n:03d}"
+            base = f"{SITE_ID}/{node_id}"
+            yield f"{base}/status", {"node_id": node_id, "state": "online", "payload_crc": True}
+            yield f"{base}/zones", {"node_id": node_id,
+                                    "zones": [{"zone_id": z, "attached": True} for z in ZONES]}
+            for z in ZONES:
+                yield f"{base}/{z}", zone_payload.encode_json({
+                    "node_id": node_id, "zone_id": z, "timestamp": 0,
+                    "current_mA": 100.0, "voltage_V": 12.0, "power_mW": 1200.0})
+                for alarm in ALARMS:
+                    yield f"{base}/alarms/{z}/{alarm}", {"node_id": node_id, "zone_id": z,
+                                                         "alarm": alarm, "active": False}
+
+    def seed(self):
+        publisher = mqtt.Client()
+        publisher.connect(self.args.broker, self.args.port, 60)
+        publisher.loop_start()
+        for topic, payload in self._seed_topics():
+            self.expected.add(topic)
+            if not isinstance(payload, bytes):
+                payload = json.dumps(payload)
+            publisher.publish(topic, payload, qos=1, retain=True).wait_for_publish()
+        publisher.loop_stop()
+        publisher.disconnect()
+        print(f"[BENCH] Seeded {len(self.expected)} retained topics for {self.args.nodes} nodes")
+
+    def clear(self):
+        publisher = mqtt.Client()
+        publisher.connect(self.args.broker, self.args.port, 60)
+        publisher.loop_start()
+        for topic in self.expected:
+            publisher.publish(topic, b"", qos=1, retain=True).wait_for_publish()
+        publisher.loop_stop()
+        publisher.disconnect()
+
+    def _on_message(self, client, userdata, msg):
+        if not msg.retain or msg.topic not in self.expected:
+            return
+        with self.lock:
+            self.received.add(msg.topic)
+            if len(self.received) == len(self.expected):
+                self.done.set()
+
+    def measure(self):
+        """One fresh subscription; returns (connect_ms, full_state_ms or None)."""
+        self.received = set()
+        self.done.clear()
+        connected = threading.Event()
+        client = mqtt.Client()
+        client.on_message = self._on_message
+        client.on_connect = lambda c, u, f, rc: connected.set()
+
+        start = time.perf_counter()
+        client.connect(self.args.broker, self.args.port, 60)
+        client.loop_start()
+        connected.wait(self.args.timeout)
+        connect_ms = (time.perf_counter() - start) * 1000.0
+        # Same subscriptions as mqtt_fastapi_server.py
+        client.subscribe(f"{SITE_ID}/+/+")
+        client.subscribe(f"{SITE_ID}/+/+/protection")
+        client.subscribe(f"{SITE_ID}/+/alarms/#", qos=1)
+        complete = self.done.wait(self.args.timeout)
+        full_ms = (time.perf_counter() - start) * 1000.0 if complete else None
+        client.loop_stop()
+        client.disconnect()
+        return connect_ms, full_ms
+
+    def run(self):
+        self.seed()
+        try:
+            results = [self.measure() for _ in range(self.args.runs)]
+        finally:
+            if not self.args.keep:
+                self.clear()
+        self.report(results)
+
+    def report(self, results):
+        print()
+        print("Time to Full State")
+        print("=" * 40)
+        print(f"   Nodes: {self.args.nodes}, retained topics: {len(self.expected)}")
+        for i, (connect_ms, full_ms) in enumerate(results, 1):
+            full = f"{full_ms:8.1f} ms" if full_ms is not None else "incomplete"
+            print(f"   run {i}: connect {connect_ms:7.1f} ms, full state {full}")
+        complete = sorted(f for _, f in results if f is not None)
+        if complete:
+            print(f"   median full state: {complete[len(complete) // 2]:.1f} ms "
+                  f"({len(self.expected) / (complete[len(complete) // 2] / 1000.0):.0f} topics/s)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--nodes", type=int, default=50)
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--timeout", type=float, default=10.0)
+    parser.add_argument("--keep", action="store_true",
+                        help="leave the seeded retained topics on the broker")
+    StateRebuildBench(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
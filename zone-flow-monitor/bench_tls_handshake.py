@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Checks a TLS broker listener the way an MQTT_TLS node uses it and reports
+what TLS costs on the wire.
+
+Each run opens a TCP connection, does the TLS handshake (offering the
+previous session, as the node does), sends MQTT CONNECT and waits for
+CONNACK, then publishes --publishes QoS 0 messages of --payload bytes. The
+TLS layer runs over memory BIOs so the bytes actually sent are counted:
+handshake bytes for a full vs a resumed handshake, and the record overhead
+added to every publish. The broker's certificate must match --fingerprint
+(SHA-1, as pinned on the node) if one is given.
+
+Times here are host times; the node reports its own handshake time and
+heap under "transport" in its diagnostics.
+"""
+
+import argparse
+import hashlib
+import socket
+import ssl
+import struct
+import time
+
+
+def mqtt_string(s):
+    data = s.encode("utf-8")
+    return struct.pack("!H", len(data)) + data
+
+
+def mqtt_packet(kind, body):
+    length = len(body)
+    encoded = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        encoded.append(byte | (0x80 if length else 0))
+        if not length:
+            break
+    return bytes([kind]) + bytes(encoded) + body
+
+
+def connect_packet(client_id):
+    # Protocol "MQTT" level 4, clean session, 60 s keep-alive
+    return mqtt_packet(0x10, mqtt_string("MQTT") + bytes([4, 0x02]) + struct.pack("!H", 60)
+                       + mqtt_string(client_id))
+
+
+def publish_packet(topic, payload):
+    return mqtt_packet(0x30, mqtt_string(topic) + payload)
+
+
+class TlsConnection:
+    """TLS over a socket through memory BIOs, counting bytes on the wire."""
+
+    def __init__(self, ctx, host, port, session):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.incoming = ssl.MemoryBIO()
+        self.outgoing = ssl.MemoryBIO()
+        self.tls = ctx.wrap_bio(self.incoming, self.outgoing, server_hostname=host,
+                                session=session)
+        self.sent = 0
+        self.received = 0
+
+    def _flush(self):
+        data = self.outgoing.read()
+        if data:
+            self.sock.sendall(data)
+            self.sent += len(data)
+
+    def _fill(self):
+        data = self.sock.recv(16384)
+        if not data:
+            raise ConnectionError("broker closed the connection")
+        self.received += len(data)
+        self.incoming.write(data)
+
+    def handshake(self):
+        while True:
+            try:
+                self.tls.do_handshake()
+                self._flush()
+                return
+            except ssl.SSLWantReadError:
+                self._flush()
+                self._fill()
+
+    def write(self, data):
+        before = self.sent
+        self.tls.write(data)
+        self._flush()
+        return self.sent - before
+
+    def read(self, n):
+        while True:
+            try:
+                return self.tls.read(n)
+            except ssl.SSLWantReadError:
+                self._fill()
+
+    def close(self):
+        self.sock.close()
+
+
+def run_once(args, ctx, session):
+    start = time.perf_counter()
+    conn = TlsConnection(ctx, args.host, args.port, session)
+    tcp_ms = (time.perf_counter() - start) * 1000.0
+    conn.handshake()
+    handshake_ms = (time.perf_counter() - start) * 1000.0 - tcp_ms
+    handshake_bytes = conn.sent + conn.received
+
+    cert = conn.tls.getpeercert(binary_form=True)
+    fingerprint = hashlib.sha1(cert).hexdigest()
+
+    conn.write(connect_packet("bench-tls"))
+    connack = conn.read(4)
+    connect_ms = (time.perf_counter() - start) * 1000.0
+    if len(connack) < 4 or connack[0] != 0x20 or connack[3] != 0:
+        raise ConnectionError(f"CONNACK refused: {connack!r}")
+
+    payload = b"x" * args.payload
+    packet = publish_packet("site1/bench-tls/zone1", payload)
+    wire = [conn.write(packet) for _ in range(args.publishes)]
+    result = {
+        "resumed": conn.tls.session_reused,
+        "tcp_ms": tcp_ms,
+        "handshake_ms": handshake_ms,
+        "connect_ms": connect_ms,
+        "handshake_bytes": handshake_bytes,
+        "publish_bytes": len(packet),
+        "publish_wire": sum(wire) / len(wire) if wire else 0,
+        "fingerprint": fingerprint,
+        "cipher": conn.tls.cipher()[0],
+    }
+    session = conn.tls.session
+    conn.close()
+    return result, session
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=8883)
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--publishes", type=int, default=20)
+    parser.add_argument("--payload", type=int, default=200, help="publish payload bytes")
+    parser.add_argument("--fingerprint", help="expected SHA-1 fingerprint (AA:BB:...)")
+    args = parser.parse_args()
+
+    # Pinning, like the node: no CA validation, the fingerprint is checked instead
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.check_hostname = False
+    ctx.verify_mode = ssl.CERT_NONE
+    # BearSSL on the node speaks TLS 1.2, where resumption is by session id
+    ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    session = None
+    results = []
+    for _ in range(args.runs):
+        result, session = run_once(args, ctx, session)
+        results.append(result)
+
+    print()
+    print("TLS Reconnects")
+    print("=" * 70)
+    print(f"   Broker: {args.host}:{args.port}, cipher {results[0]['cipher']}")
+    print(f"   Certificate SHA-1: {results[0]['fingerprint']}")
+    if args.fingerprint:
+        pinned = args.fingerprint.replace(":", "").replace(" ", "").lower()
+        print(f"   Pinned fingerprint: {'match' if pinned == results[0]['fingerprint'] else 'MISMATCH'}")
+    print(f"   {'run':>3} {'resumed':>7} {'tcp':>8} {'handshake':>10} {'connack':>9} {'hs bytes':>9}")
+    for i, r in enumerate(results, 1):
+        print(f"   {i:>3} {str(r['resumed']):>7} {r['tcp_ms']:>6.1f}ms {r['handshake_ms']:>8.1f}ms "
+              f"{r['connect_ms']:>7.1f}ms {r['handshake_bytes']:>9}")
+    r = results[-1]
+    print(f"   Per publish: {r['publish_bytes']} bytes of MQTT -> {r['publish_wire']:.0f} bytes of TLS "
+          f"(+{r['publish_wire'] - r['publish_bytes']:.0f})")
+    if args.runs > 1 and not any(r["resumed"] for r in results[1:]):
+        print("   [WARNING] Broker never resumed a session; every node reconnect is a full handshake")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""
+Evaluates the node's per-zone current filter (NodeMCU_PIO/include/zone_filter.h)
+against recorded traces and reports how much noise it removes and how
+far it lags behind real load changes.
+
+The filter is the node's own zone_filter.cpp, built for the host by
+firmware_host.py, so the figures are what a ZONE_FILTER build would
+publish as current_filt_mA. Traces are either CSV files with a current_mA column, or
+zone messages one per line as captured with
+
+    mosquitto_sub -t 'site1/node1/zone1' > zone1.jsonl
+
+with batched messages expanded to their rows. Without a trace, a
+synthetic switching load with known true current is used.
+
+Noise is the RMS deviation from the true current where it is known, and
+otherwise estimated from sample-to-sample differences; either way only
+over samples at least --settle samples after a load step, so the step
+response shows up as lag rather than noise. Lag is the number of samples
+after a load step until the output is within 10% of the step of the new
+level, plus the steady-state time constant (1 - K) / K of the settled
+gain K.
+"""
+
+import argparse
+import csv
+import ctypes
+import json
+import math
+import random
+import statistics
+
+import firmware_host
+
+
+def lround(v):
+    """lroundf(): nearest, halves away from zero."""
+    return int(math.floor(abs(v) + 0.5)) * (1 if v >= 0 else -1)
+
+
+class ZoneFilter:
+    """The firmware's filter on zone 1, started afresh with one setting."""
+
+    def __init__(self, lib, q_mA2, r_mA2, gate_sigma):
+        self.lib = lib
+        lib.hostFilterBegin()
+        lib.hostFilterConfigure(0, q_mA2, r_mA2, gate_sigma)
+
+    def update(self, current_mA):
+        return self.lib.hostFilterUpdate(0, current_mA)
+
+    def stats(self):
+        stats = firmware_host.ZoneFilterStats()
+        self.lib.hostFilterStats(0, ctypes.byref(stats))
+        return stats
+
+
+def quantize(v):
+    """To the current LSB of the smallest INA219 range covering v, as the
+    RTC buffer stores readings (zone_payload.RANGE_LSB_MA)."""
+    lsb = 0.05 if abs(v) < 400 else 0.04 if abs(v) < 1000 else 0.1
+    return round(lround(v / lsb) * lsb, 2)
+
+
+def synthetic_trace(n, seed):
+    """Switching load: levels with steps and ramps, Gaussian noise plus
+    ripple aliased into the samples and an occasional spike. Returns
+    (readings, truth)."""
+    rng = random.Random(seed)
+    truth = []
+    level = 800.0
+    slope = 0.0
+    for i in range(n):
+        if i % 60 == 0 and i:
+            level = rng.choice([150.0, 800.0, 1400.0, 1900.0])
+            slope = rng.choice([0.0, 0.0, 0.0, 1.0, -1.0])
+        level = max(50.0, level + slope)
+        truth.append(level)
+    readings = []
+    for t in truth:
+        noise = rng.gauss(0.0, 6.0) + rng.uniform(-12.0, 12.0)
+        if rng.random() < 0.01:
+            noise += rng.choice([-1, 1]) * 80.0
+        readings.append(quantize(t + noise))
+    return readings, truth
+
+
+def load_trace(path):
+    readings = []
+    with open(path) as f:
+        if path.endswith((".jsonl", ".json", ".log")):
+            for line in f:
+                line = line.strip()
+                if not line.startswith("{"):
+                    continue
+                doc = json.loads(line)
+                if "samples" in doc:
+                    readings.extend(row[1] for row in doc["samples"])
+                elif "current_mA" in doc:
+                    readings.append(doc["current_mA"])
+        else:
+            for row in csv.DictReader(f):
+                readings.append(float(row["current_mA"]))
+    return readings
+
+
+def rms(values):
+    return math.sqrt(sum(v * v for v in values) / len(values)) if values else float("nan")
+
+
+def step_indices(reference, threshold):
+    return [i for i in range(1, len(reference)) if abs(reference[i] - reference[i - 1]) > threshold]
+
+
+def median_reference(x, half=3):
+    return [statistics.median(x[max(0, i - half):i + half + 1]) for i in range(len(x))]
+
+
+def step_lag(output, reference, steps, horizon=30):
+    """Samples after each step until output is within 10% of the step of
+    the new level."""
+    lags = []
+    for i in steps:
+        size = reference[i] - reference[i - 1]
+        target = reference[i]
+        for lag in range(horizon):
+            j = i + lag
+            if j >= len(output):
+                break
+            if abs(output[j] - target) <= 0.1 * abs(size):
+                lags.append(lag)
+                break
+        else:
+            lags.append(horizon)
+    return lags
+
+
+def settled(n, steps, settle):
+    """Indices at least settle samples after the last step."""
+    near = set()
+    for i in steps:
+        near.update(range(i, i + settle))
+    return [i for i in range(1, n) if i not in near]
+
+
+def evaluate(lib, readings, truth, q, r, gate, step_threshold, settle):
+    f = ZoneFilter(lib, q, r, gate)
+    out = [f.update(v) for v in readings]
+    stats = f.stats()
+    reference = truth if truth else median_reference(readings)
+    steps = step_indices(reference, step_threshold)
+    quiet = settled(len(readings), steps, settle)
+    if truth:
+        noise_raw = rms([readings[i] - truth[i] for i in quiet])
+        noise_filt = rms([out[i] - truth[i] for i in quiet])
+    else:
+        noise_raw = rms([readings[i] - readings[i - 1] for i in quiet]) / math.sqrt(2)
+        noise_filt = rms([out[i] - out[i - 1] for i in quiet]) / math.sqrt(2)
+    lags = step_lag(out, reference, steps)
+    k = stats.gain
+    return {
+        "q": q, "r": r, "gate": gate,
+        "noise_raw": noise_raw, "noise_filt": noise_filt,
+        "reduction_db": 20 * math.log10(noise_raw / noise_filt) if noise_filt > 0 else float("inf"),
+        "lag_mean": statistics.mean(lags) if lags else float("nan"),
+        "lag_max": max(lags) if lags else 0,
+        "gain": k, "tau": (1 - k) / k if k > 0 else float("inf"),
+        "spikes": stats.outliers - 2 * stats.steps, "steps": stats.steps,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("traces", nargs="*", help="CSV or captured zone message files")
+    parser.add_argument("--q", type=float, nargs="+", default=[0.25, 1.0, 4.0, 16.0, 64.0],
+                        help="process noise values to try, mA²")
+    parser.add_argument("--r", type=float, nargs="+", default=[25.0, 100.0, 400.0],
+                        help="measurement noise values to try, mA²")
+    parser.add_argument("--gate", type=float, nargs="+", default=[0.0, 4.0],
+                        help="step gates to try, sigma (0: off)")
+    parser.add_argument("--step-ma", type=float, default=100.0,
+                        help="a reference change above this is a load step")
+    parser.add_argument("--settle", type=int, default=10,
+                        help="samples after a load step left out of the noise figures")
+    parser.add_argument("--max-lag", type=float, default=3.0,
+                        help="mean step lag (samples) allowed for the recommendation")
+    parser.add_argument("--interval-ms", type=int, default=5000, help="the node's sample interval")
+    parser.add_argument("--samples", type=int, default=2000, help="synthetic trace length")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    if args.traces:
+        traces = [(path, load_trace(path), None) for path in args.traces]
+    else:
+        readings, truth = synthetic_trace(args.samples, args.seed)
+        traces = [("synthetic switching load", readings, truth)]
+
+    lib = firmware_host.load()
+    for name, readings, truth in traces:
+        if len(readings) < 10:
+            print(f"[WARNING] {name}: only {len(readings)} readings, skipped")
+            continue
+        results = [evaluate(lib, readings, truth, q, r, g, args.step_ma, args.settle)
+                   for q in args.q for r in args.r for g in args.gate]
+
+        print()
+        print(f"Filter Evaluation: {name}")
+        print("=" * 78)
+        print(f"   {len(readings)} readings, noise "
+              f"{'vs true current' if truth else 'estimated from differences'}, "
+              f"lag in samples of {args.interval_ms} ms")
+        print(f"   {'q mA2':>7} {'r mA2':>7} {'gate':>5} {'noise':>8} {'filtered':>9} {'reduct':>7} "
+              f"{'lag mean':>9} {'lag max':>8} {'gain':>6} {'tau':>6} {'spikes':>6} {'steps':>5}")
+        for res in results:
+            print(f"   {res['q']:>7.2f} {res['r']:>7.1f} {res['gate']:>5.1f} "
+                  f"{res['noise_raw']:>6.2f}mA {res['noise_filt']:>7.2f}mA {res['reduction_db']:>5.1f}dB "
+                  f"{res['lag_mean']:>9.2f} {res['lag_max']:>8} {res['gain']:>6.3f} "
+                  f"{res['tau']:>6.2f} {res['spikes']:>6} {res['steps']:>5}")
+
+        usable = [res for res in results if res["lag_mean"] <= args.max_lag]
+        if usable:
+            best = max(usable, key=lambda res: res["reduction_db"])
+            print(f"   [OK] Best within {args.max_lag:g} samples of lag: q={best['q']:g} "
+                  f"r={best['r']:g} gate={best['gate']:g}: {best['reduction_db']:.1f} dB, "
+                  f"lag {best['lag_mean']:.2f} samples "
+                  f"({best['lag_mean'] * args.interval_ms / 1000.0:.1f} s)")
+        else:
+            print(f"   [WARNING] No setting keeps the mean step lag within {args.max_lag:g} samples")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,151 @@
+"""
+Builds the node's firmware modules (NodeMCU_PIO/src) for the host and
+loads them with ctypes, so the simulations here run the node's own code
+instead of a copy of it.
+
+The Arduino functions come from NodeMCU_PIO/bench/host: a clock the caller
+sets (running on in real time, so the modules' own micros() timings
+measure their code on this host) and a log of pin writes. The C entry
+points are in bench/host/firmware_api.cpp. Needs g++; the library is
+cached per source version and set of defines.
+"""
+
+import ctypes
+import glob
+import hashlib
+import os
+import subprocess
+import tempfile
+
+FIRMWARE_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                             "..", "NodeMCU_PIO"))
+HOST_SOURCES = ["bench/host/host_arduino.cpp", "bench/host/firmware_api.cpp"]
+MODULES = ["protection", "batch_control", "zone_filter", "broker_pool", "wake_plan"]
+CXXFLAGS = ["-std=gnu++17", "-O2", "-Wall", "-Wextra", "-shared", "-fPIC", "-Iinclude", "-Ibench/host"]
+
+
+class PinWrite(ctypes.Structure):
+    """HostPinWrite in bench/host/host_arduino.h"""
+    _fields_ = [("pin", ctypes.c_uint8), ("level", ctypes.c_uint8),
+                ("at_us", ctypes.c_uint32), ("after_ns", ctypes.c_uint32)]
+
+
+class ProtectionEvent(ctypes.Structure):
+    """ProtectionEvent in include/protection.h"""
+    _fields_ = [("zone", ctypes.c_uint8), ("shed", ctypes.c_bool), ("current_mA", ctypes.c_float),
+                ("at_ms", ctypes.c_uint32), ("latency_us", ctypes.c_uint32)]
+
+
+class ZoneFilterStats(ctypes.Structure):
+    """ZoneFilterStats in include/zone_filter.h"""
+    _fields_ = [("updates", ctypes.c_uint32), ("outliers", ctypes.c_uint32),
+                ("steps", ctypes.c_uint32), ("gain", ctypes.c_float)]
+
+
+class BrokerHealth(ctypes.Structure):
+    """BrokerHealth in include/broker_pool.h"""
+    _fields_ = [("server", ctypes.c_char * 40), ("port", ctypes.c_uint16),
+                ("attempts", ctypes.c_uint32), ("failures", ctypes.c_uint32),
+                ("failure_rate", ctypes.c_float), ("connect_ms", ctypes.c_uint32),
+                ("last_connect_ms", ctypes.c_uint32), ("consecutive_failures", ctypes.c_uint8),
+                ("good_probes", ctypes.c_uint8), ("retry_at_ms", ctypes.c_uint32),
+                ("connects", ctypes.c_uint32)]
+
+
+class WakeState(ctypes.Structure):
+    """WakeState in include/wake_plan.h"""
+    _fields_ = [("now_us", ctypes.c_uint64), ("planned_us", ctypes.c_uint64),
+                ("next_tick_us", ctypes.c_uint64), ("next_tick", ctypes.c_uint32),
+                ("samples_per_publish", ctypes.c_uint32), ("phase_tick", ctypes.c_uint32),
+                ("flags", ctypes.c_uint8), ("window_done", ctypes.c_bool),
+                ("window_failed", ctypes.c_bool), ("echo_due", ctypes.c_bool),
+                ("alarms_pending", ctypes.c_bool), ("filled", ctypes.c_bool)]
+
+
+class WakePlan(ctypes.Structure):
+    """WakePlan in include/wake_plan.h"""
+    _fields_ = [("action", ctypes.c_uint8), ("flags", ctypes.c_uint8), ("wake_us", ctypes.c_uint64)]
+
+
+# WakeAction and the DEEP_SLEEP_* flags (include/deep_sleep.h)
+WAKE_SAMPLE, WAKE_PUBLISH, WAKE_SLEEP = range(3)
+DEEP_SLEEP_RADIO = 0x1
+DEEP_SLEEP_WINDOW_FAILED = 0x2
+DEEP_SLEEP_ECHO_DUE = 0x4
+
+
+# name: (restype, argtypes)
+FUNCTIONS = {
+    "hostSetMicros": (None, [ctypes.c_uint64]),
+    "hostPopPinWrite": (ctypes.c_bool, [ctypes.POINTER(PinWrite)]),
+    "hostZoneCount": (ctypes.c_uint8, []),
+    "hostSampleBufferCapacity": (ctypes.c_uint8, []),
+    "hostProtectionBegin": (None, []),
+    "hostProtectionConfigure": (None, [ctypes.c_uint8, ctypes.c_float, ctypes.c_float,
+                                       ctypes.c_uint32, ctypes.c_uint32]),
+    "hostProtectionSample": (None, [ctypes.c_uint8, ctypes.c_float, ctypes.c_uint64]),
+    "hostProtectionState": (ctypes.c_uint8, [ctypes.c_uint8]),
+    "hostProtectionPopEvent": (ctypes.c_bool, [ctypes.POINTER(ProtectionEvent)]),
+    "hostBatchBegin": (None, [ctypes.c_uint8, ctypes.c_uint8, ctypes.c_uint8]),
+    "hostBatchUpdate": (ctypes.c_uint8, [ctypes.c_uint32, ctypes.c_uint32, ctypes.c_int32]),
+    "hostBatchSamples": (ctypes.c_uint8, []),
+    "hostBatchLink": (ctypes.c_char_p, []),
+    "hostBrokerSet": (None, [ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_uint16),
+                             ctypes.c_uint8]),
+    "hostBrokerCount": (ctypes.c_uint8, []),
+    "hostBrokerHealth": (None, [ctypes.c_uint8, ctypes.POINTER(BrokerHealth)]),
+    "hostBrokerNext": (ctypes.c_uint8, [ctypes.c_uint32]),
+    "hostBrokerRetryDelay": (ctypes.c_uint32, [ctypes.c_uint32]),
+    "hostBrokerAttempted": (None, [ctypes.c_uint8, ctypes.c_bool, ctypes.c_uint32, ctypes.c_uint32]),
+    "hostBrokerDisconnected": (None, []),
+    "hostBrokerActive": (ctypes.c_int8, []),
+    "hostBrokerFailbackCandidate": (ctypes.c_int8, [ctypes.c_uint32]),
+    "hostBrokerProbed": (ctypes.c_bool, [ctypes.c_uint8, ctypes.c_bool, ctypes.c_uint32, ctypes.c_uint32]),
+    "hostBrokerFailbackTarget": (ctypes.c_int8, []),
+    "hostBrokerFailovers": (ctypes.c_uint32, []),
+    "hostBrokerFailbacks": (ctypes.c_uint32, []),
+    "hostFilterBegin": (None, []),
+    "hostFilterConfigure": (None, [ctypes.c_uint8, ctypes.c_float, ctypes.c_float, ctypes.c_float]),
+    "hostFilterUpdate": (ctypes.c_float, [ctypes.c_uint8, ctypes.c_float]),
+    "hostFilterStats": (None, [ctypes.c_uint8, ctypes.POINTER(ZoneFilterStats)]),
+    "hostWakePlan": (None, [ctypes.POINTER(WakeState), ctypes.POINTER(WakePlan)]),
+}
+
+
+def _build(defines):
+    flags = CXXFLAGS + [f"-D{name}={value}" for name, value in sorted(defines.items())]
+    key = hashlib.sha1(" ".join(flags).encode())
+    sources = HOST_SOURCES + [f"src/{module}.cpp" for module in MODULES]
+    inputs = sources + sorted(os.path.relpath(p, FIRMWARE_DIR) for pattern in ("include/*.h", "bench/host/*.h")
+                              for p in glob.glob(os.path.join(FIRMWARE_DIR, pattern)))
+    for path in inputs:
+        with open(os.path.join(FIRMWARE_DIR, path), "rb") as f:
+            key.update(f.read())
+    out_dir = os.path.join(tempfile.gettempdir(), "firmware_host")
+    library = os.path.join(out_dir, f"firmware_{key.hexdigest()[:16]}.so")
+    if not os.path.exists(library):
+        os.makedirs(out_dir, exist_ok=True)
+        print(f"[HOST] Building {', '.join(MODULES)} for the host")
+        subprocess.run(["g++", *flags, *sources, "-o", library + ".tmp"], cwd=FIRMWARE_DIR, check=True)
+        os.replace(library + ".tmp", library)
+    return library
+
+
+def load(**defines):
+    """The firmware library; keyword arguments override node_config.h
+    defaults (e.g. PROTECTION_INTERVAL_MS=20)."""
+    lib = ctypes.CDLL(_build(defines))
+    for name, (restype, argtypes) in FUNCTIONS.items():
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+    return lib
+
+
+def pin_writes(lib):
+    """Pin writes logged since the last call, oldest first."""
+    writes = []
+    write = PinWrite()
+    while lib.hostPopPinWrite(ctypes.byref(write)):
+        writes.append(PinWrite.from_buffer_copy(write))
+    return writes
@@ -4,23 +4,39 @@ Simple FastAPI server that receives MQTT messages and exposes them via REST API.
 Designed for Raspberry Pi microgrid monitoring system.
 """
 
+import asyncio
 import json
+import os
+import struct
 import threading
 import time
+from collections import deque
 from datetime import datetime
 from typing import Optional, Dict, Any
 
 import paho.mqtt.client as mqtt
-from fastapi import FastAPI, HTTPException
+from fastapi import FastAPI, HTTPException, Request
 from fastapi.middleware.cors import CORSMiddleware
+from fastapi.responses import StreamingResponse
 import uvicorn
 
+import zone_payload
+
 
 class MQTTDataStore:
     """Thread-safe data store for MQTT messages."""
     
     def __init__(self):
         self._data: Dict[str, Any] = {}
+        self._protection_events = deque(maxlen=100)
+        self._diagnostics: Dict[str, Any] = {}
+        self._zones: Dict[str, Any] = {}
+        self._profiles: Dict[str, Any] = {}
+        self._status: Dict[str, Any] = {}
+        self._config: Dict[str, Any] = {}
+        self._battery: Dict[str, Dict[str, Any]] = {}
+        self._ripple: Dict[str, Dict[str, Any]] = {}
+        self._no_crc: set = set()  # nodes whose firmware predates the zone payload CRC
         self._lock = threading.Lock()
     
     def update_data(self, node_id: str, zone_id: str, payload: Dict[str, Any]):
@@ -37,10 +53,532 @@ class MQTTDataStore:
         key = f"{node_id}/{zone_id}"
         with self._lock:
             return self._data.get(key)
+    
+    def get_nodes(self) -> Dict[str, list]:
+        """Nodes seen so far (readings or zone list), with the zones that have readings."""
+        with self._lock:
+            nodes: Dict[str, list] = {node_id: [] for node_id in (*self._status, *self._zones)}
+            for key in self._data:
+                node_id, zone_id = key.split("/", 1)
+                nodes.setdefault(node_id, []).append(zone_id)
+            return nodes
+    
+    def update_diagnostics(self, node_id: str, payload: Dict[str, Any]):
+        """Update the latest diagnostics (bus statistics) for a node."""
+        with self._lock:
+            self._diagnostics[node_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+    
+    def get_diagnostics(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get the latest diagnostics for a node."""
+        with self._lock:
+            return self._diagnostics.get(node_id)
+    
+    def update_zones(self, node_id: str, payload: Dict[str, Any]):
+        """Update the zone list (attached sensors) reported by a node."""
+        with self._lock:
+            self._zones[node_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+    
+    def get_zones(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get the latest zone list for a node."""
+        with self._lock:
+            return self._zones.get(node_id)
+    
+    def update_status(self, node_id: str, payload: Dict[str, Any]):
+        """Update a node's online/offline/sleeping status (retained birth and last will)."""
+        with self._lock:
+            self._status[node_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+            # Firmware with the CRC-32 trailer says so at birth; the last
+            # will doesn't carry it
+            if payload.get("state") != "offline":
+                if payload.get("payload_crc"):
+                    self._no_crc.discard(node_id)
+                else:
+                    self._no_crc.add(node_id)
+    
+    def requires_crc(self, node_id: str) -> bool:
+        """Whether the node's zone data must end in a CRC-32 trailer: unless
+        its last birth status came from firmware without one."""
+        with self._lock:
+            return node_id not in self._no_crc
+    
+    def get_status(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get a node's last reported status."""
+        with self._lock:
+            return self._status.get(node_id)
+    
+    def update_profiles(self, node_id: str, payload: Dict[str, Any]):
+        """Update the INA219 profiles and measured noise floors for a node."""
+        with self._lock:
+            self._profiles[node_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+    
+    def get_profiles(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get the latest INA219 profiles for a node."""
+        with self._lock:
+            return self._profiles.get(node_id)
+    
+    def update_config(self, node_id: str, payload: Dict[str, Any]):
+        """Update a node's active runtime config (retained echo after every change)."""
+        with self._lock:
+            self._config[node_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+    
+    def get_config(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get the runtime config a node last reported as applied."""
+        with self._lock:
+            return self._config.get(node_id)
+    
+    def update_battery(self, node_id: str, zone_id: str, payload: Dict[str, Any]):
+        """Update a battery zone's state of charge (battery_gauge.h), once per window."""
+        with self._lock:
+            self._battery.setdefault(node_id, {})[zone_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+    
+    def get_battery(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get the latest state of charge of every battery zone of a node."""
+        with self._lock:
+            return self._battery.get(node_id)
+    
+    def update_ripple(self, node_id: str, zone_id: str, payload: Dict[str, Any]):
+        """Update a zone's latest ripple burst analysis (ripple_monitor.h)."""
+        with self._lock:
+            self._ripple.setdefault(node_id, {})[zone_id] = {
+                **payload,
+                "received_at": datetime.now().isoformat()
+            }
+    
+    def get_ripple(self, node_id: str) -> Optional[Dict[str, Any]]:
+        """Get the latest ripple analysis of every zone of a node."""
+        with self._lock:
+            return self._ripple.get(node_id)
+    
+    def add_protection_event(self, payload: Dict[str, Any]):
+        """Record a load-shedding event reported by a node."""
+        with self._lock:
+            self._protection_events.append({
+                **payload,
+                "received_at": datetime.now().isoformat()
+            })
+    
+    def get_protection_events(self, node_id: str) -> list:
+        """Get recent load-shedding events for a node, newest first."""
+        with self._lock:
+            return [e for e in reversed(self._protection_events)
+                    if e.get("node_id") == node_id]
+
+
+class AlarmHub:
+    """Latest alarm state per node/zone/alarm, fanned out to SSE clients.
+    
+    MQTT callbacks run on the paho network thread, so events are handed to
+    the asyncio loop with call_soon_threadsafe and never block on a slow
+    client: a full client queue drops the event for that client only.
+    """
+    
+    def __init__(self):
+        self._alarms: Dict[str, Any] = {}
+        self._subscribers = set()
+        self._lock = threading.Lock()
+        self._loop: Optional[asyncio.AbstractEventLoop] = None
+    
+    def attach_loop(self, loop: asyncio.AbstractEventLoop):
+        """Set the event loop that owns the subscriber queues."""
+        self._loop = loop
+    
+    def publish(self, payload: Dict[str, Any]):
+        """Record an alarm transition and push it to every stream client."""
+        key = f"{payload.get('node_id')}/{payload.get('zone_id')}/{payload.get('alarm')}"
+        event = {**payload, "received_at": datetime.now().isoformat()}
+        with self._lock:
+            self._alarms[key] = event
+            subscribers = list(self._subscribers)
+        if self._loop is not None:
+            for queue in subscribers:
+                self._loop.call_soon_threadsafe(self._offer, queue, event)
+    
+    @staticmethod
+    def _offer(queue: asyncio.Queue, event: Dict[str, Any]):
+        try:
+            queue.put_nowait(event)
+        except asyncio.QueueFull:
+            pass
+    
+    def get_alarms(self, active_only: bool = False) -> list:
+        """Get the latest state of every known alarm."""
+        with self._lock:
+            return [a for a in self._alarms.values() if a.get("active") or not active_only]
+    
+    def subscribe(self) -> asyncio.Queue:
+        queue: asyncio.Queue = asyncio.Queue(maxsize=100)
+        with self._lock:
+            self._subscribers.add(queue)
+        return queue
+    
+    def unsubscribe(self, queue: asyncio.Queue):
+        with self._lock:
+            self._subscribers.discard(queue)
+
+
+class StreamTracker:
+    """Per-node delivery statistics from the boot_id/seq/uptime_ms stamps.
+    
+    Every publish carries a sequence number per stream, scoped by a random
+    boot id; zone data messages cover the sample range first_seq..seq. A
+    sequence number above the highest seen opens a gap, one that fills a
+    gap counts as reordered, and one seen before counts as a duplicate.
+    
+    Node and backend clocks are not synchronized, so latency is measured
+    relative to the fastest message of the boot: (ingest - uptime_ms) minus
+    its minimum. That is the delay above the best-case path, which is what
+    queueing, batching and retransmits add.
+    """
+    
+    MAX_MISSING = 4096
+    LATENCY_WINDOW = 1000
+    
+    def __init__(self):
+        self._nodes: Dict[str, Any] = {}
+        self._lock = threading.Lock()
+    
+    def _node(self, node_id: str, boot_id: int) -> Dict[str, Any]:
+        node = self._nodes.get(node_id)
+        if node is None or node["boot_id"] != boot_id:
+            reboots = 0 if node is None else node["reboots"] + 1
+            node = {
+                "boot_id": boot_id,
+                "reboots": reboots,
+                "streams": {},
+                "offset_ms": None,
+                "latency_ms": deque(maxlen=self.LATENCY_WINDOW),
+            }
+            self._nodes[node_id] = node
+        return node
+    
+    def record(self, node_id: str, stream: str, payload: Dict[str, Any], ingest_s: float) -> int:
+        """Account for one stamped message received at ingest_s (epoch seconds).
+        
+        Returns how many of its sequence numbers weren't seen before; 0 means
+        the whole message is a retransmission.
+        """
+        last = payload["seq"]
+        first = payload.get("first_seq", last)
+        with self._lock:
+            node = self._node(node_id, payload["boot_id"])
+            st = node["streams"].setdefault(stream, {
+                "messages": 0, "received": 0, "highest": None, "missing": set(),
+                "lost": 0, "duplicates": 0, "reordered": 0,
+            })
+            st["messages"] += 1
+            new = 0
+            for seq in range(first, last + 1):
+                if st["highest"] is None or seq > st["highest"]:
+                    if st["highest"] is not None:
+                        st["missing"].update(range(st["highest"] + 1, seq))
+                    st["highest"] = seq
+                    st["received"] += 1
+                    new += 1
+                elif seq in st["missing"]:
+                    st["missing"].discard(seq)
+                    st["reordered"] += 1
+                    st["received"] += 1
+                    new += 1
+                else:
+                    st["duplicates"] += 1
+            # Give up on the oldest holes rather than grow without bound
+            while len(st["missing"]) > self.MAX_MISSING:
+                st["missing"].discard(min(st["missing"]))
+                st["lost"] += 1
+            
+            if "uptime_ms" in payload:
+                offset = ingest_s * 1000.0 - payload["uptime_ms"]
+                if node["offset_ms"] is None or offset < node["offset_ms"]:
+                    node["offset_ms"] = offset
+                node["latency_ms"].append(offset - node["offset_ms"])
+            return new
+    
+    def get_stats(self) -> Dict[str, Any]:
+        """Gap/duplicate/reorder counts per stream and latency percentiles per node."""
+        with self._lock:
+            result = {}
+            for node_id, node in self._nodes.items():
+                latencies = sorted(node["latency_ms"])
+                
+                def pct(p):
+                    return round(latencies[min(len(latencies) - 1, int(p / 100.0 * len(latencies)))], 1)
+                
+                result[node_id] = {
+                    "boot_id": node["boot_id"],
+                    "reboots": node["reboots"],
+                    "latency_ms": {
+                        "samples": len(latencies),
+                        "p50": pct(50),
+                        "p95": pct(95),
+                        "p99": pct(99),
+                        "max": round(latencies[-1], 1),
+                    } if latencies else None,
+                    "streams": {
+                        name: {
+                            "messages": st["messages"],
+                            "received": st["received"],
+                            "highest_seq": st["highest"],
+                            "gaps": len(st["missing"]) + st["lost"],
+                            "duplicates": st["duplicates"],
+                            "reordered": st["reordered"],
+                        }
+                        for name, st in node["streams"].items()
+                    },
+                }
+            return result
+
+
+class ArrivalStats:
+    """Inter-arrival distribution of everything the nodes publish.
+    
+    Used to check that phase-staggered publish slots keep the broker load
+    flat: arrivals are folded onto the publish period, and an even spread
+    over the phase bins (low coefficient of variation) means no bursts.
+    """
+    
+    WINDOW = 5000
+    GAP_BUCKETS_MS = [1, 5, 10, 50, 100, 500, 1000]
+    
+    def __init__(self):
+        self._arrivals = deque(maxlen=self.WINDOW)
+        self._lock = threading.Lock()
+    
+    def record(self, ingest_s: float):
+        with self._lock:
+            self._arrivals.append(ingest_s)
+    
+    def get_stats(self, period_ms: int, bins: int) -> Dict[str, Any]:
+        with self._lock:
+            arrivals = list(self._arrivals)
+        if len(arrivals) < 2:
+            return {"arrivals": len(arrivals)}
+        
+        gaps = sorted((b - a) * 1000.0 for a, b in zip(arrivals, arrivals[1:]))
+        
+        def pct(p):
+            return round(gaps[min(len(gaps) - 1, int(p / 100.0 * len(gaps)))], 2)
+        
+        histogram = {}
+        lower = 0
+        for upper in self.GAP_BUCKETS_MS + [None]:
+            label = f"{lower}-{upper}ms" if upper is not None else f">={lower}ms"
+            histogram[label] = sum(1 for g in gaps
+                                   if g >= lower and (upper is None or g < upper))
+            lower = upper
+        
+        phase_counts = [0] * bins
+        for t in arrivals:
+            phase_counts[int((t * 1000.0) % period_ms * bins / period_ms)] += 1
+        mean = len(arrivals) / bins
+        variance = sum((c - mean) ** 2 for c in phase_counts) / bins
+        
+        return {
+            "arrivals": len(arrivals),
+            "span_s": round(arrivals[-1] - arrivals[0], 1),
+            "inter_arrival_ms": {
+                "min": round(gaps[0], 2),
+                "p5": pct(5),
+                "p50": pct(50),
+                "p95": pct(95),
+                "max": round(gaps[-1], 2),
+                "histogram": histogram,
+            },
+            "phase": {
+                "period_ms": period_ms,
+                "counts": phase_counts,
+                # 0 for a perfectly flat load; bursts push it up
+                "cv": round(variance ** 0.5 / mean, 3),
+                "peak_to_mean": round(max(phase_counts) / mean, 2),
+            },
+        }
+
+
+class StateRebuild:
+    """Times how long the backend takes to rebuild its state after connecting.
+    
+    Node status, the latest readings, zone lists and alarms are all retained
+    at the broker, so a fresh subscription replays them at once. The replay
+    counts as complete once no retained message has arrived for QUIET_S;
+    time to full state runs from starting the connection to the last one.
+    """
+    
+    QUIET_S = 1.0
+    
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._started = None
+        self._connected = None
+        self._last_retained = None
+        self._retained = 0
+        self._topics = set()
+    
+    def start(self):
+        with self._lock:
+            self._started = time.time()
+            self._connected = None
+            self._last_retained = None
+            self._retained = 0
+            self._topics = set()
+    
+    def connected(self):
+        with self._lock:
+            self._connected = time.time()
+    
+    def retained(self, topic: str, ingest_s: float):
+        with self._lock:
+            self._last_retained = ingest_s
+            self._retained += 1
+            self._topics.add(topic)
+    
+    def get_stats(self) -> Dict[str, Any]:
+        with self._lock:
+            if self._started is None or self._connected is None:
+                return {"connected": False}
+            last = self._last_retained or self._connected
+            ms = lambda t: round((t - self._started) * 1000.0, 1)
+            return {
+                "connected": True,
+                "connect_ms": ms(self._connected),
+                "retained_messages": self._retained,
+                "retained_topics": len(self._topics),
+                "complete": time.time() - last >= self.QUIET_S,
+                "time_to_full_state_ms": ms(last),
+            }
+
+
+class SiteGrid:
+    """Zone readings on the site-wide sample grid, indexed by tick.
+    
+    Nodes synced to the backend clock (time_sync.h in the firmware) number
+    their ticks from TIME_EPOCH_S, so one tick index is one instant on every
+    node, to within the sync errors they report. A snapshot joins all zones
+    at a tick, for a power balance across the microgrid. Readings of nodes
+    that aren't synced yet have boot-relative ticks and aren't indexed, nor
+    are rows taken across a range switch or flagged invalid.
+    """
+    
+    TICKS = 720  # kept per sample interval
+    
+    def __init__(self):
+        # interval_ms -> tick -> "node/zone" -> reading
+        self._grids: Dict[int, Dict[int, Dict[str, Any]]] = {}
+        self._lock = threading.Lock()
+    
+    def record(self, node_id: str, zone_id: str, payload: Dict[str, Any]):
+        sync_error_us = payload.get("sync_error_us", -1)
+        interval_ms = payload.get("interval_ms", 0)
+        if sync_error_us < 0 or interval_ms <= 0:
+            return
+        if "samples" in payload:
+            skip = set(payload.get("range_switch_rows", [])) | {i for i, _ in payload.get("invalid_rows", [])}
+            rows = [row for i, row in enumerate(payload["samples"]) if i not in skip]
+        elif payload.get("range_switch") or payload.get("flags"):
+            rows = []
+        else:
+            rows = [[payload["timestamp"], payload["current_mA"], payload["voltage_V"], payload["power_mW"]]]
+        
+        with self._lock:
+            grid = self._grids.setdefault(interval_ms, {})
+            for timestamp, current_mA, voltage_V, power_mW, *_ in rows:
+                grid.setdefault(timestamp // interval_ms, {})[f"{node_id}/{zone_id}"] = {
+                    "current_mA": current_mA, "voltage_V": voltage_V, "power_mW": power_mW,
+                    "sync_error_us": sync_error_us}
+            for tick in sorted(grid)[:-self.TICKS]:
+                del grid[tick]
+    
+    def snapshot(self, interval_ms: Optional[int] = None, tick: Optional[int] = None) -> Optional[Dict[str, Any]]:
+        """The zones at a tick; by default the latest tick with the most zones."""
+        with self._lock:
+            if interval_ms is None:
+                if not self._grids:
+                    return None
+                interval_ms = max(self._grids, key=lambda i: len(self._grids[i]))
+            grid = self._grids.get(interval_ms, {})
+            if tick is None and grid:
+                tick = max(grid, key=lambda t: (len(grid[t]), t))
+            zones = dict(grid.get(tick, {}))
+        if not zones:
+            return None
+        time_ms = TIME_EPOCH_S * 1000 + tick * interval_ms
+        return {
+            "tick": tick,
+            "interval_ms": interval_ms,
+            "time": datetime.utcfromtimestamp(time_ms / 1000.0).isoformat() + "Z",
+            "zones": zones,
+            "total_power_mW": round(sum(z["power_mW"] for z in zones.values()), 1),
+            # Readings are this far apart at most
+            "max_sync_error_us": max(z["sync_error_us"] for z in zones.values()),
+        }
+
+
+class TimeBeacon:
+    """Publishes the site clock for the nodes' shared sample grid.
+    
+    A beacon goes out on TIME_TOPIC every TIME_BEACON_S through every
+    connected broker. A node's request on <site>/<node>/time/req is answered
+    at once on <site>/<node>/time with its send time echoed, so the node can
+    measure the round trip (the MQTTClient callback calls reply()).
+    """
+    
+    def __init__(self):
+        self._stop = threading.Event()
+        self._thread = None
+        self.beacons = 0
+        self.replies = 0
+    
+    def message(self, **extra) -> str:
+        return json.dumps({"epoch_s": TIME_EPOCH_S, "t_us": site_time_us(), **extra})
+    
+    def reply(self, client, node_id: str, request: Dict[str, Any]):
+        client.publish(f"{SITE_ID}/{node_id}/time", self.message(t1_us=request["t1_us"]))
+        self.replies += 1
+    
+    def _run(self):
+        while not self._stop.wait(TIME_BEACON_S):
+            for c in mqtt_clients:
+                if c.connected:
+                    c.client.publish(TIME_TOPIC, self.message())
+                    self.beacons += 1
+    
+    def start(self):
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+    
+    def stop(self):
+        self._stop.set()
+    
+    def get_stats(self) -> Dict[str, Any]:
+        return {"epoch_s": TIME_EPOCH_S, "beacon_s": TIME_BEACON_S,
+                "beacons": self.beacons, "replies": self.replies}
 
 
 # Global data store
 data_store = MQTTDataStore()
+alarm_hub = AlarmHub()
+stream_tracker = StreamTracker()
+arrival_stats = ArrivalStats()
+state_rebuild = StateRebuild()
+site_grid = SiteGrid()
+time_beacon = TimeBeacon()
 
 # FastAPI app
 app = FastAPI(
@@ -59,6 +597,66 @@ app.add_middleware(
 )
 
 
+# Nodes publish under <site>/<node>/..., the node id coming from the chip id
+# or provisioning (node_identity.h)
+SITE_ID = os.environ.get("MQTT_SITE", "site1")
+# Node served by the single-node /api/v1/node1/... endpoints; the first
+# node heard from when unset
+DEFAULT_NODE = os.environ.get("DEFAULT_NODE")
+
+# <site>/<node>/<zone> readings and <site>/<node>/<diagnostics|zones|profiles>
+NODE_TOPIC = f"{SITE_ID}/+/+"
+PROTECTION_TOPIC = f"{SITE_ID}/+/+/protection"
+# Retained state of charge of battery zones, once per publish window
+BATTERY_TOPIC = f"{SITE_ID}/+/+/battery"
+# Ripple analysis of fast sample bursts, RIPPLE_ANALYSIS builds only
+RIPPLE_TOPIC = f"{SITE_ID}/+/+/ripple"
+# Retained alarm state, one topic per zone and alarm
+ALARM_TOPIC = f"{SITE_ID}/+/alarms/#"
+# Site clock for the shared sample grid: beacons, and the nodes' requests.
+# Microseconds since TIME_EPOCH_S (Unix time), which keeps tick indices in
+# 32 bits on the nodes for decades.
+TIME_TOPIC = f"{SITE_ID}/time"
+TIME_REQUEST_TOPIC = f"{SITE_ID}/+/time/req"
+TIME_EPOCH_S = int(os.environ.get("TIME_EPOCH_S", 1735689600))  # 2025-01-01 UTC
+TIME_BEACON_S = float(os.environ.get("TIME_BEACON_S", 10))
+# Brokers to listen on, "host:port" comma-separated. Nodes fail over
+# between the brokers in their config (broker_pool.h), so the backend
+# listens on all of them; a node's messages come from whichever it is on,
+# and acks go back through the broker a message came in on.
+MQTT_BROKERS = [(host, int(port or 1883)) for host, _, port in
+                (b.strip().partition(":") for b in os.environ.get("MQTT_BROKERS", "localhost:1883").split(","))]
+# Node-level message kinds; any other single level is a zone
+NODE_MESSAGES = ("diagnostics", "zones", "profiles", "status", "config")
+
+
+def _parse_topic(topic: str):
+    """Split <site>/<node>/<rest...> into (node_id, rest), or None for other sites."""
+    parts = topic.split("/")
+    if len(parts) < 3 or parts[0] != SITE_ID:
+        return None
+    return parts[1], parts[2:]
+
+
+def _stream_name(rest: list, payload: Dict[str, Any]) -> str:
+    """Name of the node publish stream a message belongs to (see telemetry.h)."""
+    if rest[0] == "alarms":
+        return "alarms"
+    if rest[-1] in ("protection", "battery", "ripple"):
+        return rest[-1]
+    if rest[0] in NODE_MESSAGES:
+        return rest[0]
+    return payload.get("zone_id", rest[0])
+
+
+def site_time_us() -> int:
+    return time.time_ns() // 1000 - TIME_EPOCH_S * 1000000
+
+
+def _default_node() -> str:
+    return DEFAULT_NODE or next(iter(data_store.get_nodes()), "node1")
+
+
 class MQTTClient:
     """MQTT client for subscribing to sensor data."""
     
@@ -69,28 +667,135 @@ class MQTTClient:
         self.client.on_connect = self._on_connect
         self.client.on_message = self._on_message
         self.client.on_disconnect = self._on_disconnect
+        self.connected = False
+        # Zone payloads dropped for a CRC mismatch, and not acked: the node
+        # sends them again
+        self.crc_rejects = 0
     
     def _on_connect(self, client, userdata, flags, rc):
         """Callback for when the client receives a CONNACK response from the server."""
         if rc == 0:
+            self.connected = True
             print(f"[OK] Connected to MQTT broker at {self.broker_host}:{self.broker_port}")
-            # Subscribe to all zone topics
-            topics = ["/node1/zone1", "/node1/zone2", "/node1/zone3"]
-            for topic in topics:
-                client.subscribe(topic)
-                print(f"[MQTT] Subscribed to topic: {topic}")
+            state_rebuild.connected()
+            # Zone readings and node-level messages from every node on the site
+            client.subscribe(NODE_TOPIC)
+            print(f"[MQTT] Subscribed to topic: {NODE_TOPIC}")
+            # Load-shedding events published by the nodes
+            client.subscribe(PROTECTION_TOPIC)
+            print(f"[MQTT] Subscribed to topic: {PROTECTION_TOPIC}")
+            client.subscribe(BATTERY_TOPIC)
+            print(f"[MQTT] Subscribed to topic: {BATTERY_TOPIC}")
+            client.subscribe(RIPPLE_TOPIC)
+            print(f"[MQTT] Subscribed to topic: {RIPPLE_TOPIC}")
+            client.subscribe(ALARM_TOPIC, qos=1)
+            print(f"[MQTT] Subscribed to topic: {ALARM_TOPIC}")
+            client.subscribe(TIME_REQUEST_TOPIC)
+            print(f"[MQTT] Subscribed to topic: {TIME_REQUEST_TOPIC}")
         else:
             print(f"[ERROR] Failed to connect to MQTT broker. Return code: {rc}")
     
     def _on_message(self, client, userdata, msg):
         """Callback for when a PUBLISH message is received from the server."""
+        # An empty retained message only deletes a topic at the broker
+        if not msg.payload:
+            return
+        ingest_s = time.time()
+        
         try:
-            # Decode the message payload
-            payload_str = msg.payload.decode('utf-8')
-            print(f"[MQTT] Received message on topic '{msg.topic}': {payload_str}")
+            encoding = zone_payload.encoding_of(msg.payload)
+            if encoding == "json":
+                print(f"[MQTT] Received message on topic '{msg.topic}': {msg.payload.decode('utf-8')}")
+            else:
+                print(f"[MQTT] Received {encoding} message on topic '{msg.topic}' ({len(msg.payload)} bytes)")
+            
+            parsed = _parse_topic(msg.topic)
+            if parsed is None:
+                return
+            node_id, rest = parsed
+            # Answered before anything else: the node times the round trip
+            if rest == ["time", "req"]:
+                time_beacon.reply(client, node_id, json.loads(msg.payload))
+                return
+            # Commands, acks and time replies to the nodes share the
+            # hierarchy; they aren't node data. <site>/config/set is the
+            # fleet-wide config update.
+            if rest[0] in ("schedule", "ack", "time") or rest[-1] in ("control", "set"):
+                return
+            
+            # Zone data may be CBOR, packed binary or CSV (zone_encoder.h);
+            # everything decodes to the JSON form. Only zone data has the
+            # CRC-32 trailer.
+            zone_data = len(rest) == 1 and rest[0] not in NODE_MESSAGES
+            payload = zone_payload.decode(msg.payload, node_id, rest[-1],
+                                          require_crc=zone_data and data_store.requires_crc(node_id))
+            
+            if msg.retain:
+                state_rebuild.retained(msg.topic, ingest_s)
+            else:
+                arrival_stats.record(ingest_s)
+            
+            # Retained messages are replays from the broker, not deliveries
+            new_samples = None
+            if "seq" in payload and "boot_id" in payload and not msg.retain:
+                new_samples = stream_tracker.record(node_id, _stream_name(rest, payload), payload, ingest_s)
+            
+            if rest[0] == "alarms":
+                alarm_hub.publish(payload)
+                state = "RAISED" if payload.get("active") else "cleared"
+                print(f"[ALARM] {payload.get('node_id')}/{payload.get('zone_id')} "
+                      f"{payload.get('alarm')} {state}")
+                return
+            
+            if rest == ["diagnostics"]:
+                data_store.update_diagnostics(node_id, payload)
+                return
+            
+            if rest == ["profiles"]:
+                data_store.update_profiles(node_id, payload)
+                return
+            
+            if rest == ["config"]:
+                data_store.update_config(node_id, payload)
+                print(f"[CONFIG] {node_id} revision {payload.get('revision')} "
+                      f"({payload.get('source')}), sample interval "
+                      f"{payload.get('sample_interval_ms')}ms")
+                return
+            
+            if rest == ["status"]:
+                data_store.update_status(node_id, payload)
+                print(f"[STATUS] {node_id} {payload.get('state')}")
+                return
             
-            # Parse JSON payload
-            payload = json.loads(payload_str)
+            if rest == ["zones"]:
+                data_store.update_zones(node_id, payload)
+                attached = [z["zone_id"] for z in payload.get("zones", []) if z.get("attached")]
+                print(f"[ZONES] {payload.get('node_id')}: attached {attached}, "
+                      f"startup {payload.get('startup_ms')}ms, "
+                      f"first sample {payload.get('first_sample_ms')}ms")
+                return
+            
+            if rest[-1] == "protection":
+                data_store.add_protection_event(payload)
+                print(f"[PROTECTION] {payload.get('node_id')}/{payload.get('zone_id')} "
+                      f"{payload.get('event')} at {payload.get('current_mA')}mA")
+                return
+            
+            if rest[-1] == "battery":
+                data_store.update_battery(node_id, rest[0], payload)
+                print(f"[BATTERY] {node_id}/{rest[0]} {payload.get('soc_pct')}% "
+                      f"{payload.get('state')}, {payload.get('remaining_mAh')}mAh left "
+                      f"({payload.get('soc_source')})")
+                return
+            
+            if rest[-1] == "ripple":
+                data_store.update_ripple(node_id, rest[0], payload)
+                voltage = payload.get("voltage_V", {})
+                current = payload.get("current_mA", {})
+                print(f"[RIPPLE] {node_id}/{rest[0]} voltage {voltage.get('rms')}V rms "
+                      f"(peak {voltage.get('dominant_Hz')}Hz), current {current.get('rms')}mA rms "
+                      f"(peak {current.get('dominant_Hz')}Hz)")
+                return
             
             # Validate required fields
             required_fields = ["node_id", "zone_id", "timestamp", "current_mA", "voltage_V", "power_mW"]
@@ -100,9 +805,35 @@ class MQTTClient:
                 print(f"[WARNING] Missing required fields in payload: {missing_fields}")
                 return
             
-            # Store the data
-            node_id = payload["node_id"]
+            # Store the data; the topic is authoritative for the node
             zone_id = payload["zone_id"]
+            
+            # Ack every delivery, retransmissions too: the node sends one
+            # again when it missed our previous ack
+            if new_samples is not None:
+                client.publish(f"{SITE_ID}/{node_id}/ack",
+                               json.dumps({"zone_id": zone_id, "seq": payload["seq"]}))
+                if new_samples == 0:
+                    print(f"[DATA] Duplicate {node_id}/{zone_id} seq {payload['seq']}, acked again")
+                    return
+            
+            # Every row of a synced node, by tick; the checks below are
+            # about the latest reading only
+            if not msg.retain:
+                site_grid.record(node_id, zone_id, payload)
+            
+            # A reading taken across an INA219 range switch may be clipped
+            # or mix two ranges; keep the previous one
+            if payload.get("range_switch"):
+                print(f"[DATA] Skipped {node_id}/{zone_id}: taken during range switch "
+                      f"to {payload.get('range')}")
+                return
+            # A failed or implausible read (I2C error, INA219 overflow, out
+            # of range) carries zeros or garbage; keep the previous one
+            if payload.get("flags"):
+                print(f"[DATA] Skipped {node_id}/{zone_id}: invalid reading "
+                      f"(flags 0x{payload['flags']:02x})")
+                return
             data_store.update_data(node_id, zone_id, payload)
             
             print(f"[DATA] Stored for {node_id}/{zone_id}: "
@@ -112,18 +843,26 @@ class MQTTClient:
             
         except json.JSONDecodeError as e:
             print(f"[ERROR] Error parsing JSON payload: {e}")
+        except zone_payload.CrcError as e:
+            self.crc_rejects += 1
+            print(f"[ERROR] Rejected corrupted {encoding} payload on '{msg.topic}': {e}")
+        except (ValueError, struct.error) as e:
+            print(f"[ERROR] Error decoding {encoding} payload: {e}")
         except Exception as e:
             print(f"[ERROR] Error processing MQTT message: {e}")
     
     def _on_disconnect(self, client, userdata, rc):
         """Callback for when the client disconnects from the server."""
+        self.connected = False
         print(f"[MQTT] Disconnected from MQTT broker. Return code: {rc}")
     
     def start(self):
         """Start the MQTT client."""
         try:
             print(f"[MQTT] Connecting to MQTT broker at {self.broker_host}:{self.broker_port}...")
-            self.client.connect(self.broker_host, self.broker_port, 60)
+            # connect_async: a broker that is down now is picked up when it
+            # comes back, without holding up the others
+            self.client.connect_async(self.broker_host, self.broker_port, 60)
             # Start the network loop in a separate thread
             self.client.loop_start()
         except Exception as e:
@@ -135,15 +874,19 @@ class MQTTClient:
         self.client.disconnect()
 
 
-# Global MQTT client
-mqtt_client = MQTTClient()
+# One MQTT client per broker
+mqtt_clients = [MQTTClient(host, port) for host, port in MQTT_BROKERS]
 
 
 @app.on_event("startup")
 async def startup_event():
     """Initialize MQTT client when FastAPI starts."""
     print("[SERVER] Starting Microgrid MQTT API server...")
-    mqtt_client.start()
+    alarm_hub.attach_loop(asyncio.get_running_loop())
+    state_rebuild.start()
+    for mqtt_client in mqtt_clients:
+        mqtt_client.start()
+    time_beacon.start()
     # Give MQTT client a moment to connect
     time.sleep(1)
 
@@ -152,7 +895,9 @@ async def startup_event():
 async def shutdown_event():
     """Clean up MQTT client when FastAPI shuts down."""
     print("[SERVER] Shutting down Microgrid MQTT API server...")
-    mqtt_client.stop()
+    time_beacon.stop()
+    for mqtt_client in mqtt_clients:
+        mqtt_client.stop()
 
 
 @app.get("/")
@@ -162,9 +907,22 @@ async def root():
         "message": "Microgrid MQTT API",
         "version": "1.0.0",
         "endpoints": {
+            "nodes": "/api/v1/nodes",
+            "zone_data": "/api/v1/nodes/{node_id}/zones/{zone_id}",
             "zone1_data": "/api/v1/node1/zone1",
             "zone2_data": "/api/v1/node1/zone2", 
             "zone3_data": "/api/v1/node1/zone3",
+            "protection_events": "/api/v1/node1/protection",
+            "battery": "/api/v1/nodes/{node_id}/battery",
+            "ripple": "/api/v1/nodes/{node_id}/ripple",
+            "diagnostics": "/api/v1/node1/diagnostics",
+            "zones": "/api/v1/node1/zones",
+            "profiles": "/api/v1/node1/profiles",
+            "alarms": "/api/v1/alarms",
+            "alarm_stream": "/api/v1/alarms/stream",
+            "streams": "/api/v1/streams",
+            "arrivals": "/api/v1/arrivals",
+            "snapshot": "/api/v1/snapshot",
             "status": "/api/v1/status",
             "docs": "/docs",
             "redoc": "/redoc"
@@ -172,69 +930,209 @@ async def root():
     }
 
 
-@app.get("/api/v1/node1/zone1")
-async def get_node1_zone1_data():
-    """Get the latest sensor data for node1/zone1."""
-    data = data_store.get_data("node1", "zone1")
-    
+def _require(data: Optional[Dict[str, Any]], detail: str) -> Dict[str, Any]:
     if data is None:
-        raise HTTPException(
-            status_code=404, 
-            detail="No data available for node1/zone1. Check if MQTT messages are being received."
-        )
-    
+        raise HTTPException(status_code=404, detail=detail)
     return data
 
+
+@app.get("/api/v1/nodes")
+async def get_nodes():
+    """List the nodes heard from on the site and the zones they have reported."""
+    return {
+        "site_id": SITE_ID,
+        "nodes": [{"node_id": node_id,
+                   "state": (data_store.get_status(node_id) or {}).get("state", "unknown"),
+                   "zones": sorted(zones)}
+                  for node_id, zones in data_store.get_nodes().items()],
+    }
+
+
+@app.get("/api/v1/nodes/{node_id}/zones/{zone_id}")
+async def get_zone_data(node_id: str, zone_id: str):
+    """Get the latest sensor data for a node/zone."""
+    return _require(data_store.get_data(node_id, zone_id),
+                    f"No data available for {node_id}/{zone_id}. "
+                    "Check if MQTT messages are being received.")
+
+
+@app.get("/api/v1/nodes/{node_id}/status")
+async def get_node_status(node_id: str):
+    """Get a node's status: online, sleeping, or offline (last will)."""
+    return _require(data_store.get_status(node_id),
+                    f"No status received from {node_id} yet.")
+
+
+@app.get("/api/v1/nodes/{node_id}/protection")
+async def get_protection_events(node_id: str):
+    """Get recent load-shedding events (shed/reclose) for a node, newest first."""
+    return {"events": data_store.get_protection_events(node_id)}
+
+
+@app.get("/api/v1/nodes/{node_id}/battery")
+async def get_battery(node_id: str):
+    """Get the state of charge, remaining charge and time to empty/full of a node's battery zones."""
+    return _require(data_store.get_battery(node_id),
+                    f"No battery zone reported by {node_id} yet.")
+
+
+@app.get("/api/v1/nodes/{node_id}/ripple")
+async def get_ripple(node_id: str):
+    """Get the latest ripple analysis per zone: RMS, peak-to-peak and dominant frequency of bus voltage and current."""
+    return _require(data_store.get_ripple(node_id),
+                    f"No ripple analysis received from {node_id} yet (RIPPLE_ANALYSIS builds only).")
+
+
+@app.get("/api/v1/nodes/{node_id}/diagnostics")
+async def get_diagnostics(node_id: str):
+    """Get the latest diagnostics for a node (I2C clock, recoveries, per-sensor stats)."""
+    return _require(data_store.get_diagnostics(node_id),
+                    f"No diagnostics received from {node_id} yet.")
+
+
+@app.get("/api/v1/nodes/{node_id}/zones")
+async def get_zone_list(node_id: str):
+    """Get a node's zone list: attached sensors, unassigned INA219 addresses, startup timing."""
+    return _require(data_store.get_zones(node_id),
+                    f"No zone list received from {node_id} yet.")
+
+
+@app.get("/api/v1/nodes/{node_id}/profiles")
+async def get_profiles(node_id: str):
+    """Get a node's INA219 profiles (range, ADC resolution, averaging) with measured noise floors."""
+    return _require(data_store.get_profiles(node_id),
+                    f"No profiles received from {node_id} yet.")
+
+
+@app.get("/api/v1/nodes/{node_id}/config")
+async def get_node_config(node_id: str):
+    """Get the runtime config a node has applied (runtime_config.h); change it with push_config.py."""
+    return _require(data_store.get_config(node_id),
+                    f"No config received from {node_id} yet.")
+
+
+# Single-node endpoints used by the dashboard; they serve DEFAULT_NODE
+@app.get("/api/v1/node1/zone1")
+async def get_node1_zone1_data():
+    """Get the latest sensor data for zone1 of the default node."""
+    return await get_zone_data(_default_node(), "zone1")
+
 @app.get("/api/v1/node1/zone2")
 async def get_node1_zone2_data():
-    """Get the latest sensor data for node1/zone2."""
-    data = data_store.get_data("node1", "zone2")
-    
-    if data is None:
-        raise HTTPException(
-            status_code=404, 
-            detail="No data available for node1/zone2. Check if MQTT messages are being received."
-        )
-    
-    return data
+    """Get the latest sensor data for zone2 of the default node."""
+    return await get_zone_data(_default_node(), "zone2")
 
 @app.get("/api/v1/node1/zone3")
 async def get_node1_zone3_data():
-    """Get the latest sensor data for node1/zone3."""
-    data = data_store.get_data("node1", "zone3")
+    """Get the latest sensor data for zone3 of the default node."""
+    return await get_zone_data(_default_node(), "zone3")
+
+
+@app.get("/api/v1/node1/protection")
+async def get_node1_protection_events():
+    """Get recent load-shedding events of the default node."""
+    return await get_protection_events(_default_node())
+
+
+@app.get("/api/v1/node1/diagnostics")
+async def get_node1_diagnostics():
+    """Get the latest diagnostics of the default node."""
+    return await get_diagnostics(_default_node())
+
+
+@app.get("/api/v1/node1/zones")
+async def get_node1_zones():
+    """Get the zone list of the default node."""
+    return await get_zone_list(_default_node())
+
+
+@app.get("/api/v1/node1/profiles")
+async def get_node1_profiles():
+    """Get the INA219 profiles of the default node."""
+    return await get_profiles(_default_node())
+
+
+@app.get("/api/v1/alarms")
+async def get_alarms(active_only: bool = False):
+    """Get the latest state of every alarm reported by the nodes."""
+    return {"alarms": alarm_hub.get_alarms(active_only)}
+
+
+@app.get("/api/v1/alarms/stream")
+async def stream_alarms(request: Request):
+    """Server-Sent Events stream of alarm transitions.
     
-    if data is None:
-        raise HTTPException(
-            status_code=404, 
-            detail="No data available for node1/zone3. Check if MQTT messages are being received."
-        )
+    Starts with the currently active alarms, then pushes every transition as
+    it arrives from MQTT. A comment line is sent every 15 s as keep-alive.
+    """
+    queue = alarm_hub.subscribe()
     
-    return data
+    async def events():
+        try:
+            for alarm in alarm_hub.get_alarms(active_only=True):
+                yield f"event: alarm\ndata: {json.dumps(alarm)}\n\n"
+            while not await request.is_disconnected():
+                try:
+                    alarm = await asyncio.wait_for(queue.get(), timeout=15)
+                except asyncio.TimeoutError:
+                    yield ": keep-alive\n\n"
+                    continue
+                yield f"event: alarm\ndata: {json.dumps(alarm)}\n\n"
+        finally:
+            alarm_hub.unsubscribe(queue)
+    
+    return StreamingResponse(events(), media_type="text/event-stream",
+                             headers={"Cache-Control": "no-cache"})
+
+
+@app.get("/api/v1/streams")
+async def get_stream_stats():
+    """Per-node delivery statistics: gaps, duplicates, reordering and device-to-ingest latency."""
+    return stream_tracker.get_stats()
+
+
+@app.get("/api/v1/arrivals")
+async def get_arrival_stats(period_ms: int = 5000, bins: int = 20):
+    """Inter-arrival distribution of node publishes and their spread over the publish period."""
+    if period_ms <= 0 or not 1 <= bins <= 1000:
+        raise HTTPException(status_code=400, detail="period_ms must be > 0 and bins 1..1000")
+    return arrival_stats.get_stats(period_ms, bins)
+
+
+@app.get("/api/v1/snapshot")
+async def get_snapshot(interval_ms: Optional[int] = None, tick: Optional[int] = None):
+    """Every synced zone at one tick of the site grid; the latest tick with the most zones by default."""
+    return _require(site_grid.snapshot(interval_ms, tick),
+                    "No readings on the site grid at that tick; nodes sync to the time beacon first.")
 
 
 @app.get("/api/v1/status")
 async def get_status():
     """Get API status and basic statistics."""
-    # Check if we have data for all zones
-    zone1_data = data_store.get_data("node1", "zone1")
-    zone2_data = data_store.get_data("node1", "zone2")
-    zone3_data = data_store.get_data("node1", "zone3")
+    nodes = data_store.get_nodes()
     
     # Get the most recent update time
     last_updates = []
-    for data in [zone1_data, zone2_data, zone3_data]:
-        if data and data.get("received_at"):
-            last_updates.append(data["received_at"])
+    data_available = {}
+    for node_id, zones in nodes.items():
+        for zone_id in zones:
+            data = data_store.get_data(node_id, zone_id)
+            data_available[f"{node_id}/{zone_id}"] = data is not None
+            if data and data.get("received_at"):
+                last_updates.append(data["received_at"])
     
     return {
         "status": "running",
-        "mqtt_broker": f"{mqtt_client.broker_host}:{mqtt_client.broker_port}",
-        "subscribed_topics": ["/node1/zone1", "/node1/zone2", "/node1/zone3"],
-        "data_available": {
-            "node1/zone1": zone1_data is not None,
-            "node1/zone2": zone2_data is not None,
-            "node1/zone3": zone3_data is not None
-        },
+        "mqtt_broker": f"{mqtt_clients[0].broker_host}:{mqtt_clients[0].broker_port}",
+        "mqtt_brokers": {f"{c.broker_host}:{c.broker_port}": c.connected for c in mqtt_clients},
+        "site_id": SITE_ID,
+        "default_node": _default_node(),
+        "state_rebuild": state_rebuild.get_stats(),
+        "crc_rejects": sum(c.crc_rejects for c in mqtt_clients),
+        "time_sync": time_beacon.get_stats(),
+        "subscribed_topics": [NODE_TOPIC, PROTECTION_TOPIC, BATTERY_TOPIC, RIPPLE_TOPIC, ALARM_TOPIC,
+                              TIME_REQUEST_TOPIC],
+        "data_available": data_available,
         "last_update": max(last_updates) if last_updates else None
     }
 
@@ -242,7 +1140,7 @@ async def get_status():
 if __name__ == "__main__":
     print("[SERVER] Starting Microgrid MQTT FastAPI Server...")
     print("[INFO] Access API documentation at: http://0.0.0.0:8000/docs")
-    print("[INFO] Access API at: http://0.0.0.0:8000/api/v1/node1/zone1")
+    print("[INFO] Access API at: http://0.0.0.0:8000/api/v1/nodes")
     print("[INFO] Check status at: http://0.0.0.0:8000/api/v1/status")
     print("[INFO] Server accessible from network via RPi IP address")
     print("[INFO] Press Ctrl+C to stop the server")
@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""
+MQTT-SN gateway for nodes built with MQTT_SN
+(NodeMCU_PIO/include/mqttsn_client.h).
+
+Nodes send MQTT-SN 1.2 datagrams over UDP to this gateway, which runs
+next to the broker and carries all of them over one MQTT connection. The
+broker and the backend see the usual <site>/<node>/... topics with the
+usual payloads, so nothing else changes.
+
+A node's own topics arrive by predefined topic id, relative to its topic
+root, which the gateway takes from the node's will topic (<root>/status)
+at CONNECT; other topics are registered by name. Subscriptions go to the
+broker on the node's behalf and matching messages are sent back to the
+node. A node that misses 1.5 keepalive periods is dropped and its will
+published, as a broker would.
+
+    python3 mqttsn_gateway.py --broker localhost --listen 1883
+"""
+
+import argparse
+import socket
+import struct
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+CONNECT, CONNACK, WILLTOPICREQ, WILLTOPIC, WILLMSGREQ, WILLMSG = 0x04, 0x05, 0x06, 0x07, 0x08, 0x09
+REGISTER, REGACK, PUBLISH, PUBACK = 0x0A, 0x0B, 0x0C, 0x0D
+SUBSCRIBE, SUBACK = 0x12, 0x13
+PINGREQ, PINGRESP, DISCONNECT = 0x16, 0x17, 0x18
+
+FLAG_RETAIN = 0x10
+FLAG_WILL = 0x08
+TOPIC_NORMAL, TOPIC_PREDEFINED = 0x00, 0x01
+RC_ACCEPTED, RC_INVALID_TOPIC = 0x00, 0x02
+
+# Predefined topic ids, as in mqttsn_client.h
+NODE_TOPICS = ["status", "zones", "diagnostics", "profiles", "config", "config/set", "ack", "schedule",
+               "time", "time/req"]
+ZONE_TOPICS = ["", "control", "protection", "battery", "ripple"]
+
+
+def predefined_name(root, topic_id):
+    if 1 <= topic_id <= len(NODE_TOPICS):
+        return root + NODE_TOPICS[topic_id - 1]
+    zone, kind = topic_id >> 8, topic_id & 0xFF
+    if zone == 0 or kind >= len(ZONE_TOPICS):
+        return None
+    return f"{root}zone{zone}" + (f"/{ZONE_TOPICS[kind]}" if kind else "")
+
+
+def predefined_id(root, topic):
+    if not root or not topic.startswith(root):
+        return 0
+    suffix = topic[len(root):]
+    if suffix in NODE_TOPICS:
+        return NODE_TOPICS.index(suffix) + 1
+    if not suffix.startswith("zone") or not suffix[4:5].isdigit():
+        return 0
+    number, _, kind = suffix[4:].partition("/")
+    if not number.isdigit() or not 0 < int(number) <= 0xFF or kind not in ZONE_TOPICS:
+        return 0
+    if kind == "" and suffix.endswith("/"):
+        return 0
+    return int(number) << 8 | ZONE_TOPICS.index(kind)
+
+
+def frame(msg_type, body=b""):
+    length = len(body) + 2
+    if length > 255:
+        return struct.pack(">BHB", 0x01, len(body) + 4, msg_type) + body
+    return struct.pack(">BB", length, msg_type) + body
+
+
+def parse(datagram):
+    """Returns (type, body), or None for a malformed datagram."""
+    if len(datagram) < 2:
+        return None
+    if datagram[0] == 0x01:
+        if len(datagram) < 4:
+            return None
+        (length,), header = struct.unpack_from(">H", datagram, 1), 4
+    else:
+        length, header = datagram[0], 2
+    if length < header or length > len(datagram):
+        return None
+    return datagram[header - 1], datagram[header:length]
+
+
+class Session:
+    def __init__(self, address, client_id, keepalive_s):
+        self.address = address
+        self.client_id = client_id
+        self.keepalive_s = keepalive_s
+        self.last_seen = time.monotonic()
+        self.root = ""
+        self.will_topic = None
+        self.will_flags = 0
+        self.will_message = None
+        self.active = False
+        self.ids = {}  # name -> normal topic id
+        self.names = {}  # normal topic id -> name
+        self.subscriptions = set()
+
+    def topic_id(self, name):
+        if name not in self.ids:
+            topic_id = len(self.ids) + 1
+            self.ids[name] = topic_id
+            self.names[topic_id] = name
+        return self.ids[name]
+
+    def expired(self, now):
+        return self.keepalive_s and now - self.last_seen > 1.5 * self.keepalive_s
+
+
+class Gateway:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.sessions = {}  # address -> Session
+        self.subscribers = {}  # topic -> set of addresses
+        self.stats = {"datagrams_in": 0, "bytes_in": 0, "datagrams_out": 0, "bytes_out": 0,
+                      "published": 0, "delivered": 0}
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind((args.bind, args.listen))
+        self.sock.settimeout(1.0)
+        self.mqtt = mqtt.Client(client_id=f"mqttsn-gateway-{args.listen}")
+        self.mqtt.on_connect = self._on_connect
+        self.mqtt.on_message = self._on_message
+
+    # --- broker side ---
+
+    def _on_connect(self, client, userdata, flags, rc):
+        if rc != 0:
+            print(f"[ERROR] Broker refused the gateway: {rc}")
+            return
+        print(f"[OK] Gateway connected to {self.args.broker}:{self.args.port}")
+        with self.lock:
+            for topic in self.subscribers:
+                client.subscribe(topic)
+
+    def _on_message(self, client, userdata, msg):
+        with self.lock:
+            targets = [self.sessions[a] for topic, addresses in self.subscribers.items()
+                       if mqtt.topic_matches_sub(topic, msg.topic) for a in addresses
+                       if a in self.sessions and self.sessions[a].active]
+            for session in targets:
+                topic_id = predefined_id(session.root, msg.topic)
+                topic_type = TOPIC_PREDEFINED
+                if not topic_id:
+                    topic_id, topic_type = session.topic_id(msg.topic), TOPIC_NORMAL
+                flags = (FLAG_RETAIN if msg.retain else 0) | topic_type
+                self._send(session.address, PUBLISH, struct.pack(">BHH", flags, topic_id, 0) + msg.payload)
+                self.stats["delivered"] += 1
+
+    def _subscribe(self, session, topic):
+        session.subscriptions.add(topic)
+        self.subscribers.setdefault(topic, set()).add(session.address)
+        # Subscribing again makes the broker send the retained message
+        # again, which a reconnecting node needs
+        self.mqtt.subscribe(topic)
+
+    def _forget(self, session, publish_will):
+        self.sessions.pop(session.address, None)
+        for topic in session.subscriptions:
+            addresses = self.subscribers.get(topic, set())
+            addresses.discard(session.address)
+            if not addresses:
+                self.subscribers.pop(topic, None)
+                self.mqtt.unsubscribe(topic)
+        if publish_will and session.will_topic:
+            self.mqtt.publish(session.will_topic, session.will_message or b"",
+                              qos=(session.will_flags >> 5) & 0x03, retain=bool(session.will_flags & FLAG_RETAIN))
+            print(f"[GATEWAY] {session.client_id} timed out, will published on {session.will_topic}")
+
+    # --- node side ---
+
+    def _send(self, address, msg_type, body=b""):
+        datagram = frame(msg_type, body)
+        self.sock.sendto(datagram, address)
+        self.stats["datagrams_out"] += 1
+        self.stats["bytes_out"] += len(datagram)
+
+    def _handle(self, address, msg_type, body):
+        session = self.sessions.get(address)
+        if session:
+            session.last_seen = time.monotonic()
+
+        if msg_type == CONNECT:
+            flags, _, duration = struct.unpack_from(">BBH", body)
+            client_id = body[4:].decode("utf-8", "replace")
+            # A node that reconnects from a new port replaces its old session
+            for old in [s for s in self.sessions.values() if s.client_id == client_id or s.address == address]:
+                self._forget(old, publish_will=False)
+            session = self.sessions[address] = Session(address, client_id, duration)
+            if flags & FLAG_WILL:
+                self._send(address, WILLTOPICREQ)
+            else:
+                session.active = True
+                self._send(address, CONNACK, bytes([RC_ACCEPTED]))
+            return
+        if msg_type == PINGREQ:
+            # Also answers failback probes, which have no session
+            self._send(address, PINGRESP)
+            return
+        if session is None:
+            self._send(address, DISCONNECT)
+            return
+
+        if msg_type == WILLTOPIC:
+            session.will_flags = body[0] if body else 0
+            session.will_topic = body[1:].decode("utf-8")
+            session.root = session.will_topic[:session.will_topic.rfind("/") + 1]
+            self._send(address, WILLMSGREQ)
+        elif msg_type == WILLMSG:
+            session.will_message = bytes(body)
+            session.active = True
+            self._send(address, CONNACK, bytes([RC_ACCEPTED]))
+            print(f"[GATEWAY] {session.client_id} connected from {address[0]}:{address[1]} "
+                  f"as {session.root or '(no root)'}")
+        elif msg_type == REGISTER:
+            _, msg_id = struct.unpack_from(">HH", body)
+            topic_id = session.topic_id(body[4:].decode("utf-8"))
+            self._send(address, REGACK, struct.pack(">HHB", topic_id, msg_id, RC_ACCEPTED))
+        elif msg_type == PUBLISH:
+            flags, topic_id, msg_id = struct.unpack_from(">BHH", body)
+            if flags & 0x03 == TOPIC_PREDEFINED:
+                topic = predefined_name(session.root, topic_id)
+            else:
+                topic = session.names.get(topic_id)
+            qos = (flags >> 5) & 0x03
+            if topic is None:
+                if qos == 1:
+                    self._send(address, PUBACK, struct.pack(">HHB", topic_id, msg_id, RC_INVALID_TOPIC))
+                return
+            self.mqtt.publish(topic, bytes(body[5:]), retain=bool(flags & FLAG_RETAIN))
+            self.stats["published"] += 1
+            if qos == 1:
+                self._send(address, PUBACK, struct.pack(">HHB", topic_id, msg_id, RC_ACCEPTED))
+        elif msg_type == SUBSCRIBE:
+            flags, msg_id = struct.unpack_from(">BH", body)
+            if flags & 0x03 == TOPIC_PREDEFINED:
+                (topic_id,) = struct.unpack_from(">H", body, 3)
+                topic = predefined_name(session.root, topic_id)
+            else:
+                topic = body[3:].decode("utf-8")
+                topic_id = 0 if "+" in topic or "#" in topic else session.topic_id(topic)
+            if topic is None:
+                self._send(address, SUBACK, struct.pack(">BHHB", 0, topic_id, msg_id, RC_INVALID_TOPIC))
+                return
+            self._send(address, SUBACK, struct.pack(">BHHB", 0, topic_id, msg_id, RC_ACCEPTED))
+            self._subscribe(session, topic)
+        elif msg_type == DISCONNECT:
+            self._forget(session, publish_will=False)
+            self._send(address, DISCONNECT)
+            print(f"[GATEWAY] {session.client_id} disconnected")
+
+    def _expire(self):
+        now = time.monotonic()
+        for session in [s for s in self.sessions.values() if s.expired(now)]:
+            self._forget(session, publish_will=True)
+
+    def _report(self, elapsed, cpu):
+        s = self.stats
+        per = cpu * 1e6 / s["datagrams_in"] if s["datagrams_in"] else 0.0
+        print(f"[GATEWAY] {len(self.sessions)} nodes, in {s['datagrams_in']} datagrams / {s['bytes_in']} bytes, "
+              f"out {s['datagrams_out']} / {s['bytes_out']}, published {s['published']}, "
+              f"delivered {s['delivered']}, CPU {per:.0f} us per datagram over {elapsed:.0f} s")
+
+    def run(self):
+        self.mqtt.connect_async(self.args.broker, self.args.port, 60)
+        self.mqtt.loop_start()
+        print(f"[GATEWAY] Listening for MQTT-SN on udp/{self.args.bind}:{self.args.listen}")
+        start = report_at = time.monotonic()
+        cpu_start = time.process_time()
+        try:
+            while True:
+                try:
+                    datagram, address = self.sock.recvfrom(65535)
+                except socket.timeout:
+                    datagram = None
+                with self.lock:
+                    if datagram:
+                        self.stats["datagrams_in"] += 1
+                        self.stats["bytes_in"] += len(datagram)
+                        message = parse(datagram)
+                        if message:
+                            try:
+                                self._handle(address, *message)
+                            except (struct.error, UnicodeDecodeError) as e:
+                                print(f"[WARNING] Bad datagram from {address[0]}:{address[1]}: {e}")
+                    self._expire()
+                now = time.monotonic()
+                if self.args.stats and now - report_at >= self.args.stats:
+                    report_at = now
+                    self._report(now - start, time.process_time() - cpu_start)
+        except KeyboardInterrupt:
+            pass
+        finally:
+            self._report(time.monotonic() - start, time.process_time() - cpu_start)
+            self.mqtt.loop_stop()
+            self.mqtt.disconnect()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883, help="broker TCP port")
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--listen", type=int, default=1883, help="MQTT-SN UDP port (MQTTSN_PORT)")
+    parser.add_argument("--stats", type=float, default=60.0, help="seconds between stats lines (0: off)")
+    Gateway(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Pushes a runtime config update to one node or the whole site and waits
+for the nodes to echo the applied config (NodeMCU_PIO/include/runtime_config.h).
+
+The update is a JSON object with the fields to change, e.g.
+
+    push_config.py --node pump-room '{"sample_interval_ms": 2000}'
+    push_config.py --fleet '{"zones": [{"trip_mA": 2500}, null, null]}'
+    push_config.py --node pump-room '{"command": "defaults"}'
+    push_config.py --node pump-room '{"mqtt_backups": ["192.168.0.140:1883"]}'
+
+It goes out retained on <site>/<node>/config/set (or <site>/config/set
+with --fleet), so low-power nodes pick it up at their next publish window.
+A node applies it between two ticks, stores it and echoes the result
+retained on <site>/<node>/config with a new revision. An update that
+changes nothing is not stored again and produces no new echo; a rejected
+one only shows on the node's serial output.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+import paho.mqtt.client as mqtt
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("update", help="JSON object with the fields to change")
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--node", help="node id")
+    target.add_argument("--fleet", action="store_true", help="every node of the site")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--site", default="site1")
+    parser.add_argument("--wait", type=float, default=30.0,
+                        help="seconds to wait for echoes (longer for low-power nodes)")
+    args = parser.parse_args()
+
+    try:
+        update = json.loads(args.update)
+    except json.JSONDecodeError as e:
+        parser.error(f"update is not JSON: {e}")
+    if not isinstance(update, dict):
+        parser.error("update must be a JSON object")
+
+    set_topic = f"{args.site}/config/set" if args.fleet else f"{args.site}/{args.node}/config/set"
+    echo_topic = f"{args.site}/+/config" if args.fleet else f"{args.site}/{args.node}/config"
+
+    # The config before the push comes in retained on subscribe; echoes
+    # published while subscribed arrive with the retain flag clear
+    before = {}
+    applied = {}
+
+    def on_message(client, userdata, msg):
+        node_id = msg.topic.split("/")[1]
+        config = json.loads(msg.payload)
+        if msg.retain:
+            before[node_id] = config.get("revision")
+        else:
+            applied[node_id] = config
+
+    client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(args.broker, args.port, 60)
+    client.subscribe(echo_topic)
+    client.loop_start()
+    time.sleep(1.0)
+
+    client.publish(set_topic, json.dumps(update), retain=True).wait_for_publish()
+    print(f"[CONFIG] Sent to {set_topic}: {json.dumps(update)}")
+
+    deadline = time.time() + args.wait
+    while time.time() < deadline and (args.fleet or not applied):
+        time.sleep(0.2)
+    client.loop_stop()
+    client.disconnect()
+
+    for node_id, config in sorted(applied.items()):
+        print(f"[CONFIG] {node_id}: revision {before.get(node_id)} -> {config.get('revision')}, "
+              f"sample interval {config.get('sample_interval_ms')}ms, "
+              f"broker {config.get('mqtt_server')}:{config.get('mqtt_port')}")
+    if not applied:
+        print("[WARNING] No node echoed a new config: unchanged, rejected, or not connected yet")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
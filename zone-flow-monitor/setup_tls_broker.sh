@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# TLS listener for Mosquitto, for nodes built with MQTT_TLS
+# Creates a self-signed broker certificate, a Mosquitto config with a plain
+# listener on localhost (backend) and a TLS listener for the nodes, and
+# prints the SHA-1 fingerprint to pin in NodeMCU_PIO/src/main.cpp.
+#
+# Usage: ./setup_tls_broker.sh [broker-hostname-or-ip] [output-dir]
+# Test:  mosquitto -c <output-dir>/mosquitto_tls.conf -v
+
+set -e
+
+HOST="${1:-$(hostname -I 2>/dev/null | awk '{print $1}')}"
+HOST="${HOST:-localhost}"
+OUT="${2:-tls}"
+PORT=8883
+
+mkdir -p "$OUT"
+
+echo "🔐 Generating broker certificate for $HOST..."
+# ECDSA P-256 keeps the BearSSL handshake on the ESP8266 far cheaper than RSA
+openssl ecparam -name prime256v1 -genkey -noout -out "$OUT/broker.key"
+openssl req -new -x509 -key "$OUT/broker.key" -out "$OUT/broker.crt" -days 825 \
+    -subj "/CN=$HOST" 2>/dev/null
+
+echo "📝 Writing $OUT/mosquitto_tls.conf..."
+cat > "$OUT/mosquitto_tls.conf" <<CONF
+per_listener_settings false
+allow_anonymous true
+
+# Backend on the same host
+listener 1883 127.0.0.1
+
+# Nodes; OpenSSL's server-side session cache lets a reconnecting node
+# resume its session instead of a full handshake
+listener $PORT
+certfile $(realpath "$OUT/broker.crt")
+keyfile $(realpath "$OUT/broker.key")
+tls_version tlsv1.2
+CONF
+
+FINGERPRINT=$(openssl x509 -in "$OUT/broker.crt" -noout -fingerprint -sha1 | cut -d= -f2)
+echo ""
+echo "✅ Done. Pin this fingerprint in mqtt_fingerprints (NodeMCU_PIO/src/main.cpp):"
+echo "   \"$FINGERPRINT\""
+echo ""
+echo "Build the node with: pio run -e nodemcuv2_tls"
+echo "Check handshakes:    python3 bench_tls_handshake.py $HOST --port $PORT"
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+Runs the node's adaptive batch sizing (NodeMCU_PIO/src/batch_control.cpp,
+built for the host by firmware_host.py, thresholds from node_config.h)
+against a simulated lossy link and compares it with fixed batch sizes.
+
+Every publish slot sends one message per zone carrying the samples
+batched since the last slot. A message is lost with the link's loss rate
+and resent after the ack timeout (ack_window.h); its ack arrives one
+jittered RTT after the transmission that got through. The smoothed RTT
+(Karn's rule), the retransmit count and the RSSI feed the controller at
+each slot, which sets the batch for the next one.
+
+The built-in link goes good -> fair -> poor -> good; --rssi/--rtt-ms/--loss
+pin a single link instead. Exits non-zero if a batch exceeds the latency
+bound or the controller doesn't return to the minimum on the final good
+stretch.
+"""
+
+import argparse
+import random
+import sys
+
+import firmware_host
+
+# Rough MQTT + JSON cost of one zone message and of one extra sample row
+MESSAGE_BYTES = 260
+ROW_BYTES = 40
+ACK_BYTES = 70
+
+
+class BatchControl:
+    """The firmware's controller (batchBegin()/batchUpdate())."""
+
+    def __init__(self, lib, min_samples, max_samples, initial):
+        self.lib = lib
+        lib.hostBatchBegin(min_samples, max_samples, initial)
+
+    @property
+    def samples(self):
+        return self.lib.hostBatchSamples()
+
+    @property
+    def link(self):
+        return self.lib.hostBatchLink().decode()
+
+    def update(self, srtt_ms, retransmits, rssi):
+        return self.lib.hostBatchUpdate(round(srtt_ms), retransmits, rssi)
+
+
+class FixedBatch:
+    def __init__(self, samples):
+        self.samples = samples
+        self.link = "-"
+
+    def update(self, srtt_ms, retransmits, rssi):
+        return self.samples
+
+
+def builtin_link(minutes):
+    """(start_s, name, rssi, rtt_ms, loss) stretches of the built-in link."""
+    names = [("good", -55, 30, 0.0), ("fair", -72, 180, 0.02),
+             ("poor", -84, 650, 0.15), ("good", -58, 35, 0.0)]
+    return [(i * minutes * 60, *link) for i, link in enumerate(names)]
+
+
+def simulate(controller, link, duration_s, args, rng):
+    """Runs one controller over the link; returns per-stretch results."""
+    stretches = {start: {"name": name, "slots": 0, "messages": 0, "samples": 0,
+                         "bytes": 0, "retransmits": 0, "latency_sum": 0.0,
+                         "latency_max": 0.0, "batch_max": 0}
+                 for start, name, *_ in link}
+    interval_s = args.sample_interval_ms / 1000.0
+    timeout_s = args.ack_timeout_ms / 1000.0
+    srtt = 0.0
+    retransmits = 0
+    t = 0.0
+    violations = 0
+    while t < duration_s:
+        start, name, rssi, rtt_ms, loss = [l for l in link if l[0] <= t][-1]
+        st = stretches[start]
+        samples = controller.samples
+        st["slots"] += 1
+        st["batch_max"] = max(st["batch_max"], samples)
+        if samples * args.sample_interval_ms > args.max_latency_ms:
+            violations += 1
+
+        for _ in range(args.zones):
+            attempts = 1
+            while rng.random() < loss:
+                attempts += 1
+            retransmits += attempts - 1
+            rtt = rtt_ms * rng.lognormvariate(0.0, 0.3) / 1000.0
+            delivered_s = (attempts - 1) * timeout_s + rtt
+            if attempts == 1:
+                srtt = rtt * 1000.0 if srtt == 0 else (7 * srtt + rtt * 1000.0) / 8
+            st["messages"] += attempts
+            st["retransmits"] += attempts - 1
+            st["samples"] += samples
+            st["bytes"] += attempts * (MESSAGE_BYTES + (samples - 1) * ROW_BYTES) + ACK_BYTES
+            # Sample i of the batch waited for the samples taken after it
+            for i in range(samples):
+                latency = (samples - 1 - i) * interval_s + delivered_s
+                st["latency_sum"] += latency
+                st["latency_max"] = max(st["latency_max"], latency)
+
+        t += samples * interval_s
+        controller.update(srtt, retransmits, rssi)
+    return [stretches[start] for start, *_ in link], violations
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sample-interval-ms", type=int, default=5000)
+    parser.add_argument("--min-latency-ms", type=int, default=5000)
+    parser.add_argument("--max-latency-ms", type=int, default=60000)
+    parser.add_argument("--ack-timeout-ms", type=int, default=2000)
+    parser.add_argument("--zones", type=int, default=3)
+    parser.add_argument("--minutes", type=float, default=20.0,
+                        help="length of each stretch of the built-in link")
+    parser.add_argument("--rssi", type=int, help="pin the link: RSSI in dBm")
+    parser.add_argument("--rtt-ms", type=float, default=50.0)
+    parser.add_argument("--loss", type=float, default=0.0)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    if args.rssi is not None:
+        link = [(0, "pinned", args.rssi, args.rtt_ms, args.loss)]
+        duration_s = args.minutes * 60
+    else:
+        link = builtin_link(args.minutes)
+        duration_s = len(link) * args.minutes * 60
+
+    lib = firmware_host.load()
+    capacity = lib.hostSampleBufferCapacity()
+    min_samples = min(capacity, args.min_latency_ms // args.sample_interval_ms)
+    max_samples = min(capacity, args.max_latency_ms // args.sample_interval_ms)
+    controllers = [
+        (f"fixed {min_samples}", FixedBatch(min_samples)),
+        (f"fixed {max_samples}", FixedBatch(max_samples)),
+        ("adaptive", BatchControl(lib, min_samples, max_samples, min_samples)),
+    ]
+
+    print(f"Batching over {duration_s / 60:.0f} min, {args.zones} zones, "
+          f"sample interval {args.sample_interval_ms} ms, "
+          f"batch {min_samples}..{max_samples} samples")
+    failures = 0
+    for label, controller in controllers:
+        results, violations = simulate(controller, link, duration_s, args, random.Random(args.seed))
+        print()
+        print(label)
+        print(f"   {'link':<7} {'batch max':>9} {'msgs/h':>8} {'bytes/sample':>12} "
+              f"{'lat mean':>9} {'lat max':>9} {'retx':>5}")
+        hours = args.minutes / 60.0
+        for st in results:
+            mean = st["latency_sum"] / max(st["samples"], 1)
+            print(f"   {st['name']:<7} {st['batch_max']:>9} {st['messages'] / hours:>8.0f} "
+                  f"{st['bytes'] / max(st['samples'], 1):>12.1f} {mean:>8.1f}s "
+                  f"{st['latency_max']:>8.1f}s {st['retransmits']:>5}")
+        if violations:
+            failures += 1
+            print(f"   [ERROR] {violations} batch(es) over the {args.max_latency_ms} ms bound")
+        if label == "adaptive" and args.rssi is None and controller.samples != min_samples:
+            failures += 1
+            print(f"   [ERROR] ended at {controller.samples} samples on a good link")
+
+    print()
+    print("[OK] Batches within bounds" if failures == 0 else f"[ERROR] {failures} failure(s)")
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+"""
+Wake/sleep simulation of the NodeMCU deep-sleep mode (nodemcuv2_deepsleep
+build) with a battery life estimate, so remote nodes can be sized before
+flashing. simulate_power.py covers the light-sleep low-power mode.
+
+Every wake is a reset that boots, samples the tick into the RTC ring and
+sleeps again with the radio disabled. What a wake does next is decided by
+the firmware's own wake planning (NodeMCU_PIO/src/wake_plan.cpp, built
+for the host by firmware_host.py as a DEEP_SLEEP_MODE build): every N-th
+tick (at the node's phase) the wake before it asks for the radio, and that
+wake opens one publish window for the whole ring. An alarm gets a radio
+wake at once unless the last window failed; a failed window leaves the
+samples for the next radio wake, with one more try when the ring fills,
+after which it overwrites its oldest sample. The sleep timer runs off by
+up to --timer-error: a wake that comes early sleeps again, or waits awake
+for its tick when within DEEP_SLEEP_POLL_MS.
+"""
+
+import argparse
+import ctypes
+import random
+
+import firmware_host
+
+# MIN_SLEEP_US in NodeMCU_PIO/src/deep_sleep.cpp
+MIN_SLEEP_S = 0.01
+
+
+class DeepSleepSim:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.lib = firmware_host.load(DEEP_SLEEP_MODE=1, ZONE_FILTER=int(args.zone_filter))
+        self.capacity = self.lib.hostSampleBufferCapacity()
+        if args.wakes_per_publish is None:
+            # The firmware default, shrunk to the buffer like SAMPLE_BUFFER_CAP()
+            args.wakes_per_publish = min(10, self.capacity)
+        self.charge = {}   # state -> mA*s
+        self.time = {}     # state -> s
+        self.count = {name: 0 for name in ("wakes", "radio_wakes", "urgent_wakes", "early_wakes",
+                                           "polled_wakes", "samples", "overwritten", "missed_ticks",
+                                           "windows", "failed_windows", "alarms")}
+        self.max_latency_s = 0.0
+
+    def spend(self, state, seconds, ma):
+        self.time[state] = self.time.get(state, 0.0) + seconds
+        self.charge[state] = self.charge.get(state, 0.0) + seconds * (ma + self.args.board_ma)
+
+    def in_outage(self, t):
+        a = self.args
+        return a.outage is not None and a.outage[0] * 3600 <= t < (a.outage[0] + a.outage[1]) * 3600
+
+    def window_ok(self, t):
+        return not self.in_outage(t) and self.rng.random() >= self.args.window_failure
+
+    def run(self):
+        a = self.args
+        interval = a.sample_interval
+        ina_awake = a.zones * a.ina_active_ma
+        ina_asleep = a.zones * a.ina_powerdown_ma
+        alarm_p = a.alarms_per_day * interval / 86400.0
+        end = a.days * 86400.0
+
+        t = 0.0             # node clock, s
+        planned = 0.0       # time the current wake was planned for
+        next_tick = 0
+        # A fresh start has the radio and the config echo due
+        flags = firmware_host.DEEP_SLEEP_RADIO | firmware_host.DEEP_SLEEP_ECHO_DUE
+        echo_due = True
+        ring = []           # tick times of the buffered samples
+        alarm_pending = False
+        state = firmware_host.WakeState()
+        plan = firmware_host.WakePlan()
+
+        while t < end:
+            radio = bool(flags & firmware_host.DEEP_SLEEP_RADIO)
+            self.count["wakes"] += 1
+            self.spend("boot", a.boot_ms / 1000.0, a.cpu_ma + ina_asleep)
+            if radio:
+                self.count["radio_wakes"] += 1
+                self.spend("rf_boot", a.rf_boot_ms / 1000.0, a.radio_ma + ina_asleep)
+            t += (a.boot_ms + (a.rf_boot_ms if radio else 0)) / 1000.0
+            window_done = False
+            window_failed = False
+            sampled = False
+            overwritten = self.count["overwritten"]
+
+            while True:
+                state.now_us = round(t * 1e6)
+                state.planned_us = round(planned * 1e6)
+                state.next_tick_us = round(next_tick * interval * 1e6)
+                state.next_tick = next_tick
+                state.samples_per_publish = a.wakes_per_publish
+                state.phase_tick = a.phase
+                state.flags = flags
+                state.window_done = window_done
+                state.window_failed = window_failed
+                state.echo_due = echo_due
+                state.alarms_pending = alarm_pending
+                state.filled = len(ring) >= self.capacity and self.count["overwritten"] == overwritten
+                self.lib.hostWakePlan(ctypes.byref(state), ctypes.byref(plan))
+
+                if plan.action == firmware_host.WAKE_SAMPLE:
+                    # Wait awake for a close tick, then sample it
+                    tick_at = next_tick * interval
+                    if tick_at > t:
+                        self.count["polled_wakes"] += 1
+                        self.spend("poll", tick_at - t, a.cpu_ma + ina_asleep)
+                        t = tick_at
+                    current = int(t // interval)
+                    self.count["missed_ticks"] += current - next_tick
+                    next_tick = current + 1
+                    self.spend("sample", a.sample_ms / 1000.0, a.cpu_ma + ina_awake)
+                    t += a.sample_ms / 1000.0
+                    self.count["samples"] += 1
+                    sampled = True
+                    if len(ring) == self.capacity:
+                        ring.pop(0)
+                        self.count["overwritten"] += 1
+                    ring.append(current * interval)
+                    if self.rng.random() < alarm_p:
+                        self.count["alarms"] += 1
+                        alarm_pending = True
+                    continue
+
+                if plan.action == firmware_host.WAKE_PUBLISH:
+                    window_done = True
+                    self.count["windows"] += 1
+                    if self.window_ok(t):
+                        self.spend("wifi_connect", a.wifi_connect_s, a.radio_ma + ina_asleep)
+                        self.spend("mqtt_publish", a.mqtt_publish_s, a.radio_tx_ma + ina_asleep)
+                        t += a.wifi_connect_s + a.mqtt_publish_s
+                        if ring:
+                            self.max_latency_s = max(self.max_latency_s, t - ring[0])
+                        ring = []
+                        alarm_pending = False
+                        echo_due = False
+                    else:
+                        self.count["failed_windows"] += 1
+                        self.spend("wifi_timeout", a.wifi_timeout_s, a.radio_ma + ina_asleep)
+                        t += a.wifi_timeout_s
+                        window_failed = True
+                    continue
+
+                # A wake that neither sampled nor published came early
+                if not sampled and not window_done:
+                    self.count["early_wakes"] += 1
+                elif plan.wake_us == 0:
+                    self.count["urgent_wakes"] += 1
+                flags = plan.flags
+                planned = max(t + MIN_SLEEP_S, plan.wake_us / 1e6)
+                break
+
+            sleep_s = max(MIN_SLEEP_S, planned - t)
+            actual = sleep_s * (1.0 + self.rng.uniform(-a.timer_error, a.timer_error))
+            self.spend("deep_sleep", actual, a.deep_sleep_ua / 1000.0 + ina_asleep)
+            t += actual
+
+        return t
+
+    def report(self):
+        a = self.args
+        total_s = self.run()
+        total_charge = sum(self.charge.values())
+        avg_ma = total_charge / total_s
+        awake_s = total_s - self.time["deep_sleep"]
+        c = self.count
+
+        print("Microgrid Node Deep-Sleep Simulation")
+        print("=" * 40)
+        print("Configuration:")
+        print(f"   Sample interval: {a.sample_interval:g} s")
+        print(f"   Wakes per publish: {a.wakes_per_publish} "
+              f"(radio every {a.sample_interval * a.wakes_per_publish:g} s)")
+        print(f"   Zones: {a.zones}, simulated {a.days:g} days")
+        if a.wakes_per_publish > self.capacity:
+            print(f"[WARNING] {a.wakes_per_publish} wakes per publish exceed the RTC buffer "
+                  f"({self.capacity}); the firmware will not build")
+        print()
+
+        print("Time and charge by state:")
+        for name, seconds in self.time.items():
+            print(f"   {name:<13} {seconds / total_s * 100:8.4f} %  "
+                  f"= {self.charge[name] / total_s:8.4f} mA avg")
+        print()
+
+        print("Wakes:")
+        print(f"   Total:             {c['wakes']:8d} ({c['wakes'] / a.days:.0f}/day)")
+        print(f"   With radio:        {c['radio_wakes']:8d}")
+        print(f"   Immediate radio:   {c['urgent_wakes']:8d} ({c['alarms']} alarms)")
+        print(f"   Early, slept again:{c['early_wakes']:8d}")
+        print(f"   Waited for tick:   {c['polled_wakes']:8d}")
+        print(f"   Windows failed:    {c['failed_windows']:8d} of {c['windows']}")
+        print(f"   Samples:           {c['samples']:8d}, overwritten {c['overwritten']}, "
+              f"missed ticks {c['missed_ticks']}")
+        print(f"   Max data latency:  {self.max_latency_s:8.1f} s")
+        print()
+
+        print("Results:")
+        print(f"   CPU duty cycle:    {100.0 * awake_s / total_s:8.4f} %")
+        print(f"   Average current:   {avg_ma:8.3f} mA")
+        print(f"   Charge per day:    {avg_ma * 24:8.2f} mAh")
+        if a.battery_mah > 0:
+            hours = a.battery_mah / avg_ma
+            print(f"   Battery life:      {hours:8.1f} h ({hours / 24.0:.1f} days) "
+                  f"on {a.battery_mah:g} mAh")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sample-interval", type=float, default=60.0,
+                        help="seconds between sample ticks (SAMPLE_INTERVAL_MS)")
+    parser.add_argument("--wakes-per-publish", type=int,
+                        help="ticks per radio wake (SAMPLES_PER_PUBLISH; default 10, "
+                             "or the RTC buffer if smaller)")
+    parser.add_argument("--phase", type=int, default=0,
+                        help="tick of the node's radio wake within the period")
+    parser.add_argument("--zones", type=int, default=3)
+    parser.add_argument("--zone-filter", action="store_true", help="ZONE_FILTER build (smaller ring)")
+    parser.add_argument("--days", type=float, default=7.0, help="simulated time")
+    parser.add_argument("--battery-mah", type=float, default=2000.0,
+                        help="battery capacity for a runtime estimate")
+    parser.add_argument("--seed", type=int, default=1)
+
+    events = parser.add_argument_group("events")
+    events.add_argument("--alarms-per-day", type=float, default=1.0,
+                        help="alarm transitions, each asking for a radio wake")
+    events.add_argument("--window-failure", type=float, default=0.02,
+                        help="chance a publish window fails to connect")
+    events.add_argument("--outage", type=float, nargs=2, metavar=("START_H", "HOURS"),
+                        help="AP outage: every window in it fails")
+    events.add_argument("--timer-error", type=float, default=0.02,
+                        help="deep-sleep timer error, as a fraction of the sleep")
+
+    timing = parser.add_argument_group("timing")
+    timing.add_argument("--boot-ms", type=float, default=150.0,
+                        help="ROM boot and setup() on a wake, radio disabled")
+    timing.add_argument("--rf-boot-ms", type=float, default=50.0,
+                        help="extra on a wake with the radio: RF calibration")
+    timing.add_argument("--sample-ms", type=float, default=8.0,
+                        help="INA219 wake, reads and RTC writes")
+    timing.add_argument("--poll-ms", type=float, default=300.0, help="DEEP_SLEEP_POLL_MS")
+    timing.add_argument("--wifi-connect-s", type=float, default=2.5,
+                        help="association + DHCP after radio wake")
+    timing.add_argument("--mqtt-publish-s", type=float, default=0.5,
+                        help="MQTT connect, publish, acks and disconnect")
+    timing.add_argument("--wifi-timeout-s", type=float, default=10.0,
+                        help="WIFI_CONNECT_TIMEOUT_MS of a failing window")
+
+    current = parser.add_argument_group("currents (mA unless noted)")
+    current.add_argument("--deep-sleep-ua", type=float, default=20.0,
+                         help="ESP8266 in deep sleep, uA")
+    current.add_argument("--cpu-ma", type=float, default=15.0,
+                         help="CPU running, radio off")
+    current.add_argument("--radio-ma", type=float, default=75.0,
+                         help="radio receiving / associating")
+    current.add_argument("--radio-tx-ma", type=float, default=85.0,
+                         help="average while transmitting the batch")
+    current.add_argument("--ina-active-ma", type=float, default=1.0,
+                         help="per INA219, continuous conversion")
+    current.add_argument("--ina-powerdown-ma", type=float, default=0.006,
+                         help="per INA219, power-down mode")
+    current.add_argument("--board-ma", type=float, default=0.0,
+                         help="regulator/USB bridge quiescent draw; about 5 on a NodeMCU devkit, "
+                              "which dwarfs deep sleep")
+
+    DeepSleepSim(parser.parse_args()).report()
+
+
+if __name__ == "__main__":
+    main()
@@ -4,13 +4,18 @@ MQTT Data Simulator for Microgrid Dashboard
 Simulates NodeMCU sensor data for testing purposes on PC
 """
 
-import json
 import time
 import random
 import threading
 from datetime import datetime
 import paho.mqtt.client as mqtt
 
+import zone_payload
+
+# Same hierarchy as the firmware: <site>/<node>/<zone>
+SITE_ID = "site1"
+NODE_ID = "node1"
+
 class MQTTSimulator:
     def __init__(self, broker_host="localhost", broker_port=1883):
         self.broker_host = broker_host
@@ -51,7 +56,7 @@ class MQTTSimulator:
         power_mW = current_mA * voltage_V  # Calculate power
         
         return {
-            "node_id": "node1",
+            "node_id": NODE_ID,
             "zone_id": f"zone{zone_id}",
             "timestamp": datetime.now().isoformat() + "Z",
             "current_mA": round(current_mA, 1),
@@ -73,7 +78,7 @@ class MQTTSimulator:
             self.client.loop_start()
             
             print("[SIMULATOR] Starting MQTT data simulation...")
-            print(f"[SIMULATOR] Publishing to topics: /node1/zone1, /node1/zone2, /node1/zone3")
+            print(f"[SIMULATOR] Publishing to topics: {SITE_ID}/{NODE_ID}/zone1..zone3")
             print(f"[SIMULATOR] Sending data every {interval} seconds")
             print("[SIMULATOR] Press Ctrl+C to stop")
             print("-" * 50)
@@ -85,8 +90,8 @@ class MQTTSimulator:
                 # Generate and send data for all 3 zones
                 for zone_id in [1, 2, 3]:
                     data = self.simulate_sensor_data(zone_id)
-                    payload = json.dumps(data)
-                    topic = f"/node1/zone{zone_id}"
+                    payload = zone_payload.encode_json(data)
+                    topic = f"{SITE_ID}/{NODE_ID}/zone{zone_id}"
                     
                     result = self.client.publish(topic, payload)
                     
@@ -133,7 +138,7 @@ def main():
     print(f"Configuration:")
     print(f"   MQTT Broker: {BROKER_HOST}:{BROKER_PORT}")
     print(f"   Send Interval: {SEND_INTERVAL} seconds")
-    print(f"   Topics: /node1/zone1, /node1/zone2, /node1/zone3")
+    print(f"   Topics: {SITE_ID}/{NODE_ID}/zone1..zone3")
     print()
     
     # Ask user for options
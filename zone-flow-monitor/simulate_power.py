@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""
+Power model for the NodeMCU low-power mode (nodemcuv2_lowpower build).
+Estimates duty cycle and charge drawn per hour for a sampling/publishing
+configuration, so battery-backed nodes can be sized before flashing.
+
+The timeline mirrors the firmware: the CPU light-sleeps between sample
+ticks, wakes the INA219s for one read per tick, and every N ticks brings
+WiFi up for a single MQTT publish window before powering the radio down.
+"""
+
+import argparse
+import math
+
+# Must match SAMPLE_BUFFER_CAPACITY in NodeMCU_PIO/include/sample_buffer.h
+RTC_BUFFER_CAPACITY = 15
+
+
+class PowerModel:
+    def __init__(self, args):
+        self.args = args
+
+    def period_s(self):
+        """One publish period: N sample ticks."""
+        return self.args.sample_interval * self.args.samples_per_publish
+
+    def simulate_period(self):
+        """Return charge (mA*s) and time (s) per state for one publish period."""
+        a = self.args
+        period = self.period_s()
+        ticks = a.samples_per_publish
+        ina_awake = a.zones * a.ina_active_ma
+        ina_asleep = a.zones * a.ina_powerdown_ma
+
+        # Per tick: sample read plus the wake margin polled before the tick
+        sample_s = (a.sample_ms + a.wake_margin_ms) / 1000.0
+        # One publish window per period
+        window_s = a.wifi_connect_s + a.mqtt_publish_s
+
+        states = {
+            "sample": (ticks * sample_s, a.cpu_ma + ina_awake),
+            "wifi_connect": (a.wifi_connect_s, a.radio_ma + ina_asleep),
+            "mqtt_publish": (a.mqtt_publish_s, a.radio_tx_ma + ina_asleep),
+        }
+        awake_s = sum(t for t, _ in states.values())
+        states["light_sleep"] = (max(0.0, period - awake_s), a.light_sleep_ma + ina_asleep)
+
+        # Ticks that land inside the publish window are skipped by the
+        # firmware (the grid never shifts), so they show up as missed samples
+        missed = max(0, math.ceil(window_s / a.sample_interval) - 1)
+
+        charge = {name: t * (i + a.board_ma) for name, (t, i) in states.items()}
+        return states, charge, missed
+
+    def report(self):
+        a = self.args
+        period = self.period_s()
+        states, charge, missed = self.simulate_period()
+        periods_per_hour = 3600.0 / period
+
+        total_charge = sum(charge.values())
+        avg_ma = total_charge / period
+        awake_s = period - states["light_sleep"][0]
+        radio_s = states["wifi_connect"][0] + states["mqtt_publish"][0]
+        baseline_ma = a.always_on_ma + a.board_ma + a.zones * a.ina_active_ma
+
+        print("Microgrid Node Power Model")
+        print("=" * 40)
+        print("Configuration:")
+        print(f"   Sample interval: {a.sample_interval:g} s")
+        print(f"   Samples per publish: {a.samples_per_publish} "
+              f"(publish every {period:g} s)")
+        print(f"   Zones: {a.zones}")
+        if a.samples_per_publish > RTC_BUFFER_CAPACITY:
+            print(f"[WARNING] {a.samples_per_publish} samples exceed the RTC buffer "
+                  f"({RTC_BUFFER_CAPACITY}); the firmware will not build")
+        print()
+
+        print("Per publish period:")
+        for name, (t, i) in states.items():
+            print(f"   {name:<13} {t * 1000:10.1f} ms  @ {i + a.board_ma:7.2f} mA  "
+                  f"= {charge[name] / 3.6:8.3f} uAh")
+        print()
+
+        print("Results:")
+        print(f"   CPU duty cycle:    {100.0 * awake_s / period:6.2f} %")
+        print(f"   Radio duty cycle:  {100.0 * radio_s / period:6.2f} %")
+        print(f"   Average current:   {avg_ma:8.3f} mA")
+        print(f"   Charge per hour:   {avg_ma:8.3f} mAh")
+        print(f"   Always-on draw:    {baseline_ma:8.3f} mAh "
+              f"({baseline_ma / avg_ma:.1f}x more)")
+        print(f"   Missed ticks/hour: {missed * periods_per_hour:8.1f}")
+        if a.battery_mah > 0:
+            hours = a.battery_mah / avg_ma
+            print(f"   Battery life:      {hours:8.1f} h ({hours / 24.0:.1f} days) "
+                  f"on {a.battery_mah:g} mAh")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sample-interval", type=float, default=5.0,
+                        help="seconds between sample ticks (SAMPLE_INTERVAL_MS)")
+    parser.add_argument("--samples-per-publish", type=int, default=12,
+                        help="ticks buffered per publish window (SAMPLES_PER_PUBLISH)")
+    parser.add_argument("--zones", type=int, default=3)
+    parser.add_argument("--battery-mah", type=float, default=0.0,
+                        help="battery capacity for a runtime estimate")
+
+    timing = parser.add_argument_group("timing")
+    timing.add_argument("--sample-ms", type=float, default=8.0,
+                        help="awake time per tick: INA219 wake, reads, RTC writes")
+    timing.add_argument("--wake-margin-ms", type=float, default=3.0,
+                        help="WAKE_MARGIN_US in power_manager.cpp")
+    timing.add_argument("--wifi-connect-s", type=float, default=2.5,
+                        help="association + DHCP after radio wake")
+    timing.add_argument("--mqtt-publish-s", type=float, default=0.3,
+                        help="MQTT connect, publish, flush and disconnect")
+
+    current = parser.add_argument_group("currents (mA)")
+    current.add_argument("--always-on-ma", type=float, default=70.0,
+                         help="ESP8266 with WiFi permanently on")
+    current.add_argument("--cpu-ma", type=float, default=15.0,
+                         help="CPU running, radio in modem sleep")
+    current.add_argument("--radio-ma", type=float, default=75.0,
+                         help="radio receiving / associating")
+    current.add_argument("--radio-tx-ma", type=float, default=85.0,
+                         help="average while transmitting the batch")
+    current.add_argument("--light-sleep-ma", type=float, default=0.9)
+    current.add_argument("--ina-active-ma", type=float, default=1.0,
+                         help="per INA219, continuous conversion")
+    current.add_argument("--ina-powerdown-ma", type=float, default=0.006,
+                         help="per INA219, power-down mode")
+    current.add_argument("--board-ma", type=float, default=5.0,
+                         help="regulator/USB bridge quiescent draw (NodeMCU devkit)")
+
+    PowerModel(parser.parse_args()).report()
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,4 @@
-import { useState, useEffect } from "react";
+import { useState, useEffect, useRef } from "react";
 
 export interface EnergyDataPoint {
   timestamp: Date;
@@ -31,11 +31,24 @@ export interface MQTTServerResponse {
   zone_id: string;
   timestamp: string;
   current_mA: number;
+  current_filt_mA?: number;  // nodes built with ZONE_FILTER
   voltage_V: number;
   power_mW: number;
   received_at: string;
 }
 
+// Alarm transition pushed by the server's alarm stream
+export interface AlarmEvent {
+  node_id: string;
+  zone_id: string;
+  alarm: string;
+  active: boolean;
+  value: number;
+  threshold?: number;
+  timestamp: number;
+  received_at: string;
+}
+
 // API configuration - will work both in development and production
 const getApiBaseUrl = () => {
   // In development, use the proxy configured in vite.config.ts
@@ -50,7 +63,7 @@ const getApiBaseUrl = () => {
 // Convert MQTT server response to our internal format
 const convertMQTTResponse = (response: MQTTServerResponse): EnergyDataPoint => ({
   timestamp: new Date(response.timestamp),
-  current: response.current_mA / 1000, // Convert mA to A
+  current: (response.current_filt_mA ?? response.current_mA) / 1000, // Convert mA to A
   voltage: response.voltage_V,
   power: response.power_mW / 1000 // Convert mW to W
 });
@@ -100,7 +113,16 @@ const isDataStale = (lastUpdateTime: string | null): boolean => {
   return diffSeconds > 15; // Consider stale after 15 seconds
 };
 
+// Alarms that take a zone offline without waiting for the data to go stale
+const OFFLINE_ALARMS = ['zone_offline', 'sensor_error'];
+
+const zoneNumber = (zoneId: string): number => parseInt(zoneId.replace('zone', ''), 10);
+
 export function useEnergyData() {
+  const [alarms, setAlarms] = useState<{ [key: string]: AlarmEvent }>({});
+  // Zones held offline by an active alarm, consulted by the poll below
+  const alarmedZones = useRef<{ [key: string]: number }>({});
+
   const [data, setData] = useState<MicrogridData>(() => ({
     zones: {
       1: {
@@ -170,7 +192,8 @@ export function useEnergyData() {
                 };
                 
                 // Zone is online if we got fresh data and it's not stale
-                newData.status[zoneId] = serverStatus.isOnline && !dataIsStale;
+                newData.status[zoneId] = serverStatus.isOnline && !dataIsStale &&
+                  !Object.values(alarmedZones.current).includes(zoneId);
                 
                 // Track latest update time
                 const updateTime = new Date(zoneResponse.received_at);
@@ -216,6 +239,42 @@ export function useEnergyData() {
     };
   }, []);
 
+  // Alarms arrive out of band over Server-Sent Events instead of waiting for
+  // the next poll; EventSource reconnects on its own if the server restarts
+  useEffect(() => {
+    const source = new EventSource(`${getApiBaseUrl()}/alarms/stream`);
+
+    source.addEventListener('alarm', (event) => {
+      const alarm: AlarmEvent = JSON.parse((event as MessageEvent).data);
+      const key = `${alarm.node_id}/${alarm.zone_id}/${alarm.alarm}`;
+
+      setAlarms(prev => {
+        const next = { ...prev };
+        if (alarm.active) {
+          next[key] = alarm;
+        } else {
+          delete next[key];
+        }
+        return next;
+      });
+
+      if (OFFLINE_ALARMS.includes(alarm.alarm)) {
+        const zoneId = zoneNumber(alarm.zone_id);
+        if (alarm.active) {
+          alarmedZones.current[key] = zoneId;
+          setData(prevData => ({
+            ...prevData,
+            status: { ...prevData.status, [zoneId]: false }
+          }));
+        } else {
+          delete alarmedZones.current[key];
+        }
+      }
+    });
+
+    return () => source.close();
+  }, []);
+
   // Calculate aggregate statistics for all zones
   const zones = [data.zones[1], data.zones[2], data.zones[3]];
   const totalPower = zones.reduce((sum, zone) => sum + zone.power, 0);
@@ -231,7 +290,9 @@ export function useEnergyData() {
     }
   }
 
-  const hasAlerts = !data.status[1] || !data.status[2] || !data.status[3] || !data.isConnected;
+  const activeAlarms = Object.values(alarms);
+  const hasAlerts = !data.status[1] || !data.status[2] || !data.status[3] || !data.isConnected ||
+    activeAlarms.length > 0;
 
   return {
     data,
@@ -240,6 +301,7 @@ export function useEnergyData() {
       averageVoltage,
       highestLoadZone
     },
-    hasAlerts
+    hasAlerts,
+    alarms: activeAlarms
   };
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+"""
+Decoders for the zone data payload encodings of the node firmware
+(NodeMCU_PIO/include/zone_encoder.h). Every encoding decodes to the JSON
+document the node publishes by default, so the rest of the backend does
+not care which one a node was built with.
+
+The encoding is recognised from the first byte: "{" JSON, "#" CSV, 0xB5
+packed binary, a CBOR map header (0xA0-0xBF) CBOR.
+
+Every payload ends in a fixed-size trailer with the CRC-32 of the bytes
+before it, which is checked before anything is parsed. A payload without
+the trailer is a CrcError too (a corrupted trailer looks the same), unless
+the caller knows the node's firmware predates it.
+"""
+
+import json
+import re
+import struct
+import zlib
+from typing import Any, Dict, Optional
+
+PACKED_MAGIC = 0xB5
+RANGE_SWITCH = 0x2  # ZONE_FLAG_RANGE_SWITCH
+# ZONE_FLAGS_INVALID: no reading, I2C error, INA219 overflow, out of range
+INVALID = 0x1 | 0x4 | 0x8 | 0x10
+
+# ZONE_FIELDS: name, packed lsb, ranged, signed. A ranged lsb counts current
+# LSBs of the row's INA219 range. current_filt_mA only comes from
+# ZONE_FILTER builds; rows carry as many fields as the node sent.
+FIELDS = [("current_mA", 1.0, True, True), ("voltage_V", 0.004, False, False),
+          ("power_mW", 20.0, True, False), ("current_filt_mA", 1.0, True, True)]
+FIELD_DECIMALS = [2, 3, 1, 2]
+# Packed versions 1 to 6 stored every row at these fixed lsbs
+FIXED_LSB = [0.1, 0.001, 2.0, 0.1]
+# InaRange -> current LSB in mA; packed rows carry it in flags bits 5-6
+RANGE_LSB_MA = [0.05, 0.04, 0.1]
+RANGE_SHIFT = 5
+# Packed payload version -> fields per row; 3 and up end in the CRC, 5 and
+# up have the sync error in the header, 7 and up ranged lsbs
+PACKED_FIELDS = {1: 3, 2: 4, 3: 3, 4: 4, 5: 3, 6: 4, 7: 3, 8: 4}
+
+# Trailers: ,"crc32":"<hex>"} (JSON), "crc32": uint32 (CBOR), #crc32,<hex> line (CSV)
+JSON_TRAILER = re.compile(rb',"crc32":"([0-9a-f]{8})"}$')
+CBOR_TRAILER = b"\x65crc32\x1a"
+CSV_TRAILER = re.compile(rb"\n#crc32,([0-9a-f]{8})$")
+
+
+class CrcError(ValueError):
+    """The payload's CRC-32 doesn't match its bytes."""
+
+
+def encoding_of(raw: bytes) -> str:
+    if not raw:
+        return "empty"
+    first = raw[0]
+    if first == ord("{"):
+        return "json"
+    if first == ord("#"):
+        return "csv"
+    if first == PACKED_MAGIC:
+        return "packed"
+    if 0xA0 <= first <= 0xBF:
+        return "cbor"
+    return "unknown"
+
+
+def _check(raw: bytes, covered: int, crc: int) -> None:
+    actual = zlib.crc32(raw[:covered])
+    if actual != crc:
+        raise CrcError(f"zone payload CRC {actual:08x} != {crc:08x}")
+
+
+def check_crc(raw: bytes, required: bool = True) -> bytes:
+    """Checks the CRC-32 trailer; returns the payload without it. Without
+    a trailer, raises CrcError if required, else returns it unchecked."""
+    encoding = encoding_of(raw)
+    if encoding == "json":
+        match = JSON_TRAILER.search(raw)
+        if match:
+            _check(raw, match.start(), int(match.group(1), 16))
+            return raw[:match.start()] + b"}"
+    elif encoding == "csv":
+        match = CSV_TRAILER.search(raw)
+        if match:
+            _check(raw, match.start(), int(match.group(1), 16))
+            return raw[:match.start()]
+    elif encoding == "cbor":
+        tail = len(raw) - len(CBOR_TRAILER) - 4
+        if tail > 0 and raw[tail:tail + len(CBOR_TRAILER)] == CBOR_TRAILER:
+            _check(raw, tail, int.from_bytes(raw[-4:], "big"))
+            # One map entry fewer; the node's maps stay under 24 entries
+            return bytes([raw[0] - 1]) + raw[1:tail]
+    elif encoding == "packed" and len(raw) > 5 and raw[1] >= 3:
+        _check(raw, len(raw) - 4, struct.unpack_from("<I", raw, len(raw) - 4)[0])
+        return raw[:-4]
+    if required:
+        raise CrcError(f"{encoding} zone payload has no CRC-32 trailer")
+    return raw
+
+
+def encode_json(doc: Dict[str, Any]) -> bytes:
+    """The node's JSON form of a document, CRC-32 trailer included, for
+    the simulators and benches that stand in for a node."""
+    body = json.dumps(doc, separators=(",", ":")).encode()[:-1]
+    return body + b',"crc32":"%08x"}' % zlib.crc32(body)
+
+
+def _document(node_id, zone_id, rng, boot_id, first_seq, seq, uptime_ms, rows,
+              interval_ms=0, sync_error_us=-1):
+    """Builds the JSON form from rows of (timestamp, [field values], flags).
+    sync_error_us >= 0: the ticks are on the site grid (time_sync.h)."""
+    timestamp, values, flags = rows[-1]
+    doc = {"node_id": node_id, "zone_id": zone_id, "timestamp": timestamp}
+    for (name, *_), value in zip(FIELDS, values):
+        doc[name] = value
+    doc.update({"range": rng, "boot_id": boot_id, "seq": seq, "uptime_ms": uptime_ms})
+    if first_seq != seq:
+        doc["first_seq"] = first_seq
+    if sync_error_us >= 0:
+        doc.update({"tick": timestamp // interval_ms, "interval_ms": interval_ms,
+                    "sync_error_us": sync_error_us})
+    if flags & RANGE_SWITCH:
+        doc["range_switch"] = True
+    if flags & INVALID:
+        doc["flags"] = flags & INVALID
+    if first_seq != seq:
+        doc["samples"] = [[t] + list(v) for t, v, _ in rows]
+        switched = [i for i, (_, _, f) in enumerate(rows) if f & RANGE_SWITCH]
+        if switched:
+            doc["range_switch_rows"] = switched
+        invalid = [[i, f & INVALID] for i, (_, _, f) in enumerate(rows) if f & INVALID]
+        if invalid:
+            doc["invalid_rows"] = invalid
+    return doc
+
+
+def _decode_packed(raw: bytes, node_id: str, zone_id: str) -> Dict[str, Any]:
+    version = raw[1]
+    if version not in PACKED_FIELDS:
+        raise ValueError(f"unsupported packed zone payload version {version}")
+    header = "<BBBIIIQIIiB" if version >= 5 else "<BBBIIIQIIB"
+    magic, version, count, boot_id, first_seq, seq, uptime_ms, first_tick, interval_ms, *sync, range_len = \
+        struct.unpack_from(header, raw, 0)
+    sync_error_us = sync[0] if sync else -1
+    fields = FIELDS[:PACKED_FIELDS[version]]
+    offset = struct.calcsize(header)
+    rng = raw[offset:offset + range_len].decode("ascii")
+    offset += range_len
+
+    row_format = "<H" + "".join("h" if signed else "H" for *_, signed in fields) + "B"
+    row_size = struct.calcsize(row_format)
+    rows = []
+    for _ in range(count):
+        tick_offset, *counts, flags = struct.unpack_from(row_format, raw, offset)
+        offset += row_size
+        if version >= 7:
+            current_lsb = RANGE_LSB_MA[flags >> RANGE_SHIFT]
+            flags &= (1 << RANGE_SHIFT) - 1
+            lsbs = [lsb * current_lsb if ranged else lsb for _, lsb, ranged, _ in fields]
+        else:
+            lsbs = FIXED_LSB
+        values = [round(c * lsb, d) for c, lsb, d in zip(counts, lsbs, FIELD_DECIMALS)]
+        rows.append(((first_tick + tick_offset) * interval_ms, values, flags))
+    return _document(node_id, zone_id, rng, boot_id, first_seq, seq, uptime_ms, rows,
+                     interval_ms, sync_error_us)
+
+
+def _decode_csv(raw: bytes) -> Dict[str, Any]:
+    lines = raw.decode("ascii").split("\n")
+    node_id, zone_id, rng, boot_id, first_seq, seq, uptime_ms, *grid = lines[0][1:].split(",")
+    interval_ms, sync_error_us = (int(grid[0]), int(grid[1])) if grid else (0, -1)
+    rows = []
+    for line in lines[1:]:
+        if not line:
+            continue
+        timestamp, *values, flags = line.split(",")
+        rows.append((int(timestamp), [float(v) for v in values], int(flags)))
+    return _document(node_id, zone_id, rng, int(boot_id), int(first_seq), int(seq),
+                     int(uptime_ms), rows, interval_ms, sync_error_us)
+
+
+class _Cbor:
+    """The subset of CBOR the node writes: uints, text, arrays, maps, true, float32."""
+
+    def __init__(self, raw: bytes):
+        self.raw = raw
+        self.pos = 0
+
+    def _argument(self, info):
+        if info < 24:
+            return info
+        size = {24: 1, 25: 2, 26: 4, 27: 8}[info]
+        value = int.from_bytes(self.raw[self.pos:self.pos + size], "big")
+        self.pos += size
+        return value
+
+    def item(self):
+        head = self.raw[self.pos]
+        self.pos += 1
+        major, info = head >> 5, head & 0x1F
+        if major == 7:
+            if info == 26:
+                (value,) = struct.unpack_from(">f", self.raw, self.pos)
+                self.pos += 4
+                return value
+            if info == 27:
+                (value,) = struct.unpack_from(">d", self.raw, self.pos)
+                self.pos += 8
+                return value
+            return {20: False, 21: True, 22: None}[info]
+        arg = self._argument(info)
+        if major == 0:
+            return arg
+        if major == 1:
+            return -1 - arg
+        if major == 3:
+            text = self.raw[self.pos:self.pos + arg].decode("utf-8")
+            self.pos += arg
+            return text
+        if major == 4:
+            return [self.item() for _ in range(arg)]
+        if major == 5:
+            return {self.item(): self.item() for _ in range(arg)}
+        raise ValueError(f"unsupported CBOR major type {major}")
+
+
+def _decode_cbor(raw: bytes) -> Dict[str, Any]:
+    doc = _Cbor(raw).item()
+    # float32 on the wire; round back to the stored resolution
+    for (name, *_), d in zip(FIELDS, FIELD_DECIMALS):
+        if name in doc:
+            doc[name] = round(doc[name], d)
+    for row in doc.get("samples", []):
+        row[1:] = [round(v, d) for v, d in zip(row[1:], FIELD_DECIMALS)]
+    return doc
+
+
+def decode(raw: bytes, node_id: Optional[str] = None, zone_id: Optional[str] = None,
+           require_crc: bool = True) -> Dict[str, Any]:
+    """Decodes a node payload of any encoding; node and zone come from the
+    topic for the packed encoding, which doesn't carry them. Raises
+    CrcError for a payload that was corrupted on the way, or that has no
+    trailer when require_crc is set (zone data from current firmware)."""
+    raw = check_crc(raw, require_crc)
+    encoding = encoding_of(raw)
+    if encoding == "packed":
+        return _decode_packed(raw, node_id, zone_id)
+    if encoding == "csv":
+        return _decode_csv(raw)
+    if encoding == "cbor":
+        return _decode_cbor(raw)
+    return json.loads(raw.decode("utf-8"))